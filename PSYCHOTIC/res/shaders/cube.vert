@@ -1,12 +1,23 @@
 #version 460 core
 
-layout (std140, binding = 0) uniform per_frame_data {
-	uniform mat4 mvp;
-	uniform int is_wire_frame;
+layout (std140, binding = 1) uniform view_data {
+	uniform mat4 view_projection;
+	// instances come from the culling pass' compacted list instead of gl_InstanceID
+	uniform uint use_visible_list;
+	// world to view, lighting is done in view space
+	uniform mat4 view;
 };
 
+// structure of arrays: one array per row of the 3x4 affine instance transform
+layout (std430, binding = 0) readonly buffer instance_row0 { vec4 row0[]; };
+layout (std430, binding = 1) readonly buffer instance_row1 { vec4 row1[]; };
+layout (std430, binding = 2) readonly buffer instance_row2 { vec4 row2[]; };
+layout (std430, binding = 4) readonly buffer visible_instances { uint visible[]; };
+
 layout (location = 0) out vec2 out_uv;
-layout (location = 1) out vec3 out_color;
+layout (location = 1) out vec3 out_barycentric;
+layout (location = 2) out vec3 out_position;
+layout (location = 3) out vec3 out_normal;
 
 const vec3 pos[8] = vec3[8](
 	vec3(-1.0, -1.0, 1.0), vec3( 1.0, -1.0, 1.0),
@@ -39,9 +50,27 @@ const int indices[36] = int[36](
 	3, 2, 6, 6, 7, 3
 );
 
+// per face, in the order of indices
+const vec3 normals[6] = vec3[6](
+	vec3(0.0, 0.0, 1.0), vec3(1.0, 0.0, 0.0), vec3(0.0, 0.0, -1.0),
+	vec3(-1.0, 0.0, 0.0), vec3(0.0, -1.0, 0.0), vec3(0.0, 1.0, 0.0)
+);
+
 void main() {
 	int i = indices[gl_VertexID];
-	gl_Position = mvp * vec4(pos[i], 1.0);
-	out_color = is_wire_frame > 0 ? vec3(0.0) : vec3(1.0);
+	int instance = gl_BaseInstance + gl_InstanceID;
+	if (use_visible_list != 0u) {
+		instance = int(visible[instance]);
+	}
+	vec4 local = vec4(pos[i], 1.0);
+	vec3 world = vec3(dot(row0[instance], local), dot(row1[instance], local), dot(row2[instance], local));
+	gl_Position = view_projection * vec4(world, 1.0);
+	// instances only scale uniformly, the rows transform the normal as well
+	vec3 normal = normals[gl_VertexID / 6];
+	out_position = (view * vec4(world, 1.0)).xyz;
+	out_normal = mat3(view) * vec3(dot(row0[instance].xyz, normal), dot(row1[instance].xyz, normal), dot(row2[instance].xyz, normal));
 	out_uv = tc[i];
+	// wireframe is resolved in the fragment shader instead of a second GL_LINE pass
+	int corner = gl_VertexID % 3;
+	out_barycentric = vec3(corner == 0, corner == 1, corner == 2);
 }
\ No newline at end of file
@@ -2,11 +2,25 @@
 
 in vec2 out_uv;
 in vec4 out_color;
+flat in int out_glyph;
+flat in vec4 out_clip;
 
 layout (binding = 0) uniform sampler2D texture_sampler;
+layout (binding = 1) uniform sampler2D glyph_sampler;
 
 out vec4 frag_color;
 
 void main() {
-	frag_color = out_color * texture(texture_sampler, out_uv.st);
-}
+	// the scissor test, per command so one multi-draw can span several clip rects
+	if (any(lessThan(gl_FragCoord.xy, out_clip.xy)) || any(greaterThanEqual(gl_FragCoord.xy, out_clip.zw))) {
+		discard;
+	}
+	if (out_glyph == 1) {
+		// the outline is at 0.5, smooth over about one screen pixel whatever the scale
+		float distance = texture(glyph_sampler, out_uv).r;
+		float width = fwidth(distance) * 0.75;
+		frag_color = vec4(out_color.rgb, out_color.a * smoothstep(0.5 - width, 0.5 + width, distance));
+	} else {
+		frag_color = out_color * texture(texture_sampler, out_uv.st);
+	}
+}
\ No newline at end of file
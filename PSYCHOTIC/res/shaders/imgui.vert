@@ -8,11 +8,27 @@ layout(std140, binding = 0) uniform PerFrameData {
 	uniform mat4 mvp;
 };
 
+// FONT_GLYPH_BINDING, where each glyph of the distance field atlas is
+layout (std430, binding = 6) readonly buffer glyph_rects { vec4 rects[]; };
+// IMGUI_CLIP_BINDING, one window space rect per ImDrawCmd at the command's base instance
+layout (std430, binding = 10) readonly buffer clip_rects { vec4 clips[]; };
+
 out vec2 out_uv;
 out vec4 out_color;
+flat out int out_glyph;
+flat out vec4 out_clip;
 
 void main() {
-	out_uv = in_uv;
+	// glyph quads come with uv.x = 2 + glyph index (+ 0.5 on the right edge)
+	out_glyph = in_uv.x >= 2.0 ? 1 : 0;
+	if (out_glyph == 1) {
+		float glyph = floor(in_uv.x - 2.0);
+		vec4 rect = rects[int(glyph)];
+		out_uv = mix(rect.xy, rect.zw, vec2((in_uv.x - 2.0 - glyph) * 2.0, in_uv.y));
+	} else {
+		out_uv = in_uv;
+	}
 	out_color = in_color;
+	out_clip = clips[gl_BaseInstance];
 	gl_Position = mvp * vec4(in_position.xy, 0.0, 1.0);
 }
\ No newline at end of file
@@ -1,9 +1,84 @@
 #version 460 core
 
 layout (location = 0) in vec3 out_color;
+layout (location = 1) in vec3 out_position;
+layout (location = 2) in vec3 out_normal;
+
+layout (std140, binding = 3) uniform light_data {
+	mat4 view;
+	mat4 inverse_projection;
+	vec2 screen_size;
+	float z_near;
+	float z_far;
+	uint grid_x;
+	uint grid_y;
+	uint grid_z;
+	uint light_count;
+	uint mode;
+	uint cluster_max;
+};
+
+struct light_source {
+	vec3 position;
+	float radius;
+	vec3 color;
+	float cos_inner;
+	vec3 direction;
+	float cos_outer;
+};
+
+layout (std430, binding = 7) readonly buffer view_lights { light_source lights[]; };
+// light counts per cluster, then cluster_max light ids per cluster
+layout (std430, binding = 8) readonly buffer light_clusters { uint clusters[]; };
 
 layout (location = 0) out vec4 frag_color;
 
+vec3 light_contribution(light_source light, vec3 albedo, vec3 position, vec3 normal, vec3 to_eye) {
+	vec3 to_light = light.position - position;
+	float distance_sq = dot(to_light, to_light);
+	float radius_sq = light.radius * light.radius;
+	if (distance_sq > radius_sq) {
+		return vec3(0.0);
+	}
+
+	// inverse square, windowed to reach 0 at the radius
+	vec3 l = to_light * inversesqrt(distance_sq);
+	float window = clamp(1.0 - (distance_sq * distance_sq) / (radius_sq * radius_sq), 0.0, 1.0);
+	float attenuation = window * window / (distance_sq + 1.0);
+	// point lights have cos_outer < -1, so this is 1 for them
+	attenuation *= smoothstep(light.cos_outer, light.cos_inner, dot(-l, light.direction));
+
+	float diffuse = max(dot(normal, l), 0.0);
+	float specular = pow(max(dot(normal, normalize(l + to_eye)), 0.0), 32.0) * 0.25;
+	return light.color * (albedo * diffuse + specular) * attenuation * 4.0;
+}
+
+// view space position and normal; mode 0 is unlit, 1 walks the fragment's cluster, 2 every light
+vec3 shade(vec3 albedo, vec3 position, vec3 normal) {
+	if (mode == 0u) {
+		return albedo;
+	}
+
+	normal = normalize(normal);
+	vec3 to_eye = normalize(-position);
+	vec3 color = albedo * 0.08;
+	if (mode == 1u) {
+		uvec2 tile = min(uvec2(gl_FragCoord.xy / screen_size * vec2(grid_x, grid_y)), uvec2(grid_x, grid_y) - 1u);
+		float slice = log(max(-position.z, z_near) / z_near) / log(z_far / z_near) * float(grid_z);
+		uint cluster = tile.x + tile.y * grid_x + min(uint(slice), grid_z - 1u) * grid_x * grid_y;
+		uint count = clusters[cluster];
+		uint base = grid_x * grid_y * grid_z + cluster * cluster_max;
+		for (uint i = 0u; i < count; i++) {
+			color += light_contribution(lights[clusters[base + i]], albedo, position, normal, to_eye);
+		}
+	} else {
+		for (uint i = 0u; i < light_count; i++) {
+			color += light_contribution(lights[i], albedo, position, normal, to_eye);
+		}
+	}
+	return color;
+}
+
 void main() {
-	frag_color = vec4(out_color, 1.0);
+	frag_color = vec4(shade(out_color, out_position, out_normal), 1.0);
 }
\ No newline at end of file
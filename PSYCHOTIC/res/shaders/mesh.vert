@@ -3,13 +3,21 @@
 layout (std140, binding = 0) uniform per_frame_data {
 	uniform mat4 mvp;
 	uniform int is_wire_frame;
+	// view space, for lighting; model_view includes the dequantize scale, normals only need the rotation
+	uniform mat4 model_view;
+	uniform mat4 normal_matrix;
 };
 
 layout (location = 0) in vec3 in_position;
+layout (location = 1) in vec4 in_normal;
 
 layout (location = 0) out vec3 out_color;
+layout (location = 1) out vec3 out_position;
+layout (location = 2) out vec3 out_normal;
 
 void main() {
 	gl_Position = mvp * vec4(in_position, 1.0);
-	out_color = is_wire_frame > 0 ? vec3(0.0) : in_position.xyz; 
+	out_color = is_wire_frame > 0 ? vec3(0.0) : in_normal.xyz * 0.5 + 0.5; 
+	out_position = (model_view * vec4(in_position, 1.0)).xyz;
+	out_normal = mat3(normal_matrix) * in_normal.xyz;
 }
\ No newline at end of file
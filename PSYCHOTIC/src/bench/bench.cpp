@@ -0,0 +1,210 @@
+#include "bench.h"
+
+#include <memory/memory.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+
+struct bench_stats {
+	double min;
+	double max;
+	double mean;
+	double p50;
+	double p95;
+	double p99;
+};
+
+bench_stats compute_stats(std::vector<double> samples);
+void write_stats_json(FILE *file, const char *name, std::vector<double> &samples, bool last);
+void collect_gpu_query(bench_state *bench, int slot, bool wait);
+
+void psybench::create(bench_info *info, bench_state *bench) {
+	bench->info = *info;
+	bench->frame_index = 0;
+
+	glCreateQueries(GL_TIME_ELAPSED, BENCH_QUERY_RING, bench->queries);
+	for (int i = 0; i < BENCH_QUERY_RING; i++) {
+		bench->query_frame[i] = -1;
+	}
+
+	bench->cpu_ms.reserve(info->frame_count);
+	bench->gpu_ms.reserve(info->frame_count);
+}
+
+void psybench::destroy(bench_state *bench) {
+	glDeleteQueries(BENCH_QUERY_RING, bench->queries);
+}
+
+void psybench::begin_frame(bench_state *bench) {
+	const int slot = bench->frame_index % BENCH_QUERY_RING;
+	if (bench->query_frame[slot] >= 0) {
+		collect_gpu_query(bench, slot, true);
+	}
+
+	bench->frame_begin_ticks = ticks();
+	glBeginQuery(GL_TIME_ELAPSED, bench->queries[slot]);
+	bench->query_frame[slot] = bench->frame_index;
+}
+
+void psybench::end_frame(bench_state *bench) {
+	glEndQuery(GL_TIME_ELAPSED);
+	const double cpu = ticks_to_ms(ticks() - bench->frame_begin_ticks);
+	if (measuring(bench)) {
+		bench->cpu_ms.push_back(cpu);
+	}
+
+	bench->frame_index++;
+
+	// oldest first, so gpu_ms stays in frame order; drain everything on the last frame
+	const bool last = done(bench);
+	for (int frame = bench->frame_index - BENCH_QUERY_RING; frame < bench->frame_index; frame++) {
+		const int slot = (frame + BENCH_QUERY_RING) % BENCH_QUERY_RING;
+		if (frame >= 0 && bench->query_frame[slot] == frame) {
+			collect_gpu_query(bench, slot, last);
+			if (bench->query_frame[slot] >= 0) {
+				break;
+			}
+		}
+	}
+}
+
+bool psybench::done(bench_state *bench) {
+	return bench->frame_index >= bench->info.warmup_frames + bench->info.frame_count;
+}
+
+bool psybench::measuring(bench_state *bench) {
+	return bench->frame_index >= bench->info.warmup_frames;
+}
+
+void psybench::add_sample(bench_state *bench, const char *series, double value) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_BENCH);
+	for (bench_series &s : bench->series) {
+		if (s.name == series) {
+			s.samples.push_back(value);
+			return;
+		}
+	}
+	// sized for the whole run up front so recording a sample never allocates
+	bench_series s = {};
+	s.name = series;
+	s.samples.reserve(bench->info.warmup_frames + bench->info.frame_count);
+	s.samples.push_back(value);
+	bench->series.push_back(std::move(s));
+}
+
+void psybench::set_value(bench_state *bench, const char *name, double value) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_BENCH);
+	for (bench_value &v : bench->values) {
+		if (v.name == name) {
+			v.value = value;
+			return;
+		}
+	}
+	bench_value v = {};
+	v.name = name;
+	v.value = value;
+	bench->values.push_back(v);
+}
+
+bool psybench::write_report(bench_state *bench) {
+	std::string csv_path = std::string(bench->info.report_path) + ".csv";
+	std::string json_path = std::string(bench->info.report_path) + ".json";
+
+	FILE *csv = fopen(csv_path.c_str(), "w");
+	if (!csv) {
+		fprintf(stderr, "Error: could not write %s\n", csv_path.c_str());
+		return false;
+	}
+	fprintf(csv, "frame,cpu_ms,gpu_ms\n");
+	for (size_t i = 0; i < bench->cpu_ms.size(); i++) {
+		const double gpu = i < bench->gpu_ms.size() ? bench->gpu_ms[i] : 0.0;
+		fprintf(csv, "%zu,%.4f,%.4f\n", i, bench->cpu_ms[i], gpu);
+	}
+	fclose(csv);
+
+	FILE *json = fopen(json_path.c_str(), "w");
+	if (!json) {
+		fprintf(stderr, "Error: could not write %s\n", json_path.c_str());
+		return false;
+	}
+	fprintf(json, "{\n");
+	fprintf(json, "\t\"frames\": %zu,\n", bench->cpu_ms.size());
+	fprintf(json, "\t\"warmup_frames\": %d,\n", bench->info.warmup_frames);
+	fprintf(json, "\t\"renderer\": \"%s\",\n", (const char *)glGetString(GL_RENDERER));
+	for (bench_value &v : bench->values) {
+		fprintf(json, "\t\"%s\": %.4f,\n", v.name.c_str(), v.value);
+	}
+	for (bench_series &s : bench->series) {
+		write_stats_json(json, s.name.c_str(), s.samples, false);
+	}
+	write_stats_json(json, "cpu_ms", bench->cpu_ms, false);
+	write_stats_json(json, "gpu_ms", bench->gpu_ms, true);
+	fprintf(json, "}\n");
+	fclose(json);
+
+	bench_stats cpu = compute_stats(bench->cpu_ms);
+	bench_stats gpu = compute_stats(bench->gpu_ms);
+	printf("cpu ms: p50 %.3f p95 %.3f p99 %.3f min %.3f max %.3f\n", cpu.p50, cpu.p95, cpu.p99, cpu.min, cpu.max);
+	printf("gpu ms: p50 %.3f p95 %.3f p99 %.3f min %.3f max %.3f\n", gpu.p50, gpu.p95, gpu.p99, gpu.min, gpu.max);
+
+	return true;
+}
+
+uint64_t psybench::ticks() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double psybench::ticks_to_ms(uint64_t ticks) {
+	return (double)ticks / 1000000.0;
+}
+
+bench_stats compute_stats(std::vector<double> samples) {
+	bench_stats stats = {};
+	if (samples.empty()) {
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	const size_t last = samples.size() - 1;
+
+	double sum = 0.0;
+	for (double s : samples) {
+		sum += s;
+	}
+
+	stats.min = samples.front();
+	stats.max = samples.back();
+	stats.mean = sum / (double)samples.size();
+	stats.p50 = samples[(size_t)(last * 0.50 + 0.5)];
+	stats.p95 = samples[(size_t)(last * 0.95 + 0.5)];
+	stats.p99 = samples[(size_t)(last * 0.99 + 0.5)];
+	return stats;
+}
+
+void write_stats_json(FILE *file, const char *name, std::vector<double> &samples, bool last) {
+	bench_stats stats = compute_stats(samples);
+	fprintf(file,
+		"\t\"%s\": { \"count\": %zu, \"min\": %.4f, \"max\": %.4f, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f }%s\n",
+		name, samples.size(), stats.min, stats.max, stats.mean, stats.p50, stats.p95, stats.p99,
+		last ? "" : ",");
+}
+
+void collect_gpu_query(bench_state *bench, int slot, bool wait) {
+	if (!wait) {
+		GLint available = 0;
+		glGetQueryObjectiv(bench->queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			return;
+		}
+	}
+
+	GLuint64 elapsed = 0;
+	glGetQueryObjectui64v(bench->queries[slot], GL_QUERY_RESULT, &elapsed);
+	if (bench->query_frame[slot] >= bench->info.warmup_frames) {
+		bench->gpu_ms.push_back(psybench::ticks_to_ms(elapsed));
+	}
+	bench->query_frame[slot] = -1;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define BENCH_QUERY_RING 4
+
+struct bench_info {
+	int frame_count;
+	int warmup_frames;
+	const char *report_path; // writes <path>.csv (per frame) and <path>.json (summary)
+};
+
+struct bench_series {
+	std::string name;
+	std::vector<double> samples;
+};
+
+struct bench_value {
+	std::string name;
+	double value;
+};
+
+struct bench_state {
+	bench_info info;
+	int frame_index;
+
+	uint64_t frame_begin_ticks;
+
+	// GL_TIME_ELAPSED queries are read back BENCH_QUERY_RING - 1 frames late so
+	// the harness itself never stalls the pipeline
+	GLuint queries[BENCH_QUERY_RING];
+	int query_frame[BENCH_QUERY_RING];
+
+	std::vector<double> cpu_ms;
+	std::vector<double> gpu_ms;
+
+	std::vector<bench_series> series;
+	std::vector<bench_value> values;
+};
+
+namespace psybench {
+	void create(bench_info *info, bench_state *bench);
+	void destroy(bench_state *bench);
+	void begin_frame(bench_state *bench);
+	void end_frame(bench_state *bench);
+	bool done(bench_state *bench);
+	bool measuring(bench_state *bench);
+
+	void add_sample(bench_state *bench, const char *series, double value);
+	void set_value(bench_state *bench, const char *name, double value);
+
+	bool write_report(bench_state *bench);
+
+	uint64_t ticks();
+	double ticks_to_ms(uint64_t ticks);
+}
@@ -0,0 +1,131 @@
+#include "buffer.h"
+
+#include <profiler/profiler.h>
+#include <state/state.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+void map_stream(stream_buffer *stream, GLsizeiptr region_size);
+void wait_fence(GLsync *fence);
+GLintptr align_offset(GLintptr offset, GLsizeiptr alignment);
+void release_retired(stream_buffer *stream);
+
+void psybuffer::create_stream(stream_buffer *stream, GLsizeiptr region_size) {
+	*stream = {};
+	map_stream(stream, region_size);
+}
+
+void psybuffer::destroy_stream(stream_buffer *stream) {
+	for (int i = 0; i < STREAM_BUFFER_REGIONS; i++) {
+		if (stream->fences[i]) {
+			glDeleteSync(stream->fences[i]);
+		}
+	}
+	release_retired(stream);
+	psystate::forget(stream->buffer);
+	glUnmapNamedBuffer(stream->buffer);
+	glDeleteBuffers(1, &stream->buffer);
+	*stream = {};
+}
+
+void psybuffer::begin_frame(stream_buffer *stream) {
+	PSY_PROFILE_SCOPE("stream wait");
+	wait_fence(&stream->fences[stream->region]);
+	stream->head = 0;
+}
+
+void psybuffer::end_frame(stream_buffer *stream) {
+	stream->fences[stream->region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	stream->region = (stream->region + 1) % STREAM_BUFFER_REGIONS;
+
+	// the driver keeps a deleted buffer alive until the commands using it retire
+	release_retired(stream);
+}
+
+stream_allocation psybuffer::allocate(stream_buffer *stream, GLsizeiptr size, GLsizeiptr alignment) {
+	const GLintptr base = (GLintptr)stream->region * stream->region_size;
+	GLintptr offset = align_offset(base + stream->head, alignment);
+
+	if (offset + size > base + stream->region_size) {
+		// grow so the whole frame fits in one region again; the old buffer stays mapped
+		// and bound for everything already handed out this frame until end_frame. Every
+		// grow at least doubles, so the retired list only fills on a 2^8 jump in one frame
+		GLsizeiptr region_size = stream->region_size * 2;
+		while (region_size < stream->head + size + alignment) {
+			region_size *= 2;
+		}
+
+		if (stream->retired_count == STREAM_BUFFER_MAX_RETIRED) {
+			fprintf(stderr, "Error: stream buffer grew %d times in one frame (%lld bytes requested)\n",
+				STREAM_BUFFER_MAX_RETIRED, (long long)size);
+			abort();
+		}
+		stream->retired[stream->retired_count++] = stream->buffer;
+		for (int i = 0; i < STREAM_BUFFER_REGIONS; i++) {
+			if (stream->fences[i]) {
+				glDeleteSync(stream->fences[i]);
+				stream->fences[i] = 0;
+			}
+		}
+
+		const int region = stream->region;
+		map_stream(stream, region_size);
+		stream->region = region;
+		stream->head = 0;
+
+		const GLintptr grown_base = (GLintptr)stream->region * stream->region_size;
+		offset = align_offset(grown_base, alignment);
+	}
+
+	stream->head = offset + size - (GLintptr)stream->region * stream->region_size;
+
+	stream_allocation allocation = {};
+	allocation.buffer = stream->buffer;
+	allocation.offset = offset;
+	allocation.pointer = stream->mapped + offset;
+	return allocation;
+}
+
+void map_stream(stream_buffer *stream, GLsizeiptr region_size) {
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glCreateBuffers(1, &stream->buffer);
+	glNamedBufferStorage(stream->buffer, region_size * STREAM_BUFFER_REGIONS, nullptr, flags);
+	stream->mapped = (uint8_t *)glMapNamedBufferRange(stream->buffer, 0, region_size * STREAM_BUFFER_REGIONS, flags);
+	if (!stream->mapped) {
+		fprintf(stderr, "Error: failed to map stream buffer (%lld bytes)\n", (long long)(region_size * STREAM_BUFFER_REGIONS));
+	}
+	stream->region_size = region_size;
+}
+
+void wait_fence(GLsync *fence) {
+	if (!*fence) {
+		return;
+	}
+
+	GLenum result = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED) {
+		result = glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+	glDeleteSync(*fence);
+	*fence = 0;
+}
+
+GLintptr align_offset(GLintptr offset, GLsizeiptr alignment) {
+	if (alignment <= 1) {
+		return offset;
+	}
+	return (offset + alignment - 1) / alignment * alignment;
+}
+
+void release_retired(stream_buffer *stream) {
+	for (int i = 0; i < stream->retired_count; i++) {
+		psystate::forget(stream->retired[i]);
+	}
+	for (int i = 0; i < stream->retired_count; i++) {
+		glUnmapNamedBuffer(stream->retired[i]);
+	}
+	glDeleteBuffers(stream->retired_count, stream->retired);
+	stream->retired_count = 0;
+}
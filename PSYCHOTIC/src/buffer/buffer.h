@@ -0,0 +1,41 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+
+#define STREAM_BUFFER_REGIONS 3
+#define STREAM_BUFFER_MAX_RETIRED 8
+
+// Persistently mapped ring split into one region per frame in flight. Writes go
+// straight into the mapping; a fence per region makes sure the GPU is done
+// reading a region before the CPU wraps around to it again.
+struct stream_buffer {
+	GLuint buffer;
+	uint8_t *mapped;
+	GLsizeiptr region_size;
+	int region;
+	GLsizeiptr head;
+	GLsync fences[STREAM_BUFFER_REGIONS];
+
+	// buffers replaced by a grow this frame, still mapped and bound until the frame is
+	// submitted and deleted then
+	GLuint retired[STREAM_BUFFER_MAX_RETIRED];
+	int retired_count;
+};
+
+struct stream_allocation {
+	GLuint buffer;
+	GLintptr offset;
+	void *pointer;
+};
+
+namespace psybuffer {
+	void create_stream(stream_buffer *stream, GLsizeiptr region_size);
+	void destroy_stream(stream_buffer *stream);
+	void begin_frame(stream_buffer *stream);
+	void end_frame(stream_buffer *stream);
+
+	// alignment does not need to be a power of two (vertex strides are fine)
+	stream_allocation allocate(stream_buffer *stream, GLsizeiptr size, GLsizeiptr alignment);
+}
@@ -0,0 +1,349 @@
+#include "capture.h"
+
+#include <bench/bench.h>
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+
+#include <stb/stb_image_write.h>
+
+#include <string.h>
+
+void capture_encoder(capture_state *capture);
+void encode_slot(capture_state *capture, capture_slot *slot, std::vector<uint8_t> *scratch);
+void rgba_to_yuv420(const uint8_t *rgba, int width, int height, uint8_t *out);
+void resize_slot(capture_slot *slot, int width, int height);
+void finish_readback(capture_state *capture, uint32_t index, bool wait);
+void flush(capture_state *capture);
+
+void psycapture::create(capture_state *capture, int encoder_count) {
+	for (capture_slot &slot : capture->slots) {
+		slot.buffer = 0;
+		slot.mapped = nullptr;
+		slot.size = 0;
+		slot.fence = 0;
+		slot.state = CAPTURE_SLOT_FREE;
+	}
+	capture->next_slot = 0;
+	capture->queue_head = 0;
+	capture->queue_tail = 0;
+	capture->quit = false;
+	capture->screenshot_path = "screenshot.png";
+	capture->recording = false;
+	capture->record_file = nullptr;
+	capture->stats = capture_stats();
+
+	encoder_count = encoder_count > 0 ? encoder_count : 1;
+	for (int i = 0; i < encoder_count; i++) {
+		capture->encoders.emplace_back(capture_encoder, capture);
+	}
+}
+
+void psycapture::destroy(capture_state *capture) {
+	if (capture->recording) {
+		psycapture::stop_recording(capture);
+	}
+	flush(capture);
+
+	{
+		std::lock_guard<std::mutex> guard(capture->lock);
+		capture->quit = true;
+	}
+	capture->wake.notify_all();
+	for (std::thread &encoder : capture->encoders) {
+		encoder.join();
+	}
+	capture->encoders.clear();
+
+	for (capture_slot &slot : capture->slots) {
+		if (slot.buffer) {
+			glUnmapNamedBuffer(slot.buffer);
+			glDeleteBuffers(1, &slot.buffer);
+		}
+	}
+}
+
+void psycapture::update(capture_state *capture) {
+	PSY_PROFILE_SCOPE("psycapture::update");
+	const uint64_t start = psybench::ticks();
+	{
+		// a new frame, capture() adds its readback to this
+		std::lock_guard<std::mutex> guard(capture->lock);
+		capture->stats.gl_ms = 0.0;
+	}
+	// oldest first, a fence that has not passed means none of the newer ones have
+	for (uint32_t i = 0; i < CAPTURE_SLOTS; i++) {
+		const uint32_t index = (capture->next_slot + i) % CAPTURE_SLOTS;
+		if (capture->slots[index].state == CAPTURE_SLOT_READING) {
+			finish_readback(capture, index, false);
+			if (capture->slots[index].state == CAPTURE_SLOT_READING) {
+				break;
+			}
+		}
+	}
+	std::lock_guard<std::mutex> guard(capture->lock);
+	capture->stats.gl_ms += psybench::ticks_to_ms(psybench::ticks() - start);
+}
+
+void psycapture::capture(capture_state *capture, GLuint framebuffer, int width, int height, bool screenshot) {
+	if (capture->recording && (width != capture->record_width || height != capture->record_height)) {
+		fprintf(stderr, "Warning: framebuffer resized to %dx%d, recording stopped\n", width, height);
+		psycapture::stop_recording(capture);
+	}
+	const bool record = capture->recording;
+	if (!screenshot && !record) {
+		return;
+	}
+	PSY_PROFILE_SCOPE("psycapture::capture");
+	const uint64_t start = psybench::ticks();
+
+	// the slot about to be reused is the oldest one, wait for it to come back
+	const uint32_t index = capture->next_slot;
+	capture_slot *slot = &capture->slots[index];
+	double stall_ms = 0.0;
+	if (slot->state != CAPTURE_SLOT_FREE) {
+		PSY_PROFILE_SCOPE("capture stall");
+		const uint64_t stall_start = psybench::ticks();
+		if (slot->state == CAPTURE_SLOT_READING) {
+			finish_readback(capture, index, true);
+		}
+		std::unique_lock<std::mutex> guard(capture->lock);
+		capture->returned.wait(guard, [slot] { return slot->state == CAPTURE_SLOT_FREE; });
+		stall_ms = psybench::ticks_to_ms(psybench::ticks() - stall_start);
+	}
+	capture->next_slot = (index + 1) % CAPTURE_SLOTS;
+
+	resize_slot(slot, width, height);
+	slot->screenshot = screenshot;
+	slot->record = record;
+	slot->sequence = record ? capture->record_sequence++ : 0;
+
+	glNamedFramebufferReadBuffer(framebuffer, GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->state = CAPTURE_SLOT_READING;
+
+	std::lock_guard<std::mutex> guard(capture->lock);
+	capture->stats.stall_ms += stall_ms;
+	capture->stats.gl_ms += psybench::ticks_to_ms(psybench::ticks() - start);
+	capture->stats.screenshots += screenshot;
+	capture->stats.recorded_frames += record;
+}
+
+bool psycapture::start_recording(capture_state *capture, const char *path, int width, int height, int fps) {
+	if (capture->recording) {
+		psycapture::stop_recording(capture);
+	}
+
+	const size_t length = strlen(path);
+	capture->y4m = length > 4 && !strcmp(path + length - 4, ".y4m");
+	capture->record_path = path;
+	if (capture->y4m) {
+		capture->record_file = fopen(path, "wb");
+		if (!capture->record_file) {
+			fprintf(stderr, "Error: could not open %s for recording\n", path);
+			return false;
+		}
+		// 4:2:0 with full range BT.601, which is what rgba_to_yuv420 writes
+		fprintf(capture->record_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, fps);
+	}
+
+	capture->recording = true;
+	capture->record_width = width;
+	capture->record_height = height;
+	capture->record_sequence = 0;
+	capture->written_sequence = 0;
+	printf("recording %dx%d to %s\n", width, height, path);
+	return true;
+}
+
+void psycapture::stop_recording(capture_state *capture) {
+	if (!capture->recording) {
+		return;
+	}
+	capture->recording = false;
+	flush(capture);
+
+	if (capture->record_file) {
+		fclose(capture->record_file);
+		capture->record_file = nullptr;
+	}
+	printf("recorded %u frames to %s\n", capture->record_sequence, capture->record_path.c_str());
+}
+
+capture_stats psycapture::stats(capture_state *capture) {
+	std::lock_guard<std::mutex> guard(capture->lock);
+	capture_stats stats = capture->stats;
+	stats.queued = capture->queue_head - capture->queue_tail;
+	return stats;
+}
+
+void capture_encoder(capture_state *capture) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_CAPTURE);
+	std::vector<uint8_t> scratch;
+	for (;;) {
+		uint32_t index = 0;
+		{
+			std::unique_lock<std::mutex> guard(capture->lock);
+			capture->wake.wait(guard, [capture] { return capture->quit || capture->queue_head != capture->queue_tail; });
+			if (capture->queue_head == capture->queue_tail) {
+				return;
+			}
+			index = capture->queue[capture->queue_tail % CAPTURE_SLOTS];
+			capture->queue_tail++;
+		}
+
+		capture_slot *slot = &capture->slots[index];
+		const uint64_t start = psybench::ticks();
+		encode_slot(capture, slot, &scratch);
+		const double encode_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+
+		{
+			std::lock_guard<std::mutex> guard(capture->lock);
+			slot->state = CAPTURE_SLOT_FREE;
+			capture->stats.encode_ms += encode_ms;
+			capture->stats.encoded++;
+		}
+		capture->returned.notify_all();
+	}
+}
+
+// GL rows are bottom up, everything written here is top down
+void encode_slot(capture_state *capture, capture_slot *slot, std::vector<uint8_t> *scratch) {
+	PSY_PROFILE_SCOPE("capture encode");
+	const int stride = slot->width * 4;
+	const uint8_t *top_row = slot->mapped + (size_t)(slot->height - 1) * stride;
+
+	if (slot->screenshot) {
+		stbi_write_png(capture->screenshot_path.c_str(), slot->width, slot->height, 4, top_row, -stride);
+	}
+	if (!slot->record) {
+		return;
+	}
+
+	if (!capture->y4m) {
+		char path[512];
+		snprintf(path, sizeof(path), "%s_%06u.png", capture->record_path.c_str(), slot->sequence);
+		stbi_write_png(path, slot->width, slot->height, 4, top_row, -stride);
+		return;
+	}
+
+	const int chroma_width = (slot->width + 1) / 2;
+	const int chroma_height = (slot->height + 1) / 2;
+	scratch->resize((size_t)slot->width * slot->height + 2 * (size_t)chroma_width * chroma_height);
+	rgba_to_yuv420(slot->mapped, slot->width, slot->height, scratch->data());
+
+	// conversion runs in parallel, the stream itself is written in frame order
+	std::unique_lock<std::mutex> guard(capture->lock);
+	capture->returned.wait(guard, [capture, slot] { return capture->written_sequence == slot->sequence; });
+	fwrite("FRAME\n", 1, 6, capture->record_file);
+	fwrite(scratch->data(), 1, scratch->size(), capture->record_file);
+	capture->written_sequence++;
+	guard.unlock();
+	capture->returned.notify_all();
+}
+
+// full range BT.601 in 8 bit fixed point, chroma averaged over each 2x2 block,
+// rgba is bottom up and the planes come out top down
+void rgba_to_yuv420(const uint8_t *rgba, int width, int height, uint8_t *out) {
+	const int chroma_width = (width + 1) / 2;
+	const int chroma_height = (height + 1) / 2;
+	uint8_t *y_plane = out;
+	uint8_t *u_plane = y_plane + (size_t)width * height;
+	uint8_t *v_plane = u_plane + (size_t)chroma_width * chroma_height;
+
+	for (int y = 0; y < height; y++) {
+		const uint8_t *row = rgba + (size_t)(height - 1 - y) * width * 4;
+		uint8_t *luma = y_plane + (size_t)y * width;
+		for (int x = 0; x < width; x++) {
+			const int r = row[x * 4 + 0], g = row[x * 4 + 1], b = row[x * 4 + 2];
+			luma[x] = (uint8_t)((77 * r + 150 * g + 29 * b + 128) >> 8);
+		}
+	}
+
+	for (int cy = 0; cy < chroma_height; cy++) {
+		const int y0 = cy * 2;
+		const int y1 = y0 + 1 < height ? y0 + 1 : y0;
+		const uint8_t *row0 = rgba + (size_t)(height - 1 - y0) * width * 4;
+		const uint8_t *row1 = rgba + (size_t)(height - 1 - y1) * width * 4;
+		for (int cx = 0; cx < chroma_width; cx++) {
+			const int x0 = cx * 2;
+			const int x1 = x0 + 1 < width ? x0 + 1 : x0;
+			const int r = row0[x0 * 4 + 0] + row0[x1 * 4 + 0] + row1[x0 * 4 + 0] + row1[x1 * 4 + 0];
+			const int g = row0[x0 * 4 + 1] + row0[x1 * 4 + 1] + row1[x0 * 4 + 1] + row1[x1 * 4 + 1];
+			const int b = row0[x0 * 4 + 2] + row0[x1 * 4 + 2] + row1[x0 * 4 + 2] + row1[x1 * 4 + 2];
+			// sums of four, the extra >> 2 averages them
+			const int u = ((-43 * r - 85 * g + 128 * b + 512) >> 10) + 128;
+			const int v = ((128 * r - 107 * g - 21 * b + 512) >> 10) + 128;
+			u_plane[(size_t)cy * chroma_width + cx] = (uint8_t)(u < 0 ? 0 : u > 255 ? 255 : u);
+			v_plane[(size_t)cy * chroma_width + cx] = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+		}
+	}
+}
+
+// free slots only, the mapping is recreated when the framebuffer size changed
+void resize_slot(capture_slot *slot, int width, int height) {
+	const size_t size = (size_t)width * height * 4;
+	slot->width = width;
+	slot->height = height;
+	if (slot->buffer && slot->size == size) {
+		return;
+	}
+	if (slot->buffer) {
+		glUnmapNamedBuffer(slot->buffer);
+		glDeleteBuffers(1, &slot->buffer);
+	}
+
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &slot->buffer);
+	glNamedBufferStorage(slot->buffer, (GLsizeiptr)size, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+	slot->mapped = (const uint8_t *)glMapNamedBufferRange(slot->buffer, 0, (GLsizeiptr)size, flags);
+	slot->size = size;
+	if (!slot->mapped) {
+		fprintf(stderr, "Error: failed to map capture buffer (%zu bytes)\n", size);
+	}
+}
+
+// GL thread: once the readback landed the slot belongs to the encoders
+void finish_readback(capture_state *capture, uint32_t index, bool wait) {
+	capture_slot *slot = &capture->slots[index];
+	GLenum result = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (wait && result == GL_TIMEOUT_EXPIRED) {
+		result = glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+	if (result == GL_TIMEOUT_EXPIRED) {
+		return;
+	}
+	glDeleteSync(slot->fence);
+	slot->fence = 0;
+
+	{
+		std::lock_guard<std::mutex> guard(capture->lock);
+		slot->state = CAPTURE_SLOT_ENCODING;
+		capture->queue[capture->queue_head % CAPTURE_SLOTS] = index;
+		capture->queue_head++;
+	}
+	capture->wake.notify_one();
+}
+
+// GL thread: waits until every slot is back from the encoders
+void flush(capture_state *capture) {
+	for (uint32_t i = 0; i < CAPTURE_SLOTS; i++) {
+		const uint32_t index = (capture->next_slot + i) % CAPTURE_SLOTS;
+		if (capture->slots[index].state == CAPTURE_SLOT_READING) {
+			finish_readback(capture, index, true);
+		}
+	}
+	std::unique_lock<std::mutex> guard(capture->lock);
+	capture->returned.wait(guard, [capture] {
+		for (const capture_slot &slot : capture->slots) {
+			if (slot.state != CAPTURE_SLOT_FREE) {
+				return false;
+			}
+		}
+		return true;
+	});
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// pixel pack buffers in flight; a frame is read back a few frames after it was drawn and
+// stays in its buffer until an encoder is done with it. When all of them are busy the
+// next capture waits, so recording slows the app down instead of dropping frames
+#define CAPTURE_SLOTS 6
+
+enum capture_slot_state {
+	CAPTURE_SLOT_FREE,
+	// glReadPixels issued, fence pending
+	CAPTURE_SLOT_READING,
+	// fence passed, queued for or owned by an encoder
+	CAPTURE_SLOT_ENCODING
+};
+
+struct capture_slot {
+	GLuint buffer;
+	// persistent coherent mapping, encoders read straight from it
+	const uint8_t *mapped;
+	size_t size;
+	int width;
+	int height;
+	GLsync fence;
+	// the GL thread moves a slot to reading and encoding, an encoder hands it back
+	std::atomic<capture_slot_state> state;
+
+	bool screenshot;
+	bool record;
+	// position in the recording, frames are written in this order
+	uint32_t sequence;
+};
+
+// written under capture_state::lock, copied out with psycapture::stats
+struct capture_stats {
+	uint32_t screenshots;
+	uint32_t recorded_frames;
+	// GL thread time spent polling fences and issuing readbacks, last frame: update()
+	// starts the frame over, capture() adds to it
+	double gl_ms;
+	// GL thread time spent waiting for a free slot, total
+	double stall_ms;
+	// encoder time, total over every frame encoded
+	double encode_ms;
+	uint32_t encoded;
+	uint32_t queued;
+};
+
+struct capture_state {
+	capture_slot slots[CAPTURE_SLOTS];
+	uint32_t next_slot;
+
+	std::vector<std::thread> encoders;
+	std::mutex lock;
+	std::condition_variable wake;
+	// signalled whenever an encoder hands a slot back
+	std::condition_variable returned;
+	// slots waiting for an encoder, a slot is queued at most once so this never overflows
+	uint32_t queue[CAPTURE_SLOTS];
+	uint32_t queue_head;
+	uint32_t queue_tail;
+	bool quit;
+
+	std::string screenshot_path;
+
+	// GL thread side of a recording
+	bool recording;
+	// .y4m streams into one file, anything else is a prefix for numbered PNGs
+	bool y4m;
+	std::string record_path;
+	FILE *record_file;
+	int record_width;
+	int record_height;
+	uint32_t record_sequence;
+	// encoder side, the next frame allowed into record_file
+	uint32_t written_sequence;
+
+	capture_stats stats;
+};
+
+namespace psycapture {
+	void create(capture_state *capture, int encoder_count);
+	// finishes a running recording and every pending screenshot
+	void destroy(capture_state *capture);
+
+	// GL thread, once per frame before capture(): hands readbacks whose fence passed to the encoders
+	void update(capture_state *capture);
+	// GL thread: queues a readback of framebuffer's first color attachment as a screenshot,
+	// a recorded frame or both; does nothing when neither is wanted
+	void capture(capture_state *capture, GLuint framebuffer, int width, int height, bool screenshot);
+
+	bool start_recording(capture_state *capture, const char *path, int width, int height, int fps);
+	// blocks until every recorded frame is written
+	void stop_recording(capture_state *capture);
+
+	capture_stats stats(capture_state *capture);
+}
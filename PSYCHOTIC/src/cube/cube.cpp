@@ -0,0 +1,120 @@
+#include "cube.h"
+
+#include <profiler/profiler.h>
+
+#include <glm/ext.hpp>
+
+// std140 block at uniform binding 1, shared by every instanced draw of the frame
+struct view_data {
+	glm::mat4 view_projection;
+	GLuint use_visible_list;
+	GLuint padding[3];
+	glm::mat4 view;
+};
+
+namespace cube {
+	void create(cube_context *cube, shader_manager *shaders, texture_manager *textures, uint32_t count) {
+		cube->program = psyshader::load(shaders, "cube.vert", "cube.frag");
+		glCreateVertexArrays(1, &cube->vao);
+		cube->texture = psytexture::load(textures, "res/textures/goreshit.jpg");
+		cube->pipeline = psystate::pipeline();
+		cube->pipeline.vertex_array = cube->vao;
+		cube->pipeline.depth_test = true;
+		cube->uniform_alignment = 0;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &cube->uniform_alignment);
+		set_instances(cube, count);
+	}
+
+	void destroy(cube_context *cube) {
+		psyscene::destroy(&cube->scene);
+		psystate::forget(cube->vao);
+		glDeleteVertexArrays(1, &cube->vao);
+	}
+
+	// lays count cubes out on a grid around the origin as root nodes, a single cube keeps the
+	// identity transform so the default scene is unchanged; only the camera moves
+	void set_instances(cube_context *cube, uint32_t count) {
+		PSY_PROFILE_SCOPE("cube::set_instances");
+
+		count = count > 0 ? count : 1;
+		int side = 1;
+		while ((uint64_t)side * side * side < count) {
+			side++;
+		}
+
+		psyscene::destroy(&cube->scene);
+		psyscene::create(&cube->scene, count);
+		const float center = (side - 1) * 0.5f;
+		const glm::vec3 axis = glm::normalize(glm::vec3(1.0f, 1.0f, 0.0f));
+		for (uint32_t i = 0; i < count; i++) {
+			const glm::vec3 cell = glm::vec3(
+				(float)(i % side),
+				(float)(i / side % side),
+				(float)(i / (side * side)));
+			scene_transform local = {};
+			local.position = (cell - center) * CUBE_SPACING;
+			local.rotation = glm::angleAxis(i * 0.618034f, axis);
+			local.scale = 1.0f;
+			// the unit cube's circumscribed sphere
+			psyscene::add(&cube->scene, SCENE_NO_PARENT, local, 1.7320508f);
+		}
+		// every copy starts out complete
+		for (uint32_t copy = 0; copy < SCENE_BUFFER_COPIES; copy++) {
+			psyscene::update(&cube->scene, copy);
+		}
+		cube->grid_side = side;
+	}
+
+	// orbit far enough out to see the whole grid, one cube gives the original 3.5 / 10 setup
+	glm::mat4 view(const cube_context *cube, float time, float yaw) {
+		const float extent = (cube->grid_side - 1) * CUBE_SPACING;
+		const float distance = 3.5f + extent * 1.5f;
+		return glm::rotate(
+			glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -distance)),
+			time + yaw,
+			glm::vec3(0.0f, 1.0f, 0.0f));
+	}
+
+	glm::mat4 projection(const cube_context *cube, float ratio, float *z_near, float *z_far) {
+		const float extent = (cube->grid_side - 1) * CUBE_SPACING;
+		const float near_plane = 0.1f;
+		const float far_plane = 10.0f + extent * 3.0f;
+		if (z_near) *z_near = near_plane;
+		if (z_far) *z_far = far_plane;
+		return glm::perspective(45.0f, ratio, near_plane, far_plane);
+	}
+
+	glm::mat4 camera(const cube_context *cube, float ratio, float time, float yaw) {
+		return projection(cube, ratio, nullptr, nullptr) * view(cube, time, yaw);
+	}
+
+	float light_extent(const cube_context *cube) {
+		return (cube->grid_side - 1) * CUBE_SPACING * 0.5f + CUBE_SPACING;
+	}
+
+	void cull(cube_context *cube, cull_context *cull, stream_buffer *stream, const glm::mat4 &view_projection, const cull_cpu_result *cpu, uint32_t copy) {
+		psycull::cull(cull, stream, view_projection, 36, cube->scene.buffer, psyscene::array_offset(&cube->scene, copy, 3), cpu, cube->scene.count);
+	}
+
+	void draw(cube_context *cube, shader_manager *shaders, texture_manager *textures, cull_context *cull, stream_buffer *stream, const glm::mat4 &view_projection, const glm::mat4 &view, uint32_t copy) {
+		PSY_PROFILE_GPU_SCOPE("cube::draw");
+
+		const GLsizeiptr row_bytes = psyscene::array_size(&cube->scene);
+		stream_allocation view_allocation = psybuffer::allocate(stream, sizeof(view_data), cube->uniform_alignment);
+		view_data *view_block = (view_data *)view_allocation.pointer;
+		view_block->view_projection = view_projection;
+		view_block->use_visible_list = cull->mode != CULL_MODE_NONE;
+		view_block->view = view;
+		psystate::bind_buffer_range(GL_UNIFORM_BUFFER, 1, view_allocation.buffer, view_allocation.offset, sizeof(view_data));
+
+		for (GLuint row = 0; row < 3; row++) {
+			psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, row, cube->scene.buffer, psyscene::array_offset(&cube->scene, copy, row), row_bytes);
+		}
+
+		cube->pipeline.program = psyshader::get(shaders, cube->program);
+		psystate::apply(&cube->pipeline);
+		psystate::bind_texture(0, psytexture::get(textures, cube->texture));
+
+		psycull::draw(cull, 36, cube->scene.count);
+	}
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <buffer/buffer.h>
+#include <cull/cull.h>
+#include <scene/scene.h>
+#include <shader/shader.h>
+#include <state/state.h>
+#include <texture/texture.h>
+
+#include <stdint.h>
+
+#define CUBE_SPACING 3.0f
+
+struct cube_context {
+	GLuint vao;
+	shader_handle program;
+	texture_handle texture;
+	// program is filled in per draw, a reload can replace it
+	state_pipeline pipeline;
+
+	// one node per instance, the scene writes their transforms and bounding spheres
+	// into the instance SSBO
+	scene_graph scene;
+	// cubes per edge of the grid they are laid out on
+	int grid_side;
+	// stream allocation alignment of the view block, queried once
+	GLint uniform_alignment;
+};
+
+namespace cube {
+	void create(cube_context *cube, shader_manager *shaders, texture_manager *textures, uint32_t count);
+	void destroy(cube_context *cube);
+	void set_instances(cube_context *cube, uint32_t count);
+	// orbits far enough out to see the whole grid, camera is projection * view; z_near and
+	// z_far may be null
+	glm::mat4 view(const cube_context *cube, float time, float yaw);
+	glm::mat4 projection(const cube_context *cube, float ratio, float *z_near, float *z_far);
+	glm::mat4 camera(const cube_context *cube, float ratio, float time, float yaw);
+	// half size of the box around the grid the lights are scattered through
+	float light_extent(const cube_context *cube);
+	// culls the instances in copy for view_projection (with cpu's ids on the CPU path), draw renders whatever survived
+	void cull(cube_context *cube, cull_context *cull, stream_buffer *stream, const glm::mat4 &view_projection, const cull_cpu_result *cpu, uint32_t copy);
+	void draw(cube_context *cube, shader_manager *shaders, texture_manager *textures, cull_context *cull, stream_buffer *stream, const glm::mat4 &view_projection, const glm::mat4 &view, uint32_t copy);
+}
@@ -0,0 +1,413 @@
+#include "cull.h"
+
+#include <bench/bench.h>
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+
+#include <imgui.h>
+
+#include <emmintrin.h>
+#include <xmmintrin.h>
+
+#include <string.h>
+
+void extract_planes(const glm::mat4 &view_projection, glm::vec4 planes[6]);
+void cull_batch(void *data, uint32_t begin, uint32_t end);
+uint32_t cull_spheres_sse(const cull_spheres *spheres, uint32_t begin, uint32_t end, const glm::vec4 planes[6], uint32_t *visible);
+void create_pyramid(cull_context *cull, int width, int height);
+void collect_readback(cull_context *cull, int slot);
+bool cull_queries_ready(const GLuint *queries);
+
+void psycull::create(cull_context *cull, shader_manager *shaders) {
+	cull->shaders = shaders;
+	cull->cull_program = psyshader::load_compute(shaders, "cull.comp");
+	cull->pyramid_program = psyshader::load_compute(shaders, "hiz.comp");
+	cull->mode = CULL_MODE_GPU;
+	cull->hiz = true;
+	cull->visible_buffer = 0;
+	cull->visible_capacity = 0;
+	cull->hiz_texture = 0;
+	cull->hiz_width = 0;
+	cull->hiz_height = 0;
+	cull->hiz_levels = 0;
+	cull->hiz_valid = false;
+	cull->frame = 0;
+	cull->stats = {};
+	cull->ssbo_alignment = 0;
+	cull->uniform_alignment = 0;
+	glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &cull->ssbo_alignment);
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &cull->uniform_alignment);
+
+	glCreateBuffers(1, &cull->output_buffer);
+	glNamedBufferStorage(cull->output_buffer, sizeof(cull_output), nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &cull->readback_buffer);
+	glNamedBufferStorage(cull->readback_buffer, sizeof(cull_output) * CULL_READBACK_LATENCY, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+	cull->readback = (cull_output *)glMapNamedBufferRange(cull->readback_buffer, 0, sizeof(cull_output) * CULL_READBACK_LATENCY, flags);
+
+	glCreateQueries(GL_TIMESTAMP, CULL_READBACK_LATENCY * 2, cull->cull_queries);
+	glCreateQueries(GL_TIMESTAMP, CULL_READBACK_LATENCY * 2, cull->pyramid_queries);
+	for (int i = 0; i < CULL_READBACK_LATENCY; i++) {
+		cull->readback_fences[i] = 0;
+		cull->cull_pending[i] = false;
+		cull->pyramid_pending[i] = false;
+	}
+}
+
+void psycull::destroy(cull_context *cull) {
+	for (int i = 0; i < CULL_READBACK_LATENCY; i++) {
+		if (cull->readback_fences[i]) {
+			glDeleteSync(cull->readback_fences[i]);
+		}
+	}
+	glDeleteQueries(CULL_READBACK_LATENCY * 2, cull->cull_queries);
+	glDeleteQueries(CULL_READBACK_LATENCY * 2, cull->pyramid_queries);
+	glUnmapNamedBuffer(cull->readback_buffer);
+	psystate::forget(cull->output_buffer);
+	psystate::forget(cull->visible_buffer);
+	psystate::forget(cull->hiz_texture);
+	glDeleteBuffers(1, &cull->readback_buffer);
+	glDeleteBuffers(1, &cull->output_buffer);
+	glDeleteBuffers(1, &cull->visible_buffer);
+	glDeleteTextures(1, &cull->hiz_texture);
+}
+
+// shared by every batch of one cull_cpu call
+struct cpu_cull_batch {
+	const cull_spheres *spheres;
+	glm::vec4 planes[6];
+	uint32_t *visible;
+	uint32_t *counts;
+};
+
+void psycull::cull_cpu(job_system *jobs, const glm::mat4 &view_projection, const cull_spheres *spheres, uint32_t count, cull_cpu_result *result) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_CULL);
+	PSY_PROFILE_SCOPE("psycull::cull_cpu");
+	const uint64_t start = psybench::ticks();
+
+	// every batch writes its ids where its own range starts, then they get packed in order
+	const uint32_t batches = (count + CULL_CPU_BATCH - 1) / CULL_CPU_BATCH;
+	result->visible.resize(count);
+	result->batch_counts.resize(batches);
+
+	cpu_cull_batch batch = {};
+	batch.spheres = spheres;
+	extract_planes(view_projection, batch.planes);
+	batch.visible = result->visible.data();
+	batch.counts = result->batch_counts.data();
+	psyjob::parallel_for(jobs, count, CULL_CPU_BATCH, cull_batch, &batch);
+
+	uint32_t visible = 0;
+	for (uint32_t i = 0; i < batches; i++) {
+		memmove(&result->visible[visible], &result->visible[i * CULL_CPU_BATCH], result->batch_counts[i] * sizeof(uint32_t));
+		visible += result->batch_counts[i];
+	}
+	result->visible.resize(visible);
+	result->cull_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+}
+
+void psycull::cull(cull_context *cull, stream_buffer *stream, const glm::mat4 &view_projection, GLsizei vertex_count,
+	GLuint sphere_buffer, GLintptr sphere_offset, const cull_cpu_result *cpu, uint32_t count) {
+	PSY_PROFILE_GPU_SCOPE("psycull::cull");
+
+	const int slot = cull->frame % CULL_READBACK_LATENCY;
+	collect_readback(cull, slot);
+	cull->view_projection = view_projection;
+	cull->stats.instances = count;
+
+	if (cull->mode == CULL_MODE_NONE) {
+		cull->stats.visible = count;
+		cull->stats.frustum_culled = 0;
+		cull->stats.occlusion_culled = 0;
+		cull->stats.cull_ms = 0.0;
+		return;
+	}
+
+	glm::vec4 planes[6];
+	extract_planes(view_projection, planes);
+
+	if (cull->mode == CULL_MODE_CPU) {
+		cull->stats.cull_ms = cpu->cull_ms;
+		cull->stats.visible = (uint32_t)cpu->visible.size();
+		cull->stats.frustum_culled = count - cull->stats.visible;
+		cull->stats.occlusion_culled = 0;
+
+		const GLsizeiptr size = (GLsizeiptr)(cpu->visible.size() + 1) * sizeof(uint32_t);
+		stream_allocation ids = psybuffer::allocate(stream, size, cull->ssbo_alignment);
+		memcpy(ids.pointer, cpu->visible.data(), cpu->visible.size() * sizeof(uint32_t));
+		psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, 4, ids.buffer, ids.offset, size);
+		return;
+	}
+
+	psycull::prepare(cull, count, 0, 0);
+
+	stream_allocation data_allocation = psybuffer::allocate(stream, sizeof(cull_data), cull->uniform_alignment);
+	cull_data *data = (cull_data *)data_allocation.pointer;
+	data->hiz_view_projection = cull->hiz_view_projection;
+	memcpy(data->planes, planes, sizeof(planes));
+	data->hiz_size = glm::vec2((float)cull->hiz_width, (float)cull->hiz_height);
+	data->sphere_count = count;
+	data->hiz_enabled = cull->hiz && cull->hiz_valid;
+	data->hiz_levels = cull->hiz_levels;
+
+	cull_output reset = {};
+	reset.count = (GLuint)vertex_count;
+	glNamedBufferSubData(cull->output_buffer, 0, sizeof(cull_output), &reset);
+
+	psystate::bind_buffer_range(GL_UNIFORM_BUFFER, 2, data_allocation.buffer, data_allocation.offset, sizeof(cull_data));
+	psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, 3, sphere_buffer, sphere_offset, (GLsizeiptr)count * sizeof(glm::vec4));
+	psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, 4, cull->visible_buffer, 0, (GLsizeiptr)cull->visible_capacity * sizeof(uint32_t));
+	psystate::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, 5, cull->output_buffer);
+	if (cull->hiz_texture) {
+		psystate::bind_texture(0, cull->hiz_texture);
+	}
+
+	glQueryCounter(cull->cull_queries[slot * 2 + 0], GL_TIMESTAMP);
+	psystate::use_program(psyshader::get(cull->shaders, cull->cull_program));
+	glDispatchCompute((count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+	glQueryCounter(cull->cull_queries[slot * 2 + 1], GL_TIMESTAMP);
+	cull->cull_pending[slot] = true;
+
+	// the draw reading the results gets its barrier from the frame graph, the copy is ours
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glCopyNamedBufferSubData(cull->output_buffer, cull->readback_buffer, 0, slot * sizeof(cull_output), sizeof(cull_output));
+}
+
+void psycull::draw(cull_context *cull, GLsizei vertex_count, uint32_t count) {
+	if (cull->mode == CULL_MODE_GPU) {
+		psystate::bind_indirect_buffer(cull->output_buffer);
+		glDrawArraysIndirect(GL_TRIANGLES, nullptr);
+	} else if (cull->mode == CULL_MODE_CPU) {
+		glDrawArraysInstanced(GL_TRIANGLES, 0, vertex_count, (GLsizei)cull->stats.visible);
+	} else {
+		glDrawArraysInstanced(GL_TRIANGLES, 0, vertex_count, (GLsizei)count);
+	}
+}
+
+void psycull::prepare(cull_context *cull, uint32_t count, int width, int height) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_CULL);
+	// a pyramid skipped for a frame is stale once it comes back
+	if (cull->mode != CULL_MODE_GPU || !cull->hiz) {
+		cull->hiz_valid = false;
+	}
+	if (cull->mode != CULL_MODE_GPU) {
+		return;
+	}
+	if (count > cull->visible_capacity) {
+		psystate::forget(cull->visible_buffer);
+		glDeleteBuffers(1, &cull->visible_buffer);
+		glCreateBuffers(1, &cull->visible_buffer);
+		glNamedBufferStorage(cull->visible_buffer, (GLsizeiptr)count * sizeof(uint32_t), nullptr, 0);
+		cull->visible_capacity = count;
+	}
+
+	// level 0 is half the depth resolution
+	const int hiz_width = width / 2 > 0 ? width / 2 : 1;
+	const int hiz_height = height / 2 > 0 ? height / 2 : 1;
+	if (cull->hiz && width > 0 && (hiz_width != cull->hiz_width || hiz_height != cull->hiz_height)) {
+		create_pyramid(cull, hiz_width, hiz_height);
+	}
+}
+
+void psycull::build_pyramid(cull_context *cull, GLuint depth_texture, int width, int height) {
+	if (cull->mode != CULL_MODE_GPU || !cull->hiz) {
+		cull->hiz_valid = false;
+		return;
+	}
+	PSY_PROFILE_GPU_SCOPE("psycull::build_pyramid");
+
+	psycull::prepare(cull, 0, width, height);
+	const int hiz_width = cull->hiz_width;
+	const int hiz_height = cull->hiz_height;
+
+	const int slot = cull->frame % CULL_READBACK_LATENCY;
+	glQueryCounter(cull->pyramid_queries[slot * 2 + 0], GL_TIMESTAMP);
+	const GLuint pyramid_program = psyshader::get(cull->shaders, cull->pyramid_program);
+	psystate::use_program(pyramid_program);
+
+	int level_width = hiz_width;
+	int level_height = hiz_height;
+	for (int level = 0; level < cull->hiz_levels; level++) {
+		psystate::bind_texture(0, level == 0 ? depth_texture : cull->hiz_texture);
+		glProgramUniform1i(pyramid_program, 0, level == 0 ? 0 : level - 1);
+		glBindImageTexture(0, cull->hiz_texture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glDispatchCompute((level_width + 7) / 8, (level_height + 7) / 8, 1);
+		// between levels only, whoever samples the finished pyramid asks the frame graph
+		if (level + 1 < cull->hiz_levels) {
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}
+
+		level_width = level_width / 2 > 0 ? level_width / 2 : 1;
+		level_height = level_height / 2 > 0 ? level_height / 2 : 1;
+	}
+
+	glQueryCounter(cull->pyramid_queries[slot * 2 + 1], GL_TIMESTAMP);
+	cull->pyramid_pending[slot] = true;
+
+	cull->hiz_view_projection = cull->view_projection;
+	cull->hiz_valid = true;
+}
+
+void psycull::end_frame(cull_context *cull) {
+	const int slot = cull->frame % CULL_READBACK_LATENCY;
+	if (cull->cull_pending[slot]) {
+		if (cull->readback_fences[slot]) {
+			glDeleteSync(cull->readback_fences[slot]);
+		}
+		cull->readback_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	cull->frame++;
+}
+
+void psycull::draw_overlay(const cull_stats *stats, cull_mode *mode, bool *hiz) {
+	if (!ImGui::Begin("Culling")) {
+		ImGui::End();
+		return;
+	}
+
+	int selected = (int)*mode;
+	ImGui::RadioButton("off", &selected, CULL_MODE_NONE);
+	ImGui::SameLine();
+	ImGui::RadioButton("gpu", &selected, CULL_MODE_GPU);
+	ImGui::SameLine();
+	ImGui::RadioButton("cpu (frustum only)", &selected, CULL_MODE_CPU);
+	*mode = (cull_mode)selected;
+	ImGui::Checkbox("hi-z occlusion", hiz);
+
+	ImGui::Separator();
+	ImGui::Text("instances        %u", stats->instances);
+	ImGui::Text("visible          %u", stats->visible);
+	ImGui::Text("frustum culled   %u", stats->frustum_culled);
+	ImGui::Text("occlusion culled %u", stats->occlusion_culled);
+	ImGui::Separator();
+	ImGui::Text("cull pass        %.3f ms (%s)", stats->cull_ms, *mode == CULL_MODE_CPU ? "cpu" : "gpu");
+	ImGui::Text("hi-z pyramid     %.3f ms", stats->pyramid_ms);
+	ImGui::End();
+}
+
+// Gribb-Hartmann, normalized so the sphere test can compare against the radius directly
+void extract_planes(const glm::mat4 &view_projection, glm::vec4 planes[6]) {
+	const glm::vec4 row0 = glm::vec4(view_projection[0][0], view_projection[1][0], view_projection[2][0], view_projection[3][0]);
+	const glm::vec4 row1 = glm::vec4(view_projection[0][1], view_projection[1][1], view_projection[2][1], view_projection[3][1]);
+	const glm::vec4 row2 = glm::vec4(view_projection[0][2], view_projection[1][2], view_projection[2][2], view_projection[3][2]);
+	const glm::vec4 row3 = glm::vec4(view_projection[0][3], view_projection[1][3], view_projection[2][3], view_projection[3][3]);
+
+	planes[0] = row3 + row0;
+	planes[1] = row3 - row0;
+	planes[2] = row3 + row1;
+	planes[3] = row3 - row1;
+	planes[4] = row3 + row2;
+	planes[5] = row3 - row2;
+	for (int i = 0; i < 6; i++) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+// four spheres per iteration, a lane survives while it is not fully behind any plane
+void cull_batch(void *data, uint32_t begin, uint32_t end) {
+	cpu_cull_batch *batch = (cpu_cull_batch *)data;
+	batch->counts[begin / CULL_CPU_BATCH] = cull_spheres_sse(batch->spheres, begin, end, batch->planes, batch->visible + begin);
+}
+
+// writes the ids of [begin, end) that pass all six planes to visible, returns how many
+uint32_t cull_spheres_sse(const cull_spheres *spheres, uint32_t begin, uint32_t end, const glm::vec4 planes[6], uint32_t *visible) {
+	uint32_t written = 0;
+
+	__m128 plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+	for (int p = 0; p < 6; p++) {
+		plane_x[p] = _mm_set1_ps(planes[p].x);
+		plane_y[p] = _mm_set1_ps(planes[p].y);
+		plane_z[p] = _mm_set1_ps(planes[p].z);
+		plane_w[p] = _mm_set1_ps(planes[p].w);
+	}
+
+	const __m128 sign = _mm_set1_ps(-0.0f);
+	for (uint32_t i = begin; i < end; i += 4) {
+		const __m128 x = _mm_loadu_ps(&spheres->x[i]);
+		const __m128 y = _mm_loadu_ps(&spheres->y[i]);
+		const __m128 z = _mm_loadu_ps(&spheres->z[i]);
+		const __m128 negative_radius = _mm_xor_ps(_mm_loadu_ps(&spheres->radius[i]), sign);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int p = 0; p < 6; p++) {
+			__m128 distance = _mm_add_ps(_mm_mul_ps(plane_x[p], x), plane_w[p]);
+			distance = _mm_add_ps(distance, _mm_mul_ps(plane_y[p], y));
+			distance = _mm_add_ps(distance, _mm_mul_ps(plane_z[p], z));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negative_radius));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		for (uint32_t lane = 0; lane < 4; lane++) {
+			if ((mask & (1 << lane)) && i + lane < end) {
+				visible[written++] = i + lane;
+			}
+		}
+	}
+	return written;
+}
+
+void create_pyramid(cull_context *cull, int width, int height) {
+	psystate::forget(cull->hiz_texture);
+	glDeleteTextures(1, &cull->hiz_texture);
+
+	int levels = 1;
+	while ((width >> levels) > 0 || (height >> levels) > 0) {
+		levels++;
+	}
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &cull->hiz_texture);
+	glTextureStorage2D(cull->hiz_texture, levels, GL_R32F, width, height);
+	glTextureParameteri(cull->hiz_texture, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTextureParameteri(cull->hiz_texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureParameteri(cull->hiz_texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(cull->hiz_texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	cull->hiz_width = width;
+	cull->hiz_height = height;
+	cull->hiz_levels = levels;
+	cull->hiz_valid = false;
+}
+
+// results of the frame that last used this slot, CULL_READBACK_LATENCY frames ago. Never
+// waits: whatever the GPU has not finished yet is dropped and the previous stats stay,
+// the slot is written again this frame
+void collect_readback(cull_context *cull, int slot) {
+	if (cull->readback_fences[slot]) {
+		const GLenum status = glClientWaitSync(cull->readback_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		glDeleteSync(cull->readback_fences[slot]);
+		cull->readback_fences[slot] = 0;
+
+		const cull_output *output = &cull->readback[slot];
+		const bool signaled = status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+		if (signaled && cull->mode == CULL_MODE_GPU) {
+			cull->stats.visible = output->instance_count;
+			cull->stats.frustum_culled = output->frustum_culled;
+			cull->stats.occlusion_culled = output->occlusion_culled;
+		}
+	}
+
+	GLuint64 begin = 0, end = 0;
+	if (cull->cull_pending[slot] && cull_queries_ready(&cull->cull_queries[slot * 2])) {
+		glGetQueryObjectui64v(cull->cull_queries[slot * 2 + 0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(cull->cull_queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+		if (cull->mode == CULL_MODE_GPU) {
+			cull->stats.cull_ms = (end - begin) / 1e6;
+		}
+	}
+	cull->cull_pending[slot] = false;
+	if (cull->pyramid_pending[slot] && cull_queries_ready(&cull->pyramid_queries[slot * 2])) {
+		glGetQueryObjectui64v(cull->pyramid_queries[slot * 2 + 0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(cull->pyramid_queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+		cull->stats.pyramid_ms = (end - begin) / 1e6;
+	}
+	cull->pyramid_pending[slot] = false;
+}
+
+bool cull_queries_ready(const GLuint *queries) {
+	GLint begin = 0, end = 0;
+	glGetQueryObjectiv(queries[0], GL_QUERY_RESULT_AVAILABLE, &begin);
+	glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &end);
+	return begin && end;
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <buffer/buffer.h>
+#include <shader/shader.h>
+#include <job/job.h>
+
+#include <stdint.h>
+#include <vector>
+
+// frames between issuing the stats copy / timer queries and reading them back
+#define CULL_READBACK_LATENCY 3
+#define CULL_GROUP_SIZE 64
+// instances per job on the CPU path, a multiple of 4
+#define CULL_CPU_BATCH 16384
+
+enum cull_mode {
+	CULL_MODE_NONE,
+	CULL_MODE_GPU,
+	CULL_MODE_CPU
+};
+
+// layout shared with cull.comp (binding 5), also the indirect draw command
+struct cull_output {
+	// DrawArraysIndirectCommand
+	GLuint count;
+	GLuint instance_count;
+	GLuint first;
+	GLuint base_instance;
+
+	GLuint frustum_culled;
+	GLuint occlusion_culled;
+	GLuint padding[2];
+};
+
+// std140 block at uniform binding 2
+struct cull_data {
+	glm::mat4 hiz_view_projection;
+	glm::vec4 planes[6];
+	glm::vec2 hiz_size;
+	GLuint sphere_count;
+	GLuint hiz_enabled;
+	GLint hiz_levels;
+	GLuint padding[3];
+};
+
+// bounding spheres as separate arrays so the CPU path can test four at a time
+struct cull_spheres {
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	std::vector<float> radius;
+};
+
+// visible ids from cull_cpu, built off the render thread and handed to cull()
+struct cull_cpu_result {
+	std::vector<uint32_t> visible;
+	// visible ids each batch found, before they are packed together
+	std::vector<uint32_t> batch_counts;
+	double cull_ms;
+};
+
+struct cull_stats {
+	uint32_t instances;
+	uint32_t visible;
+	uint32_t frustum_culled;
+	uint32_t occlusion_culled;
+	double cull_ms;
+	double pyramid_ms;
+};
+
+struct cull_context {
+	cull_mode mode;
+	bool hiz;
+
+	shader_manager *shaders;
+	shader_handle cull_program;
+	shader_handle pyramid_program;
+	// stream allocation alignment of the ids and the cull_data block, queried once
+	GLint ssbo_alignment;
+	GLint uniform_alignment;
+
+	// compacted instance ids (binding 4) and the cull_output they are counted in
+	GLuint visible_buffer;
+	uint32_t visible_capacity;
+	GLuint output_buffer;
+
+	// previous frame's depth, max-reduced per mip
+	GLuint hiz_texture;
+	int hiz_width;
+	int hiz_height;
+	int hiz_levels;
+	bool hiz_valid;
+	glm::mat4 view_projection;
+	glm::mat4 hiz_view_projection;
+
+	// cull_output copies and begin/end GL_TIMESTAMP pairs (the bench already owns
+	// GL_TIME_ELAPSED for the frame), read CULL_READBACK_LATENCY frames late
+	GLuint readback_buffer;
+	cull_output *readback;
+	GLsync readback_fences[CULL_READBACK_LATENCY];
+	GLuint cull_queries[CULL_READBACK_LATENCY * 2];
+	GLuint pyramid_queries[CULL_READBACK_LATENCY * 2];
+	bool cull_pending[CULL_READBACK_LATENCY];
+	bool pyramid_pending[CULL_READBACK_LATENCY];
+	int frame;
+
+	cull_stats stats;
+};
+
+namespace psycull {
+	void create(cull_context *cull, shader_manager *shaders);
+	void destroy(cull_context *cull);
+
+	// frustum culls count spheres on the job system; spheres must hold count rounded up
+	// to a multiple of 4 entries. Touches no GL, so it runs on whichever thread builds the frame
+	void cull_cpu(job_system *jobs, const glm::mat4 &view_projection, const cull_spheres *spheres, uint32_t count, cull_cpu_result *result);
+	// culls count instances against view_projection (and the Hi-Z pyramid of the previous
+	// frame on the GPU path), leaves the visible ids bound at SSBO binding 4; the CPU path
+	// uploads the ids in cpu instead. No barrier is issued for draw()
+	void cull(cull_context *cull, stream_buffer *stream, const glm::mat4 &view_projection, GLsizei vertex_count,
+		GLuint sphere_buffer, GLintptr sphere_offset, const cull_cpu_result *cpu, uint32_t count);
+	// sizes the visible list and the pyramid up front so the frame graph imports the
+	// buffers the frame will actually use; cull and build_pyramid call it as well
+	void prepare(cull_context *cull, uint32_t count, int width, int height);
+	// draws vertex_count vertices per visible instance
+	void draw(cull_context *cull, GLsizei vertex_count, uint32_t count);
+	// max-reduces this frame's depth into the pyramid the next frame tests against
+	void build_pyramid(cull_context *cull, GLuint depth_texture, int width, int height);
+	void end_frame(cull_context *cull);
+
+	// mode and hiz are the settings the next frame is built with
+	void draw_overlay(const cull_stats *stats, cull_mode *mode, bool *hiz);
+}
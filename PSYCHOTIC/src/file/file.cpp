@@ -0,0 +1,216 @@
+#include "file.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool list_directory(const std::string &directory, std::vector<std::string> *files);
+
+bool psyfile::map(const char *path, mapped_file *file) {
+	*file = {};
+
+#if defined(_WIN32)
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (handle == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+
+	LARGE_INTEGER size = {};
+	GetFileSizeEx(handle, &size);
+	if (size.QuadPart == 0) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	HANDLE mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (!mapping) {
+		CloseHandle(handle);
+		return false;
+	}
+
+	const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) {
+		CloseHandle(mapping);
+		CloseHandle(handle);
+		return false;
+	}
+
+	file->data = data;
+	file->size = (size_t)size.QuadPart;
+	file->file = handle;
+	file->mapping = mapping;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat info = {};
+	if (fstat(fd, &info) != 0 || info.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void *data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		close(fd);
+		return false;
+	}
+
+	file->data = data;
+	file->size = (size_t)info.st_size;
+	file->fd = fd;
+#endif
+
+	return true;
+}
+
+void psyfile::unmap(mapped_file *file) {
+	if (!file->data) {
+		return;
+	}
+
+#if defined(_WIN32)
+	UnmapViewOfFile(file->data);
+	CloseHandle((HANDLE)file->mapping);
+	CloseHandle((HANDLE)file->file);
+#else
+	munmap((void *)file->data, file->size);
+	close(file->fd);
+#endif
+
+	*file = {};
+}
+
+bool psyfile::write(const char *path, const void *data, size_t size) {
+	const std::string temp = std::string(path) + ".tmp";
+	FILE *file = fopen(temp.c_str(), "wb");
+	if (!file) {
+		return false;
+	}
+	const bool written = fwrite(data, 1, size, file) == size;
+	if (fclose(file) != 0 || !written) {
+		remove(temp.c_str());
+		return false;
+	}
+
+#if defined(_WIN32)
+	if (!MoveFileExA(temp.c_str(), path, MOVEFILE_REPLACE_EXISTING)) {
+#else
+	if (rename(temp.c_str(), path) != 0) {
+#endif
+		remove(temp.c_str());
+		return false;
+	}
+	return true;
+}
+
+bool psyfile::create_directories(const char *path) {
+	std::string partial;
+	const size_t length = strlen(path);
+	for (size_t i = 0; i <= length; i++) {
+		if (i < length && path[i] != '/') {
+			partial += path[i];
+			continue;
+		}
+		if (!partial.empty()) {
+#if defined(_WIN32)
+			if (_mkdir(partial.c_str()) != 0 && errno != EEXIST) {
+#else
+			if (mkdir(partial.c_str(), 0755) != 0 && errno != EEXIST) {
+#endif
+				return false;
+			}
+		}
+		if (i < length) {
+			partial += '/';
+		}
+	}
+	return true;
+}
+
+bool psyfile::list_files(const char *directory, std::vector<std::string> *files) {
+	files->clear();
+	if (!list_directory(directory, files)) {
+		return false;
+	}
+	std::sort(files->begin(), files->end());
+	return true;
+}
+
+bool psyfile::evict(const char *path) {
+#if defined(__linux__)
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	// dirty pages are not dropped, a file just written has to reach the disk first
+	const bool evicted = fdatasync(fd) == 0 && posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+	close(fd);
+	return evicted;
+#else
+	(void)path;
+	return false;
+#endif
+}
+
+bool list_directory(const std::string &directory, std::vector<std::string> *files) {
+#if defined(_WIN32)
+	WIN32_FIND_DATAA data = {};
+	HANDLE find = FindFirstFileA((directory + "/*").c_str(), &data);
+	if (find == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	bool listed = true;
+	do {
+		if (!strcmp(data.cFileName, ".") || !strcmp(data.cFileName, "..")) {
+			continue;
+		}
+		const std::string path = directory + "/" + data.cFileName;
+		if (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) {
+			listed = list_directory(path, files) && listed;
+		} else {
+			files->push_back(path);
+		}
+	} while (FindNextFileA(find, &data));
+	FindClose(find);
+	return listed;
+#else
+	DIR *dir = opendir(directory.c_str());
+	if (!dir) {
+		return false;
+	}
+	bool listed = true;
+	while (dirent *entry = readdir(dir)) {
+		if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, "..")) {
+			continue;
+		}
+		const std::string path = directory + "/" + entry->d_name;
+		struct stat info = {};
+		if (stat(path.c_str(), &info) != 0) {
+			listed = false;
+		} else if (S_ISDIR(info.st_mode)) {
+			listed = list_directory(path, files) && listed;
+		} else if (S_ISREG(info.st_mode)) {
+			files->push_back(path);
+		}
+	}
+	closedir(dir);
+	return listed;
+#endif
+}
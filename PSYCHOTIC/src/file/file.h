@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+// read-only memory mapping of a whole file
+struct mapped_file {
+	const void *data;
+	size_t size;
+#if defined(_WIN32)
+	void *file;
+	void *mapping;
+#else
+	int fd;
+#endif
+};
+
+namespace psyfile {
+	bool map(const char *path, mapped_file *file);
+	void unmap(mapped_file *file);
+
+	// writes to <path>.tmp and renames over path so readers never see a partial file
+	bool write(const char *path, const void *data, size_t size);
+	// mkdir -p, separators are '/'
+	bool create_directories(const char *path);
+	// every regular file under directory, recursively, as directory/<relative path> with '/'
+	// separators, sorted
+	bool list_files(const char *directory, std::vector<std::string> *files);
+	// drops the file from the page cache so the next read comes from disk; false where the
+	// platform has no way to do it
+	bool evict(const char *path);
+}
@@ -0,0 +1,289 @@
+#include "font.h"
+
+#include <bench/bench.h>
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+
+#include <imgui.h>
+
+// ImGui compiles its copy of stb_truetype static inside imgui_draw.cpp, this one is ours
+#define STBTT_STATIC
+#define STBTT_malloc(x, u) ((void)(u), psymemory::allocate(x, MEMORY_TAG_FONT))
+#define STBTT_free(x, u) ((void)(u), psymemory::release(x))
+#define STB_TRUETYPE_IMPLEMENTATION
+#include <imstb_truetype.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// distance field value on the glyph outline, and how much it changes per pixel
+#define FONT_SDF_EDGE 128
+#define FONT_SDF_DISTANCE_SCALE (FONT_SDF_EDGE / (float)FONT_SDF_PADDING)
+
+struct font_raster_job {
+	font_cache *font;
+	font_upload_list *out;
+};
+
+uint32_t take_cell(font_cache *font, uint64_t frame);
+void rasterize_glyphs(void *data, uint32_t begin, uint32_t end);
+
+bool psyfont::create(font_cache *font, const char *path, uint32_t first, uint32_t last, int atlas_size) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_FONT);
+	const uint64_t start = psybench::ticks();
+
+	if (!psyvfs::open(path, &font->file)) {
+		fprintf(stderr, "Error: failed to open font %s\n", path);
+		return false;
+	}
+	const uint8_t *data = (const uint8_t *)font->file.data;
+	font->info = new stbtt_fontinfo();
+	if (!stbtt_InitFont(font->info, data, stbtt_GetFontOffsetForIndex(data, 0))) {
+		fprintf(stderr, "Error: %s is not a TrueType font\n", path);
+		delete font->info;
+		font->info = nullptr;
+		psyvfs::close(&font->file);
+		return false;
+	}
+
+	// the scale ImGui's builder uses, so glyphs line up with the metrics it computed
+	font->scale = stbtt_ScaleForPixelHeight(font->info, FONT_SDF_SIZE);
+
+	int largest = 0;
+	font->glyphs.clear();
+	for (uint32_t codepoint = first; codepoint <= last; codepoint++) {
+		const int index = stbtt_FindGlyphIndex(font->info, (int)codepoint);
+		if (index == 0) {
+			continue;
+		}
+
+		font_glyph glyph = {};
+		glyph.codepoint = codepoint;
+		glyph.index = index;
+		glyph.cell = FONT_NO_CELL;
+		int advance = 0, bearing = 0;
+		stbtt_GetGlyphHMetrics(font->info, index, &advance, &bearing);
+		glyph.advance = advance * font->scale;
+
+		// the box stbtt_GetGlyphSDF rasterizes into, empty glyphs stay 0 x 0 and are never drawn
+		int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+		stbtt_GetGlyphBitmapBoxSubpixel(font->info, index, font->scale, font->scale, 0.0f, 0.0f, &x0, &y0, &x1, &y1);
+		if (x0 != x1 && y0 != y1) {
+			glyph.x_offset = x0 - FONT_SDF_PADDING;
+			glyph.y_offset = y0 - FONT_SDF_PADDING;
+			glyph.width = x1 - x0 + 2 * FONT_SDF_PADDING;
+			glyph.height = y1 - y0 + 2 * FONT_SDF_PADDING;
+		}
+		largest = glyph.width > largest ? glyph.width : largest;
+		largest = glyph.height > largest ? glyph.height : largest;
+		font->glyphs.push_back(glyph);
+	}
+
+	// a texel of gutter keeps bilinear filtering from reaching into the next cell
+	font->cell_size = largest + 1;
+	font->cells_per_row = atlas_size / font->cell_size;
+	if (font->cells_per_row == 0) {
+		fprintf(stderr, "Error: a %d pixel font atlas cannot hold %d pixel glyphs\n", atlas_size, largest);
+		psyfont::destroy(font);
+		return false;
+	}
+	font->cells.assign((size_t)font->cells_per_row * font->cells_per_row, FONT_NO_CELL);
+	font->atlas_size = atlas_size;
+	font->frame = 0;
+	font->missing.reserve(font->glyphs.size());
+
+	glCreateTextures(GL_TEXTURE_2D, 1, &font->texture);
+	glTextureParameteri(font->texture, GL_TEXTURE_MAX_LEVEL, 0);
+	glTextureParameteri(font->texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTextureParameteri(font->texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTextureParameteri(font->texture, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(font->texture, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTextureStorage2D(font->texture, 1, GL_R8, atlas_size, atlas_size);
+	const GLubyte outside = 0;
+	glClearTexImage(font->texture, 0, GL_RED, GL_UNSIGNED_BYTE, &outside);
+
+	// a glyph without a cell has an empty rect, which samples a corner far outside any outline
+	const std::vector<float> rects(font->glyphs.size() * 4, 0.0f);
+	glCreateBuffers(1, &font->glyph_buffer);
+	glNamedBufferStorage(font->glyph_buffer, rects.size() * sizeof(float), rects.data(), GL_DYNAMIC_STORAGE_BIT);
+
+	font->stats = font_stats();
+	font->stats.atlas_bytes = (size_t)atlas_size * atlas_size + rects.size() * sizeof(float);
+	font->stats.create_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+	return true;
+}
+
+void psyfont::destroy(font_cache *font) {
+	psystate::forget(font->texture);
+	psystate::forget(font->glyph_buffer);
+	glDeleteTextures(1, &font->texture);
+	glDeleteBuffers(1, &font->glyph_buffer);
+	font->texture = 0;
+	font->glyph_buffer = 0;
+	delete font->info;
+	font->info = nullptr;
+	psyvfs::close(&font->file);
+}
+
+void psyfont::install(font_cache *font, ImFont *target) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_IMGUI);
+	target->Glyphs.clear();
+	target->IndexAdvanceX.clear();
+	target->IndexLookup.clear();
+	target->FallbackGlyph = nullptr;
+	target->MetricsTotalSurface = 0;
+
+	const float baseline = floorf(target->Ascent + 0.5f);
+	for (size_t i = 0; i < font->glyphs.size(); i++) {
+		const font_glyph *glyph = &font->glyphs[i];
+		const float x0 = (float)glyph->x_offset;
+		const float y0 = (float)glyph->y_offset + baseline;
+		const float u0 = FONT_GLYPH_UV_BASE + (float)i;
+		target->AddGlyph(nullptr, (ImWchar)glyph->codepoint,
+			x0, y0, x0 + glyph->width, y0 + glyph->height,
+			u0, 0.0f, u0 + 0.5f, 1.0f,
+			glyph->advance);
+	}
+	target->BuildLookupTable();
+}
+
+void psyfont::update(font_cache *font, const ImDrawData *draw_data, job_system *jobs, font_upload_list *out) {
+	PSY_PROFILE_SCOPE("psyfont::update");
+	PSY_MEMORY_SCOPE(MEMORY_TAG_FONT);
+	const uint64_t start = psybench::ticks();
+	const uint64_t frame = ++font->frame;
+	const uint32_t glyph_count = (uint32_t)font->glyphs.size();
+
+	out->uploads.clear();
+	out->pixels.clear();
+	font->missing.clear();
+
+	// four vertices per glyph quad, only the first one of a frame does anything
+	for (int i = 0; i < draw_data->CmdListsCount; i++) {
+		const ImDrawList *list = draw_data->CmdLists[i];
+		for (const ImDrawVert &vertex : list->VtxBuffer) {
+			if (vertex.uv.x < FONT_GLYPH_UV_BASE) {
+				continue;
+			}
+			const uint32_t id = (uint32_t)(vertex.uv.x - FONT_GLYPH_UV_BASE);
+			if (id >= glyph_count || font->glyphs[id].last_used == frame) {
+				continue;
+			}
+			font->glyphs[id].last_used = frame;
+			if (font->glyphs[id].cell == FONT_NO_CELL) {
+				font->missing.push_back(id);
+			}
+		}
+	}
+
+	uint32_t pixel_count = 0;
+	for (uint32_t id : font->missing) {
+		font_glyph *glyph = &font->glyphs[id];
+		font_upload upload = {};
+		upload.glyph = id;
+		upload.cell = take_cell(font, frame);
+		if (upload.cell == FONT_NO_CELL) {
+			// still gets an upload, to clear a rect that may point at a cell someone else has now
+			font->stats.dropped++;
+			out->uploads.push_back(upload);
+			continue;
+		}
+		glyph->cell = upload.cell;
+		font->cells[upload.cell] = id;
+		upload.width = glyph->width;
+		upload.height = glyph->height;
+		upload.offset = pixel_count;
+		pixel_count += (uint32_t)(glyph->width * glyph->height);
+		out->uploads.push_back(upload);
+		font->stats.rasterized++;
+	}
+
+	if (!out->uploads.empty()) {
+		const uint64_t raster_start = psybench::ticks();
+		out->pixels.resize(pixel_count);
+		font_raster_job job = { font, out };
+		psyjob::parallel_for(jobs, (uint32_t)out->uploads.size(), 4, rasterize_glyphs, &job);
+		font->stats.raster_ms += psybench::ticks_to_ms(psybench::ticks() - raster_start);
+	}
+	font->stats.update_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+}
+
+void psyfont::upload(font_cache *font, const font_upload_list *list) {
+	if (list->uploads.empty()) {
+		return;
+	}
+	PSY_PROFILE_SCOPE("psyfont::upload");
+
+	const float texel = 1.0f / font->atlas_size;
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	for (const font_upload &upload : list->uploads) {
+		float rect[4] = {};
+		if (upload.cell != FONT_NO_CELL) {
+			const int x = (int)(upload.cell % font->cells_per_row) * font->cell_size;
+			const int y = (int)(upload.cell / font->cells_per_row) * font->cell_size;
+			glTextureSubImage2D(
+				font->texture, 0,
+				x, y,
+				upload.width, upload.height,
+				GL_RED,
+				GL_UNSIGNED_BYTE,
+				list->pixels.data() + upload.offset);
+			rect[0] = x * texel;
+			rect[1] = y * texel;
+			rect[2] = (x + upload.width) * texel;
+			rect[3] = (y + upload.height) * texel;
+		}
+		glNamedBufferSubData(font->glyph_buffer, upload.glyph * sizeof(rect), sizeof(rect), rect);
+	}
+}
+
+void psyfont::bind(font_cache *font) {
+	psystate::bind_texture(1, font->texture);
+	psystate::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, FONT_GLYPH_BINDING, font->glyph_buffer);
+}
+
+// an empty cell, otherwise the one whose glyph was drawn longest ago; never one the
+// frame being updated uses
+uint32_t take_cell(font_cache *font, uint64_t frame) {
+	uint32_t oldest = FONT_NO_CELL;
+	uint64_t oldest_used = frame;
+	for (uint32_t cell = 0; cell < (uint32_t)font->cells.size(); cell++) {
+		const uint32_t owner = font->cells[cell];
+		if (owner == FONT_NO_CELL) {
+			font->stats.resident++;
+			return cell;
+		}
+		if (font->glyphs[owner].last_used < oldest_used) {
+			oldest_used = font->glyphs[owner].last_used;
+			oldest = cell;
+		}
+	}
+	if (oldest != FONT_NO_CELL) {
+		font->glyphs[font->cells[oldest]].cell = FONT_NO_CELL;
+		font->cells[oldest] = FONT_NO_CELL;
+		font->stats.evicted++;
+	}
+	return oldest;
+}
+
+// stb_truetype only reads the font, so workers rasterize side by side
+void rasterize_glyphs(void *data, uint32_t begin, uint32_t end) {
+	font_raster_job *job = (font_raster_job *)data;
+	const font_cache *font = job->font;
+	for (uint32_t i = begin; i < end; i++) {
+		const font_upload *upload = &job->out->uploads[i];
+		if (upload->cell == FONT_NO_CELL) {
+			continue;
+		}
+		const font_glyph *glyph = &font->glyphs[upload->glyph];
+		int width = 0, height = 0, x = 0, y = 0;
+		uint8_t *sdf = stbtt_GetGlyphSDF(font->info, font->scale, glyph->index, FONT_SDF_PADDING,
+			FONT_SDF_EDGE, FONT_SDF_DISTANCE_SCALE, &width, &height, &x, &y);
+		if (sdf && width == upload->width && height == upload->height) {
+			memcpy(job->out->pixels.data() + upload->offset, sdf, (size_t)width * height);
+		}
+		stbtt_FreeSDF(sdf, nullptr);
+	}
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <job/job.h>
+#include <vfs/vfs.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// glyphs are rasterized once as signed distance fields at this size and scaled to any
+// other size in imgui.frag; the edge is at 128 with FONT_SDF_PADDING pixels of falloff
+#define FONT_SDF_SIZE 32.0f
+#define FONT_SDF_PADDING 4
+// a glyph quad's uv.x is FONT_GLYPH_UV_BASE + glyph index, + 0.5 on its right edge, so
+// imgui.vert can tell glyphs from the rest of ImGui's geometry and look their cell up
+#define FONT_GLYPH_UV_BASE 2.0f
+// std430 binding of the per glyph atlas rects imgui.vert reads
+#define FONT_GLYPH_BINDING 6
+#define FONT_NO_CELL 0xffffffffu
+
+struct stbtt_fontinfo;
+struct ImFont;
+struct ImDrawData;
+
+struct font_glyph {
+	uint32_t codepoint;
+	int index;
+	// distance field size and its offset from the pen position, in pixels at FONT_SDF_SIZE
+	int width;
+	int height;
+	int x_offset;
+	int y_offset;
+	float advance;
+	// atlas cell while resident, FONT_NO_CELL otherwise
+	uint32_t cell;
+	// update() call that last saw it drawn, the least recent one is evicted first
+	uint64_t last_used;
+};
+
+// one glyph rasterized on the main thread, waiting for the GL thread
+struct font_upload {
+	uint32_t glyph;
+	uint32_t cell;
+	int width;
+	int height;
+	// into font_upload_list::pixels
+	uint32_t offset;
+};
+
+// travels with the frame snapshot, so a cell is only overwritten once the frame that
+// drew its previous glyph has been submitted
+struct font_upload_list {
+	std::vector<font_upload> uploads;
+	std::vector<uint8_t> pixels;
+};
+
+struct font_stats {
+	double create_ms;
+	// atlas texture and glyph rects
+	size_t atlas_bytes;
+	uint32_t resident;
+	uint32_t rasterized;
+	uint32_t evicted;
+	// glyphs a frame needed while every cell held another glyph of that same frame, they draw nothing
+	uint32_t dropped;
+	// main thread time of the last update(), and of every rasterization so far
+	double update_ms;
+	double raster_ms;
+};
+
+struct font_cache {
+	vfs_file file;
+	stbtt_fontinfo *info;
+	float scale;
+
+	std::vector<font_glyph> glyphs;
+	// glyph in each cell, FONT_NO_CELL while empty
+	std::vector<uint32_t> cells;
+	int cell_size;
+	int cells_per_row;
+	int atlas_size;
+	uint64_t frame;
+	// glyphs the frame being updated needs and does not have, kept for its capacity
+	std::vector<uint32_t> missing;
+
+	// single channel, distance fields only
+	GLuint texture;
+	// vec4 uv rect per glyph
+	GLuint glyph_buffer;
+
+	font_stats stats;
+};
+
+namespace psyfont {
+	// maps the font and measures every glyph in [first, last], nothing is rasterized yet
+	bool create(font_cache *font, const char *path, uint32_t first, uint32_t last, int atlas_size);
+	void destroy(font_cache *font);
+
+	// replaces target's glyphs (target is the same font at FONT_SDF_SIZE, built by ImGui
+	// without glyphs) with ones addressing the cache; size it with ImGuiIO::FontGlobalScale
+	void install(font_cache *font, ImFont *target);
+	// main thread, after ImGui::Render(): marks the glyphs draw_data uses and rasterizes the
+	// missing ones into free or least recently used cells
+	void update(font_cache *font, const ImDrawData *draw_data, job_system *jobs, font_upload_list *out);
+
+	// GL thread, before anything of the frame out belongs to is drawn
+	void upload(font_cache *font, const font_upload_list *list);
+	// texture unit 1 and the glyph rects
+	void bind(font_cache *font);
+}
@@ -0,0 +1,375 @@
+#include "frame.h"
+
+#include <imgui/imgui_backend.h>
+#include <profiler/profiler.h>
+#include <scene/scene.h>
+
+#include <glm/ext.hpp>
+
+#include <math.h>
+#include <stdio.h>
+
+void latch_camera(scene_context *scene);
+void track_latency(render_state *render, uint64_t input_time);
+void cull_pass(frame_graph *graph, void *user);
+void lights_pass(frame_graph *graph, void *user);
+void cube_pass(frame_graph *graph, void *user);
+void mesh_pass(frame_graph *graph, void *user);
+void pyramid_pass(frame_graph *graph, void *user);
+void imgui_pass(frame_graph *graph, void *user);
+
+void psyframe::prepare(frame_snapshot *frame, scene_context *scene, job_system *jobs) {
+	PSY_PROFILE_SCOPE("psyframe::prepare");
+	psyscene::update(&scene->cube->scene, frame->instance_copy);
+	frame->view_projection = cube::camera(scene->cube, frame->ratio, frame->time, frame->yaw);
+	if (frame->culling == CULL_MODE_CPU) {
+		psycull::cull_cpu(jobs, frame->view_projection, &scene->cube->scene.spheres, scene->cube->scene.count, &frame->cpu_cull);
+	}
+}
+
+void psyframe::render(void *user, int slot) {
+	render_state *render = (render_state *)user;
+	scene_context *scene = render->scene;
+	bench_state *bench = render->bench;
+	frame_snapshot *frame = &render->snapshots[slot];
+
+	PSY_PROFILER_BEGIN_FRAME();
+	if (render->headless) {
+		psybench::begin_frame(bench);
+	}
+	psyframe::collect_latency(render, false);
+	psycapture::update(render->capture);
+
+	psywindow::begin_frame(scene->window, &frame->info);
+	psybuffer::begin_frame(scene->stream);
+	psyshader::update(scene->shaders);
+	psytexture::update(scene->textures);
+	if (scene->imgui->sdf) {
+		psyfont::upload(&scene->imgui->font, &frame->glyphs);
+	}
+
+	scene->cull->mode = frame->culling;
+	scene->cull->hiz = frame->hiz;
+	psystate::set_cached(frame->state_cache);
+	scene->frame = frame;
+	scene->latched = false;
+	psyframe::build_graph(render->graph, scene, true);
+	psygraph::execute(render->graph);
+
+	if (render->headless && render->imgui_diff && frame->index == render->warmup_frames) {
+		const int mismatched = psyimgui::compare_paths(scene->imgui, scene->window, scene->shaders, scene->stream, scene->per_frame_data_buffer, &frame->draw_data, &frame->info);
+		psybench::set_value(bench, "imgui_diff_pixels", mismatched);
+		render->exit_code = mismatched ? 1 : render->exit_code;
+	}
+	if (frame->toggle_recording || (render->record_path && frame->index == 0)) {
+		if (render->capture->recording) {
+			psycapture::stop_recording(render->capture);
+		} else {
+			psycapture::start_recording(render->capture, render->record_path ? render->record_path : "recording.y4m",
+				scene->window->framebuffer_width, scene->window->framebuffer_height, render->record_fps);
+		}
+	}
+	psycapture::capture(render->capture, scene->window->framebuffer, scene->window->framebuffer_width, scene->window->framebuffer_height, frame->screenshot);
+
+	psybuffer::end_frame(scene->stream);
+	psycull::end_frame(scene->cull);
+	psylight::end_frame(scene->lights);
+	// the main thread writes the copy of frame index + 2 as soon as this returns
+	psyscene::fence(&scene->cube->scene, frame->instance_copy);
+	psyscene::wait(&scene->cube->scene, (frame->index + 2) % SCENE_BUFFER_COPIES);
+	psystate::end_frame();
+
+	if (render->headless) {
+		const state_stats *state = psystate::stats();
+		psybench::add_sample(bench, "gl_state_calls", state->requested);
+		psybench::add_sample(bench, "gl_state_issued", state->issued);
+		psybench::add_sample(bench, "gl_state_redundant", state->redundant);
+		for (const graph_timing &timing : render->graph->stats.timings) {
+			if (!timing.culled) {
+				char series[64];
+				snprintf(series, sizeof(series), "graph_%s_gpu_ms", timing.name);
+				psybench::add_sample(bench, series, timing.gpu_ms);
+			}
+		}
+		psybench::end_frame(bench);
+	}
+
+	psywindow::end_frame(scene->window);
+	track_latency(render, scene->latched ? scene->input_time : frame->input_time);
+	PSY_PROFILER_END_FRAME();
+
+	if (render->headless) {
+		const double since_startup = psybench::ticks_to_ms(psybench::ticks() - render->startup_ticks);
+		if (frame->index == 0) {
+			psybench::set_value(bench, "first_frame_ms", since_startup);
+		}
+		if (!render->textures_reported && psytexture::all_resident(scene->textures)) {
+			psybench::set_value(bench, "textures_resident_ms", since_startup);
+			psybench::set_value(bench, "texture_cache_hits", scene->textures->cache_hits);
+			psybench::set_value(bench, "texture_cache_misses", scene->textures->cache_misses);
+			render->textures_reported = true;
+		}
+	}
+
+	render->feedback.cull = scene->cull->stats;
+	render->feedback.graph = render->graph->stats;
+	render->feedback.state = *psystate::stats();
+	render->feedback.capture = psycapture::stats(render->capture);
+	render->feedback.graph_arena = render->graph->arena;
+	render->feedback.recording = render->capture->recording;
+	if (render->headless && render->capture->recording) {
+		psybench::add_sample(bench, "capture_ms", render->feedback.capture.gl_ms);
+	}
+}
+
+void psyframe::build_graph(frame_graph *graph, scene_context *scene, bool imgui) {
+	PSY_PROFILE_SCOPE("psyframe::build_graph");
+	cull_context *cull = scene->cull;
+	const bool gpu_cull = cull->mode == CULL_MODE_GPU;
+	psycull::prepare(cull, scene->cube->scene.count, scene->window->framebuffer_width, scene->window->framebuffer_height);
+
+	psygraph::begin(graph);
+
+	graph_texture_desc color_desc = {};
+	color_desc.format = GL_RGBA8;
+	color_desc.width = scene->window->framebuffer_width;
+	color_desc.height = scene->window->framebuffer_height;
+	color_desc.levels = 1;
+	color_desc.clear = true;
+	color_desc.clear_color = glm::vec4(0.2f, 0.3f, 0.3f, 1.0f);
+	const graph_resource color = psygraph::import_texture(graph, "window color", scene->window->color_texture, &color_desc);
+	psygraph::mark_output(graph, color);
+
+	graph_texture_desc depth_desc = color_desc;
+	depth_desc.format = GL_DEPTH_COMPONENT32F;
+	depth_desc.clear_color = glm::vec4(1.0f);
+	scene->depth = psygraph::create_texture(graph, "scene depth", &depth_desc);
+
+	const graph_resource instances = psygraph::import_buffer(graph, "instances", scene->cube->scene.buffer);
+	const graph_resource visible = psygraph::import_buffer(graph, "visible ids", cull->visible_buffer);
+	const graph_resource output = psygraph::import_buffer(graph, "cull output", cull->output_buffer);
+	const graph_resource world_lights = psygraph::import_buffer(graph, "world lights", scene->lights->light_buffer);
+	const graph_resource view_lights = psygraph::import_buffer(graph, "view lights", scene->lights->view_buffer);
+	const graph_resource clusters = psygraph::import_buffer(graph, "light clusters", scene->lights->cluster_buffer);
+	graph_resource hiz = GRAPH_INVALID;
+	if (gpu_cull && cull->hiz) {
+		graph_texture_desc hiz_desc = {};
+		hiz_desc.format = GL_R32F;
+		hiz_desc.width = cull->hiz_width;
+		hiz_desc.height = cull->hiz_height;
+		hiz_desc.levels = cull->hiz_levels;
+		hiz = psygraph::import_texture(graph, "hi-z", cull->hiz_texture, &hiz_desc);
+	}
+
+	// the CPU and pass-through paths cull inside the cube pass, there is nothing for the GPU to wait on
+	if (gpu_cull) {
+		const graph_pass_handle pass = psygraph::add_pass(graph, "cull", cull_pass, scene);
+		psygraph::use(graph, pass, instances, GRAPH_READ_STORAGE);
+		if (hiz != GRAPH_INVALID) {
+			psygraph::use(graph, pass, hiz, GRAPH_READ_TEXTURE);
+		}
+		psygraph::use(graph, pass, visible, GRAPH_WRITE_STORAGE);
+		psygraph::use(graph, pass, output, GRAPH_WRITE_STORAGE);
+	}
+
+	// also sets up the frame's light_frame_data when lighting is off
+	{
+		const graph_pass_handle pass = psygraph::add_pass(graph, "lights", lights_pass, scene);
+		psygraph::use(graph, pass, world_lights, GRAPH_READ_STORAGE);
+		psygraph::use(graph, pass, view_lights, GRAPH_WRITE_STORAGE);
+		psygraph::use(graph, pass, clusters, GRAPH_WRITE_STORAGE);
+	}
+
+	{
+		const graph_pass_handle pass = psygraph::add_pass(graph, "cubes", cube_pass, scene);
+		psygraph::use(graph, pass, instances, GRAPH_READ_STORAGE);
+		if (gpu_cull) {
+			psygraph::use(graph, pass, visible, GRAPH_READ_STORAGE);
+			psygraph::use(graph, pass, output, GRAPH_READ_INDIRECT);
+		}
+		psygraph::use(graph, pass, view_lights, GRAPH_READ_STORAGE);
+		psygraph::use(graph, pass, clusters, GRAPH_READ_STORAGE);
+		psygraph::use(graph, pass, color, GRAPH_WRITE_ATTACHMENT);
+		psygraph::use(graph, pass, scene->depth, GRAPH_WRITE_ATTACHMENT);
+	}
+
+	if (scene->mesh) {
+		const graph_pass_handle pass = psygraph::add_pass(graph, "mesh", mesh_pass, scene);
+		psygraph::use(graph, pass, view_lights, GRAPH_READ_STORAGE);
+		psygraph::use(graph, pass, clusters, GRAPH_READ_STORAGE);
+		psygraph::use(graph, pass, color, GRAPH_WRITE_ATTACHMENT);
+		psygraph::use(graph, pass, scene->depth, GRAPH_WRITE_ATTACHMENT);
+	}
+
+	// read by next frame's cull pass, so nothing this frame keeps it alive
+	if (hiz != GRAPH_INVALID) {
+		const graph_pass_handle pass = psygraph::add_pass(graph, "hi-z", pyramid_pass, scene);
+		psygraph::use(graph, pass, scene->depth, GRAPH_READ_TEXTURE);
+		psygraph::use(graph, pass, hiz, GRAPH_WRITE_IMAGE);
+		psygraph::set_side_effects(graph, pass);
+	}
+
+	if (imgui) {
+		const graph_pass_handle pass = psygraph::add_pass(graph, "imgui", imgui_pass, scene);
+		psygraph::use(graph, pass, color, GRAPH_WRITE_ATTACHMENT);
+	}
+
+	psygraph::compile(graph);
+}
+
+void psyframe::collect_latency(render_state *render, bool wait) {
+	for (int i = 0; i < FRAME_LATENCY_RING; i++) {
+		const int index = (render->latency_frame + i) % FRAME_LATENCY_RING;
+		GLsync fence = render->latency_fences[index];
+		if (!fence) {
+			continue;
+		}
+		const GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? 1000000000ull : 0);
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return;
+		}
+		wait = false;
+
+		const uint64_t now = psybench::ticks();
+		glDeleteSync(fence);
+		render->latency_fences[index] = nullptr;
+		render->feedback.present_time = now;
+		if (render->latency_input[index]) {
+			render->feedback.latency_ms = psybench::ticks_to_ms(now - render->latency_input[index]);
+			if (render->headless && psybench::measuring(render->bench)) {
+				psybench::add_sample(render->bench, "input_latency_ms", render->feedback.latency_ms);
+			}
+		}
+	}
+}
+
+void psyframe::draw_mesh(mesh_context *mesh, GLuint program, GLuint per_frame_data_buffer, int framebuffer_height, float ratio, float time, float distance, float lod_threshold, float lod_hysteresis, uint32_t *lod) {
+	PSY_PROFILE_GPU_SCOPE("psyframe::draw_mesh");
+
+	// fit the mesh into a 2 unit box, at 3.5 that is the spot the cube occupies
+	const glm::vec3 extent = mesh->aabb_max - mesh->aabb_min;
+	const float fit = 2.0f / glm::max(glm::max(extent.x, extent.y), glm::max(extent.z, 1e-6f));
+	const glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), time, glm::vec3(0.0f, 1.0f, 0.0f));
+	const glm::mat4 model =
+		glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -distance)) * rotation *
+		glm::scale(glm::mat4(1.0f), glm::vec3(fit)) *
+		glm::translate(glm::mat4(1.0f), -(mesh->aabb_min + extent * 0.5f)) *
+		mesh->dequantize;
+	const glm::mat4 pers_projection = glm::perspective(45.0f, ratio, 0.1f, glm::max(10.0f, distance + 2.0f));
+
+	if (lod_threshold >= 0.0f) {
+		// error is taken at the nearest point of the box's bounding sphere
+		const float pixels_per_unit = fabsf(pers_projection[1][1]) * 0.5f * framebuffer_height;
+		const float nearest = glm::max(distance - 1.7320508f, 0.1f);
+		*lod = psymesh::select_lod(mesh, fit, nearest, pixels_per_unit, lod_threshold, lod_hysteresis, *lod);
+	} else {
+		*lod = 0;
+	}
+
+	per_frame_data frame_data = {};
+	frame_data.mvp = pers_projection * model;
+	frame_data.is_wire_frame = false;
+	// the mesh camera sits at the origin looking down -z, the same view space the
+	// cube camera's lights are in
+	frame_data.model_view = model;
+	frame_data.normal_matrix = rotation;
+
+	state_pipeline pipeline = psystate::pipeline();
+	pipeline.program = program;
+	pipeline.vertex_array = mesh->vao;
+	pipeline.depth_test = true;
+	psystate::apply(&pipeline);
+	{
+		PSY_PROFILE_SCOPE("mesh upload");
+		glNamedBufferSubData(per_frame_data_buffer, 0, sizeof(per_frame_data), &frame_data);
+	}
+	psymesh::draw(mesh, *lod);
+}
+
+void cull_pass(frame_graph *, void *user) {
+	scene_context *scene = (scene_context *)user;
+	latch_camera(scene);
+	cube::cull(scene->cube, scene->cull, scene->stream, scene->view_projection, &scene->frame->cpu_cull, scene->frame->instance_copy);
+}
+
+void lights_pass(frame_graph *, void *user) {
+	scene_context *scene = (scene_context *)user;
+	latch_camera(scene);
+	float z_near = 0.0f, z_far = 0.0f;
+	const glm::mat4 projection = cube::projection(scene->cube, scene->frame->ratio, &z_near, &z_far);
+	const glm::mat4 view = cube::view(scene->cube, scene->frame->time, scene->yaw);
+	psylight::bin(scene->lights, scene->stream, view, projection, z_near, z_far, scene->window->framebuffer_width, scene->window->framebuffer_height);
+}
+
+void cube_pass(frame_graph *, void *user) {
+	scene_context *scene = (scene_context *)user;
+	latch_camera(scene);
+	if (scene->cull->mode != CULL_MODE_GPU) {
+		cube::cull(scene->cube, scene->cull, scene->stream, scene->view_projection, &scene->frame->cpu_cull, scene->frame->instance_copy);
+	}
+	psylight::bind(scene->lights);
+	const glm::mat4 view = cube::view(scene->cube, scene->frame->time, scene->yaw);
+	cube::draw(scene->cube, scene->shaders, scene->textures, scene->cull, scene->stream, scene->view_projection, view, scene->frame->instance_copy);
+}
+
+void mesh_pass(frame_graph *, void *user) {
+	scene_context *scene = (scene_context *)user;
+	psylight::bind(scene->lights);
+	psyframe::draw_mesh(scene->mesh, psyshader::get(scene->shaders, scene->mesh_program), scene->per_frame_data_buffer, scene->window->framebuffer_height, scene->frame->ratio, scene->frame->time,
+		scene->mesh_distance, scene->lod_threshold, scene->lod_hysteresis, &scene->mesh_lod);
+}
+
+void pyramid_pass(frame_graph *graph, void *user) {
+	scene_context *scene = (scene_context *)user;
+	psycull::build_pyramid(scene->cull, psygraph::get(graph, scene->depth), scene->window->framebuffer_width, scene->window->framebuffer_height);
+}
+
+void imgui_pass(frame_graph *, void *user) {
+	scene_context *scene = (scene_context *)user;
+	psyimgui::render(scene->imgui, scene->shaders, scene->stream, scene->per_frame_data_buffer, &scene->frame->draw_data, &scene->frame->info);
+}
+
+// render thread, right before the first pass that needs the camera: picks up input that
+// arrived after the snapshot was taken. CPU culling already ran against the snapshot's
+// camera so it keeps that one, drawing with a different one would drop visible cubes
+void latch_camera(scene_context *scene) {
+	if (scene->latched) {
+		return;
+	}
+	scene->latched = true;
+	scene->view_projection = scene->frame->view_projection;
+	scene->yaw = scene->frame->yaw;
+	scene->input_time = scene->frame->input_time;
+	if (!scene->latch || scene->frame->culling == CULL_MODE_CPU) {
+		return;
+	}
+
+	uint32_t sequence;
+	float yaw;
+	uint64_t time;
+	do {
+		sequence = scene->latch->sequence.load(std::memory_order_acquire);
+		yaw = scene->latch->yaw.load(std::memory_order_relaxed);
+		time = scene->latch->time.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while ((sequence & 1) || sequence != scene->latch->sequence.load(std::memory_order_relaxed));
+
+	if (time > scene->frame->input_time && yaw != scene->frame->yaw) {
+		scene->view_projection = cube::camera(scene->cube, scene->frame->ratio, scene->frame->time, yaw);
+		scene->yaw = yaw;
+		scene->input_time = time;
+		scene->late_latches++;
+	}
+}
+
+// render thread, after the present: the fence completes once the GPU is done with the
+// frame, which is as close to the photons as GL lets us get
+void track_latency(render_state *render, uint64_t input_time) {
+	const int index = render->latency_frame % FRAME_LATENCY_RING;
+	if (render->latency_fences[index]) {
+		psyframe::collect_latency(render, true);
+	}
+	render->latency_fences[index] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	render->latency_input[index] = input_time;
+	render->latency_frame++;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <bench/bench.h>
+#include <buffer/buffer.h>
+#include <capture/capture.h>
+#include <cube/cube.h>
+#include <cull/cull.h>
+#include <font/font.h>
+#include <graph/graph.h>
+#include <job/job.h>
+#include <light/light.h>
+#include <memory/memory.h>
+#include <mesh/mesh.h>
+#include <shader/shader.h>
+#include <state/state.h>
+#include <texture/texture.h>
+#include <window/window.h>
+
+#include <imgui.h>
+
+#include <stdint.h>
+#include <atomic>
+
+// presents whose latency is still being waited for
+#define FRAME_LATENCY_RING 4
+
+// imgui/imgui_backend.h, which draws the overlays out of frame_feedback
+struct imgui_context;
+
+// uniform block 0, what the mesh and ImGui programs read
+struct per_frame_data {
+	glm::mat4 mvp;
+	int is_wire_frame;
+	int padding[3];
+	// view space, for lighting
+	glm::mat4 model_view;
+	glm::mat4 normal_matrix;
+};
+
+// everything the render thread needs of one frame, built on the main thread while the
+// render thread is still drawing the previous one
+struct frame_snapshot {
+	int index;
+	window_info info;
+	float ratio;
+	float time;
+	float yaw;
+	glm::mat4 view_projection;
+	// newest input the frame was built with, 0 if nothing arrived since the last one
+	uint64_t input_time;
+
+	cull_mode culling;
+	bool hiz;
+	bool state_cache;
+	cull_cpu_result cpu_cull;
+	// the scene buffer copy this frame's instances are in
+	uint32_t instance_copy;
+
+	// ImGui's own lists are rebuilt by the next NewFrame, so the render thread gets copies
+	ImDrawData draw_data;
+	// glyphs the draw data uses for the first time
+	font_upload_list glyphs;
+	bool screenshot;
+	bool toggle_recording;
+};
+
+// what the render thread reports back, copied while it is idle
+struct frame_feedback {
+	cull_stats cull;
+	graph_stats graph;
+	state_stats state;
+	double render_ms;
+	double wait_ms;
+	capture_stats capture;
+	bool recording;
+	memory_arena graph_arena;
+	// when the last frame was presented and how long after its newest input that was
+	uint64_t present_time;
+	double latency_ms;
+};
+
+// the newest camera input, published by the main thread each time it drains events and
+// read by the render thread right before the first pass that uses the camera. A seqlock:
+// the writer never waits, a reader retries if it raced a write
+struct camera_latch {
+	std::atomic<uint32_t> sequence;
+	std::atomic<float> yaw;
+	std::atomic<uint64_t> time;
+};
+
+// everything the passes of the frame graph need, handed to them as user data
+struct scene_context {
+	shader_manager *shaders;
+	texture_manager *textures;
+	cull_context *cull;
+	stream_buffer *stream;
+	cube_context *cube;
+	light_context *lights;
+	mesh_context *mesh;
+	GLuint mesh_program;
+	float mesh_distance;
+	float lod_threshold;
+	float lod_hysteresis;
+	uint32_t mesh_lod;
+	imgui_context *imgui;
+	GLuint per_frame_data_buffer;
+	window_state *window;
+
+	// the frame being drawn, and its camera once latch_camera ran
+	const frame_snapshot *frame;
+	camera_latch *latch;
+	bool latched;
+	glm::mat4 view_projection;
+	float yaw;
+	uint64_t input_time;
+	uint32_t late_latches;
+
+	graph_resource depth;
+};
+
+// render thread side of the app, user data of psyframe::render
+struct render_state {
+	scene_context *scene;
+	frame_graph *graph;
+	bench_state *bench;
+	frame_snapshot *snapshots;
+	frame_feedback feedback;
+
+	// F1 screenshots and F5 / --record recordings, read back and encoded off the GL thread
+	capture_state *capture;
+	int record_fps;
+
+	// fence behind each present and the input time it showed
+	GLsync latency_fences[FRAME_LATENCY_RING];
+	uint64_t latency_input[FRAME_LATENCY_RING];
+	int latency_frame;
+
+	// the options the render thread acts on: headless runs report to bench, --imgui-diff
+	// compares the paths on the first frame past warmup, --record starts with frame 0
+	bool headless;
+	bool imgui_diff;
+	int warmup_frames;
+	const char *record_path;
+
+	uint64_t startup_ticks;
+	bool textures_reported;
+	int exit_code;
+};
+
+namespace psyframe {
+	// main thread: world transforms, the camera and CPU culling of a frame, nothing here may
+	// call GL; the scene writes into the mapped copy the render thread made sure is free
+	void prepare(frame_snapshot *frame, scene_context *scene, job_system *jobs);
+	// render thread, a render_function over a render_state: draws the snapshot in slot,
+	// everything GL happens here
+	void render(void *user, int slot);
+	// declares this frame's passes: GPU culling, cubes, the optional mesh, the Hi-Z pyramid
+	// for next frame's occlusion test and ImGui, all drawing into the window's color target
+	void build_graph(frame_graph *graph, scene_context *scene, bool imgui);
+	// render thread: reads back finished present fences oldest first, wait blocks on the oldest one
+	void collect_latency(render_state *render, bool wait);
+	// the mesh fitted into a 2 unit box, spinning distance in front of the camera. lod is
+	// the level drawn last time, updated to the one drawn now; a negative lod_threshold
+	// keeps the full level
+	void draw_mesh(mesh_context *mesh, GLuint program, GLuint per_frame_data_buffer, int framebuffer_height, float ratio, float time, float distance, float lod_threshold, float lod_hysteresis, uint32_t *lod);
+
+	// headless benches, frame_bench.cpp
+	void run_mesh_bench(const char *source_path, window_state *window, GLuint program, GLuint per_frame_data_buffer, light_context *lights, stream_buffer *stream, float lod_threshold, float lod_hysteresis, bench_state *bench);
+	void run_cube_sweep(frame_graph *graph, scene_context *scene, job_system *jobs, bench_state *bench);
+	void run_light_sweep(frame_graph *graph, scene_context *scene, job_system *jobs, bench_state *bench);
+}
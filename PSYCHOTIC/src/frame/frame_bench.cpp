@@ -0,0 +1,282 @@
+#include "frame.h"
+
+#include <file/file.h>
+
+#include <stdio.h>
+#include <string>
+
+// copies of the mesh each --mesh-bench detail level sweep frame draws
+#define MESH_SWEEP_DRAWS 16
+
+void measure_sweep(frame_graph *graph, scene_context *scene, job_system *jobs, frame_snapshot *snapshot, int warmup_frames, int measured_frames, GLuint *queries, double *cpu_ms, double *gpu_ms);
+
+// bakes source_path next to itself, then compares assimp import against loading
+// the blob, measures post-transform cache efficiency of the baked index order and
+// sweeps the mesh away from the camera with detail level selection on and off
+void psyframe::run_mesh_bench(const char *source_path, window_state *window, GLuint program, GLuint per_frame_data_buffer, light_context *lights, stream_buffer *stream, float lod_threshold, float lod_hysteresis, bench_state *bench) {
+	const std::string blob_path = std::string(source_path) + ".psymesh";
+
+	mesh_bake_stats stats = {};
+	if (!psymesh::bake(source_path, blob_path.c_str(), &stats)) {
+		return;
+	}
+	psybench::set_value(bench, "mesh_assimp_import_ms", stats.import_ms);
+	psybench::set_value(bench, "mesh_optimize_ms", stats.optimize_ms);
+	psybench::set_value(bench, "mesh_vertices", stats.vertices);
+	psybench::set_value(bench, "mesh_triangles", stats.triangles);
+	psybench::set_value(bench, "mesh_acmr_before", stats.acmr_before);
+	psybench::set_value(bench, "mesh_acmr_after", stats.acmr_after);
+	psybench::set_value(bench, "mesh_simplify_ms", stats.simplify_ms);
+	psybench::set_value(bench, "mesh_lod_count", stats.lod_count);
+	for (uint32_t i = 0; i < stats.lod_count; i++) {
+		char name[64];
+		snprintf(name, sizeof(name), "mesh_lod%u_triangles", i);
+		psybench::set_value(bench, name, stats.lod_triangles[i]);
+		snprintf(name, sizeof(name), "mesh_lod%u_error", i);
+		psybench::set_value(bench, name, stats.lod_error[i]);
+	}
+
+	// the blob is dropped from the page cache first so the first load reads the disk,
+	// the second one is warm
+	const bool evicted = psyfile::evict(blob_path.c_str());
+	psybench::set_value(bench, "mesh_blob_cache_evicted", evicted);
+	if (!evicted) {
+		fprintf(stderr, "Warning: could not drop %s from the page cache, the cold load is warm\n", blob_path.c_str());
+	}
+	const char *load_names[2] = { "mesh_blob_load_cold_ms", "mesh_blob_load_warm_ms" };
+	mesh_context mesh = {};
+	for (int i = 0; i < 2; i++) {
+		const uint64_t start = psybench::ticks();
+		psymesh::load(blob_path.c_str(), &mesh);
+		glFinish();
+		psybench::set_value(bench, load_names[i], psybench::ticks_to_ms(psybench::ticks() - start));
+		if (i == 0) {
+			psymesh::destroy(&mesh);
+		}
+	}
+	if (!mesh.vao) {
+		return;
+	}
+
+	// unlit, both measurements are about vertex work
+	const light_mode lighting = lights->mode;
+	lights->mode = LIGHT_MODE_OFF;
+	psylight::bin(lights, stream, glm::mat4(1.0f), glm::mat4(1.0f), 0.1f, 10.0f, window->framebuffer_width, window->framebuffer_height);
+	psylight::bind(lights);
+	lights->mode = lighting;
+
+	GLuint query = 0;
+	glCreateQueries(GL_VERTEX_SHADER_INVOCATIONS, 1, &query);
+	psystate::bind_framebuffer(window->framebuffer);
+	psystate::use_program(program);
+	glBeginQuery(GL_VERTEX_SHADER_INVOCATIONS, query);
+	psymesh::draw(&mesh, 0);
+	glEndQuery(GL_VERTEX_SHADER_INVOCATIONS);
+
+	GLuint64 invocations = 0;
+	glGetQueryObjectui64v(query, GL_QUERY_RESULT, &invocations);
+	glDeleteQueries(1, &query);
+
+	psybench::set_value(bench, "mesh_vs_invocations", (double)invocations);
+	psybench::set_value(bench, "mesh_post_transform_hit_rate", 1.0 - (double)invocations / (double)mesh.index_count);
+	printf("mesh: assimp import %.2f ms, acmr %.3f -> %.3f, %llu vs invocations for %u indices\n",
+		stats.import_ms, stats.acmr_before, stats.acmr_after, (unsigned long long)invocations, mesh.index_count);
+
+	// the same distances with selection on and off; hysteresis is settled by the warmup
+	const float distances[] = { 2.0f, 4.0f, 8.0f, 16.0f, 32.0f, 64.0f, 128.0f };
+	const int warmup_frames = 5;
+	const int measured_frames = 30;
+	GLuint queries[measured_frames];
+	glCreateQueries(GL_TIME_ELAPSED, measured_frames, queries);
+	psystate::viewport(0, 0, window->framebuffer_width, window->framebuffer_height);
+	const float ratio = window->framebuffer_width / (float)window->framebuffer_height;
+
+	printf("mesh lod sweep, %u levels:\n%10s %6s %10s %10s %10s %10s\n", mesh.lod_count, "distance", "level", "tris on", "tris off", "gpu on", "gpu off");
+	for (float distance : distances) {
+		uint32_t lods[2] = {};
+		double gpu_ms[2] = {};
+		for (int on = 0; on < 2; on++) {
+			for (int frame = 0; frame < warmup_frames + measured_frames; frame++) {
+				const bool measured = frame >= warmup_frames;
+				if (measured) {
+					glBeginQuery(GL_TIME_ELAPSED, queries[frame - warmup_frames]);
+				}
+				// several draws a frame so the vertex work stands out of the timer noise
+				for (int draw = 0; draw < MESH_SWEEP_DRAWS; draw++) {
+					psyframe::draw_mesh(&mesh, program, per_frame_data_buffer, window->framebuffer_height, ratio, frame / 60.0f, distance, on ? lod_threshold : -1.0f, lod_hysteresis, &lods[on]);
+				}
+				if (measured) {
+					glEndQuery(GL_TIME_ELAPSED);
+				}
+			}
+			for (int i = 0; i < measured_frames; i++) {
+				GLuint64 elapsed = 0;
+				glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+				gpu_ms[on] += elapsed / 1e6;
+			}
+			gpu_ms[on] /= measured_frames;
+		}
+
+		const uint32_t triangles_on = mesh.lods[lods[1]].index_count / 3 * MESH_SWEEP_DRAWS;
+		const uint32_t triangles_off = mesh.lods[lods[0]].index_count / 3 * MESH_SWEEP_DRAWS;
+		char name[64];
+		snprintf(name, sizeof(name), "mesh_lod_%g_level", distance);
+		psybench::set_value(bench, name, lods[1]);
+		snprintf(name, sizeof(name), "mesh_lod_%g_triangles_on", distance);
+		psybench::set_value(bench, name, triangles_on);
+		snprintf(name, sizeof(name), "mesh_lod_%g_triangles_off", distance);
+		psybench::set_value(bench, name, triangles_off);
+		snprintf(name, sizeof(name), "mesh_lod_%g_gpu_ms_on", distance);
+		psybench::set_value(bench, name, gpu_ms[1]);
+		snprintf(name, sizeof(name), "mesh_lod_%g_gpu_ms_off", distance);
+		psybench::set_value(bench, name, gpu_ms[0]);
+		printf("%10g %6u %10u %10u %10.3f %10.3f\n", distance, lods[1], triangles_on, triangles_off, gpu_ms[1], gpu_ms[0]);
+	}
+
+	glDeleteQueries(measured_frames, queries);
+	psymesh::destroy(&mesh);
+}
+
+// renders the instanced cubes alone at 1 .. 1,000,000 instances and records mean
+// CPU and GPU frame time per step; GPU queries are only read back once a step is done
+void psyframe::run_cube_sweep(frame_graph *graph, scene_context *scene, job_system *jobs, bench_state *bench) {
+	const uint32_t counts[] = { 1, 10, 100, 1000, 10000, 100000, 1000000 };
+	const int warmup_frames = 10;
+	const int measured_frames = 60;
+
+	GLuint queries[measured_frames];
+	glCreateQueries(GL_TIME_ELAPSED, measured_frames, queries);
+
+	frame_snapshot snapshot = {};
+	snapshot.info = window_info();
+	snapshot.info.width = scene->window->framebuffer_width;
+	snapshot.info.height = scene->window->framebuffer_height;
+	snapshot.culling = scene->cull->mode;
+	snapshot.hiz = scene->cull->hiz;
+
+	printf("cube sweep:\n%10s %10s %10s\n", "instances", "cpu ms", "gpu ms");
+	for (uint32_t count : counts) {
+		cube::set_instances(scene->cube, count);
+
+		double cpu_ms = 0.0, gpu_ms = 0.0;
+		measure_sweep(graph, scene, jobs, &snapshot, warmup_frames, measured_frames, queries, &cpu_ms, &gpu_ms);
+		char name[64];
+		snprintf(name, sizeof(name), "cubes_%u_cpu_ms", count);
+		psybench::set_value(bench, name, cpu_ms);
+		snprintf(name, sizeof(name), "cubes_%u_gpu_ms", count);
+		psybench::set_value(bench, name, gpu_ms);
+		printf("%10u %10.3f %10.3f\n", count, cpu_ms, gpu_ms);
+	}
+
+	glDeleteQueries(measured_frames, queries);
+}
+
+// draws the current cubes lit by 1 .. 10,000 lights, binned into clusters and looped over
+// by every fragment, and records mean CPU and GPU frame time and the binning pass per step
+void psyframe::run_light_sweep(frame_graph *graph, scene_context *scene, job_system *jobs, bench_state *bench) {
+	const uint32_t counts[] = { 1, 10, 100, 1000, 10000 };
+	const light_mode modes[] = { LIGHT_MODE_CLUSTERED, LIGHT_MODE_BRUTE_FORCE };
+	const char *mode_names[] = { "clustered", "brute" };
+	const int warmup_frames = 10;
+	const int measured_frames = 60;
+
+	GLuint queries[measured_frames];
+	glCreateQueries(GL_TIME_ELAPSED, measured_frames, queries);
+
+	frame_snapshot snapshot = {};
+	snapshot.info = window_info();
+	snapshot.info.width = scene->window->framebuffer_width;
+	snapshot.info.height = scene->window->framebuffer_height;
+	snapshot.culling = scene->cull->mode;
+	snapshot.hiz = scene->cull->hiz;
+
+	printf("light sweep, %u cubes:\n%10s %10s %10s %10s %10s %10s\n", scene->cube->scene.count, "lights", "mode", "cpu ms", "gpu ms", "bin ms", "overflow");
+	for (uint32_t count : counts) {
+		psylight::set_lights(scene->lights, count, cube::light_extent(scene->cube));
+		for (int m = 0; m < 2; m++) {
+			scene->lights->mode = modes[m];
+
+			double cpu_ms = 0.0, gpu_ms = 0.0;
+			measure_sweep(graph, scene, jobs, &snapshot, warmup_frames, measured_frames, queries, &cpu_ms, &gpu_ms);
+			// binning times and the overflow count lag LIGHT_READBACK_LATENCY frames, well inside the measured ones
+			const light_stats *stats = &scene->lights->stats;
+
+			char name[64];
+			snprintf(name, sizeof(name), "lights_%u_%s_cpu_ms", count, mode_names[m]);
+			psybench::set_value(bench, name, cpu_ms);
+			snprintf(name, sizeof(name), "lights_%u_%s_gpu_ms", count, mode_names[m]);
+			psybench::set_value(bench, name, gpu_ms);
+			snprintf(name, sizeof(name), "lights_%u_%s_bin_ms", count, mode_names[m]);
+			psybench::set_value(bench, name, stats->bin_ms);
+			if (modes[m] == LIGHT_MODE_CLUSTERED) {
+				snprintf(name, sizeof(name), "lights_%u_overflow", count);
+				psybench::set_value(bench, name, stats->overflow);
+			}
+			printf("%10u %10s %10.3f %10.3f %10.3f %10u\n", count, mode_names[m], cpu_ms, gpu_ms, stats->bin_ms, modes[m] == LIGHT_MODE_CLUSTERED ? stats->overflow : 0);
+		}
+	}
+
+	glDeleteQueries(measured_frames, queries);
+}
+
+// one sweep step: frames built and drawn back to back like the main loop, only without the
+// render thread in between; mean CPU and GPU frame time of the measured ones
+void measure_sweep(frame_graph *graph, scene_context *scene, job_system *jobs, frame_snapshot *snapshot, int warmup_frames, int measured_frames, GLuint *queries, double *cpu_ms, double *gpu_ms) {
+	double cpu_total = 0.0;
+	for (int frame = 0; frame < warmup_frames + measured_frames; frame++) {
+		const bool measured = frame >= warmup_frames;
+		const uint64_t start = psybench::ticks();
+
+		snapshot->index = frame;
+		snapshot->ratio = snapshot->info.width / (float)snapshot->info.height;
+		snapshot->time = frame / 60.0f;
+		snapshot->instance_copy = frame % SCENE_BUFFER_COPIES;
+		psyframe::prepare(snapshot, scene, jobs);
+
+		psywindow::begin_frame(scene->window, &snapshot->info);
+		psybuffer::begin_frame(scene->stream);
+		psytexture::update(scene->textures);
+
+		// the mesh stays out of the sweep
+		mesh_context *mesh = scene->mesh;
+		scene->mesh = nullptr;
+		scene->frame = snapshot;
+		scene->latched = false;
+		psyframe::build_graph(graph, scene, false);
+		scene->mesh = mesh;
+
+		if (measured) {
+			glBeginQuery(GL_TIME_ELAPSED, queries[frame - warmup_frames]);
+		}
+		psygraph::execute(graph);
+		if (measured) {
+			glEndQuery(GL_TIME_ELAPSED);
+		}
+
+		psybuffer::end_frame(scene->stream);
+		psycull::end_frame(scene->cull);
+		psylight::end_frame(scene->lights);
+		// no render thread in between, the next frame writes its copy right away
+		psyscene::fence(&scene->cube->scene, snapshot->instance_copy);
+		psyscene::wait(&scene->cube->scene, (frame + 1) % SCENE_BUFFER_COPIES);
+		psystate::end_frame();
+		psywindow::end_frame(scene->window);
+		if (measured) {
+			cpu_total += psybench::ticks_to_ms(psybench::ticks() - start);
+		}
+	}
+	// whatever runs next starts over at copy 0
+	for (uint32_t copy = 0; copy < SCENE_BUFFER_COPIES; copy++) {
+		psyscene::wait(&scene->cube->scene, copy);
+	}
+
+	double gpu_total = 0.0;
+	for (int i = 0; i < measured_frames; i++) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+		gpu_total += elapsed / 1e6;
+	}
+
+	*cpu_ms = cpu_total / measured_frames;
+	*gpu_ms = gpu_total / measured_frames;
+}
@@ -0,0 +1,618 @@
+#include "graph.h"
+
+#include <bench/bench.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+
+#include <imgui.h>
+
+#include <stdio.h>
+#include <algorithm>
+
+void cull_passes(frame_graph *graph);
+void assign_slots(frame_graph *graph);
+void place_barriers(frame_graph *graph);
+void build_framebuffers(frame_graph *graph);
+void collect_timings(frame_graph *graph, int slot);
+bool is_depth_format(GLenum format);
+size_t texture_bytes(const graph_texture_desc *desc);
+bool same_desc(const graph_texture_desc *a, const graph_texture_desc *b);
+GLbitfield barrier_bit(graph_access access);
+
+void psygraph::create(frame_graph *graph) {
+	graph->frame = 0;
+	graph->stats.compile_ms = 0.0;
+	graph->stats.target_bytes = 0;
+	graph->stats.peak_target_bytes = 0;
+	graph->stats.unaliased_bytes = 0;
+	graph->stats.barriers = 0;
+	for (int i = 0; i < GRAPH_QUERY_LATENCY; i++) {
+		glCreateQueries(GL_TIMESTAMP, GRAPH_MAX_PASSES * 2, graph->queries[i]);
+	}
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	psymemory::create_arena(&graph->arena, GRAPH_ARENA_SIZE);
+	psymemory::create_pool(&graph->slot_blocks, sizeof(graph_pool_slot), GRAPH_MAX_SLOTS);
+	psymemory::create_pool(&graph->framebuffer_blocks, sizeof(graph_framebuffer), GRAPH_MAX_FRAMEBUFFERS);
+	graph->pool.reserve(GRAPH_MAX_SLOTS);
+	graph->framebuffers.reserve(GRAPH_MAX_FRAMEBUFFERS);
+}
+
+void psygraph::destroy(frame_graph *graph) {
+	for (int i = 0; i < GRAPH_QUERY_LATENCY; i++) {
+		glDeleteQueries(GRAPH_MAX_PASSES * 2, graph->queries[i]);
+	}
+	for (graph_framebuffer *framebuffer : graph->framebuffers) {
+		psystate::forget(framebuffer->framebuffer);
+		glDeleteFramebuffers(1, &framebuffer->framebuffer);
+	}
+	for (graph_pool_slot *slot : graph->pool) {
+		psystate::forget(slot->texture);
+		glDeleteTextures(1, &slot->texture);
+	}
+	graph->framebuffers.clear();
+	graph->pool.clear();
+	psymemory::destroy_pool(&graph->slot_blocks);
+	psymemory::destroy_pool(&graph->framebuffer_blocks);
+	psymemory::destroy_arena(&graph->arena);
+}
+
+void psygraph::begin(frame_graph *graph) {
+	graph->passes.clear();
+	graph->resources.clear();
+	psymemory::reset(&graph->arena);
+}
+
+graph_resource psygraph::create_texture(frame_graph *graph, const char *name, const graph_texture_desc *desc) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	graph_resource_entry entry = {};
+	entry.name = name;
+	entry.texture = true;
+	entry.desc = *desc;
+	graph->resources.push_back(entry);
+	return (graph_resource)(graph->resources.size() - 1);
+}
+
+graph_resource psygraph::import_texture(frame_graph *graph, const char *name, GLuint texture, const graph_texture_desc *desc) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	graph_resource_entry entry = {};
+	entry.name = name;
+	entry.texture = true;
+	entry.imported = true;
+	entry.desc = *desc;
+	entry.object = texture;
+	graph->resources.push_back(entry);
+	return (graph_resource)(graph->resources.size() - 1);
+}
+
+graph_resource psygraph::import_buffer(frame_graph *graph, const char *name, GLuint buffer) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	graph_resource_entry entry = {};
+	entry.name = name;
+	entry.imported = true;
+	entry.object = buffer;
+	graph->resources.push_back(entry);
+	return (graph_resource)(graph->resources.size() - 1);
+}
+
+void psygraph::mark_output(frame_graph *graph, graph_resource resource) {
+	graph->resources[resource].output = true;
+}
+
+graph_pass_handle psygraph::add_pass(frame_graph *graph, const char *name, graph_execute execute, void *user) {
+	if (graph->passes.size() == GRAPH_MAX_PASSES) {
+		fprintf(stderr, "Error: frame graph pass limit (%d) reached, %s dropped\n", GRAPH_MAX_PASSES, name);
+		return GRAPH_INVALID;
+	}
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	graph_pass pass = {};
+	pass.name = name;
+	pass.execute = execute;
+	pass.user = user;
+	graph->passes.push_back(pass);
+	return (graph_pass_handle)(graph->passes.size() - 1);
+}
+
+void psygraph::use(frame_graph *graph, graph_pass_handle pass, graph_resource resource, graph_access access) {
+	if (pass == GRAPH_INVALID) {
+		return;
+	}
+	graph_pass *entry = &graph->passes[pass];
+	if (entry->use_count == GRAPH_MAX_USES) {
+		fprintf(stderr, "Error: frame graph use limit (%d) reached in pass %s\n", GRAPH_MAX_USES, entry->name);
+		return;
+	}
+	graph_use *use = &entry->uses[entry->use_count++];
+	use->resource = resource;
+	use->access = access;
+}
+
+void psygraph::set_side_effects(frame_graph *graph, graph_pass_handle pass) {
+	if (pass != GRAPH_INVALID) {
+		graph->passes[pass].side_effects = true;
+	}
+}
+
+void psygraph::compile(frame_graph *graph) {
+	PSY_PROFILE_SCOPE("psygraph::compile");
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	const uint64_t start = psybench::ticks();
+
+	cull_passes(graph);
+	assign_slots(graph);
+	place_barriers(graph);
+	build_framebuffers(graph);
+
+	graph->stats.compile_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+}
+
+void psygraph::execute(frame_graph *graph) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_GRAPH);
+	const int slot = graph->frame % GRAPH_QUERY_LATENCY;
+	collect_timings(graph, slot);
+
+	std::vector<graph_timing> &pending = graph->pending[slot];
+	pending.clear();
+
+	for (size_t i = 0; i < graph->passes.size(); i++) {
+		graph_pass *pass = &graph->passes[i];
+
+		graph_timing timing = {};
+		timing.name = pass->name;
+		timing.culled = pass->culled;
+		pending.push_back(timing);
+		if (pass->culled) {
+			continue;
+		}
+
+		glQueryCounter(graph->queries[slot][i * 2 + 0], GL_TIMESTAMP);
+
+		if (pass->barrier) {
+			glMemoryBarrier(pass->barrier);
+		}
+		if (pass->framebuffer) {
+			psystate::bind_framebuffer(pass->framebuffer);
+			psystate::viewport(0, 0, pass->width, pass->height);
+
+			// first attachment write of the frame clears, later ones load
+			for (uint32_t u = 0; u < pass->use_count; u++) {
+				const graph_use &use = pass->uses[u];
+				graph_resource_entry *resource = &graph->resources[use.resource];
+				if (use.access != GRAPH_WRITE_ATTACHMENT || resource->cleared) {
+					continue;
+				}
+				resource->cleared = true;
+				if (!resource->desc.clear) {
+					continue;
+				}
+				psystate::disable(GL_SCISSOR_TEST);
+				if (is_depth_format(resource->desc.format)) {
+					const GLfloat depth = resource->desc.clear_color.x;
+					psystate::depth_mask(true);
+					glClearNamedFramebufferfv(pass->framebuffer, GL_DEPTH, 0, &depth);
+				} else {
+					glClearNamedFramebufferfv(pass->framebuffer, GL_COLOR, 0, &resource->desc.clear_color.x);
+				}
+			}
+		}
+
+		{
+			PSY_PROFILE_SCOPE(pass->name);
+			pass->execute(graph, pass->user);
+		}
+
+		glQueryCounter(graph->queries[slot][i * 2 + 1], GL_TIMESTAMP);
+	}
+
+	graph->frame++;
+}
+
+GLuint psygraph::get(frame_graph *graph, graph_resource resource) {
+	const graph_resource_entry *entry = &graph->resources[resource];
+	if (entry->imported || entry->slot < 0) {
+		return entry->object;
+	}
+	return graph->pool[entry->slot]->texture;
+}
+
+void psygraph::draw_overlay(const graph_stats *stats) {
+	if (!ImGui::Begin("Frame graph")) {
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("render targets %.2f MB (peak %.2f MB, %.2f MB without aliasing)",
+		stats->target_bytes / (1024.0 * 1024.0),
+		stats->peak_target_bytes / (1024.0 * 1024.0),
+		stats->unaliased_bytes / (1024.0 * 1024.0));
+	ImGui::Text("barriers %u, compile %.3f ms", stats->barriers, stats->compile_ms);
+
+	if (ImGui::BeginTable("passes", 2, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)) {
+		ImGui::TableSetupColumn("pass");
+		ImGui::TableSetupColumn("gpu ms");
+		ImGui::TableHeadersRow();
+		for (const graph_timing &timing : stats->timings) {
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(timing.name);
+			ImGui::TableNextColumn();
+			if (timing.culled) {
+				ImGui::TextDisabled("culled");
+			} else {
+				ImGui::Text("%.3f", timing.gpu_ms);
+			}
+		}
+		ImGui::EndTable();
+	}
+	ImGui::End();
+}
+
+// walks back from the outputs, a pass survives if something later needs a resource it touches
+void cull_passes(frame_graph *graph) {
+	bool *needed = psymemory::push_array<bool>(&graph->arena, graph->resources.size());
+	// the arena ran out (push reported it), nothing is culled this frame
+	if (!needed) {
+		for (graph_pass &pass : graph->passes) {
+			pass.culled = false;
+		}
+		return;
+	}
+	for (size_t i = 0; i < graph->resources.size(); i++) {
+		needed[i] = graph->resources[i].output;
+	}
+
+	for (size_t i = graph->passes.size(); i-- > 0;) {
+		graph_pass *pass = &graph->passes[i];
+		bool alive = pass->side_effects;
+		for (uint32_t u = 0; u < pass->use_count; u++) {
+			const graph_use &use = pass->uses[u];
+			const bool write = use.access >= GRAPH_WRITE_ATTACHMENT;
+			alive = alive || (write && needed[use.resource]);
+		}
+		pass->culled = !alive;
+		if (!alive) {
+			continue;
+		}
+		// writes count too: an attachment that is not cleared here loads what earlier passes left
+		for (uint32_t u = 0; u < pass->use_count; u++) {
+			const graph_use &use = pass->uses[u];
+			needed[use.resource] = true;
+		}
+	}
+}
+
+void assign_slots(frame_graph *graph) {
+	for (graph_resource_entry &resource : graph->resources) {
+		resource.first_use = -1;
+		resource.last_use = -1;
+		resource.slot = -1;
+		resource.cleared = false;
+	}
+	for (size_t i = 0; i < graph->passes.size(); i++) {
+		if (graph->passes[i].culled) {
+			continue;
+		}
+		for (uint32_t u = 0; u < graph->passes[i].use_count; u++) {
+			const graph_use &use = graph->passes[i].uses[u];
+			graph_resource_entry *resource = &graph->resources[use.resource];
+			resource->first_use = resource->first_use < 0 ? (int)i : resource->first_use;
+			resource->last_use = (int)i;
+		}
+	}
+
+	graph_resource *transients = psymemory::push_array<graph_resource>(&graph->arena, graph->resources.size());
+	if (!transients) {
+		return;
+	}
+	size_t transient_count = 0;
+	for (size_t i = 0; i < graph->resources.size(); i++) {
+		const graph_resource_entry *resource = &graph->resources[i];
+		if (resource->texture && !resource->imported && resource->first_use >= 0) {
+			transients[transient_count++] = (graph_resource)i;
+		}
+	}
+	std::sort(transients, transients + transient_count, [graph](graph_resource a, graph_resource b) {
+		return graph->resources[a].first_use < graph->resources[b].first_use;
+	});
+
+	for (graph_pool_slot *slot : graph->pool) {
+		slot->used = false;
+		slot->free_after = -1;
+	}
+
+	graph->stats.unaliased_bytes = 0;
+	for (size_t t = 0; t < transient_count; t++) {
+		graph_resource_entry *resource = &graph->resources[transients[t]];
+		graph->stats.unaliased_bytes += texture_bytes(&resource->desc);
+
+		int found = -1;
+		for (size_t s = 0; s < graph->pool.size() && found < 0; s++) {
+			graph_pool_slot *slot = graph->pool[s];
+			if (same_desc(&slot->desc, &resource->desc) && (!slot->used || slot->free_after < resource->first_use)) {
+				found = (int)s;
+			}
+		}
+		if (found < 0) {
+			graph_pool_slot *slot = (graph_pool_slot *)psymemory::take(&graph->slot_blocks);
+			if (!slot) {
+				fprintf(stderr, "Error: frame graph slot limit (%d) reached, %s has no texture\n", GRAPH_MAX_SLOTS, resource->name);
+				continue;
+			}
+			*slot = {};
+			slot->desc = resource->desc;
+			slot->bytes = texture_bytes(&resource->desc);
+			glCreateTextures(GL_TEXTURE_2D, 1, &slot->texture);
+			glTextureStorage2D(slot->texture, resource->desc.levels, resource->desc.format, resource->desc.width, resource->desc.height);
+			glTextureParameteri(slot->texture, GL_TEXTURE_MIN_FILTER, resource->desc.levels > 1 ? GL_NEAREST_MIPMAP_NEAREST : GL_NEAREST);
+			glTextureParameteri(slot->texture, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			graph->pool.push_back(slot);
+			found = (int)graph->pool.size() - 1;
+		}
+
+		graph->pool[found]->used = true;
+		graph->pool[found]->free_after = resource->last_use;
+		resource->slot = found;
+	}
+
+	// slots nobody wanted for GRAPH_RETAIN_FRAMES go, along with framebuffers built on them
+	graph->stats.target_bytes = 0;
+	for (size_t s = graph->pool.size(); s-- > 0;) {
+		graph_pool_slot *slot = graph->pool[s];
+		slot->idle_frames = slot->used ? 0 : slot->idle_frames + 1;
+		if (slot->idle_frames <= GRAPH_RETAIN_FRAMES) {
+			graph->stats.target_bytes += slot->bytes;
+			continue;
+		}
+		for (size_t f = graph->framebuffers.size(); f-- > 0;) {
+			graph_framebuffer *framebuffer = graph->framebuffers[f];
+			if (framebuffer->color == slot->texture || framebuffer->depth == slot->texture) {
+				psystate::forget(framebuffer->framebuffer);
+				glDeleteFramebuffers(1, &framebuffer->framebuffer);
+				psymemory::give(&graph->framebuffer_blocks, framebuffer);
+				graph->framebuffers.erase(graph->framebuffers.begin() + f);
+			}
+		}
+		psystate::forget(slot->texture);
+		glDeleteTextures(1, &slot->texture);
+		psymemory::give(&graph->slot_blocks, slot);
+		graph->pool.erase(graph->pool.begin() + s);
+		for (graph_resource_entry &resource : graph->resources) {
+			resource.slot = resource.slot > (int)s ? resource.slot - 1 : resource.slot;
+		}
+	}
+	graph->stats.peak_target_bytes = std::max(graph->stats.peak_target_bytes, graph->stats.target_bytes);
+}
+
+// a barrier is only needed after a shader image/storage write, and only for the bits
+// of the accesses that follow it; imported objects remember their last write across frames
+void place_barriers(frame_graph *graph) {
+	int *last_write = psymemory::push_array<int>(&graph->arena, graph->resources.size());
+	GLbitfield *covered = psymemory::push_array<GLbitfield>(&graph->arena, graph->resources.size());
+	// the arena ran out, every pass waits on everything
+	if (!last_write || !covered) {
+		for (graph_pass &pass : graph->passes) {
+			pass.barrier = pass.culled ? 0 : GL_ALL_BARRIER_BITS;
+		}
+		return;
+	}
+	for (size_t r = 0; r < graph->resources.size(); r++) {
+		const graph_resource_entry *resource = &graph->resources[r];
+		last_write[r] = -1;
+		if (!resource->imported) {
+			continue;
+		}
+		for (const graph_object_state &state : graph->objects) {
+			if (state.object == resource->object && state.texture == resource->texture) {
+				last_write[r] = state.access;
+			}
+		}
+	}
+
+	graph->stats.barriers = 0;
+	for (graph_pass &pass : graph->passes) {
+		pass.barrier = 0;
+		if (pass.culled) {
+			continue;
+		}
+		for (uint32_t u = 0; u < pass.use_count; u++) {
+			const graph_use &use = pass.uses[u];
+			const int written = last_write[use.resource];
+			if (written == GRAPH_WRITE_IMAGE || written == GRAPH_WRITE_STORAGE) {
+				const GLbitfield bit = barrier_bit(use.access);
+				if (!(covered[use.resource] & bit)) {
+					pass.barrier |= bit;
+					covered[use.resource] |= bit;
+				}
+			}
+		}
+		for (uint32_t u = 0; u < pass.use_count; u++) {
+			const graph_use &use = pass.uses[u];
+			if (use.access >= GRAPH_WRITE_ATTACHMENT) {
+				last_write[use.resource] = use.access;
+				covered[use.resource] = 0;
+			}
+		}
+		graph->stats.barriers += pass.barrier != 0;
+	}
+
+	// one glMemoryBarrier covers every resource, so bits issued for one count for all
+	// resources written before it; good enough since passes rarely share bits otherwise
+	graph->objects.clear();
+	for (size_t r = 0; r < graph->resources.size(); r++) {
+		const graph_resource_entry *resource = &graph->resources[r];
+		if (resource->imported && (last_write[r] == GRAPH_WRITE_IMAGE || last_write[r] == GRAPH_WRITE_STORAGE)) {
+			graph_object_state state = {};
+			state.object = resource->object;
+			state.texture = resource->texture;
+			state.access = (graph_access)last_write[r];
+			graph->objects.push_back(state);
+		}
+	}
+}
+
+void build_framebuffers(frame_graph *graph) {
+	// room for every cached framebuffer plus one new one per pass
+	bool *used = psymemory::push_array<bool>(&graph->arena, graph->framebuffers.size() + graph->passes.size());
+	if (!used) {
+		return;
+	}
+
+	for (graph_pass &pass : graph->passes) {
+		pass.framebuffer = 0;
+		if (pass.culled) {
+			continue;
+		}
+
+		graph_framebuffer framebuffer = {};
+		framebuffer.transient = true;
+		for (uint32_t u = 0; u < pass.use_count; u++) {
+			const graph_use &use = pass.uses[u];
+			if (use.access != GRAPH_WRITE_ATTACHMENT) {
+				continue;
+			}
+			const graph_resource_entry *resource = &graph->resources[use.resource];
+			const GLuint texture = psygraph::get(graph, use.resource);
+			framebuffer.transient = framebuffer.transient && !resource->imported && resource->slot >= 0;
+			if (is_depth_format(resource->desc.format)) {
+				framebuffer.depth = texture;
+				framebuffer.depth_format = resource->desc.format;
+			} else {
+				framebuffer.color = texture;
+				framebuffer.color_format = resource->desc.format;
+			}
+			pass.width = resource->desc.width;
+			pass.height = resource->desc.height;
+		}
+		const GLuint color = framebuffer.color;
+		const GLuint depth = framebuffer.depth;
+		if (!color && !depth) {
+			continue;
+		}
+		framebuffer.width = pass.width;
+		framebuffer.height = pass.height;
+
+		// a recycled name comes back with a different size or format, an unchanged one
+		// is the same texture: anything imported not matched in a frame is deleted at its end
+		for (size_t f = 0; f < graph->framebuffers.size() && !pass.framebuffer; f++) {
+			const graph_framebuffer *cached = graph->framebuffers[f];
+			if (cached->color == color && cached->depth == depth &&
+				cached->color_format == framebuffer.color_format && cached->depth_format == framebuffer.depth_format &&
+				cached->width == framebuffer.width && cached->height == framebuffer.height) {
+				pass.framebuffer = cached->framebuffer;
+				graph->framebuffers[f]->idle_frames = 0;
+				used[f] = true;
+			}
+		}
+		if (pass.framebuffer) {
+			continue;
+		}
+
+		graph_framebuffer *entry = (graph_framebuffer *)psymemory::take(&graph->framebuffer_blocks);
+		if (!entry) {
+			fprintf(stderr, "Error: frame graph framebuffer limit (%d) reached, pass %s skipped\n", GRAPH_MAX_FRAMEBUFFERS, pass.name);
+			pass.culled = true;
+			continue;
+		}
+		glCreateFramebuffers(1, &framebuffer.framebuffer);
+		if (color) {
+			glNamedFramebufferTexture(framebuffer.framebuffer, GL_COLOR_ATTACHMENT0, color, 0);
+		} else {
+			glNamedFramebufferDrawBuffer(framebuffer.framebuffer, GL_NONE);
+		}
+		if (depth) {
+			glNamedFramebufferTexture(framebuffer.framebuffer, GL_DEPTH_ATTACHMENT, depth, 0);
+		}
+		if (glCheckNamedFramebufferStatus(framebuffer.framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			fprintf(stderr, "Error: incomplete framebuffer for pass %s\n", pass.name);
+		}
+		used[graph->framebuffers.size()] = true;
+		*entry = framebuffer;
+		graph->framebuffers.push_back(entry);
+		pass.framebuffer = framebuffer.framebuffer;
+	}
+
+	for (size_t f = graph->framebuffers.size(); f-- > 0;) {
+		graph_framebuffer *framebuffer = graph->framebuffers[f];
+		if (!used[f] && framebuffer->transient && ++framebuffer->idle_frames <= GRAPH_RETAIN_FRAMES) {
+			continue;
+		}
+		if (!used[f]) {
+			psystate::forget(graph->framebuffers[f]->framebuffer);
+			glDeleteFramebuffers(1, &graph->framebuffers[f]->framebuffer);
+			psymemory::give(&graph->framebuffer_blocks, graph->framebuffers[f]);
+			graph->framebuffers.erase(graph->framebuffers.begin() + f);
+		}
+	}
+}
+
+// passes of the frame that last used this slot, GRAPH_QUERY_LATENCY frames ago
+void collect_timings(frame_graph *graph, int slot) {
+	std::vector<graph_timing> &pending = graph->pending[slot];
+	if (pending.empty()) {
+		return;
+	}
+	// the GPU is more than GRAPH_QUERY_LATENCY frames behind: keep the older timings rather
+	// than wait, this slot's queries are issued again and its results dropped
+	for (size_t i = 0; i < pending.size(); i++) {
+		if (pending[i].culled) {
+			continue;
+		}
+		GLint begin_available = 0, end_available = 0;
+		glGetQueryObjectiv(graph->queries[slot][i * 2 + 0], GL_QUERY_RESULT_AVAILABLE, &begin_available);
+		glGetQueryObjectiv(graph->queries[slot][i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &end_available);
+		if (!begin_available || !end_available) {
+			return;
+		}
+	}
+	for (size_t i = 0; i < pending.size(); i++) {
+		if (pending[i].culled) {
+			continue;
+		}
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(graph->queries[slot][i * 2 + 0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(graph->queries[slot][i * 2 + 1], GL_QUERY_RESULT, &end);
+		pending[i].gpu_ms = (end - begin) / 1e6;
+	}
+	graph->stats.timings = pending;
+}
+
+bool is_depth_format(GLenum format) {
+	return format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH_COMPONENT24 ||
+		format == GL_DEPTH_COMPONENT16 || format == GL_DEPTH24_STENCIL8 || format == GL_DEPTH32F_STENCIL8;
+}
+
+size_t texture_bytes(const graph_texture_desc *desc) {
+	size_t texel = 4;
+	if (desc->format == GL_RGBA16F || desc->format == GL_RG32F || desc->format == GL_DEPTH32F_STENCIL8) {
+		texel = 8;
+	} else if (desc->format == GL_RGBA32F) {
+		texel = 16;
+	} else if (desc->format == GL_R8 || desc->format == GL_R16F || desc->format == GL_DEPTH_COMPONENT16) {
+		texel = desc->format == GL_R8 ? 1 : 2;
+	}
+
+	size_t bytes = 0;
+	int width = desc->width, height = desc->height;
+	for (int level = 0; level < desc->levels; level++) {
+		bytes += (size_t)width * height * texel;
+		width = width > 1 ? width / 2 : 1;
+		height = height > 1 ? height / 2 : 1;
+	}
+	return bytes;
+}
+
+bool same_desc(const graph_texture_desc *a, const graph_texture_desc *b) {
+	return a->format == b->format && a->width == b->width && a->height == b->height && a->levels == b->levels;
+}
+
+GLbitfield barrier_bit(graph_access access) {
+	switch (access) {
+	case GRAPH_READ_TEXTURE: return GL_TEXTURE_FETCH_BARRIER_BIT;
+	case GRAPH_READ_IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	case GRAPH_READ_STORAGE: return GL_SHADER_STORAGE_BARRIER_BIT;
+	case GRAPH_READ_INDIRECT: return GL_COMMAND_BARRIER_BIT;
+	case GRAPH_WRITE_ATTACHMENT: return GL_FRAMEBUFFER_BARRIER_BIT;
+	case GRAPH_WRITE_IMAGE: return GL_SHADER_IMAGE_ACCESS_BARRIER_BIT;
+	case GRAPH_WRITE_STORAGE: return GL_SHADER_STORAGE_BARRIER_BIT;
+	}
+	return 0;
+}
@@ -0,0 +1,193 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory/memory.h>
+
+#include <stdint.h>
+#include <vector>
+
+#define GRAPH_MAX_PASSES 32
+#define GRAPH_MAX_USES 16
+// per frame scratch for compile()
+#define GRAPH_ARENA_SIZE (64 * 1024)
+// frames between issuing a pass' timestamps and reading them back
+#define GRAPH_QUERY_LATENCY 3
+// pooled transient textures and cached framebuffers alive at once
+#define GRAPH_MAX_SLOTS 64
+#define GRAPH_MAX_FRAMEBUFFERS 64
+// frames an unused slot (and a framebuffer built only on slots) is kept for, so a pass
+// that is culled now and then does not recreate its targets on every toggle
+#define GRAPH_RETAIN_FRAMES 8
+#define GRAPH_INVALID 0xffffffffu
+
+typedef uint32_t graph_resource;
+typedef uint32_t graph_pass_handle;
+
+struct frame_graph;
+typedef void (*graph_execute)(frame_graph *graph, void *user);
+
+enum graph_access {
+	GRAPH_READ_TEXTURE,    // sampled / texelFetch
+	GRAPH_READ_IMAGE,      // imageLoad
+	GRAPH_READ_STORAGE,    // SSBO read
+	GRAPH_READ_INDIRECT,   // draw / dispatch arguments
+	GRAPH_WRITE_ATTACHMENT,
+	GRAPH_WRITE_IMAGE,     // imageStore
+	GRAPH_WRITE_STORAGE    // SSBO write
+};
+
+struct graph_texture_desc {
+	GLenum format;
+	int width;
+	int height;
+	int levels;
+	// cleared by the first pass that writes it as an attachment this frame
+	bool clear;
+	glm::vec4 clear_color;
+};
+
+struct graph_use {
+	graph_resource resource;
+	graph_access access;
+};
+
+// names are not copied, string literals or anything else that outlives the graph
+struct graph_pass {
+	const char *name;
+	graph_execute execute;
+	void *user;
+	graph_use uses[GRAPH_MAX_USES];
+	uint32_t use_count;
+	// passes whose results leave the graph some other way (e.g. read back next frame)
+	bool side_effects;
+
+	// filled in by compile()
+	bool culled;
+	GLbitfield barrier;
+	GLuint framebuffer;
+	int width;
+	int height;
+};
+
+struct graph_resource_entry {
+	const char *name;
+	bool texture;
+	bool imported;
+	bool output;
+	graph_texture_desc desc;
+	GLuint object;
+
+	// filled in by compile()
+	int first_use;
+	int last_use;
+	int slot;
+	bool cleared;
+};
+
+// transient textures with the same description and disjoint lifetimes share a slot
+struct graph_pool_slot {
+	graph_texture_desc desc;
+	GLuint texture;
+	size_t bytes;
+	int free_after;
+	bool used;
+	int idle_frames;
+};
+
+// last storage/image write to an imported object, so a read next frame still gets its barrier
+struct graph_object_state {
+	GLuint object;
+	bool texture;
+	graph_access access;
+};
+
+// attachments by name and by what the graph declared them as: an imported texture deleted
+// and recreated by its owner (the window on a resize) can come back under the same name
+struct graph_framebuffer {
+	GLuint color;
+	GLuint depth;
+	GLenum color_format;
+	GLenum depth_format;
+	int width;
+	int height;
+	GLuint framebuffer;
+	// every attachment is a pool slot: kept while idle like the slots, deleted with them.
+	// Anything imported goes the frame it is not used, its owner may recycle the names
+	bool transient;
+	int idle_frames;
+};
+
+struct graph_timing {
+	const char *name;
+	double gpu_ms;
+	bool culled;
+};
+
+// what the overlay and the bench report, copyable so another thread can keep its own
+struct graph_stats {
+	// newest per-pass GPU times, CPU time spent compiling the graph
+	std::vector<graph_timing> timings;
+	double compile_ms;
+
+	// render target memory held by the pool this frame (idle slots included), its peak, and
+	// what this frame's targets would take without aliasing
+	size_t target_bytes;
+	size_t peak_target_bytes;
+	size_t unaliased_bytes;
+	uint32_t barriers;
+};
+
+struct frame_graph {
+	std::vector<graph_pass> passes;
+	std::vector<graph_resource_entry> resources;
+
+	// the wrappers live in fixed size pools and come and go one by one, the vectors only
+	// order them and are reserved up front
+	memory_pool slot_blocks;
+	memory_pool framebuffer_blocks;
+	std::vector<graph_pool_slot *> pool;
+	std::vector<graph_object_state> objects;
+	std::vector<graph_framebuffer *> framebuffers;
+
+	GLuint queries[GRAPH_QUERY_LATENCY][GRAPH_MAX_PASSES * 2];
+	std::vector<graph_timing> pending[GRAPH_QUERY_LATENCY];
+	int frame;
+
+	// declarations are plain data kept in vectors that only grow, compile's temporaries
+	// come from here; a frame that declares the same graph allocates nothing
+	memory_arena arena;
+
+	graph_stats stats;
+};
+
+namespace psygraph {
+	void create(frame_graph *graph);
+	void destroy(frame_graph *graph);
+
+	// starts declaring a new frame, the texture pool and timings carry over
+	void begin(frame_graph *graph);
+
+	graph_resource create_texture(frame_graph *graph, const char *name, const graph_texture_desc *desc);
+	graph_resource import_texture(frame_graph *graph, const char *name, GLuint texture, const graph_texture_desc *desc);
+	graph_resource import_buffer(frame_graph *graph, const char *name, GLuint buffer);
+	// keeps every pass contributing to resource alive
+	void mark_output(frame_graph *graph, graph_resource resource);
+
+	graph_pass_handle add_pass(frame_graph *graph, const char *name, graph_execute execute, void *user);
+	void use(frame_graph *graph, graph_pass_handle pass, graph_resource resource, graph_access access);
+	void set_side_effects(frame_graph *graph, graph_pass_handle pass);
+
+	// culls passes nothing depends on, assigns pool slots, works out barriers and framebuffers
+	void compile(frame_graph *graph);
+	void execute(frame_graph *graph);
+
+	// the GL object behind a resource, valid once compiled
+	GLuint get(frame_graph *graph, graph_resource resource);
+
+	void draw_overlay(const graph_stats *stats);
+
+	// builds a graph of its own and checks transients with disjoint lifetimes share a pool
+	// slot, needs a current context; --check-graph, not part of a normal run
+	bool check_aliasing();
+}
@@ -0,0 +1,46 @@
+#include "graph.h"
+
+#include <stdio.h>
+
+// the frame itself has a single transient, so a graph of its own makes sure transients
+// with disjoint lifetimes end up in one pool slot and overlapping ones do not
+bool psygraph::check_aliasing() {
+	frame_graph graph;
+	psygraph::create(&graph);
+	psygraph::begin(&graph);
+
+	graph_texture_desc desc = {};
+	desc.format = GL_RGBA8;
+	desc.width = 64;
+	desc.height = 64;
+	desc.levels = 1;
+	const graph_resource first = psygraph::create_texture(&graph, "first", &desc);
+	const graph_resource second = psygraph::create_texture(&graph, "second", &desc);
+	const graph_resource third = psygraph::create_texture(&graph, "third", &desc);
+
+	// first lives in passes 0-1, second in 2-4 and third in 3-4; nothing is executed
+	graph_pass_handle pass = psygraph::add_pass(&graph, "write first", nullptr, nullptr);
+	psygraph::use(&graph, pass, first, GRAPH_WRITE_ATTACHMENT);
+	pass = psygraph::add_pass(&graph, "read first", nullptr, nullptr);
+	psygraph::use(&graph, pass, first, GRAPH_READ_TEXTURE);
+	psygraph::set_side_effects(&graph, pass);
+	pass = psygraph::add_pass(&graph, "write second", nullptr, nullptr);
+	psygraph::use(&graph, pass, second, GRAPH_WRITE_ATTACHMENT);
+	pass = psygraph::add_pass(&graph, "write third", nullptr, nullptr);
+	psygraph::use(&graph, pass, third, GRAPH_WRITE_ATTACHMENT);
+	pass = psygraph::add_pass(&graph, "read both", nullptr, nullptr);
+	psygraph::use(&graph, pass, second, GRAPH_READ_TEXTURE);
+	psygraph::use(&graph, pass, third, GRAPH_READ_TEXTURE);
+	psygraph::set_side_effects(&graph, pass);
+	psygraph::compile(&graph);
+
+	const bool aliased = psygraph::get(&graph, first) == psygraph::get(&graph, second) &&
+		psygraph::get(&graph, second) != psygraph::get(&graph, third) &&
+		graph.pool.size() == 2 && graph.stats.target_bytes * 3 == graph.stats.unaliased_bytes * 2;
+	if (!aliased) {
+		fprintf(stderr, "Error: frame graph transients with disjoint lifetimes were not aliased (%zu slots, %zu of %zu bytes)\n",
+			graph.pool.size(), graph.stats.target_bytes, graph.stats.unaliased_bytes);
+	}
+	psygraph::destroy(&graph);
+	return aliased;
+}
@@ -0,0 +1,464 @@
+#include "imgui_backend.h"
+
+#include <bench/bench.h>
+#include <graph/graph.h>
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+
+#include <glm/ext.hpp>
+#include <stb/stb_image_write.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+// layout mandated by glMultiDrawElementsIndirect
+struct draw_elements_indirect_command {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+
+void read_framebuffer(window_state *window, uint8_t *pixels);
+
+namespace psyimgui {
+	void create(imgui_context *imgui, shader_manager *shaders, window_info *info, bool sdf) {
+		// vertex and index buffers are bound per frame from the stream buffer
+		glCreateVertexArrays(1, &imgui->vao);
+
+		glEnableVertexArrayAttrib(imgui->vao, 0);
+		glEnableVertexArrayAttrib(imgui->vao, 1);
+		glEnableVertexArrayAttrib(imgui->vao, 2);
+
+		glVertexArrayAttribFormat(imgui->vao, 0, 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, pos));
+		glVertexArrayAttribFormat(imgui->vao, 1, 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, uv));
+		glVertexArrayAttribFormat(imgui->vao, 2, 4, GL_UNSIGNED_BYTE, GL_TRUE, IM_OFFSETOF(ImDrawVert, col));
+
+		glVertexArrayAttribBinding(imgui->vao, 0, 0);
+		glVertexArrayAttribBinding(imgui->vao, 1, 0);
+		glVertexArrayAttribBinding(imgui->vao, 2, 0);
+
+		imgui->program = psyshader::load(shaders, "imgui.vert", "imgui.frag");
+		imgui->pipeline = psystate::pipeline();
+		imgui->pipeline.vertex_array = imgui->vao;
+		imgui->pipeline.blend = true;
+		imgui->pipeline.blend_src = GL_SRC_ALPHA;
+		imgui->pipeline.blend_dst = GL_ONE_MINUS_SRC_ALPHA;
+		imgui->pipeline.scissor_test = true;
+		imgui->storage_alignment = 0;
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &imgui->storage_alignment);
+		imgui->multi_draws = 0;
+		imgui->multi_draw_commands = 0;
+
+		ImGui::SetAllocatorFunctions(memory_alloc, memory_free, nullptr);
+		ImGui::CreateContext();
+
+		ImGuiIO &io = ImGui::GetIO();
+		io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
+
+		const uint64_t font_start = psybench::ticks();
+		imgui->sdf = sdf && psyfont::create(&imgui->font, "res/fonts/liberation-mono.ttf", 0x20, 0xff, 512);
+
+		ImFontConfig cfg = ImFontConfig();
+		cfg.FontDataOwnedByAtlas = false;
+		unsigned char *pixels = nullptr;
+		int width, height;
+		if (imgui->sdf) {
+			// ImGui only lays the font out, with a single glyph in its atlas; the cache
+			// supplies the rest as they are drawn
+			static const ImWchar space[] = { 0x20, 0x20, 0 };
+			cfg.GlyphRanges = space;
+			cfg.SizePixels = FONT_SDF_SIZE;
+			io.Fonts->Flags |= ImFontAtlasFlags_NoBakedLines;
+			ImFont *font = io.Fonts->AddFontFromMemoryTTF(
+				(void *)imgui->font.file.data,
+				(int)imgui->font.file.size,
+				cfg.SizePixels,
+				&cfg);
+			io.Fonts->GetTexDataAsAlpha8(&pixels, &width, &height);
+			psyfont::install(&imgui->font, font);
+			io.FontDefault = font;
+		} else {
+			cfg.RasterizerMultiply = 1.5f;
+			cfg.SizePixels = (float)info->height / 32.0f;
+			cfg.PixelSnapH = true;
+			cfg.OversampleH = 4;
+			cfg.OversampleV = 4;
+			if (psyvfs::open("res/fonts/liberation-mono.ttf", &imgui->font_file)) {
+				io.FontDefault = io.Fonts->AddFontFromMemoryTTF(
+					(void *)imgui->font_file.data,
+					(int)imgui->font_file.size,
+					cfg.SizePixels,
+					&cfg);
+			} else {
+				fprintf(stderr, "Error: failed to open font res/fonts/liberation-mono.ttf\n");
+			}
+			io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+		}
+
+		glCreateTextures(GL_TEXTURE_2D, 1, &imgui->texture);
+		glTextureParameteri(imgui->texture, GL_TEXTURE_MAX_LEVEL, 0);
+		glTextureParameteri(imgui->texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTextureParameteri(imgui->texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		if (imgui->sdf) {
+			// coverage in red, sampled as white with that alpha like the RGBA atlas
+			const GLint swizzle[4] = { GL_ONE, GL_ONE, GL_ONE, GL_RED };
+			glTextureParameteriv(imgui->texture, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+			glTextureStorage2D(imgui->texture, 1, GL_R8, width, height);
+			glTextureSubImage2D(imgui->texture, 0, 0, 0, width, height, GL_RED, GL_UNSIGNED_BYTE, pixels);
+			imgui->font_bytes = (size_t)width * height + imgui->font.stats.atlas_bytes;
+		} else {
+			glTextureStorage2D(imgui->texture, 1, GL_RGBA8, width, height);
+			glTextureSubImage2D(
+				imgui->texture, 0,
+				0, 0,
+				width, height,
+				GL_RGBA,
+				GL_UNSIGNED_BYTE,
+				pixels);
+			imgui->font_bytes = (size_t)width * height * 4;
+		}
+		imgui->font_ms = psybench::ticks_to_ms(psybench::ticks() - font_start);
+
+		io.Fonts->TexID = (ImTextureID)(intptr_t)imgui->texture;
+		io.DisplayFramebufferScale = ImVec2(1, 1);
+
+		imgui->indirect = true;
+	}
+
+	void destroy(imgui_context *imgui) {
+		ImGui::DestroyContext();
+		if (imgui->sdf) {
+			psyfont::destroy(&imgui->font);
+		}
+		psyvfs::close(&imgui->font_file);
+		psystate::forget(imgui->texture);
+		psystate::forget(imgui->vao);
+		glDeleteTextures(1, &imgui->texture);
+		glDeleteVertexArrays(1, &imgui->vao);
+	}
+
+	void new_frame(imgui_context *imgui, window_info *info, frame_feedback *feedback, cull_mode *culling, bool *hiz, bool *state_cache) {
+		PSY_PROFILE_SCOPE("psyimgui::new_frame");
+
+		ImGuiIO &io = ImGui::GetIO();
+		io.DisplaySize = ImVec2((float)info->width, (float)info->height);
+		if (imgui->sdf) {
+			// the baked font was sized for the window it started in, this one follows resizes
+			io.FontGlobalScale = (float)info->height / 32.0f / FONT_SDF_SIZE;
+		}
+		ImGui::NewFrame();
+#ifdef PSY_ENABLE_PROFILER
+		if (psyprofiler::overlay_enabled()) {
+			psyprofiler::draw_overlay();
+		} else {
+			ImGui::ShowDemoWindow();
+		}
+#else
+		ImGui::ShowDemoWindow();
+#endif
+		psycull::draw_overlay(&feedback->cull, culling, hiz);
+		psygraph::draw_overlay(&feedback->graph);
+		psystate::draw_overlay(&feedback->state, state_cache);
+		const memory_arena *arenas[] = { &feedback->graph_arena };
+		const char *arena_names[] = { "graph" };
+		psymemory::draw_overlay(arenas, arena_names, 1);
+		if (ImGui::Begin("Threads")) {
+			ImGui::Text("render thread %.3f ms", feedback->render_ms);
+			ImGui::Text("main thread waited %.3f ms", feedback->wait_ms);
+			ImGui::Text("input to present %.3f ms", feedback->latency_ms);
+			ImGui::Text("capture %.3f ms, %u queued%s", feedback->capture.gl_ms, feedback->capture.queued, feedback->recording ? ", recording (F5)" : "");
+			if (imgui->sdf) {
+				const font_stats *font = &imgui->font.stats;
+				ImGui::Text("glyphs %.3f ms, %u resident, %u rasterized, %u evicted", font->update_ms, font->resident, font->rasterized, font->evicted);
+			}
+		}
+		ImGui::End();
+		if (imgui->text_lines > 0) {
+			draw_text_stress(imgui->text_lines);
+		}
+		ImGui::Render();
+	}
+
+	// a full window of text cycling through sizes, only ImGui's own culling skips any of it
+	void draw_text_stress(int lines) {
+		const ImGuiIO &io = ImGui::GetIO();
+		ImGui::SetNextWindowPos(ImVec2(0.0f, 0.0f));
+		ImGui::SetNextWindowSize(io.DisplaySize);
+		if (ImGui::Begin("Text", nullptr, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoBackground)) {
+			const float scales[] = { 0.75f, 1.0f, 1.5f, 2.5f };
+			for (int i = 0; i < lines; i++) {
+				ImGui::SetWindowFontScale(scales[i % 4]);
+				ImGui::Text("%05d The quick brown fox jumps over the lazy dog 0123456789 {}[]<>!?", i);
+			}
+			ImGui::SetWindowFontScale(1.0f);
+		}
+		ImGui::End();
+	}
+
+	template<typename T>
+	void copy_vector(ImVector<T> *dst, const ImVector<T> *src) {
+		dst->resize(src->Size);
+		if (src->Size) {
+			memcpy(dst->Data, src->Data, (size_t)src->Size * sizeof(T));
+		}
+	}
+
+	// lists past CmdListsCount stay allocated for a later frame with more windows, and
+	// every buffer only ever grows, so once the UI settles this copies without allocating
+	void copy_draw_data(ImDrawData *dst) {
+		PSY_PROFILE_SCOPE("psyimgui::copy_draw_data");
+		PSY_MEMORY_SCOPE(MEMORY_TAG_IMGUI);
+
+		const ImDrawData *src = ImGui::GetDrawData();
+		dst->Valid = src->Valid;
+		dst->CmdListsCount = src->CmdListsCount;
+		dst->TotalIdxCount = src->TotalIdxCount;
+		dst->TotalVtxCount = src->TotalVtxCount;
+		dst->DisplayPos = src->DisplayPos;
+		dst->DisplaySize = src->DisplaySize;
+		dst->FramebufferScale = src->FramebufferScale;
+		dst->OwnerViewport = src->OwnerViewport;
+		while (dst->CmdLists.Size < src->CmdListsCount) {
+			dst->CmdLists.push_back(IM_NEW(ImDrawList)(nullptr));
+		}
+		for (int i = 0; i < src->CmdListsCount; i++) {
+			ImDrawList *list = dst->CmdLists[i];
+			const ImDrawList *source = src->CmdLists[i];
+			copy_vector(&list->CmdBuffer, &source->CmdBuffer);
+			copy_vector(&list->IdxBuffer, &source->IdxBuffer);
+			copy_vector(&list->VtxBuffer, &source->VtxBuffer);
+			list->Flags = source->Flags;
+		}
+	}
+
+	void free_draw_data(ImDrawData *draw_data) {
+		for (int i = 0; i < draw_data->CmdLists.Size; i++) {
+			IM_DELETE(draw_data->CmdLists[i]);
+		}
+		draw_data->Clear();
+		draw_data->CmdLists.clear();
+	}
+
+	void *memory_alloc(size_t size, void *) {
+		return psymemory::allocate(size, MEMORY_TAG_IMGUI);
+	}
+
+	void memory_free(void *pointer, void *) {
+		psymemory::release(pointer);
+	}
+
+	void render(imgui_context *imgui, shader_manager *shaders, stream_buffer *stream, GLuint per_frame_data_buffer, const ImDrawData *draw_data, const window_info *info) {
+		PSY_PROFILE_GPU_SCOPE("psyimgui::render");
+
+		const float left = draw_data->DisplayPos.x;
+		const float right = draw_data->DisplayPos.x + draw_data->DisplaySize.x;
+		const float top = draw_data->DisplayPos.y;
+		const float bottom = draw_data->DisplayPos.y + draw_data->DisplaySize.y;
+		const glm::mat4 ortho_projection = glm::ortho(left, right, bottom, top);
+
+		per_frame_data frame_data = {};
+		frame_data.mvp = ortho_projection;
+		frame_data.is_wire_frame = false;
+
+		imgui->pipeline.program = psyshader::get(shaders, imgui->program);
+		psystate::apply(&imgui->pipeline);
+		psystate::bind_texture(0, imgui->texture);
+		if (imgui->sdf) {
+			psyfont::bind(&imgui->font);
+		}
+
+		glNamedBufferSubData(per_frame_data_buffer, 0, sizeof(per_frame_data), &frame_data);
+
+		if (draw_data->TotalVtxCount == 0) {
+			psystate::scissor(0, 0, info->width, info->height);
+			return;
+		}
+
+		// every command list goes into one contiguous write: all vertices, then all
+		// indices (a multiple of sizeof(ImDrawVert) keeps them 2-byte aligned), then
+		// the indirect commands; clip rects go in their own allocation for the SSBO
+		// alignment, one per command, read by the shader at the command's base instance
+		int cmd_count = 0;
+		for (int i = 0; i < draw_data->CmdListsCount; i++) {
+			cmd_count += draw_data->CmdLists[i]->CmdBuffer.Size;
+		}
+		const GLsizeiptr vtx_size = (GLsizeiptr)draw_data->TotalVtxCount * sizeof(ImDrawVert);
+		const GLsizeiptr idx_size = (GLsizeiptr)draw_data->TotalIdxCount * sizeof(ImDrawIdx);
+		const GLsizeiptr cmd_begin = (vtx_size + idx_size + 3) & ~(GLsizeiptr)3;
+		const GLsizeiptr cmd_size = imgui->indirect ? cmd_count * sizeof(draw_elements_indirect_command) : 0;
+		stream_allocation upload = {};
+		stream_allocation clips = {};
+		{
+			PSY_PROFILE_SCOPE("imgui upload");
+			upload = psybuffer::allocate(stream, cmd_begin + cmd_size, sizeof(ImDrawVert));
+			clips = psybuffer::allocate(stream, cmd_count * sizeof(glm::vec4), imgui->storage_alignment);
+
+			ImDrawVert *vtx_dst = (ImDrawVert *)upload.pointer;
+			ImDrawIdx *idx_dst = (ImDrawIdx *)((uint8_t *)upload.pointer + vtx_size);
+			for (int i = 0; i < draw_data->CmdListsCount; i++) {
+				const ImDrawList *cmd_list = draw_data->CmdLists[i];
+				memcpy(vtx_dst, cmd_list->VtxBuffer.Data, cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+				memcpy(idx_dst, cmd_list->IdxBuffer.Data, cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
+				vtx_dst += cmd_list->VtxBuffer.Size;
+				idx_dst += cmd_list->IdxBuffer.Size;
+			}
+
+			// in window coordinates like the scissor box, the fragment shader discards outside
+			glm::vec4 *clip_dst = (glm::vec4 *)clips.pointer;
+			for (int i = 0; i < draw_data->CmdListsCount; i++) {
+				const ImDrawList *cmd_list = draw_data->CmdLists[i];
+				for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
+					const ImVec4 clip_rect = cmd_list->CmdBuffer[cmd_i].ClipRect;
+					*clip_dst++ = glm::vec4(
+						(float)(int)clip_rect.x, (float)(int)(info->height - clip_rect.w),
+						(float)(int)clip_rect.z, (float)(int)(info->height - clip_rect.y));
+				}
+			}
+		}
+		const GLintptr idx_offset = upload.offset + vtx_size;
+		psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, IMGUI_CLIP_BINDING, clips.buffer, clips.offset, cmd_count * sizeof(glm::vec4));
+
+		glVertexArrayVertexBuffer(imgui->vao, 0, upload.buffer, upload.offset, sizeof(ImDrawVert));
+		glVertexArrayElementBuffer(imgui->vao, upload.buffer);
+
+		if (imgui->indirect) {
+			// one indirect command per ImDrawCmd, consecutive commands sharing a texture
+			// are submitted as a single multi-draw whatever their clip rects; order is
+			// kept so blending stays identical to the direct path
+			draw_elements_indirect_command *commands = (draw_elements_indirect_command *)((uint8_t *)upload.pointer + cmd_begin);
+			const GLintptr cmd_offset = upload.offset + cmd_begin;
+			psystate::bind_indirect_buffer(upload.buffer);
+			psystate::scissor(0, 0, info->width, info->height);
+
+			GLuint bound_texture = 0;
+			int run_begin = 0;
+			int command = 0;
+			int clip = 0;
+
+			int global_vtx_offset = 0;
+			int global_idx_offset = 0;
+			for (int i = 0; i < draw_data->CmdListsCount; i++) {
+				const ImDrawList *cmd_list = draw_data->CmdLists[i];
+				for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++, clip++) {
+					const ImDrawCmd *pcmd = &cmd_list->CmdBuffer[cmd_i];
+					if (pcmd->ElemCount == 0) {
+						continue;
+					}
+
+					const GLuint texture = (GLuint)(intptr_t)pcmd->TextureId;
+					if (texture != bound_texture) {
+						if (command > run_begin) {
+							glMultiDrawElementsIndirect(
+								GL_TRIANGLES,
+								GL_UNSIGNED_SHORT,
+								(void *)(intptr_t)(cmd_offset + run_begin * sizeof(draw_elements_indirect_command)),
+								command - run_begin,
+								0);
+							imgui->multi_draws++;
+							imgui->multi_draw_commands += command - run_begin;
+						}
+						run_begin = command;
+						psystate::bind_texture(0, texture);
+						bound_texture = texture;
+					}
+
+					draw_elements_indirect_command *dst = &commands[command++];
+					dst->count = pcmd->ElemCount;
+					dst->instance_count = 1;
+					dst->first_index = (GLuint)(idx_offset / sizeof(ImDrawIdx)) + global_idx_offset + pcmd->IdxOffset;
+					dst->base_vertex = (GLint)(global_vtx_offset + pcmd->VtxOffset);
+					dst->base_instance = (GLuint)clip;
+				}
+				global_vtx_offset += cmd_list->VtxBuffer.Size;
+				global_idx_offset += cmd_list->IdxBuffer.Size;
+			}
+
+			if (command > run_begin) {
+				glMultiDrawElementsIndirect(
+					GL_TRIANGLES,
+					GL_UNSIGNED_SHORT,
+					(void *)(intptr_t)(cmd_offset + run_begin * sizeof(draw_elements_indirect_command)),
+					command - run_begin,
+					0);
+				imgui->multi_draws++;
+				imgui->multi_draw_commands += command - run_begin;
+			}
+		} else {
+			// the reference path: scissor per command as well, so --imgui-diff checks the
+			// shader's clipping against it
+			int global_vtx_offset = 0;
+			int global_idx_offset = 0;
+			int clip = 0;
+			for (int i = 0; i < draw_data->CmdListsCount; i++) {
+				const ImDrawList *cmd_list = draw_data->CmdLists[i];
+				for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++, clip++) {
+					const ImDrawCmd *pcmd = &cmd_list->CmdBuffer[cmd_i];
+					const ImVec4 clip_rect = pcmd->ClipRect;
+					psystate::scissor((int)clip_rect.x, (int)(info->height - clip_rect.w), (int)(clip_rect.z - clip_rect.x), (int)(clip_rect.w - clip_rect.y));
+					psystate::bind_texture(0, (GLuint)(intptr_t)pcmd->TextureId);
+					glDrawElementsInstancedBaseVertexBaseInstance(
+						GL_TRIANGLES,
+						(GLsizei)pcmd->ElemCount,
+						GL_UNSIGNED_SHORT,
+						(void *)(intptr_t)(idx_offset + (global_idx_offset + pcmd->IdxOffset) * sizeof(ImDrawIdx)),
+						1,
+						(GLint)(global_vtx_offset + pcmd->VtxOffset),
+						(GLuint)clip);
+				}
+				global_vtx_offset += cmd_list->VtxBuffer.Size;
+				global_idx_offset += cmd_list->IdxBuffer.Size;
+			}
+		}
+
+		psystate::scissor(0, 0, info->width, info->height);
+	}
+}
+
+int psyimgui::compare_paths(imgui_context *imgui, window_state *window, shader_manager *shaders, stream_buffer *stream, GLuint per_frame_data_buffer, const ImDrawData *draw_data, const window_info *info) {
+	const int width = window->framebuffer_width;
+	const int height = window->framebuffer_height;
+	const bool indirect = imgui->indirect;
+
+	std::vector<uint8_t> captures[2];
+	const char *paths[2] = { "imgui_direct.png", "imgui_indirect.png" };
+	for (int pass = 0; pass < 2; pass++) {
+		imgui->indirect = pass == 1;
+		psystate::disable(GL_SCISSOR_TEST);
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		psyimgui::render(imgui, shaders, stream, per_frame_data_buffer, draw_data, info);
+
+		captures[pass].resize((size_t)width * height * 4);
+		read_framebuffer(window, captures[pass].data());
+		stbi_write_png(paths[pass], width, height, 4, captures[pass].data(), 0);
+	}
+	imgui->indirect = indirect;
+
+	int mismatched = 0;
+	std::vector<uint8_t> diff((size_t)width * height * 4, 0);
+	for (int i = 0; i < width * height; i++) {
+		if (memcmp(&captures[0][i * 4], &captures[1][i * 4], 4)) {
+			diff[i * 4 + 0] = 255;
+			mismatched++;
+		}
+		diff[i * 4 + 3] = 255;
+	}
+
+	if (mismatched) {
+		stbi_write_png("imgui_diff.png", width, height, 4, diff.data(), 0);
+		fprintf(stderr, "imgui diff: %d pixels differ between direct and indirect paths (see imgui_diff.png)\n", mismatched);
+	} else {
+		printf("imgui diff: direct and indirect paths are pixel-identical\n");
+	}
+	return mismatched;
+}
+
+void read_framebuffer(window_state *window, uint8_t *pixels) {
+	glNamedFramebufferReadBuffer(window->framebuffer, GL_COLOR_ATTACHMENT0);
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, window->framebuffer);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, window->framebuffer_width, window->framebuffer_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
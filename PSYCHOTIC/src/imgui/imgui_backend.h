@@ -0,0 +1,63 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <buffer/buffer.h>
+#include <cull/cull.h>
+#include <font/font.h>
+#include <frame/frame.h>
+#include <shader/shader.h>
+#include <state/state.h>
+#include <vfs/vfs.h>
+#include <window/window.h>
+
+#include <imgui.h>
+
+#include <stddef.h>
+#include <stdint.h>
+
+// per command clip rects of the ImGui shaders, past the light bindings
+#define IMGUI_CLIP_BINDING 10
+
+struct imgui_context {
+	GLuint vao;
+	shader_handle program;
+	state_pipeline pipeline;
+	// ImGui's atlas: all glyphs when baked, otherwise just the white pixel and cursors
+	GLuint texture;
+	// coalesce command lists into glMultiDrawElementsIndirect runs instead of
+	// one glDrawElementsBaseVertex per ImDrawCmd
+	bool indirect;
+	// stream allocation alignment of the clip rects, queried once
+	GLint storage_alignment;
+	// indirect path totals, the bench reports commands per glMultiDrawElementsIndirect
+	uint64_t multi_draws;
+	uint64_t multi_draw_commands;
+
+	// glyphs are rasterized into the font cache on first use and drawn at any size
+	bool sdf;
+	font_cache font;
+	// the baked atlas's TrueType data, ImGui reads it in place until the atlas is destroyed
+	vfs_file font_file;
+	int text_lines;
+	// building and uploading the atlas, and what it takes on the GPU
+	double font_ms;
+	size_t font_bytes;
+};
+
+namespace psyimgui {
+	void create(imgui_context *imgui, shader_manager *shaders, window_info *info, bool sdf);
+	void destroy(imgui_context *imgui);
+	void new_frame(imgui_context *imgui, window_info *info, frame_feedback *feedback, cull_mode *culling, bool *hiz, bool *state_cache);
+	// --text-stress: lines of text over the whole window
+	void draw_text_stress(int lines);
+	// deep copies the draw data of the last ImGui::Render(), reusing what dst held before
+	void copy_draw_data(ImDrawData *dst);
+	void free_draw_data(ImDrawData *draw_data);
+	// ImGui's allocator, so its allocations are counted under MEMORY_TAG_IMGUI
+	void *memory_alloc(size_t size, void *user);
+	void memory_free(void *pointer, void *user);
+	void render(imgui_context *imgui, shader_manager *shaders, stream_buffer *stream, GLuint per_frame_data_buffer, const ImDrawData *draw_data, const window_info *info);
+	// --imgui-diff: draws draw_data through both paths into the window, writes the captures
+	// out and returns the number of pixels that differ
+	int compare_paths(imgui_context *imgui, window_state *window, shader_manager *shaders, stream_buffer *stream, GLuint per_frame_data_buffer, const ImDrawData *draw_data, const window_info *info);
+}
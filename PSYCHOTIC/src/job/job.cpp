@@ -0,0 +1,152 @@
+#include "job.h"
+
+#include <profiler/profiler.h>
+
+// index of the calling thread's own queue, -1 outside the pool
+static thread_local int worker_index = -1;
+
+void job_worker(job_system *system, int index);
+bool run_one(job_system *system, int index);
+bool pop_job(job_system *system, int index, job *out);
+
+void psyjob::create(job_system *system, int worker_count) {
+	worker_count = worker_count > 0 ? worker_count : 0;
+	system->queue_count = (uint32_t)worker_count + 1;
+	system->queues.reset(new job_queue[system->queue_count]);
+	for (uint32_t i = 0; i < system->queue_count; i++) {
+		system->queues[i].head = 0;
+		system->queues[i].tail = 0;
+	}
+	system->queued = 0;
+	system->quit = false;
+	system->executed = 0;
+	system->stolen = 0;
+
+	for (int i = 0; i < worker_count; i++) {
+		system->workers.emplace_back(job_worker, system, i);
+	}
+}
+
+void psyjob::destroy(job_system *system) {
+	{
+		std::lock_guard<std::mutex> guard(system->sleep_lock);
+		system->quit = true;
+	}
+	system->wake.notify_all();
+	for (std::thread &worker : system->workers) {
+		worker.join();
+	}
+	system->workers.clear();
+	system->queues.reset();
+}
+
+void psyjob::run(job_system *system, job_function function, void *data, uint32_t begin, uint32_t end, std::atomic<uint32_t> *counter) {
+	job entry = {};
+	entry.function = function;
+	entry.data = data;
+	entry.begin = begin;
+	entry.end = end;
+	entry.counter = counter;
+
+	const int index = worker_index >= 0 ? worker_index : (int)system->queue_count - 1;
+	bool queued = false;
+	{
+		job_queue *queue = &system->queues[index];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		if (queue->head - queue->tail < JOB_QUEUE_SIZE) {
+			queue->jobs[queue->head % JOB_QUEUE_SIZE] = entry;
+			queue->head++;
+			queued = true;
+		}
+	}
+	if (!queued) {
+		function(data, begin, end);
+		system->executed++;
+		counter->fetch_sub(1);
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> guard(system->sleep_lock);
+		system->queued++;
+	}
+	system->wake.notify_one();
+}
+
+void psyjob::wait(job_system *system, std::atomic<uint32_t> *counter) {
+	const int index = worker_index >= 0 ? worker_index : (int)system->queue_count - 1;
+	while (counter->load() > 0) {
+		if (!run_one(system, index)) {
+			std::this_thread::yield();
+		}
+	}
+}
+
+void psyjob::parallel_for(job_system *system, uint32_t count, uint32_t batch, job_function function, void *data) {
+	if (count == 0) {
+		return;
+	}
+	batch = batch > 0 ? batch : 1;
+
+	std::atomic<uint32_t> counter((count + batch - 1) / batch);
+	for (uint32_t begin = 0; begin < count; begin += batch) {
+		const uint32_t end = count - begin > batch ? begin + batch : count;
+		psyjob::run(system, function, data, begin, end, &counter);
+	}
+	psyjob::wait(system, &counter);
+}
+
+void job_worker(job_system *system, int index) {
+	worker_index = index;
+	for (;;) {
+		if (run_one(system, index)) {
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(system->sleep_lock);
+		system->wake.wait(guard, [system] { return system->quit || system->queued > 0; });
+		if (system->quit) {
+			return;
+		}
+	}
+}
+
+bool run_one(job_system *system, int index) {
+	job entry = {};
+	if (!pop_job(system, index, &entry)) {
+		return false;
+	}
+	system->queued--;
+
+	{
+		PSY_PROFILE_SCOPE("job");
+		entry.function(entry.data, entry.begin, entry.end);
+	}
+	system->executed++;
+	entry.counter->fetch_sub(1);
+	return true;
+}
+
+// own queue newest first while it is still in cache, then the oldest job of anyone else
+bool pop_job(job_system *system, int index, job *out) {
+	{
+		job_queue *queue = &system->queues[index];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		if (queue->head != queue->tail) {
+			queue->head--;
+			*out = queue->jobs[queue->head % JOB_QUEUE_SIZE];
+			return true;
+		}
+	}
+
+	for (uint32_t i = 1; i < system->queue_count; i++) {
+		job_queue *queue = &system->queues[(index + i) % system->queue_count];
+		std::lock_guard<std::mutex> guard(queue->lock);
+		if (queue->head != queue->tail) {
+			*out = queue->jobs[queue->tail % JOB_QUEUE_SIZE];
+			queue->tail++;
+			system->stolen++;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// jobs one queue holds, run() executes a job inline instead of queueing it past this
+#define JOB_QUEUE_SIZE 1024
+
+typedef void (*job_function)(void *data, uint32_t begin, uint32_t end);
+
+struct job {
+	job_function function;
+	void *data;
+	uint32_t begin;
+	uint32_t end;
+	// decremented once the job ran, wait() returns when it reaches zero
+	std::atomic<uint32_t> *counter;
+};
+
+// the owner pushes and pops at the back (head), thieves take from the front (tail);
+// a fixed ring so queueing never touches the heap
+struct job_queue {
+	std::mutex lock;
+	job jobs[JOB_QUEUE_SIZE];
+	uint32_t head;
+	uint32_t tail;
+};
+
+struct job_system {
+	std::vector<std::thread> workers;
+	// one per worker, plus a shared one for threads outside the pool (main, render)
+	std::unique_ptr<job_queue[]> queues;
+	uint32_t queue_count;
+
+	std::mutex sleep_lock;
+	std::condition_variable wake;
+	std::atomic<int> queued;
+	bool quit;
+
+	std::atomic<uint64_t> executed;
+	std::atomic<uint64_t> stolen;
+};
+
+namespace psyjob {
+	// worker_count 0 runs everything on the calling thread inside wait()
+	void create(job_system *system, int worker_count);
+	void destroy(job_system *system);
+
+	void run(job_system *system, job_function function, void *data, uint32_t begin, uint32_t end, std::atomic<uint32_t> *counter);
+	// runs other jobs while waiting, so it is safe to call from inside a job
+	void wait(job_system *system, std::atomic<uint32_t> *counter);
+
+	// splits [0, count) into batch sized jobs and waits for all of them
+	void parallel_for(job_system *system, uint32_t count, uint32_t batch, job_function function, void *data);
+}
@@ -0,0 +1,228 @@
+#include "light.h"
+
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+
+#include <glm/ext.hpp>
+
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+float light_random(uint32_t *state);
+void collect_light_readback(light_context *lights, int slot);
+bool light_queries_ready(const GLuint *queries);
+
+// counts, ids, then the overflow counter
+static const GLsizeiptr cluster_buffer_size = (GLsizeiptr)(LIGHT_CLUSTER_COUNT * (LIGHT_CLUSTER_MAX + 1) + 1) * sizeof(GLuint);
+static const GLintptr overflow_offset = cluster_buffer_size - sizeof(GLuint);
+
+void psylight::create(light_context *lights, shader_manager *shaders) {
+	lights->mode = LIGHT_MODE_CLUSTERED;
+	lights->shaders = shaders;
+	lights->transform_program = psyshader::load_compute(shaders, "light_transform.comp");
+	lights->bin_program = psyshader::load_compute(shaders, "light_bin.comp");
+	lights->count = 0;
+	lights->capacity = 0;
+	lights->light_buffer = 0;
+	lights->view_buffer = 0;
+	lights->frame_buffer = 0;
+	lights->frame_offset = 0;
+	lights->frame = 0;
+	lights->stats = {};
+	lights->uniform_alignment = 0;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &lights->uniform_alignment);
+
+	glCreateBuffers(1, &lights->cluster_buffer);
+	glNamedBufferStorage(lights->cluster_buffer, cluster_buffer_size, nullptr, GL_DYNAMIC_STORAGE_BIT);
+
+	const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &lights->readback_buffer);
+	glNamedBufferStorage(lights->readback_buffer, sizeof(uint32_t) * LIGHT_READBACK_LATENCY, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+	lights->readback = (uint32_t *)glMapNamedBufferRange(lights->readback_buffer, 0, sizeof(uint32_t) * LIGHT_READBACK_LATENCY, flags);
+
+	glCreateQueries(GL_TIMESTAMP, LIGHT_READBACK_LATENCY * 2, lights->queries);
+	for (int i = 0; i < LIGHT_READBACK_LATENCY; i++) {
+		lights->readback_fences[i] = 0;
+		lights->pending[i] = false;
+	}
+
+	// the frame graph imports the light buffers before any light exists
+	psylight::set_lights(lights, 0, 1.0f);
+}
+
+void psylight::destroy(light_context *lights) {
+	for (int i = 0; i < LIGHT_READBACK_LATENCY; i++) {
+		if (lights->readback_fences[i]) {
+			glDeleteSync(lights->readback_fences[i]);
+		}
+	}
+	glDeleteQueries(LIGHT_READBACK_LATENCY * 2, lights->queries);
+	glUnmapNamedBuffer(lights->readback_buffer);
+	psystate::forget(lights->cluster_buffer);
+	psystate::forget(lights->view_buffer);
+	psystate::forget(lights->light_buffer);
+	glDeleteBuffers(1, &lights->readback_buffer);
+	glDeleteBuffers(1, &lights->cluster_buffer);
+	glDeleteBuffers(1, &lights->view_buffer);
+	glDeleteBuffers(1, &lights->light_buffer);
+}
+
+void psylight::set_lights(light_context *lights, uint32_t count, float half_extent) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_LIGHT);
+	PSY_PROFILE_SCOPE("psylight::set_lights");
+
+	if (count > lights->capacity || !lights->light_buffer) {
+		const uint32_t capacity = count > 0 ? count : 1;
+		psystate::forget(lights->light_buffer);
+		psystate::forget(lights->view_buffer);
+		glDeleteBuffers(1, &lights->light_buffer);
+		glDeleteBuffers(1, &lights->view_buffer);
+		glCreateBuffers(1, &lights->light_buffer);
+		glCreateBuffers(1, &lights->view_buffer);
+		glNamedBufferStorage(lights->light_buffer, (GLsizeiptr)capacity * sizeof(light_source), nullptr, GL_DYNAMIC_STORAGE_BIT);
+		glNamedBufferStorage(lights->view_buffer, (GLsizeiptr)capacity * sizeof(light_source), nullptr, 0);
+		lights->capacity = capacity;
+	}
+	lights->count = count;
+	lights->stats.lights = count;
+	if (!count) {
+		return;
+	}
+
+	// fewer lights reach further, so the picture keeps about the same brightness
+	const float volume = 8.0f * half_extent * half_extent * half_extent;
+	const float sphere = LIGHT_COVERAGE * volume / (float)count;
+	const float radius = glm::min(cbrtf(sphere * 3.0f / (4.0f * glm::pi<float>())), half_extent * 2.0f);
+
+	std::vector<light_source> sources(count);
+	uint32_t state = 0x2545f491u;
+	for (uint32_t i = 0; i < count; i++) {
+		light_source &light = sources[i];
+		light.position = (glm::vec3(light_random(&state), light_random(&state), light_random(&state)) * 2.0f - 1.0f) * half_extent;
+		light.radius = radius;
+		// bright, saturated hues
+		const float hue = light_random(&state) * 6.0f;
+		light.color = glm::clamp(glm::vec3(fabsf(hue - 3.0f) - 1.0f, 2.0f - fabsf(hue - 2.0f), 2.0f - fabsf(hue - 4.0f)), 0.0f, 1.0f);
+
+		// every other light is a spot pointing somewhere random
+		if (i & 1) {
+			const float z = light_random(&state) * 2.0f - 1.0f;
+			const float angle = light_random(&state) * 2.0f * glm::pi<float>();
+			const float r = sqrtf(1.0f - z * z);
+			light.direction = glm::vec3(r * cosf(angle), r * sinf(angle), z);
+			light.cos_inner = cosf(glm::radians(25.0f));
+			light.cos_outer = cosf(glm::radians(35.0f));
+		} else {
+			light.direction = glm::vec3(0.0f, 0.0f, -1.0f);
+			light.cos_inner = -1.0f;
+			light.cos_outer = -2.0f;
+		}
+	}
+	glNamedBufferSubData(lights->light_buffer, 0, (GLsizeiptr)count * sizeof(light_source), sources.data());
+}
+
+void psylight::bin(light_context *lights, stream_buffer *stream, const glm::mat4 &view, const glm::mat4 &projection, float z_near, float z_far, int width, int height) {
+	PSY_PROFILE_GPU_SCOPE("psylight::bin");
+
+	const int slot = lights->frame % LIGHT_READBACK_LATENCY;
+	collect_light_readback(lights, slot);
+
+	stream_allocation allocation = psybuffer::allocate(stream, sizeof(light_frame_data), lights->uniform_alignment);
+	light_frame_data *data = (light_frame_data *)allocation.pointer;
+	data->view = view;
+	data->inverse_projection = glm::inverse(projection);
+	data->screen_size = glm::vec2((float)width, (float)height);
+	data->z_near = z_near;
+	data->z_far = z_far;
+	data->grid_x = LIGHT_GRID_X;
+	data->grid_y = LIGHT_GRID_Y;
+	data->grid_z = LIGHT_GRID_Z;
+	data->light_count = lights->count;
+	data->mode = lights->count ? lights->mode : LIGHT_MODE_OFF;
+	data->cluster_max = LIGHT_CLUSTER_MAX;
+	lights->frame_buffer = allocation.buffer;
+	lights->frame_offset = allocation.offset;
+
+	if (data->mode == LIGHT_MODE_OFF) {
+		lights->stats.bin_ms = 0.0;
+		lights->stats.overflow = 0;
+		return;
+	}
+
+	psylight::bind(lights);
+	psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, LIGHT_WORLD_BINDING, lights->light_buffer, 0, (GLsizeiptr)lights->capacity * sizeof(light_source));
+
+	glQueryCounter(lights->queries[slot * 2 + 0], GL_TIMESTAMP);
+	psystate::use_program(psyshader::get(lights->shaders, lights->transform_program));
+	glDispatchCompute((lights->count + LIGHT_GROUP_SIZE - 1) / LIGHT_GROUP_SIZE, 1, 1);
+
+	if (lights->mode == LIGHT_MODE_CLUSTERED) {
+		const GLuint zero = 0;
+		glClearNamedBufferSubData(lights->cluster_buffer, GL_R32UI, overflow_offset, sizeof(GLuint), GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		psystate::use_program(psyshader::get(lights->shaders, lights->bin_program));
+		glDispatchCompute((LIGHT_CLUSTER_COUNT + LIGHT_GROUP_SIZE - 1) / LIGHT_GROUP_SIZE, 1, 1);
+
+		// the shading passes get their barrier from the frame graph, the copy is ours
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glCopyNamedBufferSubData(lights->cluster_buffer, lights->readback_buffer, overflow_offset, slot * sizeof(uint32_t), sizeof(uint32_t));
+	}
+	glQueryCounter(lights->queries[slot * 2 + 1], GL_TIMESTAMP);
+	lights->pending[slot] = true;
+}
+
+void psylight::bind(light_context *lights) {
+	psystate::bind_buffer_range(GL_UNIFORM_BUFFER, LIGHT_UNIFORM_BINDING, lights->frame_buffer, lights->frame_offset, sizeof(light_frame_data));
+	psystate::bind_buffer_range(GL_SHADER_STORAGE_BUFFER, LIGHT_VIEW_BINDING, lights->view_buffer, 0, (GLsizeiptr)lights->capacity * sizeof(light_source));
+	psystate::bind_buffer_base(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_BINDING, lights->cluster_buffer);
+}
+
+void psylight::end_frame(light_context *lights) {
+	const int slot = lights->frame % LIGHT_READBACK_LATENCY;
+	if (lights->pending[slot] && lights->mode == LIGHT_MODE_CLUSTERED) {
+		if (lights->readback_fences[slot]) {
+			glDeleteSync(lights->readback_fences[slot]);
+		}
+		lights->readback_fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	lights->frame++;
+}
+
+// xorshift32 mapped to [0, 1)
+float light_random(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// never waits, results the GPU has not finished are dropped and the previous stats stay
+void collect_light_readback(light_context *lights, int slot) {
+	if (lights->readback_fences[slot]) {
+		const GLenum status = glClientWaitSync(lights->readback_fences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		glDeleteSync(lights->readback_fences[slot]);
+		lights->readback_fences[slot] = 0;
+		if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED) {
+			lights->stats.overflow = lights->readback[slot];
+		}
+	}
+
+	if (lights->pending[slot] && light_queries_ready(&lights->queries[slot * 2])) {
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(lights->queries[slot * 2 + 0], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(lights->queries[slot * 2 + 1], GL_QUERY_RESULT, &end);
+		lights->stats.bin_ms = (end - begin) / 1e6;
+	}
+	lights->pending[slot] = false;
+}
+
+bool light_queries_ready(const GLuint *queries) {
+	GLint begin = 0, end = 0;
+	glGetQueryObjectiv(queries[0], GL_QUERY_RESULT_AVAILABLE, &begin);
+	glGetQueryObjectiv(queries[1], GL_QUERY_RESULT_AVAILABLE, &end);
+	return begin && end;
+}
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <buffer/buffer.h>
+#include <shader/shader.h>
+
+#include <stdint.h>
+
+// view space froxel grid: screen tiles times exponential depth slices between the
+// camera's near and far plane
+#define LIGHT_GRID_X 16
+#define LIGHT_GRID_Y 9
+#define LIGHT_GRID_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_GRID_X * LIGHT_GRID_Y * LIGHT_GRID_Z)
+// lights a cluster keeps, the rest of what touches it is dropped and counted
+#define LIGHT_CLUSTER_MAX 256
+// threads of light_transform.comp and light_bin.comp
+#define LIGHT_GROUP_SIZE 128
+// set_lights sizes the lights so a point of the volume is reached by about this many
+#define LIGHT_COVERAGE 16.0f
+// std430 bindings of the view space lights and the cluster lists the shading passes read;
+// the world space lights are only read by the transform
+#define LIGHT_VIEW_BINDING 7
+#define LIGHT_CLUSTER_BINDING 8
+#define LIGHT_WORLD_BINDING 9
+// std140 uniform binding of light_frame_data
+#define LIGHT_UNIFORM_BINDING 3
+// frames between copying the overflow counter / issuing the timer queries and reading them back
+#define LIGHT_READBACK_LATENCY 3
+
+enum light_mode {
+	// the old unlit colors
+	LIGHT_MODE_OFF,
+	LIGHT_MODE_CLUSTERED,
+	// every fragment loops over every light, what clustering is measured against
+	LIGHT_MODE_BRUTE_FORCE
+};
+
+// layout shared with the light shaders, world space in the light buffer and view space
+// once transformed. Point lights have a cone that covers everything (cos_outer < -1)
+struct light_source {
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+	float cos_inner;
+	glm::vec3 direction;
+	float cos_outer;
+};
+
+// std140 block at LIGHT_UNIFORM_BINDING
+struct light_frame_data {
+	glm::mat4 view;
+	glm::mat4 inverse_projection;
+	glm::vec2 screen_size;
+	float z_near;
+	float z_far;
+	GLuint grid_x;
+	GLuint grid_y;
+	GLuint grid_z;
+	GLuint light_count;
+	GLuint mode;
+	GLuint cluster_max;
+	GLuint padding[2];
+};
+
+struct light_stats {
+	uint32_t lights;
+	// cluster list entries dropped because a cluster was full, read back late
+	uint32_t overflow;
+	double bin_ms;
+};
+
+struct light_context {
+	light_mode mode;
+
+	shader_manager *shaders;
+	shader_handle transform_program;
+	shader_handle bin_program;
+
+	uint32_t count;
+	uint32_t capacity;
+	// world space, then the same lights in this frame's view space
+	GLuint light_buffer;
+	GLuint view_buffer;
+	// per cluster light counts, then LIGHT_CLUSTER_MAX light ids per cluster, then the overflow counter
+	GLuint cluster_buffer;
+
+	// this frame's light_frame_data in the stream buffer, bound again by bind()
+	GLuint frame_buffer;
+	GLintptr frame_offset;
+	// stream allocation alignment of light_frame_data, queried once
+	GLint uniform_alignment;
+
+	// overflow counter copies and begin/end GL_TIMESTAMP pairs, read LIGHT_READBACK_LATENCY frames late
+	GLuint readback_buffer;
+	uint32_t *readback;
+	GLsync readback_fences[LIGHT_READBACK_LATENCY];
+	GLuint queries[LIGHT_READBACK_LATENCY * 2];
+	bool pending[LIGHT_READBACK_LATENCY];
+	int frame;
+
+	light_stats stats;
+};
+
+namespace psylight {
+	void create(light_context *lights, shader_manager *shaders);
+	void destroy(light_context *lights);
+
+	// scatters count point and spot lights through a box of half_extent around the origin,
+	// the same ones every run; GL thread
+	void set_lights(light_context *lights, uint32_t count, float half_extent);
+
+	// moves the lights into view space and, when clustered, bins them into the froxels of
+	// projection; z_near and z_far must be its planes. No barrier is issued for the shading passes
+	void bin(light_context *lights, stream_buffer *stream, const glm::mat4 &view, const glm::mat4 &projection, float z_near, float z_far, int width, int height);
+	// light_frame_data and the buffers for a shading pass of the frame bin() ran for
+	void bind(light_context *lights);
+	void end_frame(light_context *lights);
+}
@@ -1,7 +1,24 @@
 #include <window/window.h>
-
-#include <glm/glm.hpp>
-#include <glm/ext.hpp>
+#include <bench/bench.h>
+#include <profiler/profiler.h>
+#include <buffer/buffer.h>
+#include <mesh/mesh.h>
+#include <texture/texture.h>
+#include <cull/cull.h>
+#include <shader/shader.h>
+#include <graph/graph.h>
+#include <job/job.h>
+#include <render/render.h>
+#include <capture/capture.h>
+#include <memory/memory.h>
+#include <font/font.h>
+#include <scene/scene.h>
+#include <light/light.h>
+#include <state/state.h>
+#include <vfs/vfs.h>
+#include <cube/cube.h>
+#include <frame/frame.h>
+#include <imgui/imgui_backend.h>
 
 #include <imgui.h>
 
@@ -12,60 +29,161 @@
 
 #include <stdio.h>
 #include <stdlib.h>
-#include <fstream>
-#include <string>
-
-struct per_frame_data {
-	glm::mat4 mvp;
-	int is_wire_frame;
+#include <string.h>
+#include <chrono>
+#include <thread>
+
+struct app_options {
+	bool headless;
+	bool vsync;
+	int frame_count;
+	int warmup_frames;
+	const char *report_path;
+	const char *trace_path;
+	bool imgui_direct;
+	bool imgui_diff;
+	const char *mesh_path;
+	const char *mesh_bench_path;
+	const char *bake_source;
+	const char *bake_output;
+	int texture_stress;
+	texture_compression texture_mode;
+	int cube_count;
+	bool cube_sweep;
+	cull_mode culling;
+	bool shader_bench;
+	int job_workers;
+	// sleep until this long before the render thread needs the next frame, negative is off
+	double pace_margin_ms;
+	// records every frame from the first one, .y4m or a prefix for numbered PNGs
+	const char *record_path;
+	// fails the headless run if a frame past warmup touched the heap
+	bool assert_zero_alloc;
+	// the old 4x oversampled RGBA atlas at one size instead of distance field glyphs
+	bool font_baked;
+	// lines of text drawn at mixed sizes every frame, for measuring text heavy frames
+	int text_lines;
+	bool scene_bench;
+	// --mesh detail level selection, off always draws the full level
+	bool lod;
+	float lod_threshold;
+	float lod_hysteresis;
+	float mesh_distance;
+	int light_count;
+	light_mode lighting;
+	bool light_sweep;
+	// --state-cache off issues every state call, to measure what the cache saves
+	bool state_cache;
+	// --pack <directory> <archive> writes the archive and exits
+	const char *pack_directory;
+	const char *pack_archive;
+	// mounted at startup, null reads every asset loose
+	const char *asset_archive;
+	bool asset_bench;
+	// --check-graph runs the frame graph's aliasing check and exits
+	bool check_graph;
 };
 
-struct cube_context {
-	GLuint vao;
-	GLuint program;
-	GLuint texture;
+// radians of yaw per pixel of right button drag
+#define CAMERA_DRAG_SPEED 0.01f
+
+// keys that ask the render thread for something, main thread only
+struct frame_requests {
+	bool screenshot;
+	bool toggle_recording;
 };
 
-struct imgui_context {
-	GLuint vao;
-	GLuint vbo;
-	GLuint ebo;
-	GLuint program;
-	GLuint texture;
+// right button drag state, main thread only
+struct camera_input {
+	float yaw;
+	bool dragging;
+	double last_x;
 };
 
-namespace cube {
-	void create(cube_context *cube);
-	void destroy(cube_context *cube);
-	void render(cube_context *cube, GLuint per_frame_data_buffer, float ratio);
-}
+static window_state window;
 
-namespace psyimgui {
-	void create(imgui_context *imgui, window_info *info);
-	void destroy(imgui_context *imgui);
-	void render(imgui_context *imgui, GLuint per_frame_data_buffer, window_info *info);
-}
+uint64_t drain_input(camera_input *camera, camera_latch *latch, frame_requests *requests);
+void script_input(int frame_index);
+void pace_frame(const frame_feedback *feedback, double period_ms, double margin_ms, double build_ms);
 
-static window_state window;
+void parse_options(int argc, char **argv, app_options *options);
+
+int main(int argc, char **argv) {
+	const uint64_t startup_ticks = psybench::ticks();
+
+	app_options options = {};
+	parse_options(argc, argv, &options);
 
-void window_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
-void window_cursor_pos_callback(GLFWwindow *window, double xpos, double ypos);
-void window_mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+	if (options.bake_source) {
+		mesh_bake_stats stats = {};
+		if (!psymesh::bake(options.bake_source, options.bake_output, &stats)) {
+			return 1;
+		}
+		printf("baked %s: %u -> %u vertices, %u triangles, %u-bit indices, acmr %.3f -> %.3f\n",
+			options.bake_output, stats.source_vertices, stats.vertices, stats.triangles,
+			stats.index_size * 8, stats.acmr_before, stats.acmr_after);
+		return 0;
+	}
 
-void create_shader_program(std::string vertex_file, std::string fragment_file, GLuint *program);
-std::string read_text_from_file(std::string path);
-int check_shader(unsigned int shader, const char *type);
+	// run after every build, see the post-build step
+	if (options.pack_directory) {
+		vfs_pack_stats stats = {};
+		if (!psyvfs::pack(options.pack_directory, options.pack_archive, &stats)) {
+			return 1;
+		}
+		printf("packed %s: %u files, %u compressed, %llu -> %llu bytes in %.1f ms\n",
+			options.pack_archive, stats.files, stats.compressed,
+			(unsigned long long)stats.raw_bytes, (unsigned long long)stats.archive_bytes, stats.pack_ms);
+		return 0;
+	}
 
-int main() {
 	window_info info = {};
 	info.title = "PSYCHOTIC";
 	info.width = 1920 / 2;
 	info.height = 1080 / 2;
+	info.headless = options.headless;
+	info.vsync = options.vsync;
+
+	if (!psywindow::window_initialize(&info, &window)) {
+		fprintf(stderr, "Error: failed to create an OpenGL 4.6 context\n");
+		return 1;
+	}
+	psystate::reset();
+	psystate::set_cached(options.state_cache);
+
+	if (options.check_graph) {
+		const bool aliased = psygraph::check_aliasing();
+		printf("graph aliasing check %s\n", aliased ? "passed" : "failed");
+		psywindow::window_shutdown(&window);
+		return aliased ? 0 : 1;
+	}
 
-	psywindow::window_initialize(&info, &window);
-	psywindow::window_set_callback(&window, WINDOW_CALLBACK_KEY, window_key_callback);
-	psywindow::window_set_callback(&window, WINDOW_CALLBACK_CURSOR_POS, window_cursor_pos_callback);
-	psywindow::window_set_callback(&window, WINDOW_CALLBACK_MOUSE_BUTTON, window_mouse_button_callback);
+	PSY_PROFILER_CREATE();
+#ifdef PSY_ENABLE_PROFILER
+	if (options.trace_path) {
+		psyprofiler::capture_trace(options.trace_path);
+	}
+#endif
+
+	// culling and other per frame CPU work of the main thread fans out over these, and
+	// so does decompressing assets while loading
+	job_system jobs;
+	psyjob::create(&jobs, options.job_workers >= 0 ? options.job_workers : (int)std::thread::hardware_concurrency() - 1);
+
+	// mounts and unmounts an archive of its own, so before anything is loaded
+	vfs_bench_result asset_bench = {};
+	const bool asset_benched = options.headless && options.asset_bench && psyvfs::run_bench(&jobs, &asset_bench);
+
+	// assets come from the archive packed after the build when there is one, whatever it
+	// lacks is read loose
+	const uint64_t mount_start = psybench::ticks();
+	if (options.asset_archive && !psyvfs::mount(options.asset_archive, &jobs) && strcmp(options.asset_archive, VFS_DEFAULT_ARCHIVE)) {
+		fprintf(stderr, "Warning: could not mount %s, assets are read loose\n", options.asset_archive);
+	}
+	// everything startup reads right away decompresses at once instead of one open at a time
+	const char *const startup_assets[] = { "res/shaders/", "res/fonts/" };
+	psyvfs::preload(startup_assets, 2);
+	const double mount_ms = psybench::ticks_to_ms(psybench::ticks() - mount_start);
 
 	GLuint per_frame_data_buffer;
 	glCreateBuffers(1, &per_frame_data_buffer);
@@ -74,334 +192,553 @@ int main() {
 		sizeof(per_frame_data),
 		nullptr,
 		GL_DYNAMIC_STORAGE_BIT);
-	glBindBufferRange(GL_UNIFORM_BUFFER, 0, per_frame_data_buffer, 0, sizeof(per_frame_data));
+	psystate::bind_buffer_range(GL_UNIFORM_BUFFER, 0, per_frame_data_buffer, 0, sizeof(per_frame_data));
 
-	//cube_context cube = {};
-	//cube::create(&cube);
+	// shared per-frame upload ring, 1 MB per frame in flight to start with
+	stream_buffer stream = {};
+	psybuffer::create_stream(&stream, 1024 * 1024);
 
-	imgui_context imgui = {};
-	psyimgui::create(&imgui, &info);
+	// decoding and mip generation run on the workers, the GL thread only uploads
+	const int texture_workers = (int)std::thread::hardware_concurrency() - 1;
+	texture_manager textures;
+	psytexture::create(&textures, texture_workers, options.texture_mode, &jobs);
 
-	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+	// programs come from the binary cache when the sources and driver are unchanged,
+	// edits under res/shaders are picked up while running
+	shader_manager shaders;
+	psyshader::create(&shaders);
 
-	while (psywindow::window_alive(&window)) {
-		glfwGetFramebufferSize(window.handle, &info.width, &info.height);
-		const float ratio = info.width / (float)info.height;
-
-		glViewport(0, 0, info.width, info.height);
-		glClear(GL_COLOR_BUFFER_BIT);
-		
-		//cube::render(&cube, per_frame_data_buffer, ratio);
-		psyimgui::render(&imgui, per_frame_data_buffer, &info);
-		
-		psywindow::end_frame(&window);
-	}
+	cull_context cull = {};
+	psycull::create(&cull, &shaders);
+	cull.mode = options.culling;
 
-	psyimgui::destroy(&imgui);
-	//cube::destroy(&cube);
+	cube_context cube = {};
+	cube::create(&cube, &shaders, &textures, (uint32_t)options.cube_count);
 
-	glDeleteBuffers(1, &per_frame_data_buffer);
+	// binned into view space clusters every frame, the cube and mesh passes shade with them
+	light_context lights = {};
+	psylight::create(&lights, &shaders);
+	lights.mode = options.lighting;
+	psylight::set_lights(&lights, (uint32_t)options.light_count, cube::light_extent(&cube));
 
-	psywindow::window_shutdown(&window);
+	for (int i = 0; i < options.texture_stress; i++) {
+		psytexture::load(&textures, "res/textures/goreshit.jpg");
+	}
 
-	return 0;
-}
+	shader_handle mesh_program = SHADER_INVALID;
+	mesh_context scene_mesh = {};
+	if (options.mesh_path || options.mesh_bench_path) {
+		mesh_program = psyshader::load(&shaders, "mesh.vert", "mesh.frag");
+	}
+	if (options.mesh_path) {
+		psymesh::load(options.mesh_path, &scene_mesh);
+	}
 
-//
-//
-//
-// CREATIONS
-namespace cube {
-	void create(cube_context *cube) {
-		create_shader_program("cube.vert", "cube.frag", &cube->program);
-		glCreateVertexArrays(1, &cube->vao);
-		{
-			int width, height, comp;
-			stbi_set_flip_vertically_on_load(1);
-			uint8_t *data = stbi_load("res/textures/goreshit.jpg", &width, &height, &comp, 3);
-			if (data) {
-				GLenum format = GL_NONE;
-				if (comp == 1) format = GL_RED;
-				else if (comp == 3) format = GL_RGB;
-				else if (comp == 4) format = GL_RGBA;
-
-				glCreateTextures(GL_TEXTURE_2D, 1, &cube->texture);
-				glTextureParameteri(cube->texture, GL_TEXTURE_MAX_LEVEL, 0);
-				glTextureParameteri(cube->texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-				glTextureParameteri(cube->texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-				glTextureStorage2D(cube->texture, 1, GL_RGB8, width, height);
-				glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-
-				glTextureSubImage2D(cube->texture, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, data);
+	imgui_context imgui = {};
+	psyimgui::create(&imgui, &shaders, &info, !options.font_baked);
+	imgui.indirect = !options.imgui_direct;
+	imgui.text_lines = options.text_lines;
+
+	// passes are declared every frame; pooled targets, framebuffers and timings persist
+	frame_graph graph;
+	psygraph::create(&graph);
+
+	scene_context scene = {};
+	scene.shaders = &shaders;
+	scene.textures = &textures;
+	scene.cull = &cull;
+	scene.stream = &stream;
+	scene.cube = &cube;
+	scene.lights = &lights;
+	scene.mesh = scene_mesh.vao ? &scene_mesh : nullptr;
+	scene.mesh_program = mesh_program;
+	scene.mesh_distance = options.mesh_distance;
+	scene.lod_threshold = options.lod ? options.lod_threshold : -1.0f;
+	scene.lod_hysteresis = options.lod_hysteresis;
+	scene.imgui = &imgui;
+	scene.per_frame_data_buffer = per_frame_data_buffer;
+	scene.window = &window;
+
+	bench_state bench = {};
+	if (options.headless) {
+		bench_info bench_desc = {};
+		bench_desc.frame_count = options.frame_count;
+		bench_desc.warmup_frames = options.warmup_frames;
+		bench_desc.report_path = options.report_path;
+		psybench::create(&bench_desc, &bench);
+
+		psybench::set_value(&bench, "asset_mount_ms", mount_ms);
+		psybench::set_value(&bench, "asset_packed", psyvfs::mounted());
+		if (asset_benched) {
+			psybench::set_value(&bench, "asset_files", asset_bench.files);
+			psybench::set_value(&bench, "asset_bytes", (double)asset_bench.bytes);
+			psybench::set_value(&bench, "asset_archive_bytes", (double)asset_bench.archive_bytes);
+			psybench::set_value(&bench, "asset_cache_evicted", asset_bench.evicted);
+			psybench::set_value(&bench, "asset_loose_cold_ms", asset_bench.loose_cold_ms);
+			psybench::set_value(&bench, "asset_loose_warm_ms", asset_bench.loose_warm_ms);
+			psybench::set_value(&bench, "asset_pack_cold_ms", asset_bench.pack_cold_ms);
+			psybench::set_value(&bench, "asset_pack_warm_ms", asset_bench.pack_warm_ms);
+			printf("assets: %u files, %llu bytes, %llu packed; loose %.2f ms cold %.2f ms warm, archive %.2f ms cold %.2f ms warm%s\n",
+				asset_bench.files, (unsigned long long)asset_bench.bytes, (unsigned long long)asset_bench.archive_bytes,
+				asset_bench.loose_cold_ms, asset_bench.loose_warm_ms, asset_bench.pack_cold_ms, asset_bench.pack_warm_ms,
+				asset_bench.evicted ? "" : " (page cache not dropped, cold is warm)");
+			if (!asset_bench.matched) {
+				fprintf(stderr, "Error: the archive and the loose files differ\n");
 			}
-
-			stbi_image_free(data);
 		}
-	}
+		psybench::set_value(&bench, "font_startup_ms", imgui.font_ms);
+		psybench::set_value(&bench, "font_atlas_bytes", (double)imgui.font_bytes);
+		psybench::set_value(&bench, "shader_create_ms", shaders.create_ms);
+		psybench::set_value(&bench, "shader_cache_hits", shaders.cache_hits);
+		psybench::set_value(&bench, "shader_cache_misses", shaders.cache_misses);
+		if (options.shader_bench) {
+			double cold_ms = 0.0, warm_ms = 0.0;
+			psyshader::measure(&shaders, &cold_ms, &warm_ms);
+			psybench::set_value(&bench, "shader_cold_ms", cold_ms);
+			psybench::set_value(&bench, "shader_warm_ms", warm_ms);
+			printf("shaders: %zu programs, %.2f ms from source, %.2f ms from binary cache\n", shaders.entries.size(), cold_ms, warm_ms);
+		}
 
-	void destroy(cube_context *cube) {
-		glDeleteTextures(1, &cube->texture);
-		glDeleteProgram(cube->program);
-		glDeleteVertexArrays(1, &cube->vao);
+		if (options.mesh_bench_path) {
+			psyframe::run_mesh_bench(options.mesh_bench_path, &window, psyshader::get(&shaders, mesh_program), per_frame_data_buffer, &lights, &stream, options.lod_threshold, options.lod_hysteresis, &bench);
+		}
+		if (options.cube_sweep) {
+			psyframe::run_cube_sweep(&graph, &scene, &jobs, &bench);
+			cube::set_instances(&cube, (uint32_t)options.cube_count);
+		}
+		if (options.light_sweep) {
+			psyframe::run_light_sweep(&graph, &scene, &jobs, &bench);
+			lights.mode = options.lighting;
+			psylight::set_lights(&lights, (uint32_t)options.light_count, cube::light_extent(&cube));
+		}
+		if (options.scene_bench) {
+			psyscene::run_bench(&bench);
+		}
 	}
 
-	void render(cube_context *cube, GLuint per_frame_data_buffer, float ratio) {
-		glEnable(GL_DEPTH_TEST);
-		glEnable(GL_POLYGON_OFFSET_LINE);
-		glPolygonOffset(-1.0f, -1.0f);
-
-		glClear(GL_DEPTH_BUFFER_BIT);
-
-		const glm::mat4 model = glm::rotate(
-			glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, -3.5f)),
-			(float)glfwGetTime(),
-			glm::vec3(0.0f, 1.0f, 0.0f));
-		const glm::mat4 pers_projection = glm::perspective(45.0f, ratio, 0.1f, 10.0f);
+	// startup is done, nothing else opens what it did not take
+	psyvfs::drop_preloaded();
 
-		per_frame_data frame_data = {};
-		frame_data.mvp = pers_projection * model;
-		frame_data.is_wire_frame = false;
+	glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
 
-		glUseProgram(cube->program);
-		glBindVertexArray(cube->vao);
-		glBindTextures(0, 1, &cube->texture);
+	// GL moves to the render thread from here on, the main thread polls input, builds
+	// frame N + 1 into one snapshot while frame N is drawn from the other
+	frame_snapshot snapshots[RENDER_FRAME_SLOTS] = {};
+	render_state render = {};
+	render.scene = &scene;
+	render.graph = &graph;
+	render.bench = &bench;
+	render.snapshots = snapshots;
+	render.headless = options.headless;
+	render.imgui_diff = options.imgui_diff;
+	render.warmup_frames = options.warmup_frames;
+	render.record_path = options.record_path;
+	render.startup_ticks = startup_ticks;
+	render.exit_code = 0;
+
+	capture_state capture;
+	psycapture::create(&capture, 2);
+	render.capture = &capture;
+	render.record_fps = options.headless ? 60 : (int)psywindow::refresh_rate(&window);
+
+	render_thread renderer;
+	psyrender::start(&renderer, &window, psyframe::render, &render);
+
+	camera_latch latch;
+	latch.sequence = 0;
+	latch.yaw = 0.0f;
+	latch.time = 0;
+	scene.latch = &latch;
+
+	frame_feedback feedback = {};
+	camera_input camera = {};
+	cull_mode culling = cull.mode;
+	bool hiz = cull.hiz;
+	bool state_cache = options.state_cache;
+	frame_requests requests = {};
+	uint64_t input_time = 0;
+	double build_ms = 0.0;
+	const double period_ms = 1000.0 / psywindow::refresh_rate(&window);
+	// heap allocations by both threads once warmup is over, the steady state should have none
+	uint64_t steady_allocations[MEMORY_TAG_COUNT] = {};
+	int allocating_frames = 0;
+	int frame_index = 0;
+	while (psywindow::window_alive(&window)) {
+		if (options.pace_margin_ms >= 0.0) {
+			pace_frame(&feedback, period_ms, options.pace_margin_ms, build_ms);
+		}
 
-		glNamedBufferSubData(per_frame_data_buffer, 0, sizeof(per_frame_data), &frame_data);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
+		psymemory::begin_frame();
+		const memory_frame_stats *memory = psymemory::stats();
+		if (frame_index > options.warmup_frames) {
+			for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+				steady_allocations[i] += memory->frame[i].allocations;
+			}
+			allocating_frames += memory->frame_allocations > 0;
+		}
+		const uint64_t build_start = psybench::ticks();
 
-		frame_data.is_wire_frame = true;
-		glNamedBufferSubData(per_frame_data_buffer, 0, sizeof(per_frame_data), &frame_data);
-		glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-		glDrawArrays(GL_TRIANGLES, 0, 36);
-	}
-}
+		// the headless run has no real input, a scripted cursor keeps the latency measurable
+		if (options.headless) {
+			script_input(frame_index);
+		}
+		psywindow::poll_events(&window, &info);
+		const uint64_t newest_input = drain_input(&camera, &latch, &requests);
+		input_time = newest_input > input_time ? newest_input : input_time;
+
+		frame_snapshot *frame = &snapshots[frame_index % RENDER_FRAME_SLOTS];
+		frame->index = frame_index;
+		frame->info = info;
+		frame->ratio = info.width / (float)info.height;
+		// the headless scene is scripted on a fixed 60 Hz timestep so every run is identical
+		frame->time = options.headless ? frame_index / 60.0f : (float)glfwGetTime();
+		frame->yaw = camera.yaw;
+		frame->input_time = input_time;
+		input_time = 0;
+		frame->culling = culling;
+		frame->hiz = hiz;
+		frame->state_cache = state_cache;
+		frame->instance_copy = frame_index % SCENE_BUFFER_COPIES;
+		frame->screenshot = requests.screenshot;
+		frame->toggle_recording = requests.toggle_recording;
+		requests = frame_requests();
+		psyframe::prepare(frame, &scene, &jobs);
+
+		psyimgui::new_frame(&imgui, &info, &feedback, &culling, &hiz, &state_cache);
+		psyimgui::copy_draw_data(&frame->draw_data);
+		if (imgui.sdf) {
+			psyfont::update(&imgui.font, ImGui::GetDrawData(), &jobs, &frame->glyphs);
+		}
+		build_ms = psybench::ticks_to_ms(psybench::ticks() - build_start);
+
+		// keep sampling input until the render thread is done, what arrives now is latched
+		// into the frame it is drawing or carried into the next one
+		const uint64_t wait_start = psybench::ticks();
+		while (!psyrender::wait_for(&renderer, 0.5)) {
+			psywindow::poll_events(&window, &info);
+			const uint64_t waited_input = drain_input(&camera, &latch, &requests);
+			input_time = waited_input > input_time ? waited_input : input_time;
+		}
 
-namespace psyimgui {
-	void create(imgui_context *imgui, window_info *info) {
-		glCreateVertexArrays(1, &imgui->vao);
-
-		glCreateBuffers(1, &imgui->vbo);
-		glNamedBufferStorage(imgui->vbo, 256 * 1024, nullptr, GL_DYNAMIC_STORAGE_BIT);
-
-		glCreateBuffers(1, &imgui->ebo);
-		glNamedBufferStorage(imgui->ebo, 256 * 1024, nullptr, GL_DYNAMIC_STORAGE_BIT);
-
-		glVertexArrayElementBuffer(imgui->vao, imgui->ebo);
-		glVertexArrayVertexBuffer(imgui->vao, 0, imgui->vbo, 0, sizeof(ImDrawVert));
-
-		glEnableVertexArrayAttrib(imgui->vao, 0);
-		glEnableVertexArrayAttrib(imgui->vao, 1);
-		glEnableVertexArrayAttrib(imgui->vao, 2);
-
-		glVertexArrayAttribFormat(imgui->vao, 0, 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, pos));
-		glVertexArrayAttribFormat(imgui->vao, 1, 2, GL_FLOAT, GL_FALSE, IM_OFFSETOF(ImDrawVert, uv));
-		glVertexArrayAttribFormat(imgui->vao, 2, 4, GL_UNSIGNED_BYTE, GL_TRUE, IM_OFFSETOF(ImDrawVert, col));
-
-		glVertexArrayAttribBinding(imgui->vao, 0, 0);
-		glVertexArrayAttribBinding(imgui->vao, 1, 0);
-		glVertexArrayAttribBinding(imgui->vao, 2, 0);
-
-		create_shader_program("imgui.vert", "imgui.frag", &imgui->program);
-
-		ImGui::CreateContext();
-
-		ImGuiIO &io = ImGui::GetIO();
-		io.BackendFlags |= ImGuiBackendFlags_RendererHasVtxOffset;
-
-		ImFontConfig cfg = ImFontConfig();
-		cfg.FontDataOwnedByAtlas = false;
-		cfg.RasterizerMultiply = 1.5f;
-		cfg.SizePixels = (float)info->height / 32.0f;
-		cfg.PixelSnapH = true;
-		cfg.OversampleH = 4;
-		cfg.OversampleV = 4;
-
-		ImFont *font = io.Fonts->AddFontFromFileTTF(
-			"res/fonts/liberation-mono.ttf",
-			cfg.SizePixels,
-			&cfg);;
-
-		unsigned char *pixels = nullptr;
-		int width, height;
-		io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
-
-		glCreateTextures(GL_TEXTURE_2D, 1, &imgui->texture);
-		glTextureParameteri(imgui->texture, GL_TEXTURE_MAX_LEVEL, 0);
-		glTextureParameteri(imgui->texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTextureParameteri(imgui->texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTextureStorage2D(imgui->texture, 1, GL_RGBA8, width, height);
-
-		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-		glTextureSubImage2D(
-			imgui->texture, 0,
-			0, 0,
-			width, height,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			pixels);
-
-		io.Fonts->TexID = (ImTextureID)(intptr_t)imgui->texture;
-		io.FontDefault = font;
-		io.DisplayFramebufferScale = ImVec2(1, 1);
+		// the render thread sits idle between wait and submit
+		feedback = render.feedback;
+		feedback.render_ms = renderer.render_ms;
+		feedback.wait_ms = psybench::ticks_to_ms(psybench::ticks() - wait_start);
+		if (options.headless && psybench::done(&bench)) {
+			break;
+		}
+		psyrender::submit(&renderer, frame_index % RENDER_FRAME_SLOTS);
+		frame_index++;
 	}
 
-	void destroy(imgui_context *imgui) {
-		ImGui::DestroyContext();
-		glDeleteTextures(1, &imgui->texture);
-		glDeleteProgram(imgui->program);
-		glDeleteShader(imgui->ebo);
-		glDeleteShader(imgui->vbo);
-		glDeleteVertexArrays(1, &imgui->vao);
+	psyrender::stop(&renderer);
+	psycapture::destroy(&capture);
+	for (frame_snapshot &snapshot : snapshots) {
+		psyimgui::free_draw_data(&snapshot.draw_data);
 	}
-
-	void render(imgui_context *imgui, GLuint per_frame_data_buffer, window_info *info) {
-		glEnable(GL_BLEND);
-		glBlendEquation(GL_FUNC_ADD);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-		glDisable(GL_CULL_FACE);
-		glDisable(GL_DEPTH_TEST);
-		glEnable(GL_SCISSOR_TEST);
-
-		ImGuiIO &io = ImGui::GetIO();
-		io.DisplaySize = ImVec2((float)info->width, (float)info->height);
-		ImGui::NewFrame();
-		ImGui::ShowDemoWindow();
-		ImGui::Render();
-
-		const ImDrawData *draw_data = ImGui::GetDrawData();
-
-		const float left = draw_data->DisplayPos.x;
-		const float right = draw_data->DisplayPos.x + draw_data->DisplaySize.x;
-		const float top = draw_data->DisplayPos.y;
-		const float bottom = draw_data->DisplayPos.y + draw_data->DisplaySize.y;
-		const glm::mat4 ortho_projection = glm::ortho(left, right, bottom, top);
-
-		per_frame_data frame_data = {};
-		frame_data.mvp = ortho_projection;
-		frame_data.is_wire_frame = false;
-
-		glUseProgram(imgui->program);
-		glBindVertexArray(imgui->vao);
-		glBindTextures(0, 1, &imgui->texture);
-
-		glNamedBufferSubData(per_frame_data_buffer, 0, sizeof(per_frame_data), &frame_data);
-
-		for (int i = 0; i < draw_data->CmdListsCount; i++) {
-			const ImDrawList *cmd_list = draw_data->CmdLists[i];
-			glNamedBufferSubData(
-				imgui->vbo,
-				0,
-				(GLsizeiptr)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert),
-				cmd_list->VtxBuffer.Data);
-			glNamedBufferSubData(
-				imgui->ebo,
-				0,
-				(GLsizeiptr)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx),
-				cmd_list->IdxBuffer.Data);
-
-			for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++) {
-				const ImDrawCmd *pcmd = &cmd_list->CmdBuffer[cmd_i];
-				const ImVec4 clip_rect = pcmd->ClipRect;
-				glScissor((int)clip_rect.x, (int)(info->height - clip_rect.w), (int)(clip_rect.z - clip_rect.x), (int)(clip_rect.w - clip_rect.y));
-				glBindTextureUnit(0, (GLuint)(intptr_t)pcmd->TextureId);
-				glDrawElementsBaseVertex(
-					GL_TRIANGLES,
-					(GLsizei)pcmd->ElemCount,
-					GL_UNSIGNED_SHORT,
-					(void *)(intptr_t)(pcmd->IdxOffset * sizeof(ImDrawIdx)),
-					(GLint)pcmd->VtxOffset);
+	psyframe::collect_latency(&render, true);
+
+	if (options.headless) {
+		psybench::set_value(&bench, "graph_target_bytes", (double)graph.stats.target_bytes);
+		psybench::set_value(&bench, "graph_target_peak_bytes", (double)graph.stats.peak_target_bytes);
+		psybench::set_value(&bench, "graph_unaliased_bytes", (double)graph.stats.unaliased_bytes);
+		psybench::set_value(&bench, "graph_barriers", graph.stats.barriers);
+		psybench::set_value(&bench, "graph_compile_ms", graph.stats.compile_ms);
+		if (imgui.multi_draws) {
+			psybench::set_value(&bench, "imgui_commands_per_multi_draw", (double)imgui.multi_draw_commands / imgui.multi_draws);
+		}
+		psybench::set_value(&bench, "job_workers", (double)jobs.workers.size());
+		psybench::set_value(&bench, "jobs_executed", (double)jobs.executed);
+		psybench::set_value(&bench, "jobs_stolen", (double)jobs.stolen);
+		psybench::set_value(&bench, "input_events_dropped", (double)window.input.dropped.load());
+		psybench::set_value(&bench, "late_latched_frames", (double)scene.late_latches);
+		const capture_stats capture_totals = psycapture::stats(&capture);
+		psybench::set_value(&bench, "capture_frames", capture_totals.recorded_frames);
+		psybench::set_value(&bench, "capture_stall_ms", capture_totals.stall_ms);
+		psybench::set_value(&bench, "capture_encode_ms", capture_totals.encoded ? capture_totals.encode_ms / capture_totals.encoded : 0.0);
+		if (imgui.sdf) {
+			psybench::set_value(&bench, "font_glyphs_rasterized", imgui.font.stats.rasterized);
+			psybench::set_value(&bench, "font_glyphs_evicted", imgui.font.stats.evicted);
+			psybench::set_value(&bench, "font_glyphs_dropped", imgui.font.stats.dropped);
+			psybench::set_value(&bench, "font_raster_ms", imgui.font.stats.raster_ms);
+		}
+		const vfs_stats *assets = psyvfs::stats();
+		psybench::set_value(&bench, "asset_in_place", assets->in_place.load());
+		psybench::set_value(&bench, "asset_decompressed", assets->decompressed.load());
+		psybench::set_value(&bench, "asset_loose_reads", assets->loose.load());
+		psybench::set_value(&bench, "asset_decompress_ms", psybench::ticks_to_ms(assets->decompress_ticks.load()));
+
+		uint64_t allocations = 0;
+		for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+			allocations += steady_allocations[i];
+		}
+		psybench::set_value(&bench, "heap_allocations_steady", (double)allocations);
+		psybench::set_value(&bench, "heap_allocating_frames", allocating_frames);
+		if (options.assert_zero_alloc && allocations) {
+			fprintf(stderr, "Error: %llu heap allocations in %d frames after warmup:\n", (unsigned long long)allocations, allocating_frames);
+			for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+				if (steady_allocations[i]) {
+					fprintf(stderr, "  %s %llu\n", psymemory::tag_name((memory_tag)i), (unsigned long long)steady_allocations[i]);
+				}
 			}
+			render.exit_code = 1;
 		}
-
-		glScissor(0, 0, info->width, info->height);
+		psybench::write_report(&bench);
+		psybench::destroy(&bench);
 	}
-}
 
-//
-// CALLBACKS
-void window_key_callback(GLFWwindow *handle, int key, int scancode, int action, int mods) {
-	if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS) {
-		psywindow::kill(&window);
-	}
-	if (key == GLFW_KEY_F1 && action == GLFW_PRESS) {
-		int width, height;
-		glfwGetFramebufferSize(handle, &width, &height);
-		uint8_t *ptr = (uint8_t*)malloc(width * height * sizeof(int));
-		glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, ptr);
-		stbi_write_png("screenshot.png", width, height, 4, ptr, 0);
-		free(ptr);
+	psygraph::destroy(&graph);
+	psyimgui::destroy(&imgui);
+	cube::destroy(&cube);
+	psylight::destroy(&lights);
+	psycull::destroy(&cull);
+	psytexture::destroy(&textures);
+	if (scene_mesh.vao) {
+		psymesh::destroy(&scene_mesh);
 	}
-}
-
-void window_cursor_pos_callback(GLFWwindow *handle, double xpos, double ypos) {
-	ImGui::GetIO().MousePos = ImVec2((float)xpos, (float)ypos);
-}
+	psyshader::destroy(&shaders);
+	// the texture workers may still have been decompressing over the jobs
+	psyjob::destroy(&jobs);
+	psyvfs::unmount();
 
-void window_mouse_button_callback(GLFWwindow *handle, int button, int action, int mods) {
-	auto &io = ImGui::GetIO();
-	int index = button == GLFW_MOUSE_BUTTON_LEFT ? 0 : button == GLFW_MOUSE_BUTTON_RIGHT ? 2 : 1;
-	io.MouseDown[index] = action == GLFW_PRESS;
-}
-
-//
-// UTILS
-void create_shader_program(std::string vertex_file, std::string fragment_file, GLuint *program) {
-	std::string vertex_source = read_text_from_file("res/shaders/" + vertex_file);
-	std::string fragment_source = read_text_from_file("res/shaders/" + fragment_file);
+	psybuffer::destroy_stream(&stream);
+	psystate::forget(per_frame_data_buffer);
+	glDeleteBuffers(1, &per_frame_data_buffer);
 
-	const char *vertex_string = vertex_source.c_str();
-	const char *fragment_string = fragment_source.c_str();
+	PSY_PROFILER_DESTROY();
 
-	GLuint vertex_shader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertex_shader, 1, &vertex_string, nullptr);
-	glCompileShader(vertex_shader);
-	check_shader(vertex_shader, "VERTEX SHADER");
+	psywindow::window_shutdown(&window);
 
-	GLuint fragment_shader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragment_shader, 1, &fragment_string, nullptr);
-	glCompileShader(fragment_shader);
-	check_shader(fragment_shader, "FRAGMENT SHADER");
+	return render.exit_code;
+}
 
-	GLuint shader_program = glCreateProgram();
-	glAttachShader(shader_program, vertex_shader);
-	glAttachShader(shader_program, fragment_shader);
-	glLinkProgram(shader_program);
-	check_shader(shader_program, "PROGRAM");
+//
+// INPUT
+// main thread, once at frame start and while waiting on the render thread: applies every
+// queued event in arrival order and returns the newest event's time, 0 if there was none
+uint64_t drain_input(camera_input *camera, camera_latch *latch, frame_requests *requests) {
+	auto &io = ImGui::GetIO();
+	uint64_t newest = 0;
+	input_event event;
+	while (psywindow::pop_event(&window, &event)) {
+		newest = event.time;
+		switch (event.type) {
+		case INPUT_EVENT_KEY:
+			if (event.action != GLFW_PRESS) {
+				break;
+			}
+			if (event.code == GLFW_KEY_ESCAPE) {
+				psywindow::kill(&window);
+			}
+			if (event.code == GLFW_KEY_F1) {
+				requests->screenshot = true;
+			}
+			if (event.code == GLFW_KEY_F5) {
+				requests->toggle_recording = true;
+			}
+#ifdef PSY_ENABLE_PROFILER
+			if (event.code == GLFW_KEY_F2) {
+				psyprofiler::toggle_overlay();
+			}
+			if (event.code == GLFW_KEY_F3) {
+				psyprofiler::capture_trace("trace.json");
+			}
+#endif
+			break;
+		case INPUT_EVENT_CURSOR_POS:
+			io.AddMousePosEvent((float)event.x, (float)event.y);
+			if (camera->dragging) {
+				camera->yaw += (float)(event.x - camera->last_x) * CAMERA_DRAG_SPEED;
+			}
+			camera->last_x = event.x;
+			break;
+		case INPUT_EVENT_MOUSE_BUTTON: {
+			const int button = event.code == GLFW_MOUSE_BUTTON_LEFT ? 0 : event.code == GLFW_MOUSE_BUTTON_RIGHT ? 1 : 2;
+			io.AddMouseButtonEvent(button, event.action == GLFW_PRESS);
+			if (event.code == GLFW_MOUSE_BUTTON_RIGHT) {
+				camera->dragging = event.action == GLFW_PRESS && !io.WantCaptureMouse;
+			}
+			break;
+		}
+		case INPUT_EVENT_SCROLL:
+			io.AddMouseWheelEvent((float)event.x, (float)event.y);
+			break;
+		}
+	}
 
-	glDeleteShader(vertex_shader);
-	glDeleteShader(vertex_shader);
+	if (newest) {
+		latch->sequence.fetch_add(1, std::memory_order_acq_rel);
+		latch->yaw.store(camera->yaw, std::memory_order_relaxed);
+		latch->time.store(newest, std::memory_order_relaxed);
+		latch->sequence.fetch_add(1, std::memory_order_release);
+	}
+	return newest;
+}
 
-	*program = shader_program;
+// headless runs sweep the cursor across the window, no buttons so the image stays the same
+void script_input(int frame_index) {
+	input_event event = {};
+	event.type = INPUT_EVENT_CURSOR_POS;
+	event.time = psybench::ticks();
+	event.x = (frame_index * 7) % 640;
+	event.y = (frame_index * 3) % 480;
+	psywindow::push_event(&window, &event);
 }
 
-std::string read_text_from_file(std::string path) {
-	std::ifstream file(path);
-	std::string str;
-	std::string line;
-	while (std::getline(file, line)) {
-		str += line + "\n";
+// main thread: sleeps until just before the render thread will want the next frame, so
+// the input sampled right after is as fresh as it can be. The last bit is spun, sleep
+// overshoots by around a millisecond on most systems
+void pace_frame(const frame_feedback *feedback, double period_ms, double margin_ms, double build_ms) {
+	PSY_PROFILE_SCOPE("pace_frame");
+	if (!feedback->present_time) {
+		return;
+	}
+	const double target_ms = period_ms - build_ms - margin_ms;
+	const uint64_t deadline = feedback->present_time + (uint64_t)(target_ms > 0.0 ? target_ms * 1e6 : 0.0);
+	for (;;) {
+		const uint64_t now = psybench::ticks();
+		if (now >= deadline) {
+			break;
+		}
+		const double left_ms = psybench::ticks_to_ms(deadline - now);
+		if (left_ms > 2.0) {
+			std::this_thread::sleep_for(std::chrono::microseconds((int64_t)((left_ms - 1.5) * 1000.0)));
+		} else {
+			std::this_thread::yield();
+		}
 	}
-	return str;
 }
 
-int check_shader(unsigned int shader, const char *type) {
-	int success;
-	char infoLog[1024];
-	if (type != "PROGRAM") {
-		glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-		if (!success) {
-			glGetShaderInfoLog(shader, 1024, NULL, infoLog);
-			printf("Shader compilation error type: %s\n%s", type, infoLog);
-		}
-	} else {
-		glGetProgramiv(shader, GL_LINK_STATUS, &success);
-		if (!success) {
-			glGetProgramInfoLog(shader, 1024, NULL, infoLog);
-			printf("Program linkning error type: %s\n%s", type, infoLog);
+//
+// UTILS
+void parse_options(int argc, char **argv, app_options *options) {
+	options->headless = false;
+	options->vsync = true;
+	options->frame_count = 1000;
+	options->warmup_frames = 60;
+	options->report_path = "bench";
+	options->trace_path = nullptr;
+	options->imgui_direct = false;
+	options->imgui_diff = false;
+	options->mesh_path = nullptr;
+	options->mesh_bench_path = nullptr;
+	options->bake_source = nullptr;
+	options->bake_output = nullptr;
+	options->texture_stress = 0;
+	options->texture_mode = TEXTURE_COMPRESSION_BC1_BC3;
+	options->cube_count = 1;
+	options->cube_sweep = false;
+	options->job_workers = -1;
+	options->pace_margin_ms = -1.0;
+	options->record_path = nullptr;
+	options->assert_zero_alloc = false;
+	options->font_baked = false;
+	options->text_lines = 0;
+	options->scene_bench = false;
+	options->lod = true;
+	options->lod_threshold = 1.0f;
+	options->lod_hysteresis = 0.25f;
+	options->mesh_distance = 3.5f;
+	options->light_count = 256;
+	options->lighting = LIGHT_MODE_CLUSTERED;
+	options->light_sweep = false;
+	options->state_cache = true;
+	options->culling = CULL_MODE_GPU;
+	options->shader_bench = false;
+	options->pack_directory = nullptr;
+	options->pack_archive = nullptr;
+	options->asset_archive = VFS_DEFAULT_ARCHIVE;
+	options->asset_bench = false;
+	options->check_graph = false;
+
+	for (int i = 1; i < argc; i++) {
+		if (!strcmp(argv[i], "--headless")) {
+			options->headless = true;
+		} else if (!strcmp(argv[i], "--no-vsync")) {
+			options->vsync = false;
+		} else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+			options->frame_count = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+			options->warmup_frames = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--report") && i + 1 < argc) {
+			options->report_path = argv[++i];
+		} else if (!strcmp(argv[i], "--imgui-direct")) {
+			options->imgui_direct = true;
+		} else if (!strcmp(argv[i], "--imgui-diff")) {
+			options->imgui_diff = true;
+		} else if (!strcmp(argv[i], "--mesh") && i + 1 < argc) {
+			options->mesh_path = argv[++i];
+		} else if (!strcmp(argv[i], "--mesh-bench") && i + 1 < argc) {
+			options->mesh_bench_path = argv[++i];
+		} else if (!strcmp(argv[i], "--bake-mesh") && i + 2 < argc) {
+			options->bake_source = argv[++i];
+			options->bake_output = argv[++i];
+		} else if (!strcmp(argv[i], "--texture-stress") && i + 1 < argc) {
+			options->texture_stress = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--texture-compression") && i + 1 < argc) {
+			const char *mode = argv[++i];
+			if (!strcmp(mode, "none")) options->texture_mode = TEXTURE_COMPRESSION_NONE;
+			else if (!strcmp(mode, "bc7")) options->texture_mode = TEXTURE_COMPRESSION_BC7;
+			else options->texture_mode = TEXTURE_COMPRESSION_BC1_BC3;
+		} else if (!strcmp(argv[i], "--cubes") && i + 1 < argc) {
+			options->cube_count = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--cube-sweep")) {
+			options->cube_sweep = true;
+		} else if (!strcmp(argv[i], "--jobs") && i + 1 < argc) {
+			options->job_workers = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--pace") && i + 1 < argc) {
+			options->pace_margin_ms = atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+			options->record_path = argv[++i];
+		} else if (!strcmp(argv[i], "--assert-zero-alloc")) {
+			options->assert_zero_alloc = true;
+		} else if (!strcmp(argv[i], "--font") && i + 1 < argc) {
+			options->font_baked = !strcmp(argv[++i], "baked");
+		} else if (!strcmp(argv[i], "--text-stress") && i + 1 < argc) {
+			options->text_lines = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--scene-bench")) {
+			options->scene_bench = true;
+		} else if (!strcmp(argv[i], "--lod") && i + 1 < argc) {
+			const char *mode = argv[++i];
+			options->lod = strcmp(mode, "off") != 0;
+			if (options->lod) options->lod_threshold = (float)atof(mode);
+		} else if (!strcmp(argv[i], "--lod-hysteresis") && i + 1 < argc) {
+			options->lod_hysteresis = (float)atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--mesh-distance") && i + 1 < argc) {
+			options->mesh_distance = (float)atof(argv[++i]);
+		} else if (!strcmp(argv[i], "--lights") && i + 1 < argc) {
+			options->light_count = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "--lighting") && i + 1 < argc) {
+			const char *mode = argv[++i];
+			if (!strcmp(mode, "off")) options->lighting = LIGHT_MODE_OFF;
+			else if (!strcmp(mode, "brute")) options->lighting = LIGHT_MODE_BRUTE_FORCE;
+			else options->lighting = LIGHT_MODE_CLUSTERED;
+		} else if (!strcmp(argv[i], "--state-cache") && i + 1 < argc) {
+			options->state_cache = strcmp(argv[++i], "off") != 0;
+		} else if (!strcmp(argv[i], "--light-sweep")) {
+			options->light_sweep = true;
+		} else if (!strcmp(argv[i], "--cull") && i + 1 < argc) {
+			const char *mode = argv[++i];
+			if (!strcmp(mode, "none")) options->culling = CULL_MODE_NONE;
+			else if (!strcmp(mode, "cpu")) options->culling = CULL_MODE_CPU;
+			else options->culling = CULL_MODE_GPU;
+		} else if (!strcmp(argv[i], "--shader-bench")) {
+			options->shader_bench = true;
+		} else if (!strcmp(argv[i], "--pack") && i + 2 < argc) {
+			options->pack_directory = argv[++i];
+			options->pack_archive = argv[++i];
+		} else if (!strcmp(argv[i], "--assets") && i + 1 < argc) {
+			const char *archive = argv[++i];
+			options->asset_archive = !strcmp(archive, "loose") ? nullptr : archive;
+		} else if (!strcmp(argv[i], "--asset-bench")) {
+			options->asset_bench = true;
+		} else if (!strcmp(argv[i], "--check-graph")) {
+			options->check_graph = true;
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			options->trace_path = argv[++i];
+		} else {
+			fprintf(stderr, "Warning: unknown option %s\n", argv[i]);
 		}
 	}
-	return success;
 }
 
@@ -0,0 +1,357 @@
+#include "memory.h"
+
+#include <imgui.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+// in front of every tracked block, keeps the 16 byte alignment malloc gives; an over-aligned
+// block is placed further into the malloc'd one and offset leads back to its start
+struct memory_header {
+	uint64_t size;
+	uint16_t tag;
+	uint16_t offset;
+	uint32_t magic;
+};
+
+// 'PSYA', apart from every file magic so a stray pointer into a mapped blob is still caught
+#define MEMORY_HEADER_MAGIC 0x41595350
+// the largest alignment offset can express
+#define MEMORY_MAX_ALIGNMENT 0x8000
+
+// zero initialized before any constructor runs, so allocations from static init count too
+static memory_counters counters[MEMORY_TAG_COUNT];
+static thread_local memory_tag current_tag;
+static memory_tag_stats frame_start[MEMORY_TAG_COUNT];
+static memory_frame_stats frame_stats;
+
+void copy_counters(memory_tag_stats *out);
+void *track(uint8_t *block, size_t offset, size_t size, memory_tag tag);
+void *allocate_aligned(size_t size, size_t alignment, memory_tag tag);
+
+void *psymemory::allocate(size_t size, memory_tag tag) {
+	uint8_t *block = (uint8_t *)malloc(sizeof(memory_header) + size);
+	if (!block) {
+		return nullptr;
+	}
+	return track(block, 0, size, tag);
+}
+
+void psymemory::release(void *pointer) {
+	if (!pointer) {
+		return;
+	}
+	memory_header *header = (memory_header *)pointer - 1;
+	if (header->magic != MEMORY_HEADER_MAGIC) {
+		fprintf(stderr, "Error: freeing memory the tracker did not allocate\n");
+		abort();
+	}
+	// the tag it was allocated under, the freeing thread may be somewhere else entirely
+	counters[header->tag].frees.fetch_add(1, std::memory_order_relaxed);
+	counters[header->tag].live_bytes.fetch_sub((int64_t)header->size, std::memory_order_relaxed);
+	header->magic = 0;
+	free((uint8_t *)header - header->offset);
+}
+
+void psymemory::set_tag(memory_tag tag) {
+	current_tag = tag;
+}
+
+memory_tag psymemory::get_tag() {
+	return current_tag;
+}
+
+const char *psymemory::tag_name(memory_tag tag) {
+	switch (tag) {
+	case MEMORY_TAG_OTHER: return "other";
+	case MEMORY_TAG_GRAPH: return "graph";
+	case MEMORY_TAG_CULL: return "cull";
+	case MEMORY_TAG_SHADER: return "shader";
+	case MEMORY_TAG_TEXTURE: return "texture";
+	case MEMORY_TAG_MESH: return "mesh";
+	case MEMORY_TAG_IMGUI: return "imgui";
+	case MEMORY_TAG_JOB: return "job";
+	case MEMORY_TAG_CAPTURE: return "capture";
+	case MEMORY_TAG_BENCH: return "bench";
+	case MEMORY_TAG_PROFILER: return "profiler";
+	case MEMORY_TAG_FONT: return "font";
+	case MEMORY_TAG_SCENE: return "scene";
+	case MEMORY_TAG_LIGHT: return "light";
+	case MEMORY_TAG_VFS: return "vfs";
+	case MEMORY_TAG_COUNT: break;
+	}
+	return "?";
+}
+
+void psymemory::begin_frame() {
+	copy_counters(frame_stats.total);
+	frame_stats.frame_allocations = 0;
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+		const memory_tag_stats *total = &frame_stats.total[i];
+		memory_tag_stats *frame = &frame_stats.frame[i];
+		frame->allocations = total->allocations - frame_start[i].allocations;
+		frame->frees = total->frees - frame_start[i].frees;
+		frame->live_bytes = total->live_bytes - frame_start[i].live_bytes;
+		frame_stats.frame_allocations += frame->allocations;
+		frame_start[i] = *total;
+	}
+}
+
+const memory_frame_stats *psymemory::stats() {
+	return &frame_stats;
+}
+
+void psymemory::draw_overlay(const memory_arena *const *arenas, const char *const *arena_names, int arena_count) {
+	if (!ImGui::Begin("Memory")) {
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Text("heap allocations last frame %llu", (unsigned long long)frame_stats.frame_allocations);
+	if (ImGui::BeginTable("tags", 4, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)) {
+		ImGui::TableSetupColumn("subsystem");
+		ImGui::TableSetupColumn("per frame");
+		ImGui::TableSetupColumn("total");
+		ImGui::TableSetupColumn("live KB");
+		ImGui::TableHeadersRow();
+		for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+			const memory_tag_stats *frame = &frame_stats.frame[i];
+			const memory_tag_stats *total = &frame_stats.total[i];
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::TextUnformatted(tag_name((memory_tag)i));
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)frame->allocations);
+			ImGui::TableNextColumn();
+			ImGui::Text("%llu", (unsigned long long)total->allocations);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.1f", total->live_bytes / 1024.0);
+		}
+		ImGui::EndTable();
+	}
+
+	for (int i = 0; i < arena_count; i++) {
+		const memory_arena *arena = arenas[i];
+		ImGui::Text("%s arena %.1f / %.1f KB, peak %.1f KB, %u overflows", arena_names[i],
+			arena->head / 1024.0, arena->capacity / 1024.0, arena->peak / 1024.0, arena->overflows);
+	}
+	ImGui::End();
+}
+
+void psymemory::create_arena(memory_arena *arena, size_t capacity) {
+	arena->base = (uint8_t *)psymemory::allocate(capacity, current_tag);
+	arena->capacity = capacity;
+	arena->head = 0;
+	arena->peak = 0;
+	arena->overflows = 0;
+	arena->frame_overflows = 0;
+	memset(arena->overflow_blocks, 0, sizeof(arena->overflow_blocks));
+}
+
+void psymemory::destroy_arena(memory_arena *arena) {
+	psymemory::reset(arena);
+	psymemory::release(arena->base);
+	arena->base = nullptr;
+	arena->capacity = 0;
+}
+
+void *psymemory::push(memory_arena *arena, size_t size, size_t alignment) {
+	const size_t offset = (arena->head + alignment - 1) & ~(alignment - 1);
+	if (offset + size <= arena->capacity) {
+		arena->head = offset + size;
+		arena->peak = arena->head > arena->peak ? arena->head : arena->peak;
+		memset(arena->base + offset, 0, size);
+		return arena->base + offset;
+	}
+
+	// too small for this frame: keep going on the heap, the counts show it and peak says by how much
+	arena->overflows++;
+	const uint32_t block = arena->frame_overflows++;
+	arena->peak = offset + size > arena->peak ? offset + size : arena->peak;
+	if (block >= sizeof(arena->overflow_blocks) / sizeof(arena->overflow_blocks[0]) || alignment > 16) {
+		fprintf(stderr, "Error: arena exhausted (%zu of %zu bytes)\n", offset + size, arena->capacity);
+		return nullptr;
+	}
+	void *pointer = psymemory::allocate(size, current_tag);
+	memset(pointer, 0, size);
+	arena->overflow_blocks[block] = pointer;
+	return pointer;
+}
+
+void psymemory::reset(memory_arena *arena) {
+	const uint32_t count = sizeof(arena->overflow_blocks) / sizeof(arena->overflow_blocks[0]);
+	for (uint32_t i = 0; i < count; i++) {
+		psymemory::release(arena->overflow_blocks[i]);
+		arena->overflow_blocks[i] = nullptr;
+	}
+	arena->frame_overflows = 0;
+	arena->head = 0;
+}
+
+void psymemory::create_pool(memory_pool *pool, size_t block_size, uint32_t block_count) {
+	// every free block holds the next pointer
+	block_size = block_size < sizeof(void *) ? sizeof(void *) : block_size;
+	block_size = (block_size + 15) & ~(size_t)15;
+	pool->base = (uint8_t *)psymemory::allocate(block_size * block_count, current_tag);
+	pool->block_size = block_size;
+	pool->block_count = block_count;
+	pool->used = 0;
+	pool->free_list = nullptr;
+	for (uint32_t i = block_count; i-- > 0;) {
+		void *block = pool->base + i * block_size;
+		*(void **)block = pool->free_list;
+		pool->free_list = block;
+	}
+}
+
+void psymemory::destroy_pool(memory_pool *pool) {
+	psymemory::release(pool->base);
+	pool->base = nullptr;
+	pool->free_list = nullptr;
+}
+
+void *psymemory::take(memory_pool *pool) {
+	void *block = pool->free_list;
+	if (!block) {
+		return nullptr;
+	}
+	pool->free_list = *(void **)block;
+	pool->used++;
+	return block;
+}
+
+void psymemory::give(memory_pool *pool, void *block) {
+	*(void **)block = pool->free_list;
+	pool->free_list = block;
+	pool->used--;
+}
+
+void *track(uint8_t *block, size_t offset, size_t size, memory_tag tag) {
+	memory_header *header = (memory_header *)(block + offset);
+	header->size = size;
+	header->tag = (uint16_t)tag;
+	header->offset = (uint16_t)offset;
+	header->magic = MEMORY_HEADER_MAGIC;
+	counters[tag].allocations.fetch_add(1, std::memory_order_relaxed);
+	counters[tag].live_bytes.fetch_add((int64_t)size, std::memory_order_relaxed);
+	return header + 1;
+}
+
+// alignment is a power of two, the header sits right in front of the aligned address
+void *allocate_aligned(size_t size, size_t alignment, memory_tag tag) {
+	if (alignment <= sizeof(memory_header)) {
+		return psymemory::allocate(size, tag);
+	}
+	if (alignment > MEMORY_MAX_ALIGNMENT) {
+		return nullptr;
+	}
+	uint8_t *block = (uint8_t *)malloc(sizeof(memory_header) + alignment + size);
+	if (!block) {
+		return nullptr;
+	}
+	const uintptr_t data = ((uintptr_t)block + sizeof(memory_header) + alignment - 1) & ~(uintptr_t)(alignment - 1);
+	return track(block, data - sizeof(memory_header) - (uintptr_t)block, size, tag);
+}
+
+void copy_counters(memory_tag_stats *out) {
+	for (int i = 0; i < MEMORY_TAG_COUNT; i++) {
+		out[i].allocations = counters[i].allocations.load(std::memory_order_relaxed);
+		out[i].frees = counters[i].frees.load(std::memory_order_relaxed);
+		out[i].live_bytes = counters[i].live_bytes.load(std::memory_order_relaxed);
+	}
+}
+
+//
+// GLOBAL NEW / DELETE
+void *operator new(size_t size) {
+	void *pointer = psymemory::allocate(size, current_tag);
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size) {
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept {
+	return psymemory::allocate(size, current_tag);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept {
+	return psymemory::allocate(size, current_tag);
+}
+
+void operator delete(void *pointer) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete[](void *pointer) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete[](void *pointer, size_t) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete(void *pointer, const std::nothrow_t &) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete[](void *pointer, const std::nothrow_t &) noexcept {
+	psymemory::release(pointer);
+}
+
+#if defined(__cpp_aligned_new)
+// alignas beyond 16 (SIMD types, cache line padded structs) comes through here
+void *operator new(size_t size, std::align_val_t alignment) {
+	void *pointer = allocate_aligned(size, (size_t)alignment, current_tag);
+	if (!pointer) {
+		throw std::bad_alloc();
+	}
+	return pointer;
+}
+
+void *operator new[](size_t size, std::align_val_t alignment) {
+	return operator new(size, alignment);
+}
+
+void *operator new(size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return allocate_aligned(size, (size_t)alignment, current_tag);
+}
+
+void *operator new[](size_t size, std::align_val_t alignment, const std::nothrow_t &) noexcept {
+	return allocate_aligned(size, (size_t)alignment, current_tag);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete[](void *pointer, size_t, std::align_val_t) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+	psymemory::release(pointer);
+}
+
+void operator delete[](void *pointer, std::align_val_t, const std::nothrow_t &) noexcept {
+	psymemory::release(pointer);
+}
+#endif
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// Every operator new / delete (and ImGui's allocator) goes through the tracker, which
+// counts per subsystem: whatever PSY_MEMORY_SCOPE the allocating thread is inside.
+enum memory_tag {
+	MEMORY_TAG_OTHER,
+	MEMORY_TAG_GRAPH,
+	MEMORY_TAG_CULL,
+	MEMORY_TAG_SHADER,
+	MEMORY_TAG_TEXTURE,
+	MEMORY_TAG_MESH,
+	MEMORY_TAG_IMGUI,
+	MEMORY_TAG_JOB,
+	MEMORY_TAG_CAPTURE,
+	MEMORY_TAG_BENCH,
+	MEMORY_TAG_PROFILER,
+	MEMORY_TAG_FONT,
+	MEMORY_TAG_SCENE,
+	MEMORY_TAG_LIGHT,
+	MEMORY_TAG_VFS,
+	MEMORY_TAG_COUNT
+};
+
+struct memory_counters {
+	std::atomic<uint64_t> allocations;
+	std::atomic<uint64_t> frees;
+	std::atomic<int64_t> live_bytes;
+};
+
+// plain copy of the counters for one tag
+struct memory_tag_stats {
+	uint64_t allocations;
+	uint64_t frees;
+	int64_t live_bytes;
+};
+
+struct memory_frame_stats {
+	// allocations made between the last two begin_frame calls, by any thread
+	memory_tag_stats frame[MEMORY_TAG_COUNT];
+	memory_tag_stats total[MEMORY_TAG_COUNT];
+	uint64_t frame_allocations;
+};
+
+// bump allocator over one block; reset() frees everything at once, nothing is freed alone
+struct memory_arena {
+	uint8_t *base;
+	size_t capacity;
+	size_t head;
+	size_t peak;
+	// requests that did not fit since create_arena, for the overlay; and since the last
+	// reset, served by the heap from overflow_blocks and freed by it
+	uint32_t overflows;
+	uint32_t frame_overflows;
+	void *overflow_blocks[16];
+};
+
+// fixed size blocks threaded on a free list, for objects created and destroyed one by one
+struct memory_pool {
+	uint8_t *base;
+	size_t block_size;
+	uint32_t block_count;
+	uint32_t used;
+	void *free_list;
+};
+
+namespace psymemory {
+	// tagged malloc / free, what operator new and ImGui end up in
+	void *allocate(size_t size, memory_tag tag);
+	void release(void *pointer);
+	void set_tag(memory_tag tag);
+	memory_tag get_tag();
+	const char *tag_name(memory_tag tag);
+
+	// once per frame on the main thread, rolls the per frame counts over
+	void begin_frame();
+	const memory_frame_stats *stats();
+	void draw_overlay(const memory_arena *const *arenas, const char *const *arena_names, int arena_count);
+
+	void create_arena(memory_arena *arena, size_t capacity);
+	void destroy_arena(memory_arena *arena);
+	// zeroed, alignment is a power of two; nullptr past 16 overflows between resets or
+	// an overflow aligned past 16
+	void *push(memory_arena *arena, size_t size, size_t alignment);
+	void reset(memory_arena *arena);
+
+	template<typename T>
+	T *push_array(memory_arena *arena, size_t count) {
+		return (T *)push(arena, sizeof(T) * count, alignof(T));
+	}
+
+	void create_pool(memory_pool *pool, size_t block_size, uint32_t block_count);
+	void destroy_pool(memory_pool *pool);
+	// nullptr once every block is taken
+	void *take(memory_pool *pool);
+	void give(memory_pool *pool, void *block);
+
+	struct tag_scope {
+		memory_tag previous;
+		tag_scope(memory_tag tag) { previous = get_tag(); set_tag(tag); }
+		~tag_scope() { set_tag(previous); }
+	};
+}
+
+#define PSY_MEMORY_CONCAT_INNER(a, b) a##b
+#define PSY_MEMORY_CONCAT(a, b) PSY_MEMORY_CONCAT_INNER(a, b)
+#define PSY_MEMORY_SCOPE(tag) psymemory::tag_scope PSY_MEMORY_CONCAT(memory_scope_, __LINE__)(tag)
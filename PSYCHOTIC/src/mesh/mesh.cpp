@@ -0,0 +1,144 @@
+#include "mesh.h"
+
+#include <memory/memory.h>
+#include <state/state.h>
+#include <vfs/vfs.h>
+
+#include <glm/ext.hpp>
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+bool psymesh::load(const char *blob_path, mesh_context *mesh) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_MESH);
+	*mesh = {};
+
+	vfs_file file = {};
+	if (!psyvfs::open(blob_path, &file)) {
+		fprintf(stderr, "Error: could not open mesh %s\n", blob_path);
+		return false;
+	}
+
+	const mesh_file_header *header = (const mesh_file_header *)file.data;
+	if (file.size < sizeof(mesh_file_header) ||
+		header->magic != MESH_MAGIC ||
+		header->version != MESH_VERSION ||
+		header->vertex_stride != sizeof(mesh_vertex) ||
+		(header->index_size != 2 && header->index_size != 4) ||
+		header->index_bytes != (uint64_t)header->index_count * header->index_size ||
+		header->vertex_offset < sizeof(mesh_file_header) ||
+		header->vertex_offset > header->index_offset ||
+		(uint64_t)header->vertex_count * header->vertex_stride > header->index_offset - header->vertex_offset ||
+		// written so a stale or truncated file cannot wrap past the end of the mapping
+		header->index_offset > file.size ||
+		header->index_bytes > file.size - header->index_offset ||
+		header->lod_count == 0 ||
+		header->lod_count > MESH_MAX_LODS) {
+		fprintf(stderr, "Error: %s is not a version %d mesh blob\n", blob_path, MESH_VERSION);
+		psyvfs::close(&file);
+		return false;
+	}
+	for (uint32_t i = 0; i < header->lod_count; i++) {
+		const mesh_file_lod &lod = header->lods[i];
+		if ((uint64_t)lod.first_index + lod.index_count > header->index_count) {
+			fprintf(stderr, "Error: %s has a detail level outside its indices\n", blob_path);
+			psyvfs::close(&file);
+			return false;
+		}
+	}
+
+	// vertices and indices are contiguous in the blob, one upload straight from the mapping (or the decompressed copy)
+	const uint8_t *data = (const uint8_t *)file.data + header->vertex_offset;
+	const GLsizeiptr size = (GLsizeiptr)(header->index_offset + header->index_bytes - header->vertex_offset);
+	glCreateBuffers(1, &mesh->buffer);
+	glNamedBufferStorage(mesh->buffer, size, data, 0);
+
+	glCreateVertexArrays(1, &mesh->vao);
+	glVertexArrayVertexBuffer(mesh->vao, 0, mesh->buffer, 0, sizeof(mesh_vertex));
+	glVertexArrayElementBuffer(mesh->vao, mesh->buffer);
+
+	glEnableVertexArrayAttrib(mesh->vao, 0);
+	glEnableVertexArrayAttrib(mesh->vao, 1);
+	glVertexArrayAttribFormat(mesh->vao, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(mesh_vertex, position));
+	glVertexArrayAttribFormat(mesh->vao, 1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, offsetof(mesh_vertex, normal));
+	glVertexArrayAttribBinding(mesh->vao, 0, 0);
+	glVertexArrayAttribBinding(mesh->vao, 1, 0);
+
+	const glm::vec3 aabb_min = glm::vec3(header->aabb_min[0], header->aabb_min[1], header->aabb_min[2]);
+	const glm::vec3 aabb_max = glm::vec3(header->aabb_max[0], header->aabb_max[1], header->aabb_max[2]);
+
+	mesh->index_type = header->index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	mesh->index_offset = (GLintptr)(header->index_offset - header->vertex_offset);
+	mesh->index_count = header->lods[0].index_count;
+	mesh->vertex_count = header->vertex_count;
+	mesh->aabb_min = aabb_min;
+	mesh->aabb_max = aabb_max;
+	mesh->dequantize = glm::scale(glm::translate(glm::mat4(1.0f), aabb_min), aabb_max - aabb_min);
+	mesh->lod_count = header->lod_count;
+	for (uint32_t i = 0; i < header->lod_count; i++) {
+		mesh->lods[i].index_offset = mesh->index_offset + (GLintptr)header->lods[i].first_index * header->index_size;
+		mesh->lods[i].index_count = header->lods[i].index_count;
+		mesh->lods[i].error = header->lods[i].error;
+	}
+
+	psyvfs::close(&file);
+	return true;
+}
+
+void psymesh::destroy(mesh_context *mesh) {
+	psystate::forget(mesh->vao);
+	glDeleteBuffers(1, &mesh->buffer);
+	glDeleteVertexArrays(1, &mesh->vao);
+	*mesh = {};
+}
+
+void psymesh::draw(mesh_context *mesh, uint32_t lod) {
+	const mesh_lod &level = mesh->lods[lod < mesh->lod_count ? lod : mesh->lod_count - 1];
+	psystate::bind_vertex_array(mesh->vao);
+	glDrawElements(GL_TRIANGLES, (GLsizei)level.index_count, mesh->index_type, (void *)level.index_offset);
+}
+
+uint32_t psymesh::select_lod(const mesh_context *mesh, float model_scale, float distance, float pixels_per_unit, float threshold, float hysteresis, uint32_t current) {
+	// pixels per model unit of error at this distance
+	const float projection = model_scale * pixels_per_unit / glm::max(distance, 1e-4f);
+	current = current < mesh->lod_count ? current : mesh->lod_count - 1;
+
+	// levels get coarser and their errors grow with the index
+	uint32_t lod = 0;
+	while (lod + 1 < mesh->lod_count && mesh->lods[lod + 1].error * projection <= threshold) {
+		lod++;
+	}
+
+	if (lod > current) {
+		// coarser only once the level is comfortably below the threshold
+		while (lod > current && mesh->lods[lod].error * projection > threshold * (1.0f - hysteresis)) {
+			lod--;
+		}
+	} else if (lod < current) {
+		// finer only once the current level is clearly above it
+		if (mesh->lods[current].error * projection <= threshold * (1.0f + hysteresis)) {
+			lod = current;
+		}
+	}
+	return lod;
+}
+
+float psymesh::acmr(const uint32_t *indices, size_t index_count, uint32_t vertex_count, int cache_size) {
+	if (index_count < 3) {
+		return 0.0f;
+	}
+
+	// FIFO cache, a vertex is a hit while it is among the last cache_size misses
+	std::vector<uint32_t> timestamps(vertex_count, 0);
+	uint32_t time = (uint32_t)cache_size + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < index_count; i++) {
+		const uint32_t v = indices[i];
+		if (time - timestamps[v] > (uint32_t)cache_size) {
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+	return (float)misses / (float)(index_count / 3);
+}
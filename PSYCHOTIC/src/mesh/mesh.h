@@ -0,0 +1,115 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <stdint.h>
+
+// 'PSYM'
+#define MESH_MAGIC 0x4d595350
+#define MESH_VERSION 2
+// post-transform cache size the optimizer targets and the stats simulate
+#define MESH_CACHE_SIZE 32
+// detail levels including the full one; each is simplified to half the triangles of the
+// one before, until a level would keep more than MESH_LOD_MIN_REDUCTION of them or drop
+// below MESH_LOD_MIN_TRIANGLES
+#define MESH_MAX_LODS 8
+#define MESH_LOD_MIN_REDUCTION 0.8f
+#define MESH_LOD_MIN_TRIANGLES 64
+
+// Baked mesh blob:
+//   mesh_file_header
+//   mesh_vertex[vertex_count]            at vertex_offset
+//   uint16_t/uint32_t[index_count]       at index_offset, right after the vertices
+// so [vertex_offset, index_offset + index_bytes) can be handed to GL as is. Every detail
+// level indexes the same vertices, its indices are a range of the one index array.
+struct mesh_file_lod {
+	uint32_t first_index;
+	uint32_t index_count;
+	// largest distance from the full detail surface, in model units
+	float error;
+	uint32_t padding;
+};
+
+struct mesh_file_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertex_count;
+	uint32_t index_count;
+	uint32_t index_size;
+	uint32_t vertex_stride;
+	float aabb_min[3];
+	float aabb_max[3];
+	uint64_t vertex_offset;
+	uint64_t vertex_bytes;
+	uint64_t index_offset;
+	uint64_t index_bytes;
+	uint32_t lod_count;
+	uint32_t padding;
+	mesh_file_lod lods[MESH_MAX_LODS];
+};
+
+// positions are unorm16 inside the mesh AABB, normals are snorm 2_10_10_10
+struct mesh_vertex {
+	uint16_t position[4];
+	uint32_t normal;
+};
+
+struct mesh_bake_stats {
+	uint32_t source_vertices;
+	uint32_t vertices;
+	uint32_t triangles;
+	uint32_t index_size;
+	float acmr_before;
+	float acmr_after;
+	double import_ms;
+	double optimize_ms;
+	double simplify_ms;
+	double write_ms;
+	uint32_t lod_count;
+	uint32_t lod_triangles[MESH_MAX_LODS];
+	float lod_error[MESH_MAX_LODS];
+};
+
+struct mesh_lod {
+	// bytes into the index range of the buffer
+	GLintptr index_offset;
+	uint32_t index_count;
+	float error;
+};
+
+struct mesh_context {
+	GLuint vao;
+	GLuint buffer;
+	GLenum index_type;
+	GLintptr index_offset;
+	// of the full detail level
+	uint32_t index_count;
+	uint32_t vertex_count;
+	mesh_lod lods[MESH_MAX_LODS];
+	uint32_t lod_count;
+	glm::vec3 aabb_min;
+	glm::vec3 aabb_max;
+	// maps unorm positions back into model space
+	glm::mat4 dequantize;
+};
+
+namespace psymesh {
+	// offline: assimp import, dedup, quadric error simplification into detail levels,
+	// vertex cache + overdraw optimization per level, fetch optimization over all of them
+	bool bake(const char *source_path, const char *blob_path, mesh_bake_stats *stats);
+
+	// runtime: maps the blob and uploads it without touching assimp
+	bool load(const char *blob_path, mesh_context *mesh);
+	void destroy(mesh_context *mesh);
+	void draw(mesh_context *mesh, uint32_t lod);
+
+	// coarsest level whose error, scaled into world units by model_scale and projected at
+	// distance, stays within threshold pixels; pixels_per_unit is the projected size of a
+	// world unit at distance 1. Leaving current needs the error to clear the threshold by
+	// the hysteresis fraction, so a mesh sitting at a switch distance does not pop
+	uint32_t select_lod(const mesh_context *mesh, float model_scale, float distance, float pixels_per_unit, float threshold, float hysteresis, uint32_t current);
+
+	// average cache miss ratio (vertex shader invocations per triangle) of a FIFO cache
+	float acmr(const uint32_t *indices, size_t index_count, uint32_t vertex_count, int cache_size);
+}
@@ -0,0 +1,665 @@
+#include "mesh.h"
+
+#include <bench/bench.h>
+#include <file/file.h>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+
+#define MESH_OVERDRAW_CLUSTER 128
+
+struct vertex_key_hash {
+	size_t operator()(const mesh_vertex &v) const {
+		uint64_t h = 14695981039346656037ull;
+		const uint8_t *bytes = (const uint8_t *)&v;
+		for (size_t i = 0; i < sizeof(mesh_vertex); i++) {
+			h = (h ^ bytes[i]) * 1099511628211ull;
+		}
+		return (size_t)h;
+	}
+};
+
+struct vertex_key_equal {
+	bool operator()(const mesh_vertex &a, const mesh_vertex &b) const {
+		return memcmp(&a, &b, sizeof(mesh_vertex)) == 0;
+	}
+};
+
+// plane distance quadric (Garland-Heckbert), the symmetric 4x4 matrix plus the summed
+// triangle area so the error comes out as a squared distance
+struct quadric {
+	double a00, a01, a02, a03;
+	double a11, a12, a13;
+	double a22, a23;
+	double a33;
+	double weight;
+};
+
+struct edge_collapse {
+	uint32_t from;
+	uint32_t to;
+	float cost;
+};
+
+uint32_t pack_snorm_2_10_10_10(glm::vec3 n);
+std::vector<quadric> build_quadrics(const std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions);
+void quadric_add(quadric *q, const quadric &r);
+float quadric_error(const quadric &q, const glm::vec3 &p);
+std::vector<uint8_t> find_locked_vertices(const std::vector<uint32_t> &indices, uint32_t vertex_count);
+float simplify(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions, std::vector<quadric> &quadrics, const std::vector<uint8_t> &locked, size_t target_triangles);
+void optimize_vertex_cache(std::vector<uint32_t> &indices, uint32_t vertex_count);
+void optimize_overdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions);
+void optimize_vertex_fetch(std::vector<uint32_t> &indices, std::vector<mesh_vertex> &vertices, std::vector<glm::vec3> &positions);
+
+bool psymesh::bake(const char *source_path, const char *blob_path, mesh_bake_stats *stats) {
+	*stats = {};
+
+	uint64_t start = psybench::ticks();
+	Assimp::Importer importer;
+	const aiScene *scene = importer.ReadFile(
+		source_path,
+		aiProcess_Triangulate |
+		aiProcess_JoinIdenticalVertices |
+		aiProcess_GenSmoothNormals |
+		aiProcess_PreTransformVertices |
+		aiProcess_SortByPType);
+	if (!scene || !scene->mNumMeshes) {
+		fprintf(stderr, "Error: assimp could not import %s: %s\n", source_path, importer.GetErrorString());
+		return false;
+	}
+	stats->import_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+
+	// flatten every triangle mesh of the scene into one vertex/index list
+	std::vector<glm::vec3> source_positions;
+	std::vector<glm::vec3> source_normals;
+	std::vector<uint32_t> source_indices;
+	for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+		const aiMesh *ai_mesh = scene->mMeshes[m];
+		if (!(ai_mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE)) {
+			continue;
+		}
+
+		const uint32_t base = (uint32_t)source_positions.size();
+		for (unsigned int v = 0; v < ai_mesh->mNumVertices; v++) {
+			const aiVector3D p = ai_mesh->mVertices[v];
+			const aiVector3D n = ai_mesh->mNormals ? ai_mesh->mNormals[v] : aiVector3D(0.0f, 1.0f, 0.0f);
+			source_positions.push_back(glm::vec3(p.x, p.y, p.z));
+			source_normals.push_back(glm::vec3(n.x, n.y, n.z));
+		}
+		for (unsigned int f = 0; f < ai_mesh->mNumFaces; f++) {
+			const aiFace &face = ai_mesh->mFaces[f];
+			if (face.mNumIndices != 3) {
+				continue;
+			}
+			source_indices.push_back(base + face.mIndices[0]);
+			source_indices.push_back(base + face.mIndices[1]);
+			source_indices.push_back(base + face.mIndices[2]);
+		}
+	}
+	importer.FreeScene();
+
+	if (source_indices.empty()) {
+		fprintf(stderr, "Error: %s has no triangles\n", source_path);
+		return false;
+	}
+
+	start = psybench::ticks();
+
+	glm::vec3 aabb_min = source_positions[0];
+	glm::vec3 aabb_max = source_positions[0];
+	for (const glm::vec3 &p : source_positions) {
+		aabb_min = glm::min(aabb_min, p);
+		aabb_max = glm::max(aabb_max, p);
+	}
+	const glm::vec3 extent = glm::max(aabb_max - aabb_min, glm::vec3(1e-6f));
+
+	// quantize, then deduplicate again since nearby vertices can collapse
+	std::vector<mesh_vertex> vertices;
+	std::vector<glm::vec3> positions;
+	std::vector<uint32_t> remap(source_positions.size());
+	std::unordered_map<mesh_vertex, uint32_t, vertex_key_hash, vertex_key_equal> unique;
+	unique.reserve(source_positions.size());
+	for (size_t i = 0; i < source_positions.size(); i++) {
+		const glm::vec3 t = (source_positions[i] - aabb_min) / extent;
+		mesh_vertex v = {};
+		v.position[0] = (uint16_t)(glm::clamp(t.x, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		v.position[1] = (uint16_t)(glm::clamp(t.y, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		v.position[2] = (uint16_t)(glm::clamp(t.z, 0.0f, 1.0f) * 65535.0f + 0.5f);
+		v.normal = pack_snorm_2_10_10_10(source_normals[i]);
+
+		auto it = unique.find(v);
+		if (it == unique.end()) {
+			const uint32_t index = (uint32_t)vertices.size();
+			unique.emplace(v, index);
+			vertices.push_back(v);
+			positions.push_back(source_positions[i]);
+			remap[i] = index;
+		} else {
+			remap[i] = it->second;
+		}
+	}
+
+	std::vector<uint32_t> indices(source_indices.size());
+	for (size_t i = 0; i < source_indices.size(); i++) {
+		indices[i] = remap[source_indices[i]];
+	}
+
+	stats->source_vertices = (uint32_t)source_positions.size();
+	stats->acmr_before = acmr(indices.data(), indices.size(), (uint32_t)vertices.size(), MESH_CACHE_SIZE);
+
+	// each level is simplified from the one before, the quadrics carry what earlier
+	// collapses removed so every error is measured against the full detail surface
+	const uint64_t simplify_start = psybench::ticks();
+	std::vector<std::vector<uint32_t>> lods(1, indices);
+	std::vector<float> lod_errors(1, 0.0f);
+	std::vector<quadric> quadrics = build_quadrics(indices, positions);
+	const std::vector<uint8_t> locked = find_locked_vertices(indices, (uint32_t)vertices.size());
+	while (lods.size() < MESH_MAX_LODS) {
+		const size_t triangles = lods.back().size() / 3;
+		if (triangles / 2 < MESH_LOD_MIN_TRIANGLES) {
+			break;
+		}
+
+		std::vector<uint32_t> lod = lods.back();
+		const float error = simplify(lod, positions, quadrics, locked, triangles / 2);
+		if (lod.size() / 3 > triangles * MESH_LOD_MIN_REDUCTION) {
+			break;
+		}
+		lods.push_back(lod);
+		lod_errors.push_back(glm::max(error, lod_errors.back()));
+	}
+	stats->simplify_ms = psybench::ticks_to_ms(psybench::ticks() - simplify_start);
+
+	// levels are optimized on their own and share one index array
+	mesh_file_lod file_lods[MESH_MAX_LODS] = {};
+	indices.clear();
+	for (size_t i = 0; i < lods.size(); i++) {
+		optimize_vertex_cache(lods[i], (uint32_t)vertices.size());
+		optimize_overdraw(lods[i], positions);
+
+		file_lods[i].first_index = (uint32_t)indices.size();
+		file_lods[i].index_count = (uint32_t)lods[i].size();
+		file_lods[i].error = lod_errors[i];
+		indices.insert(indices.end(), lods[i].begin(), lods[i].end());
+
+		stats->lod_triangles[i] = (uint32_t)(lods[i].size() / 3);
+		stats->lod_error[i] = lod_errors[i];
+	}
+	stats->lod_count = (uint32_t)lods.size();
+
+	// coarser levels only use vertices of the full one, so its first use order covers them
+	optimize_vertex_fetch(indices, vertices, positions);
+
+	stats->vertices = (uint32_t)vertices.size();
+	stats->triangles = file_lods[0].index_count / 3;
+	stats->acmr_after = acmr(indices.data(), file_lods[0].index_count, (uint32_t)vertices.size(), MESH_CACHE_SIZE);
+	stats->index_size = vertices.size() <= 0xffff ? 2 : 4;
+	stats->optimize_ms = psybench::ticks_to_ms(psybench::ticks() - start) - stats->simplify_ms;
+
+	start = psybench::ticks();
+
+	mesh_file_header header = {};
+	header.magic = MESH_MAGIC;
+	header.version = MESH_VERSION;
+	header.vertex_count = (uint32_t)vertices.size();
+	header.index_count = (uint32_t)indices.size();
+	header.index_size = stats->index_size;
+	header.vertex_stride = sizeof(mesh_vertex);
+	memcpy(header.aabb_min, &aabb_min, sizeof(header.aabb_min));
+	memcpy(header.aabb_max, &aabb_max, sizeof(header.aabb_max));
+	header.vertex_offset = (sizeof(mesh_file_header) + 15) & ~15ull;
+	header.vertex_bytes = vertices.size() * sizeof(mesh_vertex);
+	header.index_offset = header.vertex_offset + header.vertex_bytes;
+	header.index_bytes = indices.size() * header.index_size;
+	header.lod_count = stats->lod_count;
+	memcpy(header.lods, file_lods, sizeof(header.lods));
+
+	// assembled in memory and written in one go, a failed or interrupted bake leaves the
+	// previous blob in place instead of a truncated one
+	std::vector<uint8_t> blob((size_t)(header.index_offset + header.index_bytes), 0);
+	memcpy(blob.data(), &header, sizeof(header));
+	memcpy(blob.data() + header.vertex_offset, vertices.data(), (size_t)header.vertex_bytes);
+	uint8_t *index_data = blob.data() + header.index_offset;
+	if (header.index_size == 2) {
+		for (size_t i = 0; i < indices.size(); i++) {
+			const uint16_t index = (uint16_t)indices[i];
+			memcpy(index_data + i * sizeof(uint16_t), &index, sizeof(index));
+		}
+	} else {
+		memcpy(index_data, indices.data(), (size_t)header.index_bytes);
+	}
+	if (!psyfile::write(blob_path, blob.data(), blob.size())) {
+		fprintf(stderr, "Error: could not write %s\n", blob_path);
+		return false;
+	}
+
+	stats->write_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+	return true;
+}
+
+uint32_t pack_snorm_2_10_10_10(glm::vec3 n) {
+	const float length = glm::length(n);
+	n = length > 0.0f ? n / length : glm::vec3(0.0f, 1.0f, 0.0f);
+	const int x = (int)roundf(glm::clamp(n.x, -1.0f, 1.0f) * 511.0f);
+	const int y = (int)roundf(glm::clamp(n.y, -1.0f, 1.0f) * 511.0f);
+	const int z = (int)roundf(glm::clamp(n.z, -1.0f, 1.0f) * 511.0f);
+	return ((uint32_t)x & 0x3ff) | (((uint32_t)y & 0x3ff) << 10) | (((uint32_t)z & 0x3ff) << 20);
+}
+
+std::vector<quadric> build_quadrics(const std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions) {
+	std::vector<quadric> quadrics(positions.size(), quadric{});
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		const glm::dvec3 a = positions[indices[t + 0]];
+		const glm::dvec3 b = positions[indices[t + 1]];
+		const glm::dvec3 c = positions[indices[t + 2]];
+		glm::dvec3 n = glm::cross(b - a, c - a);
+		const double length = glm::length(n);
+		if (length <= 0.0) {
+			continue;
+		}
+		n /= length;
+		const double d = -glm::dot(n, a);
+		const double w = length * 0.5;
+
+		quadric plane = {};
+		plane.a00 = w * n.x * n.x; plane.a01 = w * n.x * n.y; plane.a02 = w * n.x * n.z; plane.a03 = w * n.x * d;
+		plane.a11 = w * n.y * n.y; plane.a12 = w * n.y * n.z; plane.a13 = w * n.y * d;
+		plane.a22 = w * n.z * n.z; plane.a23 = w * n.z * d;
+		plane.a33 = w * d * d;
+		plane.weight = w;
+		for (int k = 0; k < 3; k++) {
+			quadric_add(&quadrics[indices[t + k]], plane);
+		}
+	}
+	return quadrics;
+}
+
+void quadric_add(quadric *q, const quadric &r) {
+	q->a00 += r.a00; q->a01 += r.a01; q->a02 += r.a02; q->a03 += r.a03;
+	q->a11 += r.a11; q->a12 += r.a12; q->a13 += r.a13;
+	q->a22 += r.a22; q->a23 += r.a23;
+	q->a33 += r.a33;
+	q->weight += r.weight;
+}
+
+// squared distance of p from the planes q was built from, averaged by area
+float quadric_error(const quadric &q, const glm::vec3 &p) {
+	const double x = p.x, y = p.y, z = p.z;
+	const double e =
+		q.a00 * x * x + 2.0 * q.a01 * x * y + 2.0 * q.a02 * x * z + 2.0 * q.a03 * x +
+		q.a11 * y * y + 2.0 * q.a12 * y * z + 2.0 * q.a13 * y +
+		q.a22 * z * z + 2.0 * q.a23 * z +
+		q.a33;
+	return q.weight > 0.0 ? (float)glm::max(e / q.weight, 0.0) : 0.0f;
+}
+
+// Vertices on an open or non-manifold edge never move. Attribute seams are open edges in
+// the index topology (both sides have their own vertices), so they stay crack free too.
+std::vector<uint8_t> find_locked_vertices(const std::vector<uint32_t> &indices, uint32_t vertex_count) {
+	std::unordered_map<uint64_t, uint32_t> edges;
+	edges.reserve(indices.size());
+	for (size_t t = 0; t < indices.size(); t += 3) {
+		for (int k = 0; k < 3; k++) {
+			const uint32_t a = indices[t + k];
+			const uint32_t b = indices[t + (k + 1) % 3];
+			edges[a < b ? ((uint64_t)a << 32) | b : ((uint64_t)b << 32) | a]++;
+		}
+	}
+
+	std::vector<uint8_t> locked(vertex_count, 0);
+	for (const auto &edge : edges) {
+		if (edge.second != 2) {
+			locked[(uint32_t)(edge.first >> 32)] = 1;
+			locked[(uint32_t)edge.first] = 1;
+		}
+	}
+	return locked;
+}
+
+// Greedy edge collapses onto an existing endpoint, in passes: every pass ranks all edges
+// by quadric error and takes the cheapest ones whose neighbourhoods do not overlap, so the
+// costs it compared stay valid. Returns the largest error of a collapse, as a distance.
+float simplify(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions, std::vector<quadric> &quadrics, const std::vector<uint8_t> &locked, size_t target_triangles) {
+	const uint32_t vertex_count = (uint32_t)positions.size();
+	std::vector<edge_collapse> collapses;
+	std::vector<uint32_t> offsets(vertex_count + 1);
+	std::vector<uint32_t> adjacency;
+	std::vector<uint32_t> remap(vertex_count);
+	std::vector<uint8_t> touched(vertex_count);
+	float max_error = 0.0f;
+
+	while (indices.size() / 3 > target_triangles) {
+		const size_t triangle_count = indices.size() / 3;
+
+		// every edge once, interior edges show up in both windings
+		collapses.clear();
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			for (int k = 0; k < 3; k++) {
+				const uint32_t a = indices[t + k];
+				const uint32_t b = indices[t + (k + 1) % 3];
+				if (a > b || (locked[a] && locked[b])) {
+					continue;
+				}
+				quadric q = quadrics[a];
+				quadric_add(&q, quadrics[b]);
+				const float cost_ab = locked[a] ? FLT_MAX : quadric_error(q, positions[b]);
+				const float cost_ba = locked[b] ? FLT_MAX : quadric_error(q, positions[a]);
+				collapses.push_back(cost_ab <= cost_ba ? edge_collapse{ a, b, cost_ab } : edge_collapse{ b, a, cost_ba });
+			}
+		}
+		if (collapses.empty()) {
+			break;
+		}
+		std::sort(collapses.begin(), collapses.end(), [](const edge_collapse &a, const edge_collapse &b) {
+			return a.cost < b.cost;
+		});
+
+		// a collapse removes about two triangles; anything costlier than the goal / 2
+		// cheapest collapses waits for the next pass and its recomputed costs
+		const size_t goal = triangle_count - target_triangles;
+		const float cost_limit = collapses[std::min(collapses.size() - 1, goal / 2)].cost;
+
+		std::fill(offsets.begin(), offsets.end(), 0);
+		for (uint32_t index : indices) {
+			offsets[index + 1]++;
+		}
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		adjacency.resize(indices.size());
+		std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+		for (size_t t = 0; t < triangle_count; t++) {
+			for (int k = 0; k < 3; k++) {
+				adjacency[fill[indices[t * 3 + k]]++] = (uint32_t)t;
+			}
+		}
+
+		for (uint32_t v = 0; v < vertex_count; v++) {
+			remap[v] = v;
+		}
+		std::fill(touched.begin(), touched.end(), 0);
+
+		size_t removed = 0;
+		for (const edge_collapse &collapse : collapses) {
+			if (removed >= goal || collapse.cost > cost_limit) {
+				break;
+			}
+			if (touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+
+			// reject collapses that flip a triangle or move a vertex another collapse of this pass moved
+			bool valid = true;
+			size_t collapsed = 0;
+			for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1] && valid; i++) {
+				const uint32_t *tri = &indices[(size_t)adjacency[i] * 3];
+				if (touched[tri[0]] || touched[tri[1]] || touched[tri[2]]) {
+					valid = false;
+					break;
+				}
+				if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+					collapsed++;
+					continue;
+				}
+
+				glm::vec3 p[3];
+				glm::vec3 q[3];
+				for (int k = 0; k < 3; k++) {
+					p[k] = positions[tri[k]];
+					q[k] = positions[tri[k] == collapse.from ? collapse.to : tri[k]];
+				}
+				const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+				const glm::vec3 after = glm::cross(q[1] - q[0], q[2] - q[0]);
+				valid = glm::dot(before, after) > 0.0f;
+			}
+			if (!valid) {
+				continue;
+			}
+
+			for (uint32_t i = offsets[collapse.from]; i < offsets[collapse.from + 1]; i++) {
+				const uint32_t *tri = &indices[(size_t)adjacency[i] * 3];
+				touched[tri[0]] = touched[tri[1]] = touched[tri[2]] = 1;
+			}
+			remap[collapse.from] = collapse.to;
+			quadric_add(&quadrics[collapse.to], quadrics[collapse.from]);
+			max_error = glm::max(max_error, collapse.cost);
+			removed += collapsed;
+		}
+		if (removed == 0) {
+			break;
+		}
+
+		size_t write = 0;
+		for (size_t t = 0; t < indices.size(); t += 3) {
+			const uint32_t a = remap[indices[t + 0]];
+			const uint32_t b = remap[indices[t + 1]];
+			const uint32_t c = remap[indices[t + 2]];
+			if (a != b && b != c && c != a) {
+				indices[write++] = a;
+				indices[write++] = b;
+				indices[write++] = c;
+			}
+		}
+		indices.resize(write);
+	}
+
+	return sqrtf(max_error);
+}
+
+// Forsyth, "Linear-Speed Vertex Cache Optimisation"
+float forsyth_vertex_score(int cache_position, uint32_t remaining) {
+	if (remaining == 0) {
+		return -1.0f;
+	}
+
+	float score = 0.0f;
+	if (cache_position >= 0) {
+		if (cache_position < 3) {
+			score = 0.75f;
+		} else {
+			const float scale = 1.0f / (MESH_CACHE_SIZE - 3);
+			score = powf(1.0f - (cache_position - 3) * scale, 1.5f);
+		}
+	}
+	return score + 2.0f * powf((float)remaining, -0.5f);
+}
+
+void optimize_vertex_cache(std::vector<uint32_t> &indices, uint32_t vertex_count) {
+	const size_t triangle_count = indices.size() / 3;
+
+	std::vector<uint32_t> remaining(vertex_count, 0);
+	for (uint32_t index : indices) {
+		remaining[index]++;
+	}
+
+	std::vector<uint32_t> offsets(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		offsets[v + 1] = offsets[v] + remaining[v];
+	}
+
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t t = 0; t < triangle_count; t++) {
+		for (int k = 0; k < 3; k++) {
+			const uint32_t v = indices[t * 3 + k];
+			adjacency[fill[v]++] = (uint32_t)t;
+		}
+	}
+
+	std::vector<int> cache_position(vertex_count, -1);
+	std::vector<float> vertex_score(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; v++) {
+		vertex_score[v] = forsyth_vertex_score(-1, remaining[v]);
+	}
+
+	std::vector<bool> emitted(triangle_count, false);
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+
+	uint32_t cache[MESH_CACHE_SIZE + 3];
+	int cache_count = 0;
+	size_t scan = 0;
+	int64_t best = -1;
+
+	for (size_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+		// nothing in the cache has triangles left, restart from the first one not emitted
+		if (best < 0) {
+			while (emitted[scan]) {
+				scan++;
+			}
+			best = (int64_t)scan;
+		}
+
+		const uint32_t *tri = &indices[(size_t)best * 3];
+		result.insert(result.end(), tri, tri + 3);
+		emitted[(size_t)best] = true;
+
+		for (int k = 0; k < 3; k++) {
+			const uint32_t v = tri[k];
+			uint32_t *list = &adjacency[offsets[v]];
+			for (uint32_t i = 0; i < remaining[v]; i++) {
+				if (list[i] == (uint32_t)best) {
+					list[i] = list[remaining[v] - 1];
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// most recent triangle goes to the front of the LRU
+		uint32_t next_cache[MESH_CACHE_SIZE + 3];
+		int next_count = 0;
+		for (int k = 0; k < 3; k++) {
+			next_cache[next_count++] = tri[k];
+		}
+		for (int i = 0; i < cache_count; i++) {
+			const uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2]) {
+				next_cache[next_count++] = v;
+			}
+		}
+
+		for (int i = 0; i < next_count; i++) {
+			const uint32_t v = next_cache[i];
+			cache_position[v] = i < MESH_CACHE_SIZE ? i : -1;
+			vertex_score[v] = forsyth_vertex_score(cache_position[v], remaining[v]);
+		}
+
+		best = -1;
+		float best_score = -1.0f;
+		for (int i = 0; i < next_count; i++) {
+			const uint32_t v = next_cache[i];
+			for (uint32_t j = 0; j < remaining[v]; j++) {
+				const uint32_t t = adjacency[offsets[v] + j];
+				const float score =
+					vertex_score[indices[t * 3 + 0]] +
+					vertex_score[indices[t * 3 + 1]] +
+					vertex_score[indices[t * 3 + 2]];
+				if (score > best_score) {
+					best_score = score;
+					best = t;
+				}
+			}
+		}
+
+		cache_count = next_count < MESH_CACHE_SIZE ? next_count : MESH_CACHE_SIZE;
+		memcpy(cache, next_cache, cache_count * sizeof(uint32_t));
+	}
+
+	indices.swap(result);
+}
+
+// Sort fixed-size clusters of the cache-optimized order so outward facing
+// clusters are drawn first (Sander et al. style), trading a few cache misses at
+// cluster boundaries for less overdraw.
+void optimize_overdraw(std::vector<uint32_t> &indices, const std::vector<glm::vec3> &positions) {
+	const size_t triangle_count = indices.size() / 3;
+	const size_t cluster_count = (triangle_count + MESH_OVERDRAW_CLUSTER - 1) / MESH_OVERDRAW_CLUSTER;
+	if (cluster_count < 2) {
+		return;
+	}
+
+	glm::vec3 mesh_center = glm::vec3(0.0f);
+	float mesh_area = 0.0f;
+
+	struct cluster {
+		size_t first;
+		size_t count;
+		glm::vec3 center;
+		glm::vec3 normal;
+		float sort_key;
+	};
+	std::vector<cluster> clusters(cluster_count);
+
+	for (size_t c = 0; c < cluster_count; c++) {
+		cluster &cl = clusters[c];
+		cl.first = c * MESH_OVERDRAW_CLUSTER;
+		cl.count = std::min((size_t)MESH_OVERDRAW_CLUSTER, triangle_count - cl.first);
+		cl.center = glm::vec3(0.0f);
+		cl.normal = glm::vec3(0.0f);
+
+		float area = 0.0f;
+		for (size_t t = cl.first; t < cl.first + cl.count; t++) {
+			const glm::vec3 a = positions[indices[t * 3 + 0]];
+			const glm::vec3 b = positions[indices[t * 3 + 1]];
+			const glm::vec3 c3 = positions[indices[t * 3 + 2]];
+			const glm::vec3 n = glm::cross(b - a, c3 - a);
+			const float tri_area = glm::length(n) * 0.5f;
+			cl.center += (a + b + c3) * (tri_area / 3.0f);
+			cl.normal += n;
+			area += tri_area;
+		}
+
+		mesh_center += cl.center;
+		mesh_area += area;
+		cl.center = area > 0.0f ? cl.center / area : positions[indices[cl.first * 3]];
+		const float length = glm::length(cl.normal);
+		cl.normal = length > 0.0f ? cl.normal / length : glm::vec3(0.0f);
+	}
+	mesh_center = mesh_area > 0.0f ? mesh_center / mesh_area : mesh_center;
+
+	for (cluster &cl : clusters) {
+		cl.sort_key = glm::dot(cl.center - mesh_center, cl.normal);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const cluster &a, const cluster &b) {
+		return a.sort_key > b.sort_key;
+	});
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (const cluster &cl : clusters) {
+		result.insert(result.end(), indices.begin() + cl.first * 3, indices.begin() + (cl.first + cl.count) * 3);
+	}
+	indices.swap(result);
+}
+
+// renumber vertices in first-use order so vertex fetch walks memory linearly
+void optimize_vertex_fetch(std::vector<uint32_t> &indices, std::vector<mesh_vertex> &vertices, std::vector<glm::vec3> &positions) {
+	std::vector<uint32_t> remap(vertices.size(), UINT32_MAX);
+	std::vector<mesh_vertex> fetch_vertices;
+	std::vector<glm::vec3> fetch_positions;
+	fetch_vertices.reserve(vertices.size());
+	fetch_positions.reserve(positions.size());
+
+	for (uint32_t &index : indices) {
+		if (remap[index] == UINT32_MAX) {
+			remap[index] = (uint32_t)fetch_vertices.size();
+			fetch_vertices.push_back(vertices[index]);
+			fetch_positions.push_back(positions[index]);
+		}
+		index = remap[index];
+	}
+
+	vertices.swap(fetch_vertices);
+	positions.swap(fetch_positions);
+}
@@ -0,0 +1,385 @@
+#include "profiler.h"
+
+#ifdef PSY_ENABLE_PROFILER
+
+#include <imgui.h>
+
+#include <float.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#define PROFILER_GPU_THREAD 0xffff
+
+struct trace_event {
+	const char *name;
+	uint32_t thread;
+	double ts_us;
+	double dur_us;
+};
+
+struct profiler_state {
+	profiler_frame frames[PROFILER_FRAME_LATENCY];
+	// set by the render thread between begin_frame and end_frame, read by every thread opening a scope
+	std::atomic<profiler_frame *> current;
+	int frame_index;
+
+	// newest frame whose GPU timestamps came back, shown by the overlay
+	profiler_scope resolved[PROFILER_MAX_SCOPES];
+	int resolved_count;
+	uint64_t resolved_cpu_begin;
+	uint64_t resolved_cpu_end;
+	uint64_t resolved_gpu_sync;
+
+	float cpu_history[PROFILER_HISTORY];
+	float gpu_history[PROFILER_HISTORY];
+	int history_index;
+
+	bool overlay;
+
+	std::string trace_path;
+	int trace_frames_left;
+	std::vector<trace_event> trace;
+
+	// frames are resolved on the render thread while the overlay is built on the main one
+	std::mutex lock;
+};
+
+static profiler_state profiler;
+static std::atomic<uint32_t> thread_counter;
+static thread_local uint32_t thread_id = thread_counter++;
+static thread_local uint32_t thread_depth;
+
+uint64_t now_ns();
+bool resolve_frame(profiler_frame *frame);
+void start_trace(const char *path);
+void write_trace();
+
+void psyprofiler::create() {
+	for (int i = 0; i < PROFILER_FRAME_LATENCY; i++) {
+		glCreateQueries(GL_TIMESTAMP, PROFILER_MAX_SCOPES * 2, profiler.frames[i].queries);
+		profiler.frames[i].scope_count = 0;
+		profiler.frames[i].open_scopes = 0;
+		profiler.frames[i].pending = false;
+	}
+	profiler.current = nullptr;
+	profiler.frame_index = 0;
+	profiler.resolved_count = 0;
+	profiler.history_index = 0;
+	profiler.overlay = false;
+	profiler.trace_frames_left = 0;
+}
+
+void psyprofiler::destroy() {
+	std::lock_guard<std::mutex> guard(profiler.lock);
+	if (profiler.trace_frames_left > 0) {
+		write_trace();
+	}
+	profiler.current = nullptr;
+	for (int i = 0; i < PROFILER_FRAME_LATENCY; i++) {
+		glDeleteQueries(PROFILER_MAX_SCOPES * 2, profiler.frames[i].queries);
+	}
+}
+
+void psyprofiler::begin_frame() {
+	profiler_frame *frame = &profiler.frames[profiler.frame_index % PROFILER_FRAME_LATENCY];
+	// a scope from PROFILER_FRAME_LATENCY frames ago is still open (a texture compressing on
+	// a worker): this frame goes unrecorded rather than resetting scopes under it
+	if (frame->open_scopes > 0) {
+		return;
+	}
+	// its timestamps are not all back yet, same: the GPU is behind, reading them would block
+	if (frame->pending) {
+		std::lock_guard<std::mutex> guard(profiler.lock);
+		if (!resolve_frame(frame)) {
+			return;
+		}
+	}
+
+	GLint64 gpu_now = 0;
+	glGetInteger64v(GL_TIMESTAMP, &gpu_now);
+
+	frame->scope_count = 0;
+	frame->cpu_begin = now_ns();
+	frame->gpu_sync = (uint64_t)gpu_now;
+	profiler.current = frame;
+}
+
+void psyprofiler::end_frame() {
+	profiler_frame *frame = profiler.current.exchange(nullptr);
+	if (!frame) {
+		return;
+	}
+	frame->cpu_end = now_ns();
+	frame->pending = true;
+	profiler.frame_index++;
+}
+
+int psyprofiler::begin_scope(const char *name, bool gpu, profiler_frame **out_frame) {
+	*out_frame = nullptr;
+	profiler_frame *frame = profiler.current;
+	if (!frame) {
+		return -1;
+	}
+
+	// holds the frame open, then checks it did not end in between; once it is current
+	// again after that, begin_frame has finished resetting it
+	frame->open_scopes++;
+	if (profiler.current != frame) {
+		frame->open_scopes--;
+		return -1;
+	}
+	const int index = frame->scope_count.fetch_add(1);
+	if (index >= PROFILER_MAX_SCOPES) {
+		frame->open_scopes--;
+		return -1;
+	}
+
+	profiler_scope *scope = &frame->scopes[index];
+	scope->name = name;
+	scope->thread = thread_id;
+	scope->depth = thread_depth++;
+	scope->gpu = gpu;
+	scope->gpu_begin = 0;
+	scope->gpu_end = 0;
+	if (gpu) {
+		glQueryCounter(frame->queries[index * 2 + 0], GL_TIMESTAMP);
+	}
+	scope->cpu_begin = now_ns();
+	*out_frame = frame;
+	return index;
+}
+
+void psyprofiler::end_scope(profiler_frame *frame, int index, bool gpu) {
+	if (index < 0 || !frame) {
+		return;
+	}
+
+	profiler_scope *scope = &frame->scopes[index];
+	scope->cpu_end = now_ns();
+	if (gpu) {
+		glQueryCounter(frame->queries[index * 2 + 1], GL_TIMESTAMP);
+	}
+	thread_depth--;
+	// last, resolve_frame may read the scope from here on
+	frame->open_scopes--;
+}
+
+void psyprofiler::toggle_overlay() {
+	profiler.overlay = !profiler.overlay;
+}
+
+bool psyprofiler::overlay_enabled() {
+	return profiler.overlay;
+}
+
+void psyprofiler::draw_overlay() {
+	ImGui::SetNextWindowSize(ImVec2(640, 360), ImGuiCond_FirstUseEver);
+	if (!ImGui::Begin("Profiler", &profiler.overlay)) {
+		ImGui::End();
+		return;
+	}
+	std::lock_guard<std::mutex> guard(profiler.lock);
+
+	const int newest = (profiler.history_index + PROFILER_HISTORY - 1) % PROFILER_HISTORY;
+	ImGui::Text("cpu %.3f ms  gpu %.3f ms", profiler.cpu_history[newest], profiler.gpu_history[newest]);
+	ImGui::PlotLines("cpu", profiler.cpu_history, PROFILER_HISTORY, profiler.history_index, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+	ImGui::PlotLines("gpu", profiler.gpu_history, PROFILER_HISTORY, profiler.history_index, nullptr, 0.0f, FLT_MAX, ImVec2(0, 40));
+
+	if (ImGui::Button("Chrome trace")) {
+		start_trace("trace.json");
+	}
+	if (profiler.trace_frames_left > 0) {
+		ImGui::SameLine();
+		ImGui::Text("recording, %d frames left", profiler.trace_frames_left);
+	}
+
+	// flame view: CPU scopes stacked by depth, GPU scopes on their own lane
+	// below, both on the frame's CPU timeline
+	const uint64_t frame_begin = profiler.resolved_cpu_begin;
+	uint64_t frame_end = profiler.resolved_cpu_end;
+	for (int i = 0; i < profiler.resolved_count; i++) {
+		const profiler_scope *scope = &profiler.resolved[i];
+		if (scope->gpu && scope->gpu_end) {
+			const uint64_t end = frame_begin + (scope->gpu_end - profiler.resolved_gpu_sync);
+			frame_end = end > frame_end ? end : frame_end;
+		}
+	}
+	const double span = frame_end > frame_begin ? (double)(frame_end - frame_begin) : 1.0;
+
+	uint32_t max_depth = 0;
+	for (int i = 0; i < profiler.resolved_count; i++) {
+		max_depth = profiler.resolved[i].depth > max_depth ? profiler.resolved[i].depth : max_depth;
+	}
+
+	const float row_height = ImGui::GetTextLineHeightWithSpacing();
+	const float width = ImGui::GetContentRegionAvail().x;
+	const ImVec2 origin = ImGui::GetCursorScreenPos();
+	const float gpu_lane = (max_depth + 1) * row_height + row_height * 0.5f;
+	ImDrawList *draw_list = ImGui::GetWindowDrawList();
+	ImGui::InvisibleButton("flame", ImVec2(width, gpu_lane + (max_depth + 1) * row_height));
+
+	for (int i = 0; i < profiler.resolved_count; i++) {
+		const profiler_scope *scope = &profiler.resolved[i];
+		for (int lane = 0; lane < (scope->gpu ? 2 : 1); lane++) {
+			uint64_t begin = scope->cpu_begin;
+			uint64_t end = scope->cpu_end;
+			if (lane == 1) {
+				if (!scope->gpu_end) {
+					continue;
+				}
+				begin = frame_begin + (scope->gpu_begin - profiler.resolved_gpu_sync);
+				end = frame_begin + (scope->gpu_end - profiler.resolved_gpu_sync);
+			}
+
+			const float x0 = origin.x + (float)((double)(begin - frame_begin) / span) * width;
+			const float x1 = origin.x + (float)((double)(end - frame_begin) / span) * width;
+			const float y0 = origin.y + (lane ? gpu_lane : 0.0f) + scope->depth * row_height;
+			const ImVec2 min = ImVec2(x0, y0);
+			const ImVec2 max = ImVec2(x1 > x0 + 1.0f ? x1 : x0 + 1.0f, y0 + row_height - 1.0f);
+
+			const ImU32 color = lane ? IM_COL32(200, 90, 60, 255) : IM_COL32(60, 120, 200, 255);
+			draw_list->AddRectFilled(min, max, color);
+			draw_list->PushClipRect(min, max, true);
+			draw_list->AddText(ImVec2(x0 + 2.0f, y0), IM_COL32_WHITE, scope->name);
+			draw_list->PopClipRect();
+
+			if (ImGui::IsMouseHoveringRect(min, max)) {
+				ImGui::SetTooltip("%s (%s)\n%.3f ms", scope->name, lane ? "gpu" : "cpu", (end - begin) / 1000000.0);
+			}
+		}
+	}
+
+	if (ImGui::BeginTable("scopes", 3, ImGuiTableFlags_RowBg | ImGuiTableFlags_Borders)) {
+		ImGui::TableSetupColumn("scope");
+		ImGui::TableSetupColumn("cpu ms");
+		ImGui::TableSetupColumn("gpu ms");
+		ImGui::TableHeadersRow();
+		for (int i = 0; i < profiler.resolved_count; i++) {
+			const profiler_scope *scope = &profiler.resolved[i];
+			ImGui::TableNextRow();
+			ImGui::TableNextColumn();
+			ImGui::Text("%*s%s", scope->depth * 2, "", scope->name);
+			ImGui::TableNextColumn();
+			ImGui::Text("%.3f", (scope->cpu_end - scope->cpu_begin) / 1000000.0);
+			ImGui::TableNextColumn();
+			if (scope->gpu_end) {
+				ImGui::Text("%.3f", (scope->gpu_end - scope->gpu_begin) / 1000000.0);
+			} else {
+				ImGui::TextUnformatted("-");
+			}
+		}
+		ImGui::EndTable();
+	}
+
+	ImGui::End();
+}
+
+void psyprofiler::capture_trace(const char *path) {
+	std::lock_guard<std::mutex> guard(profiler.lock);
+	start_trace(path);
+}
+
+void start_trace(const char *path) {
+	profiler.trace_path = path;
+	profiler.trace_frames_left = PROFILER_TRACE_FRAMES;
+	profiler.trace.clear();
+}
+
+uint64_t now_ns() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// false, touching nothing, while any of the frame's timestamps is still in flight; nested
+// scopes end after their children, so no single query tells when the frame is done
+bool resolve_frame(profiler_frame *frame) {
+	int count = frame->scope_count;
+	count = count > PROFILER_MAX_SCOPES ? PROFILER_MAX_SCOPES : count;
+
+	for (int i = 0; i < count; i++) {
+		if (!frame->scopes[i].gpu) {
+			continue;
+		}
+		GLint begin_available = 0, end_available = 0;
+		glGetQueryObjectiv(frame->queries[i * 2 + 0], GL_QUERY_RESULT_AVAILABLE, &begin_available);
+		glGetQueryObjectiv(frame->queries[i * 2 + 1], GL_QUERY_RESULT_AVAILABLE, &end_available);
+		if (!begin_available || !end_available) {
+			return false;
+		}
+	}
+
+	uint64_t gpu_first = UINT64_MAX;
+	uint64_t gpu_last = 0;
+	for (int i = 0; i < count; i++) {
+		profiler_scope *scope = &frame->scopes[i];
+		if (scope->gpu) {
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(frame->queries[i * 2 + 0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(frame->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+			scope->gpu_begin = begin;
+			scope->gpu_end = end;
+			gpu_first = begin < gpu_first ? begin : gpu_first;
+			gpu_last = end > gpu_last ? end : gpu_last;
+		}
+		profiler.resolved[i] = *scope;
+	}
+	profiler.resolved_count = count;
+	profiler.resolved_cpu_begin = frame->cpu_begin;
+	profiler.resolved_cpu_end = frame->cpu_end;
+	profiler.resolved_gpu_sync = frame->gpu_sync;
+
+	profiler.cpu_history[profiler.history_index] = (frame->cpu_end - frame->cpu_begin) / 1000000.0f;
+	profiler.gpu_history[profiler.history_index] = gpu_last > gpu_first ? (gpu_last - gpu_first) / 1000000.0f : 0.0f;
+	profiler.history_index = (profiler.history_index + 1) % PROFILER_HISTORY;
+
+	if (profiler.trace_frames_left > 0) {
+		for (int i = 0; i < count; i++) {
+			const profiler_scope *scope = &frame->scopes[i];
+			trace_event event = {};
+			event.name = scope->name;
+			event.thread = scope->thread;
+			event.ts_us = scope->cpu_begin / 1000.0;
+			event.dur_us = (scope->cpu_end - scope->cpu_begin) / 1000.0;
+			profiler.trace.push_back(event);
+
+			if (scope->gpu_end) {
+				event.thread = PROFILER_GPU_THREAD;
+				event.ts_us = (frame->cpu_begin + (scope->gpu_begin - frame->gpu_sync)) / 1000.0;
+				event.dur_us = (scope->gpu_end - scope->gpu_begin) / 1000.0;
+				profiler.trace.push_back(event);
+			}
+		}
+		if (--profiler.trace_frames_left == 0) {
+			write_trace();
+		}
+	}
+
+	frame->pending = false;
+	return true;
+}
+
+void write_trace() {
+	FILE *file = fopen(profiler.trace_path.c_str(), "w");
+	if (!file) {
+		fprintf(stderr, "Error: could not write %s\n", profiler.trace_path.c_str());
+		return;
+	}
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", PROFILER_GPU_THREAD);
+	for (const trace_event &event : profiler.trace) {
+		fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			event.name, event.thread, event.ts_us, event.dur_us);
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+
+	printf("wrote %zu trace events to %s\n", profiler.trace.size(), profiler.trace_path.c_str());
+	profiler.trace.clear();
+}
+
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+
+// CPU/GPU scope profiler. Everything here is reached through the PSY_PROFILE_*
+// macros, which expand to nothing unless PSY_ENABLE_PROFILER is defined.
+
+#ifdef PSY_ENABLE_PROFILER
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+#include <atomic>
+
+#define PROFILER_MAX_SCOPES 256
+// GPU timestamps are resolved this many frames later, if they are still not
+// available by then the frame's GPU data is dropped instead of waiting
+#define PROFILER_FRAME_LATENCY 4
+#define PROFILER_HISTORY 240
+#define PROFILER_TRACE_FRAMES 120
+
+struct profiler_scope {
+	const char *name;
+	uint32_t thread;
+	uint32_t depth;
+	uint64_t cpu_begin;
+	uint64_t cpu_end;
+	uint64_t gpu_begin;
+	uint64_t gpu_end;
+	bool gpu;
+};
+
+// scopes open and close on any thread; a frame is resolved and reused only once open_scopes
+// is back to zero, whatever the render thread's frame boundaries did meanwhile
+struct profiler_frame {
+	profiler_scope scopes[PROFILER_MAX_SCOPES];
+	GLuint queries[PROFILER_MAX_SCOPES * 2];
+	std::atomic<int> scope_count;
+	std::atomic<int> open_scopes;
+	uint64_t cpu_begin;
+	uint64_t cpu_end;
+	// GL_TIMESTAMP sampled next to cpu_begin, used to line both clocks up
+	uint64_t gpu_sync;
+	bool pending;
+};
+
+namespace psyprofiler {
+	void create();
+	void destroy();
+	void begin_frame();
+	void end_frame();
+
+	// the scope ends in the frame it began in, begin_scope returns that frame in *frame
+	int begin_scope(const char *name, bool gpu, profiler_frame **frame);
+	void end_scope(profiler_frame *frame, int index, bool gpu);
+
+	void toggle_overlay();
+	bool overlay_enabled();
+	void draw_overlay();
+
+	// records the next PROFILER_TRACE_FRAMES frames and writes them as a
+	// chrome://tracing / Perfetto compatible JSON file
+	void capture_trace(const char *path);
+
+	struct cpu_scope {
+		profiler_frame *frame;
+		int index;
+		cpu_scope(const char *name) { index = begin_scope(name, false, &frame); }
+		~cpu_scope() { end_scope(frame, index, false); }
+	};
+
+	// GL thread only
+	struct gpu_scope {
+		profiler_frame *frame;
+		int index;
+		gpu_scope(const char *name) { index = begin_scope(name, true, &frame); }
+		~gpu_scope() { end_scope(frame, index, true); }
+	};
+}
+
+#define PSY_PROFILE_CONCAT_INNER(a, b) a##b
+#define PSY_PROFILE_CONCAT(a, b) PSY_PROFILE_CONCAT_INNER(a, b)
+
+#define PSY_PROFILE_SCOPE(name) psyprofiler::cpu_scope PSY_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PSY_PROFILE_GPU_SCOPE(name) psyprofiler::gpu_scope PSY_PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PSY_PROFILER_CREATE() psyprofiler::create()
+#define PSY_PROFILER_DESTROY() psyprofiler::destroy()
+#define PSY_PROFILER_BEGIN_FRAME() psyprofiler::begin_frame()
+#define PSY_PROFILER_END_FRAME() psyprofiler::end_frame()
+
+#else
+
+#define PSY_PROFILE_SCOPE(name)
+#define PSY_PROFILE_GPU_SCOPE(name)
+#define PSY_PROFILER_CREATE()
+#define PSY_PROFILER_DESTROY()
+#define PSY_PROFILER_BEGIN_FRAME()
+#define PSY_PROFILER_END_FRAME()
+
+#endif
@@ -0,0 +1,87 @@
+#include "render.h"
+
+#include <bench/bench.h>
+#include <profiler/profiler.h>
+
+#include <chrono>
+
+void render_main(render_thread *renderer);
+
+void psyrender::start(render_thread *renderer, window_state *window, render_function function, void *user) {
+	renderer->window = window;
+	renderer->function = function;
+	renderer->user = user;
+	renderer->pending = -1;
+	renderer->busy = false;
+	renderer->quit = false;
+	renderer->wait_ms = 0.0;
+	renderer->render_ms = 0.0;
+
+	psywindow::make_current(window, false);
+	renderer->thread = std::thread(render_main, renderer);
+}
+
+void psyrender::stop(render_thread *renderer) {
+	psyrender::wait(renderer);
+	{
+		std::lock_guard<std::mutex> guard(renderer->lock);
+		renderer->quit = true;
+	}
+	renderer->wake.notify_one();
+	renderer->thread.join();
+
+	psywindow::make_current(renderer->window, true);
+}
+
+void psyrender::wait(render_thread *renderer) {
+	PSY_PROFILE_SCOPE("psyrender::wait");
+	const uint64_t start = psybench::ticks();
+	std::unique_lock<std::mutex> guard(renderer->lock);
+	renderer->idle.wait(guard, [renderer] { return !renderer->busy; });
+	renderer->wait_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+}
+
+bool psyrender::wait_for(render_thread *renderer, double timeout_ms) {
+	std::unique_lock<std::mutex> guard(renderer->lock);
+	return renderer->idle.wait_for(guard, std::chrono::microseconds((int64_t)(timeout_ms * 1000.0)), [renderer] { return !renderer->busy; });
+}
+
+void psyrender::submit(render_thread *renderer, int slot) {
+	psyrender::wait(renderer);
+	{
+		std::lock_guard<std::mutex> guard(renderer->lock);
+		renderer->pending = slot;
+		renderer->busy = true;
+	}
+	renderer->wake.notify_one();
+}
+
+void render_main(render_thread *renderer) {
+	psywindow::make_current(renderer->window, true);
+
+	for (;;) {
+		int slot = -1;
+		{
+			std::unique_lock<std::mutex> guard(renderer->lock);
+			renderer->wake.wait(guard, [renderer] { return renderer->quit || renderer->pending >= 0; });
+			if (renderer->pending < 0) {
+				break;
+			}
+			slot = renderer->pending;
+			renderer->pending = -1;
+		}
+
+		const uint64_t start = psybench::ticks();
+		renderer->function(renderer->user, slot);
+		const double render_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+
+		{
+			std::lock_guard<std::mutex> guard(renderer->lock);
+			renderer->render_ms = render_ms;
+			renderer->busy = false;
+		}
+		renderer->idle.notify_all();
+	}
+
+	psywindow::make_current(renderer->window, false);
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <window/window.h>
+
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// frames handed over to the render thread, the producer fills one while the other is drawn
+#define RENDER_FRAME_SLOTS 2
+
+// draws the frame in slot on the render thread, which owns the GL context
+typedef void (*render_function)(void *user, int slot);
+
+struct render_thread {
+	std::thread thread;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable idle;
+
+	window_state *window;
+	render_function function;
+	void *user;
+
+	// slot waiting to be drawn, -1 when none
+	int pending;
+	bool busy;
+	bool quit;
+
+	// time the producer spent blocked in wait() and the render thread spent drawing, last frame
+	double wait_ms;
+	double render_ms;
+};
+
+namespace psyrender {
+	// moves the window's context from the calling thread to a new render thread
+	void start(render_thread *renderer, window_state *window, render_function function, void *user);
+	// finishes the last frame and brings the context back to the calling thread
+	void stop(render_thread *renderer);
+
+	// blocks until the last submitted frame is drawn; until the next submit the render
+	// thread touches nothing, so this is where state can be exchanged with it
+	void wait(render_thread *renderer);
+	// same, gives up after timeout_ms and returns false if the frame is still being drawn
+	bool wait_for(render_thread *renderer, double timeout_ms);
+	void submit(render_thread *renderer, int slot);
+}
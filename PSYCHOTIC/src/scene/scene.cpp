@@ -0,0 +1,294 @@
+#include "scene.h"
+
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+
+#include <xmmintrin.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+void update_range(scene_graph *scene, scene_range range, uint8_t *target);
+void write_range(const scene_graph *scene, scene_range range, uint8_t *target);
+void write_node(const scene_graph *scene, uint32_t node, __m128 c0, __m128 c1, __m128 c2, __m128 c3, float radius, uint8_t *target);
+
+void psyscene::create(scene_graph *scene, uint32_t capacity) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_SCENE);
+
+	capacity = capacity > 0 ? capacity : 1;
+	capacity = (capacity + SCENE_NODE_GRANULARITY - 1) / SCENE_NODE_GRANULARITY * SCENE_NODE_GRANULARITY;
+	scene->capacity = capacity;
+
+	std::vector<float> *locals[] = {
+		&scene->position_x, &scene->position_y, &scene->position_z,
+		&scene->rotation_x, &scene->rotation_y, &scene->rotation_z, &scene->rotation_w,
+		&scene->scale, &scene->radius
+	};
+	for (std::vector<float> *local : locals) {
+		local->reserve(capacity);
+	}
+	scene->parent.reserve(capacity);
+	scene->subtree_end.reserve(capacity);
+	for (std::vector<glm::vec4> &column : scene->world) {
+		column.assign(capacity, glm::vec4(0.0f));
+	}
+	scene->world_scale.assign(capacity, 0.0f);
+	scene->spheres.x.assign(capacity, 0.0f);
+	scene->spheres.y.assign(capacity, 0.0f);
+	scene->spheres.z.assign(capacity, 0.0f);
+	scene->spheres.radius.assign(capacity, 0.0f);
+	scene->dirty.reserve(capacity);
+	psyscene::clear(scene);
+	memset(scene->fences, 0, sizeof(scene->fences));
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	scene->copy_size = (GLsizeiptr)capacity * sizeof(glm::vec4) * 4;
+	glCreateBuffers(1, &scene->buffer);
+	glNamedBufferStorage(scene->buffer, scene->copy_size * SCENE_BUFFER_COPIES, nullptr, flags);
+	scene->mapped = (uint8_t *)glMapNamedBufferRange(scene->buffer, 0, scene->copy_size * SCENE_BUFFER_COPIES, flags);
+	if (!scene->mapped) {
+		fprintf(stderr, "Error: failed to map scene buffer (%lld bytes)\n", (long long)(scene->copy_size * SCENE_BUFFER_COPIES));
+		return;
+	}
+	// instances past count are zero, a zero radius sphere never survives culling
+	memset(scene->mapped, 0, (size_t)scene->copy_size * SCENE_BUFFER_COPIES);
+}
+
+void psyscene::destroy(scene_graph *scene) {
+	for (GLsync &fence : scene->fences) {
+		if (fence) {
+			glDeleteSync(fence);
+			fence = 0;
+		}
+	}
+	if (scene->mapped) {
+		glUnmapNamedBuffer(scene->buffer);
+	}
+	psystate::forget(scene->buffer);
+	glDeleteBuffers(1, &scene->buffer);
+	scene->buffer = 0;
+	scene->mapped = nullptr;
+	scene->count = 0;
+	scene->capacity = 0;
+}
+
+void psyscene::clear(scene_graph *scene) {
+	std::vector<float> *locals[] = {
+		&scene->position_x, &scene->position_y, &scene->position_z,
+		&scene->rotation_x, &scene->rotation_y, &scene->rotation_z, &scene->rotation_w,
+		&scene->scale, &scene->radius
+	};
+	for (std::vector<float> *local : locals) {
+		local->clear();
+	}
+	scene->parent.clear();
+	scene->subtree_end.clear();
+	scene->dirty.clear();
+	for (std::vector<scene_range> &ranges : scene->ranges) {
+		ranges.clear();
+	}
+	scene->count = 0;
+	scene->updated_nodes = 0;
+}
+
+uint32_t psyscene::add(scene_graph *scene, uint32_t parent, const scene_transform &local, float radius) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_SCENE);
+	if (scene->count == scene->capacity) {
+		fprintf(stderr, "Error: scene is full (%u nodes)\n", scene->capacity);
+		return SCENE_NO_PARENT;
+	}
+	// the parent's subtree has to end right here, or the new node would split someone else's
+	const uint32_t node = scene->count;
+	if (parent != SCENE_NO_PARENT && (parent >= node || scene->subtree_end[parent] != node)) {
+		fprintf(stderr, "Error: scene node %u added out of depth first order under %u\n", node, parent);
+		return SCENE_NO_PARENT;
+	}
+	scene->count++;
+
+	scene->position_x.push_back(local.position.x);
+	scene->position_y.push_back(local.position.y);
+	scene->position_z.push_back(local.position.z);
+	scene->rotation_x.push_back(local.rotation.x);
+	scene->rotation_y.push_back(local.rotation.y);
+	scene->rotation_z.push_back(local.rotation.z);
+	scene->rotation_w.push_back(local.rotation.w);
+	scene->scale.push_back(local.scale);
+	scene->radius.push_back(radius);
+	scene->parent.push_back(parent);
+	scene->subtree_end.push_back(node + 1);
+	for (uint32_t ancestor = parent; ancestor != SCENE_NO_PARENT; ancestor = scene->parent[ancestor]) {
+		scene->subtree_end[ancestor] = node + 1;
+	}
+	scene->dirty.push_back(node);
+	return node;
+}
+
+void psyscene::set_local(scene_graph *scene, uint32_t node, const scene_transform &local) {
+	scene->position_x[node] = local.position.x;
+	scene->position_y[node] = local.position.y;
+	scene->position_z[node] = local.position.z;
+	scene->rotation_x[node] = local.rotation.x;
+	scene->rotation_y[node] = local.rotation.y;
+	scene->rotation_z[node] = local.rotation.z;
+	scene->rotation_w[node] = local.rotation.w;
+	scene->scale[node] = local.scale;
+	scene->dirty.push_back(node);
+}
+
+void psyscene::update(scene_graph *scene, uint32_t copy) {
+	PSY_PROFILE_SCOPE("psyscene::update");
+	PSY_MEMORY_SCOPE(MEMORY_TAG_SCENE);
+
+	// sorted, a dirty node is either inside the last range taken or starts a new one
+	std::vector<scene_range> *ranges = &scene->ranges[copy];
+	ranges->clear();
+	std::sort(scene->dirty.begin(), scene->dirty.end());
+	uint32_t covered = 0;
+	for (uint32_t node : scene->dirty) {
+		if (node < covered) {
+			continue;
+		}
+		covered = scene->subtree_end[node];
+		if (!ranges->empty() && ranges->back().end == node) {
+			ranges->back().end = covered;
+		} else {
+			ranges->push_back({ node, covered });
+		}
+	}
+	scene->dirty.clear();
+
+	uint8_t *target = scene->mapped + copy * scene->copy_size;
+	scene->updated_nodes = 0;
+	for (const scene_range &range : *ranges) {
+		update_range(scene, range, target);
+		scene->updated_nodes += range.end - range.begin;
+	}
+	// and whatever the other copies got since this one was last written
+	for (uint32_t other = 0; other < SCENE_BUFFER_COPIES; other++) {
+		if (other == copy) {
+			continue;
+		}
+		for (const scene_range &range : scene->ranges[other]) {
+			write_range(scene, range, target);
+		}
+	}
+	_mm_sfence();
+}
+
+void psyscene::fence(scene_graph *scene, uint32_t copy) {
+	if (scene->fences[copy]) {
+		glDeleteSync(scene->fences[copy]);
+	}
+	scene->fences[copy] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void psyscene::wait(scene_graph *scene, uint32_t copy) {
+	GLsync fence = scene->fences[copy];
+	if (!fence) {
+		return;
+	}
+	PSY_PROFILE_SCOPE("scene wait");
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED) {
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+	}
+	glDeleteSync(fence);
+	scene->fences[copy] = 0;
+}
+
+GLintptr psyscene::array_offset(const scene_graph *scene, uint32_t copy, int array) {
+	return (GLintptr)copy * scene->copy_size + array * psyscene::array_size(scene);
+}
+
+GLsizeiptr psyscene::array_size(const scene_graph *scene) {
+	return (GLsizeiptr)scene->capacity * sizeof(glm::vec4);
+}
+
+// parents come first, so by the time a node is reached its parent's world transform is
+// current, either from an earlier frame or from earlier in this range
+void update_range(scene_graph *scene, scene_range range, uint8_t *target) {
+	for (uint32_t i = range.begin; i < range.end; i++) {
+		// glm::mat3_cast of the rotation times the uniform scale, then the translation
+		const float x = scene->rotation_x[i];
+		const float y = scene->rotation_y[i];
+		const float z = scene->rotation_z[i];
+		const float w = scene->rotation_w[i];
+		const float s = scene->scale[i];
+		const float xx = x * x, yy = y * y, zz = z * z;
+		const float xy = x * y, xz = x * z, yz = y * z;
+		const float wx = w * x, wy = w * y, wz = w * z;
+		const __m128 l0 = _mm_setr_ps((1.0f - 2.0f * (yy + zz)) * s, 2.0f * (xy + wz) * s, 2.0f * (xz - wy) * s, 0.0f);
+		const __m128 l1 = _mm_setr_ps(2.0f * (xy - wz) * s, (1.0f - 2.0f * (xx + zz)) * s, 2.0f * (yz + wx) * s, 0.0f);
+		const __m128 l2 = _mm_setr_ps(2.0f * (xz + wy) * s, 2.0f * (yz - wx) * s, (1.0f - 2.0f * (xx + yy)) * s, 0.0f);
+		const __m128 l3 = _mm_setr_ps(scene->position_x[i], scene->position_y[i], scene->position_z[i], 1.0f);
+
+		__m128 c0 = l0, c1 = l1, c2 = l2, c3 = l3;
+		float world_scale = s;
+		const uint32_t parent = scene->parent[i];
+		if (parent != SCENE_NO_PARENT) {
+			// column j of parent * local is the parent's columns weighted by local column j
+			const __m128 p0 = _mm_load_ps(&scene->world[0][parent].x);
+			const __m128 p1 = _mm_load_ps(&scene->world[1][parent].x);
+			const __m128 p2 = _mm_load_ps(&scene->world[2][parent].x);
+			const __m128 p3 = _mm_load_ps(&scene->world[3][parent].x);
+			const __m128 *local[4] = { &l0, &l1, &l2, &l3 };
+			__m128 *world[4] = { &c0, &c1, &c2, &c3 };
+			for (int j = 0; j < 4; j++) {
+				const __m128 l = *local[j];
+				__m128 column = _mm_mul_ps(p0, _mm_shuffle_ps(l, l, _MM_SHUFFLE(0, 0, 0, 0)));
+				column = _mm_add_ps(column, _mm_mul_ps(p1, _mm_shuffle_ps(l, l, _MM_SHUFFLE(1, 1, 1, 1))));
+				column = _mm_add_ps(column, _mm_mul_ps(p2, _mm_shuffle_ps(l, l, _MM_SHUFFLE(2, 2, 2, 2))));
+				column = _mm_add_ps(column, _mm_mul_ps(p3, _mm_shuffle_ps(l, l, _MM_SHUFFLE(3, 3, 3, 3))));
+				*world[j] = column;
+			}
+			world_scale *= scene->world_scale[parent];
+		}
+
+		_mm_store_ps(&scene->world[0][i].x, c0);
+		_mm_store_ps(&scene->world[1][i].x, c1);
+		_mm_store_ps(&scene->world[2][i].x, c2);
+		_mm_store_ps(&scene->world[3][i].x, c3);
+		scene->world_scale[i] = world_scale;
+
+		const float radius = scene->radius[i] * world_scale;
+		float center[4];
+		_mm_storeu_ps(center, c3);
+		scene->spheres.x[i] = center[0];
+		scene->spheres.y[i] = center[1];
+		scene->spheres.z[i] = center[2];
+		scene->spheres.radius[i] = radius;
+		write_node(scene, i, c0, c1, c2, c3, radius, target);
+	}
+}
+
+void write_range(const scene_graph *scene, scene_range range, uint8_t *target) {
+	for (uint32_t i = range.begin; i < range.end; i++) {
+		write_node(scene, i,
+			_mm_load_ps(&scene->world[0][i].x),
+			_mm_load_ps(&scene->world[1][i].x),
+			_mm_load_ps(&scene->world[2][i].x),
+			_mm_load_ps(&scene->world[3][i].x),
+			scene->spheres.radius[i],
+			target);
+	}
+}
+
+// the shaders want rows, a transpose turns the columns into them; streaming stores since
+// the mapping is usually write combined and never read back
+void write_node(const scene_graph *scene, uint32_t node, __m128 c0, __m128 c1, __m128 c2, __m128 c3, float radius, uint8_t *target) {
+	const GLsizeiptr array_size = psyscene::array_size(scene);
+	const __m128 center = c3;
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	float *row0 = (float *)(target) + node * 4;
+	float *row1 = (float *)(target + array_size) + node * 4;
+	float *row2 = (float *)(target + 2 * array_size) + node * 4;
+	float *sphere = (float *)(target + 3 * array_size) + node * 4;
+	_mm_stream_ps(row0, c0);
+	_mm_stream_ps(row1, c1);
+	_mm_stream_ps(row2, c2);
+	// translation with the radius in w
+	const __m128 w = _mm_set_ss(radius);
+	_mm_stream_ps(sphere, _mm_shuffle_ps(center, _mm_shuffle_ps(center, w, _MM_SHUFFLE(0, 0, 2, 2)), _MM_SHUFFLE(2, 0, 1, 0)));
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <bench/bench.h>
+#include <cull/cull.h>
+
+#include <stdint.h>
+#include <vector>
+
+// copies of the instance data the GPU can still be reading while the main thread writes
+// the next one; the render thread waits for a copy two frames before it is written again
+#define SCENE_BUFFER_COPIES 3
+// node capacity is rounded up to this so every SoA array of a copy starts on an SSBO
+// offset alignment
+#define SCENE_NODE_GRANULARITY 64
+#define SCENE_NO_PARENT 0xffffffffu
+
+struct scene_transform {
+	glm::vec3 position;
+	glm::quat rotation;
+	float scale;
+};
+
+// nodes [begin, end) whose world transform changed
+struct scene_range {
+	uint32_t begin;
+	uint32_t end;
+};
+
+// Nodes are stored depth first, so every parent comes before its children and a node's
+// subtree is the contiguous range up to its subtree_end. A changed local transform dirties
+// that range and nothing else.
+struct scene_graph {
+	uint32_t count;
+	uint32_t capacity;
+
+	// local transform, one array per component
+	std::vector<float> position_x;
+	std::vector<float> position_y;
+	std::vector<float> position_z;
+	std::vector<float> rotation_x;
+	std::vector<float> rotation_y;
+	std::vector<float> rotation_z;
+	std::vector<float> rotation_w;
+	std::vector<float> scale;
+	// bounding sphere of what the node draws, around its local origin
+	std::vector<float> radius;
+	std::vector<uint32_t> parent;
+	std::vector<uint32_t> subtree_end;
+
+	// world transform, one array per matrix column (16 byte aligned, what the allocator
+	// hands out, so SSE loads them directly); world_scale is the product of the
+	// uniform scales down the path, it scales the bounding sphere
+	std::vector<glm::vec4> world[4];
+	std::vector<float> world_scale;
+	// world bounding spheres for the CPU culling path
+	cull_spheres spheres;
+
+	// nodes set_local touched since the last update, in any order, repeats allowed
+	std::vector<uint32_t> dirty;
+	// what each update wrote into its copy, a copy also needs what the others got since
+	std::vector<scene_range> ranges[SCENE_BUFFER_COPIES];
+	uint32_t updated_nodes;
+
+	// SCENE_BUFFER_COPIES times row0[capacity], row1[capacity], row2[capacity] of the
+	// affine world transform and spheres[capacity], persistently mapped
+	GLuint buffer;
+	uint8_t *mapped;
+	GLsizeiptr copy_size;
+	GLsync fences[SCENE_BUFFER_COPIES];
+};
+
+namespace psyscene {
+	// GL thread, the node arrays and the mapped buffer hold capacity nodes
+	void create(scene_graph *scene, uint32_t capacity);
+	void destroy(scene_graph *scene);
+	// drops every node, keeps the buffer
+	void clear(scene_graph *scene);
+
+	// nodes go in depth first: parent is SCENE_NO_PARENT, the last node added or one of its ancestors
+	uint32_t add(scene_graph *scene, uint32_t parent, const scene_transform &local, float radius);
+	void set_local(scene_graph *scene, uint32_t node, const scene_transform &local);
+
+	// main thread: recomputes the world transforms of the dirty subtrees and writes what
+	// changed since copy was last written straight into it; copies are taken round robin
+	void update(scene_graph *scene, uint32_t copy);
+
+	// GL thread: fence after the last command reading copy, wait before it is written again
+	void fence(scene_graph *scene, uint32_t copy);
+	void wait(scene_graph *scene, uint32_t copy);
+
+	// byte offset of a copy's row0 .. row2 (0 .. 2) or spheres (3)
+	GLintptr array_offset(const scene_graph *scene, uint32_t copy, int array);
+	GLsizeiptr array_size(const scene_graph *scene);
+
+	// --scene-bench, scene_bench.cpp: updates 100k and 1M node hierarchies with 1%, 10% and
+	// 100% of the local transforms changing every frame, then every world matrix with glm
+	void run_bench(bench_state *bench);
+}
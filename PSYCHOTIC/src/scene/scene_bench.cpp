@@ -0,0 +1,107 @@
+#include "scene.h"
+
+#include <bench/bench.h>
+
+#include <glm/ext.hpp>
+
+#include <stdio.h>
+#include <vector>
+
+uint32_t scene_random(uint32_t *state);
+
+void psyscene::run_bench(bench_state *bench) {
+	const uint32_t counts[] = { 100000, 1000000 };
+	const uint32_t percents[] = { 1, 10, 100 };
+	// the first frames after a change of rate still copy the previous rate's ranges
+	const int warmup_frames = SCENE_BUFFER_COPIES;
+	const int measured_frames = 30;
+	const glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+
+	printf("scene update:\n%10s %8s %10s %10s\n", "nodes", "changed", "touched", "ms");
+	for (uint32_t count : counts) {
+		scene_graph scene = {};
+		psyscene::create(&scene, count);
+
+		// roots with three levels of eight children below them, built depth first
+		uint32_t random = 0x9e3779b9u;
+		scene_transform local = {};
+		local.scale = 1.0f;
+		while (scene.count < count) {
+			local.position = glm::vec3((float)(scene.count % 1000), 0.0f, (float)(scene.count / 1000)) * 3.0f;
+			local.rotation = glm::angleAxis((float)scene_random(&random), up);
+			const uint32_t root = psyscene::add(&scene, SCENE_NO_PARENT, local, 1.7320508f);
+			for (int a = 0; a < 8 && scene.count < count; a++) {
+				local.position = glm::vec3(2.0f, 0.0f, 0.0f);
+				const uint32_t child = psyscene::add(&scene, root, local, 1.7320508f);
+				for (int b = 0; b < 8 && scene.count < count; b++) {
+					const uint32_t grandchild = psyscene::add(&scene, child, local, 1.7320508f);
+					for (int c = 0; c < 8 && scene.count < count; c++) {
+						psyscene::add(&scene, grandchild, local, 1.7320508f);
+					}
+				}
+			}
+		}
+		for (uint32_t copy = 0; copy < SCENE_BUFFER_COPIES; copy++) {
+			psyscene::update(&scene, copy);
+		}
+
+		char name[64];
+		for (uint32_t percent : percents) {
+			const uint32_t changed = (uint32_t)((uint64_t)count * percent / 100);
+			double total_ms = 0.0;
+			uint64_t touched = 0;
+			for (int frame = 0; frame < warmup_frames + measured_frames; frame++) {
+				for (uint32_t i = 0; i < changed; i++) {
+					const uint32_t node = percent == 100 ? i : scene_random(&random) % count;
+					local.position = glm::vec3(scene.position_x[node], scene.position_y[node], scene.position_z[node]);
+					local.rotation = glm::angleAxis(frame * 0.1f, up);
+					psyscene::set_local(&scene, node, local);
+				}
+				const uint64_t start = psybench::ticks();
+				psyscene::update(&scene, frame % SCENE_BUFFER_COPIES);
+				if (frame >= warmup_frames) {
+					total_ms += psybench::ticks_to_ms(psybench::ticks() - start);
+					touched += scene.updated_nodes;
+				}
+			}
+
+			const double ms = total_ms / measured_frames;
+			snprintf(name, sizeof(name), "scene_%u_%upct_ms", count, percent);
+			psybench::set_value(bench, name, ms);
+			snprintf(name, sizeof(name), "scene_%u_%upct_nodes", count, percent);
+			psybench::set_value(bench, name, (double)(touched / measured_frames));
+			printf("%10u %7u%% %10llu %10.3f\n", count, percent, (unsigned long long)(touched / measured_frames), ms);
+		}
+
+		// every node every frame with glm, what the old inline model matrix scaled up to a scene
+		std::vector<glm::mat4> world(count);
+		double glm_ms = 0.0;
+		for (int frame = 0; frame < measured_frames; frame++) {
+			const uint64_t start = psybench::ticks();
+			for (uint32_t i = 0; i < count; i++) {
+				const glm::quat rotation = glm::quat(scene.rotation_w[i], scene.rotation_x[i], scene.rotation_y[i], scene.rotation_z[i]);
+				const glm::mat4 model =
+					glm::translate(glm::mat4(1.0f), glm::vec3(scene.position_x[i], scene.position_y[i], scene.position_z[i])) *
+					glm::mat4_cast(rotation) *
+					glm::scale(glm::mat4(1.0f), glm::vec3(scene.scale[i]));
+				world[i] = scene.parent[i] == SCENE_NO_PARENT ? model : world[scene.parent[i]] * model;
+			}
+			glm_ms += psybench::ticks_to_ms(psybench::ticks() - start);
+		}
+		snprintf(name, sizeof(name), "scene_%u_glm_ms", count);
+		psybench::set_value(bench, name, glm_ms / measured_frames);
+		printf("%10u %8s %10u %10.3f (glm, no dirty tracking)\n", count, "all", count, glm_ms / measured_frames);
+
+		psyscene::destroy(&scene);
+	}
+}
+
+// xorshift32
+uint32_t scene_random(uint32_t *state) {
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
@@ -0,0 +1,372 @@
+#include "shader.h"
+
+#include <bench/bench.h>
+#include <file/file.h>
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+#include <vfs/vfs.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+bool build_program(shader_manager *manager, shader_entry *entry, bool use_cache, GLuint *program);
+GLuint compile_stage(GLenum stage, const std::string &source, const char *name);
+bool link_status(GLuint program, const char *name);
+uint64_t hash_program(shader_manager *manager, const std::string *sources, int count);
+void binary_path(uint64_t hash, char *path);
+void source_path(const std::string &file, char *path);
+int64_t source_modified(const shader_entry *entry);
+bool watch_triggered(shader_manager *manager);
+
+void psyshader::create(shader_manager *manager) {
+	manager->entries.clear();
+	manager->cache_hits = 0;
+	manager->cache_misses = 0;
+	manager->reloads = 0;
+	manager->create_ms = 0.0;
+
+	manager->driver = std::string((const char *)glGetString(GL_VENDOR)) + "|" +
+		(const char *)glGetString(GL_RENDERER) + "|" +
+		(const char *)glGetString(GL_VERSION);
+
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	manager->binary_cache = formats > 0 && psyfile::create_directories(SHADER_CACHE_DIR);
+	if (formats == 0) {
+		fprintf(stderr, "Warning: driver exposes no program binary formats, shaders are compiled every run\n");
+	}
+
+#if defined(_WIN32)
+	HANDLE watch = FindFirstChangeNotificationA(SHADER_DIR, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME);
+	manager->watch = watch == INVALID_HANDLE_VALUE ? nullptr : watch;
+#elif defined(__linux__)
+	// one watch on the directory, the events of the instance are never told apart
+	manager->watch = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (manager->watch >= 0 && inotify_add_watch(manager->watch, SHADER_DIR, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+		close(manager->watch);
+		manager->watch = -1;
+	}
+#else
+	manager->watch = -1;
+#endif
+}
+
+void psyshader::destroy(shader_manager *manager) {
+	for (shader_entry &entry : manager->entries) {
+		psystate::forget(entry.program);
+		glDeleteProgram(entry.program);
+	}
+	manager->entries.clear();
+
+#if defined(_WIN32)
+	if (manager->watch) {
+		FindCloseChangeNotification((HANDLE)manager->watch);
+	}
+#elif defined(__linux__)
+	if (manager->watch >= 0) {
+		close(manager->watch);
+	}
+#endif
+}
+
+shader_handle psyshader::load(shader_manager *manager, const char *vertex_file, const char *fragment_file) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_SHADER);
+	shader_entry entry = {};
+	entry.vertex = vertex_file;
+	entry.fragment = fragment_file;
+	entry.modified = source_modified(&entry);
+
+	const uint64_t start = psybench::ticks();
+	build_program(manager, &entry, true, &entry.program);
+	manager->create_ms += psybench::ticks_to_ms(psybench::ticks() - start);
+
+	manager->entries.push_back(entry);
+	return (shader_handle)(manager->entries.size() - 1);
+}
+
+shader_handle psyshader::load_compute(shader_manager *manager, const char *compute_file) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_SHADER);
+	shader_entry entry = {};
+	entry.compute = compute_file;
+	entry.modified = source_modified(&entry);
+
+	const uint64_t start = psybench::ticks();
+	build_program(manager, &entry, true, &entry.program);
+	manager->create_ms += psybench::ticks_to_ms(psybench::ticks() - start);
+
+	manager->entries.push_back(entry);
+	return (shader_handle)(manager->entries.size() - 1);
+}
+
+GLuint psyshader::get(shader_manager *manager, shader_handle handle) {
+	return handle < manager->entries.size() ? manager->entries[handle].program : 0;
+}
+
+void psyshader::update(shader_manager *manager) {
+	if (!watch_triggered(manager)) {
+		return;
+	}
+	PSY_PROFILE_SCOPE("shader reload");
+	PSY_MEMORY_SCOPE(MEMORY_TAG_SHADER);
+
+	for (shader_entry &entry : manager->entries) {
+		const int64_t modified = source_modified(&entry);
+		if (modified == entry.modified) {
+			continue;
+		}
+		entry.modified = modified;
+		entry.edited = true;
+
+		// a broken edit keeps the last good program bound
+		GLuint program = 0;
+		if (build_program(manager, &entry, true, &program)) {
+			psystate::forget(entry.program);
+			glDeleteProgram(entry.program);
+			entry.program = program;
+			manager->reloads++;
+			printf("shader: reloaded %s\n", !entry.compute.empty() ? entry.compute.c_str() : entry.vertex.c_str());
+		}
+	}
+}
+
+void psyshader::measure(shader_manager *manager, double *cold_ms, double *warm_ms) {
+	*cold_ms = 0.0;
+	*warm_ms = 0.0;
+	for (int pass = 0; pass < 2; pass++) {
+		const uint64_t start = psybench::ticks();
+		for (shader_entry &entry : manager->entries) {
+			GLuint program = 0;
+			if (build_program(manager, &entry, pass == 1, &program)) {
+				psystate::forget(entry.program);
+				glDeleteProgram(entry.program);
+				entry.program = program;
+			}
+		}
+		const double elapsed = psybench::ticks_to_ms(psybench::ticks() - start);
+		*(pass == 0 ? cold_ms : warm_ms) = elapsed;
+	}
+}
+
+std::string psyshader::read_text(const char *path, bool loose) {
+	vfs_file file = {};
+	if (!(loose ? psyvfs::open_loose(path, &file) : psyvfs::open(path, &file))) {
+		return std::string();
+	}
+	std::string text((const char *)file.data, file.size);
+	psyvfs::close(&file);
+	return text;
+}
+
+// link status is queried right away, so the timings include the driver's (possibly deferred) compile
+bool build_program(shader_manager *manager, shader_entry *entry, bool use_cache, GLuint *program) {
+	const bool compute = !entry->compute.empty();
+	const char *name = compute ? entry->compute.c_str() : entry->vertex.c_str();
+
+	std::string sources[2];
+	const int count = compute ? 1 : 2;
+	const std::string *files[2] = { compute ? &entry->compute : &entry->vertex, &entry->fragment };
+	for (int i = 0; i < count; i++) {
+		char path[SHADER_PATH_MAX];
+		source_path(*files[i], path);
+		sources[i] = psyshader::read_text(path, entry->edited);
+		if (sources[i].empty()) {
+			fprintf(stderr, "Error: could not read shader %s\n", files[i]->c_str());
+			return false;
+		}
+	}
+
+	const uint64_t hash = hash_program(manager, sources, count);
+	char path[SHADER_PATH_MAX];
+	binary_path(hash, path);
+
+	if (use_cache && manager->binary_cache) {
+		mapped_file file = {};
+		if (psyfile::map(path, &file)) {
+			const shader_cache_header *header = (const shader_cache_header *)file.data;
+			if (file.size >= sizeof(shader_cache_header) &&
+				header->magic == SHADER_CACHE_MAGIC &&
+				header->version == SHADER_CACHE_VERSION &&
+				header->hash == hash &&
+				sizeof(shader_cache_header) + header->length <= file.size) {
+				GLuint cached = glCreateProgram();
+				glProgramBinary(cached, header->format, header + 1, (GLsizei)header->length);
+
+				// drivers reject binaries after an update even when the version string
+				// did not change, fall back to compiling
+				GLint linked = GL_FALSE;
+				glGetProgramiv(cached, GL_LINK_STATUS, &linked);
+				if (linked) {
+					psyfile::unmap(&file);
+					manager->cache_hits++;
+					*program = cached;
+					return true;
+				}
+				glDeleteProgram(cached);
+			}
+			psyfile::unmap(&file);
+		}
+	}
+
+	GLuint stages[2] = {};
+	if (compute) {
+		stages[0] = compile_stage(GL_COMPUTE_SHADER, sources[0], entry->compute.c_str());
+	} else {
+		stages[0] = compile_stage(GL_VERTEX_SHADER, sources[0], entry->vertex.c_str());
+		stages[1] = compile_stage(GL_FRAGMENT_SHADER, sources[1], entry->fragment.c_str());
+	}
+
+	GLuint linked = glCreateProgram();
+	glProgramParameteri(linked, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	for (int i = 0; i < count; i++) {
+		glAttachShader(linked, stages[i]);
+	}
+	glLinkProgram(linked);
+	for (int i = 0; i < count; i++) {
+		glDetachShader(linked, stages[i]);
+		glDeleteShader(stages[i]);
+	}
+	if (!link_status(linked, name)) {
+		glDeleteProgram(linked);
+		return false;
+	}
+	manager->cache_misses++;
+
+	if (manager->binary_cache) {
+		GLint length = 0;
+		glGetProgramiv(linked, GL_PROGRAM_BINARY_LENGTH, &length);
+		if (length > 0) {
+			std::vector<uint8_t> blob(sizeof(shader_cache_header) + length);
+			shader_cache_header *header = (shader_cache_header *)blob.data();
+			GLenum format = 0;
+			glGetProgramBinary(linked, length, &length, &format, header + 1);
+
+			header->magic = SHADER_CACHE_MAGIC;
+			header->version = SHADER_CACHE_VERSION;
+			header->hash = hash;
+			header->format = format;
+			header->length = (uint32_t)length;
+			if (!psyfile::write(path, blob.data(), sizeof(shader_cache_header) + length)) {
+				fprintf(stderr, "Warning: could not write program cache %s\n", path);
+			}
+		}
+	}
+
+	*program = linked;
+	return true;
+}
+
+GLuint compile_stage(GLenum stage, const std::string &source, const char *name) {
+	const char *string = source.c_str();
+	GLuint shader = glCreateShader(stage);
+	glShaderSource(shader, 1, &string, nullptr);
+	glCompileShader(shader);
+
+	GLint success = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success) {
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), nullptr, log);
+		fprintf(stderr, "Error: %s failed to compile:\n%s", name, log);
+	}
+	return shader;
+}
+
+bool link_status(GLuint program, const char *name) {
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), nullptr, log);
+		fprintf(stderr, "Error: %s failed to link:\n%s", name, log);
+	}
+	return success == GL_TRUE;
+}
+
+// FNV-1a over the driver string and every stage's source
+uint64_t hash_program(shader_manager *manager, const std::string *sources, int count) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const auto mix = [&hash](const std::string &text) {
+		for (char c : text) {
+			hash = (hash ^ (uint8_t)c) * 0x100000001b3ull;
+		}
+		// stage separator so "ab" + "c" and "a" + "bc" differ
+		hash = (hash ^ 0xff) * 0x100000001b3ull;
+	};
+	mix(manager->driver);
+	for (int i = 0; i < count; i++) {
+		mix(sources[i]);
+	}
+	return hash;
+}
+
+void binary_path(uint64_t hash, char *path) {
+	snprintf(path, SHADER_PATH_MAX, SHADER_CACHE_DIR "/%016llx.bin", (unsigned long long)hash);
+}
+
+void source_path(const std::string &file, char *path) {
+	snprintf(path, SHADER_PATH_MAX, SHADER_DIR "/%s", file.c_str());
+}
+
+int64_t source_modified(const shader_entry *entry) {
+	const std::string *files[3] = { &entry->vertex, &entry->fragment, &entry->compute };
+	int64_t newest = 0;
+	for (const std::string *file : files) {
+		if (file->empty()) {
+			continue;
+		}
+		char path[SHADER_PATH_MAX];
+		source_path(*file, path);
+#if defined(_WIN32)
+		struct _stat64 info = {};
+		if (_stat64(path, &info) == 0 && info.st_mtime > newest) {
+			newest = (int64_t)info.st_mtime;
+		}
+#else
+		struct stat info = {};
+		if (stat(path, &info) == 0) {
+#if defined(__linux__)
+			// nanoseconds so two saves within one second still register
+			const int64_t modified = (int64_t)info.st_mtim.tv_sec * 1000000000 + info.st_mtim.tv_nsec;
+#else
+			const int64_t modified = (int64_t)info.st_mtime;
+#endif
+			newest = modified > newest ? modified : newest;
+		}
+#endif
+	}
+	return newest;
+}
+
+bool watch_triggered(shader_manager *manager) {
+#if defined(_WIN32)
+	if (!manager->watch || WaitForSingleObject((HANDLE)manager->watch, 0) != WAIT_OBJECT_0) {
+		return false;
+	}
+	FindNextChangeNotification((HANDLE)manager->watch);
+	return true;
+#elif defined(__linux__)
+	if (manager->watch < 0) {
+		return false;
+	}
+	// drain everything queued, which file it was does not matter
+	alignas(struct inotify_event) char events[4096];
+	bool triggered = false;
+	while (read(manager->watch, events, sizeof(events)) > 0) {
+		triggered = true;
+	}
+	return triggered;
+#else
+	return false;
+#endif
+}
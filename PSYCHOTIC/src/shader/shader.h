@@ -0,0 +1,85 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define SHADER_DIR "res/shaders"
+#define SHADER_PATH_MAX 260
+// linked program binaries are cached here as <source + driver hash>.bin
+#define SHADER_CACHE_DIR "cache/shaders"
+// 'PSYP'
+#define SHADER_CACHE_MAGIC 0x50595350
+#define SHADER_CACHE_VERSION 1
+#define SHADER_INVALID 0xffffffffu
+
+typedef uint32_t shader_handle;
+
+// Cache blob:
+//   shader_cache_header
+//   program binary[length]
+struct shader_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t hash;
+	uint32_t format;
+	uint32_t length;
+};
+
+struct shader_entry {
+	// file names inside SHADER_DIR, compute programs leave vertex/fragment empty
+	std::string vertex;
+	std::string fragment;
+	std::string compute;
+
+	GLuint program;
+	// newest modification time of the sources when the program was built
+	int64_t modified;
+	// sources changed on disk since startup, read loose from then on so the packed copy
+	// does not undo the edit
+	bool edited;
+};
+
+struct shader_manager {
+	std::vector<shader_entry> entries;
+
+	// vendor, renderer and version, part of the cache key since binaries are driver specific
+	std::string driver;
+	bool binary_cache;
+
+	// inotify descriptor on Linux, a change notification handle on Windows; anything
+	// it reports just triggers a modification time check of every entry
+#if defined(_WIN32)
+	void *watch;
+#else
+	int watch;
+#endif
+
+	uint32_t cache_hits;
+	uint32_t cache_misses;
+	uint32_t reloads;
+	double create_ms;
+};
+
+namespace psyshader {
+	void create(shader_manager *manager);
+	void destroy(shader_manager *manager);
+
+	// builds the program right away (from the binary cache when possible); a program that
+	// fails to build still gets a handle and is retried on the next edit
+	shader_handle load(shader_manager *manager, const char *vertex_file, const char *fragment_file);
+	shader_handle load_compute(shader_manager *manager, const char *compute_file);
+	// the current program, changes after a reload so look it up every time it is used
+	GLuint get(shader_manager *manager, shader_handle handle);
+
+	// polls the directory watcher and rebuilds programs whose sources changed on disk
+	void update(shader_manager *manager);
+
+	// rebuilds every program from source and again from the binary cache
+	void measure(shader_manager *manager, double *cold_ms, double *warm_ms);
+
+	// whole file, from the mounted archive unless loose
+	std::string read_text(const char *path, bool loose);
+}
@@ -0,0 +1,324 @@
+#include "state.h"
+
+#include <imgui.h>
+
+// a name no object has, whatever holds it is not known
+#define STATE_UNKNOWN 0xffffffffu
+
+enum state_cap {
+	STATE_CAP_DEPTH_TEST,
+	STATE_CAP_BLEND,
+	STATE_CAP_CULL_FACE,
+	STATE_CAP_SCISSOR_TEST,
+	STATE_CAP_COUNT
+};
+
+// size 0 is a glBindBufferBase of the whole buffer
+struct state_binding {
+	GLuint buffer;
+	GLintptr offset;
+	GLsizeiptr size;
+};
+
+// -1 in caps and depth_write and STATE_UNKNOWN in every name and enum is not known yet
+struct state_shadow {
+	int caps[STATE_CAP_COUNT];
+	int depth_write;
+	GLenum depth_func;
+	GLenum blend_equation;
+	GLenum blend_src;
+	GLenum blend_dst;
+	GLuint program;
+	GLuint vertex_array;
+	GLuint framebuffer;
+	GLuint indirect_buffer;
+	int viewport[4];
+	int scissor[4];
+	GLuint textures[STATE_TEXTURE_UNITS];
+	state_binding uniform_buffers[STATE_UNIFORM_BINDINGS];
+	state_binding storage_buffers[STATE_STORAGE_BINDINGS];
+};
+
+bool state_request(bool same);
+int cap_index(GLenum cap);
+void set_cap(GLenum cap, bool enabled);
+void set_depth_func(GLenum func);
+void set_blend(GLenum equation, GLenum src, GLenum dst);
+state_binding *find_binding(GLenum target, GLuint index);
+bool same_rect(const int *rect, int x, int y, int width, int height);
+
+static state_shadow shadow;
+static bool cache_enabled = true;
+static state_stats frame_counts;
+static state_stats last_frame;
+
+void psystate::reset() {
+	for (int i = 0; i < STATE_CAP_COUNT; i++) {
+		shadow.caps[i] = -1;
+	}
+	shadow.depth_write = -1;
+	shadow.depth_func = STATE_UNKNOWN;
+	shadow.blend_equation = STATE_UNKNOWN;
+	shadow.blend_src = STATE_UNKNOWN;
+	shadow.blend_dst = STATE_UNKNOWN;
+	shadow.program = STATE_UNKNOWN;
+	shadow.vertex_array = STATE_UNKNOWN;
+	shadow.framebuffer = STATE_UNKNOWN;
+	shadow.indirect_buffer = STATE_UNKNOWN;
+	// no viewport or scissor box is negative
+	for (int i = 0; i < 4; i++) {
+		shadow.viewport[i] = -1;
+		shadow.scissor[i] = -1;
+	}
+	for (GLuint i = 0; i < STATE_TEXTURE_UNITS; i++) {
+		shadow.textures[i] = STATE_UNKNOWN;
+	}
+	for (GLuint i = 0; i < STATE_UNIFORM_BINDINGS; i++) {
+		shadow.uniform_buffers[i].buffer = STATE_UNKNOWN;
+	}
+	for (GLuint i = 0; i < STATE_STORAGE_BINDINGS; i++) {
+		shadow.storage_buffers[i].buffer = STATE_UNKNOWN;
+	}
+}
+
+void psystate::set_cached(bool cached) {
+	cache_enabled = cached;
+}
+
+void psystate::forget(GLuint name) {
+	// names are per object type, a deleted buffer also clears a texture unit holding the
+	// same number; that costs one call, a stale entry would drop a needed one
+	if (shadow.program == name) shadow.program = STATE_UNKNOWN;
+	if (shadow.vertex_array == name) shadow.vertex_array = STATE_UNKNOWN;
+	if (shadow.framebuffer == name) shadow.framebuffer = STATE_UNKNOWN;
+	if (shadow.indirect_buffer == name) shadow.indirect_buffer = STATE_UNKNOWN;
+	for (GLuint i = 0; i < STATE_TEXTURE_UNITS; i++) {
+		if (shadow.textures[i] == name) shadow.textures[i] = STATE_UNKNOWN;
+	}
+	for (GLuint i = 0; i < STATE_UNIFORM_BINDINGS; i++) {
+		if (shadow.uniform_buffers[i].buffer == name) shadow.uniform_buffers[i].buffer = STATE_UNKNOWN;
+	}
+	for (GLuint i = 0; i < STATE_STORAGE_BINDINGS; i++) {
+		if (shadow.storage_buffers[i].buffer == name) shadow.storage_buffers[i].buffer = STATE_UNKNOWN;
+	}
+}
+
+state_pipeline psystate::pipeline() {
+	state_pipeline pipeline = {};
+	pipeline.depth_write = true;
+	pipeline.depth_func = GL_LESS;
+	pipeline.blend_equation = GL_FUNC_ADD;
+	pipeline.blend_src = GL_ONE;
+	pipeline.blend_dst = GL_ZERO;
+	return pipeline;
+}
+
+void psystate::apply(const state_pipeline *pipeline) {
+	const uint32_t issued = frame_counts.issued;
+
+	use_program(pipeline->program);
+	bind_vertex_array(pipeline->vertex_array);
+	set_cap(GL_DEPTH_TEST, pipeline->depth_test);
+	depth_mask(pipeline->depth_write);
+	if (pipeline->depth_test) {
+		set_depth_func(pipeline->depth_func);
+	}
+	set_cap(GL_BLEND, pipeline->blend);
+	if (pipeline->blend) {
+		set_blend(pipeline->blend_equation, pipeline->blend_src, pipeline->blend_dst);
+	}
+	set_cap(GL_CULL_FACE, pipeline->cull_face);
+	set_cap(GL_SCISSOR_TEST, pipeline->scissor_test);
+
+	frame_counts.pipelines++;
+	frame_counts.pipeline_changes += frame_counts.issued != issued;
+}
+
+void psystate::enable(GLenum cap) {
+	set_cap(cap, true);
+}
+
+void psystate::disable(GLenum cap) {
+	set_cap(cap, false);
+}
+
+void psystate::depth_mask(bool write) {
+	if (state_request(shadow.depth_write == (int)write)) {
+		glDepthMask(write ? GL_TRUE : GL_FALSE);
+		shadow.depth_write = write;
+	}
+}
+
+void psystate::use_program(GLuint program) {
+	if (state_request(shadow.program == program)) {
+		glUseProgram(program);
+		shadow.program = program;
+	}
+}
+
+void psystate::bind_vertex_array(GLuint vertex_array) {
+	if (state_request(shadow.vertex_array == vertex_array)) {
+		glBindVertexArray(vertex_array);
+		shadow.vertex_array = vertex_array;
+	}
+}
+
+void psystate::bind_framebuffer(GLuint framebuffer) {
+	if (state_request(shadow.framebuffer == framebuffer)) {
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+		shadow.framebuffer = framebuffer;
+	}
+}
+
+void psystate::bind_indirect_buffer(GLuint buffer) {
+	if (state_request(shadow.indirect_buffer == buffer)) {
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer);
+		shadow.indirect_buffer = buffer;
+	}
+}
+
+void psystate::viewport(int x, int y, int width, int height) {
+	if (state_request(same_rect(shadow.viewport, x, y, width, height))) {
+		glViewport(x, y, width, height);
+		shadow.viewport[0] = x;
+		shadow.viewport[1] = y;
+		shadow.viewport[2] = width;
+		shadow.viewport[3] = height;
+	}
+}
+
+void psystate::scissor(int x, int y, int width, int height) {
+	if (state_request(same_rect(shadow.scissor, x, y, width, height))) {
+		glScissor(x, y, width, height);
+		shadow.scissor[0] = x;
+		shadow.scissor[1] = y;
+		shadow.scissor[2] = width;
+		shadow.scissor[3] = height;
+	}
+}
+
+void psystate::bind_texture(GLuint unit, GLuint texture) {
+	const bool tracked = unit < STATE_TEXTURE_UNITS;
+	if (state_request(tracked && shadow.textures[unit] == texture)) {
+		glBindTextureUnit(unit, texture);
+		if (tracked) {
+			shadow.textures[unit] = texture;
+		}
+	}
+}
+
+void psystate::bind_buffer_base(GLenum target, GLuint index, GLuint buffer) {
+	state_binding *binding = find_binding(target, index);
+	if (state_request(binding && binding->buffer == buffer && binding->size == 0)) {
+		glBindBufferBase(target, index, buffer);
+		if (binding) {
+			binding->buffer = buffer;
+			binding->offset = 0;
+			binding->size = 0;
+		}
+	}
+}
+
+void psystate::bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	state_binding *binding = find_binding(target, index);
+	if (state_request(binding && binding->buffer == buffer && binding->offset == offset && binding->size == size)) {
+		glBindBufferRange(target, index, buffer, offset, size);
+		if (binding) {
+			binding->buffer = buffer;
+			binding->offset = offset;
+			binding->size = size;
+		}
+	}
+}
+
+void psystate::end_frame() {
+	last_frame = frame_counts;
+	frame_counts = {};
+}
+
+const state_stats *psystate::stats() {
+	return &last_frame;
+}
+
+void psystate::draw_overlay(const state_stats *stats, bool *cached) {
+	if (!ImGui::Begin("GL state")) {
+		ImGui::End();
+		return;
+	}
+
+	ImGui::Checkbox("drop redundant calls", cached);
+	ImGui::Separator();
+	ImGui::Text("state calls   %u", stats->requested);
+	ImGui::Text("issued        %u", stats->issued);
+	ImGui::Text("redundant     %u", stats->redundant);
+	ImGui::Text("pipelines     %u (%u changed state)", stats->pipelines, stats->pipeline_changes);
+	ImGui::End();
+}
+
+// counts one call, true when it has to reach GL
+bool state_request(bool same) {
+	frame_counts.requested++;
+	if (same && cache_enabled) {
+		frame_counts.redundant++;
+		return false;
+	}
+	frame_counts.issued++;
+	return true;
+}
+
+int cap_index(GLenum cap) {
+	switch (cap) {
+	case GL_DEPTH_TEST: return STATE_CAP_DEPTH_TEST;
+	case GL_BLEND: return STATE_CAP_BLEND;
+	case GL_CULL_FACE: return STATE_CAP_CULL_FACE;
+	case GL_SCISSOR_TEST: return STATE_CAP_SCISSOR_TEST;
+	default: return -1;
+	}
+}
+
+void set_cap(GLenum cap, bool enabled) {
+	const int index = cap_index(cap);
+	if (state_request(index >= 0 && shadow.caps[index] == (int)enabled)) {
+		if (enabled) {
+			glEnable(cap);
+		} else {
+			glDisable(cap);
+		}
+		if (index >= 0) {
+			shadow.caps[index] = enabled;
+		}
+	}
+}
+
+void set_depth_func(GLenum func) {
+	if (state_request(shadow.depth_func == func)) {
+		glDepthFunc(func);
+		shadow.depth_func = func;
+	}
+}
+
+void set_blend(GLenum equation, GLenum src, GLenum dst) {
+	if (state_request(shadow.blend_equation == equation)) {
+		glBlendEquation(equation);
+		shadow.blend_equation = equation;
+	}
+	if (state_request(shadow.blend_src == src && shadow.blend_dst == dst)) {
+		glBlendFunc(src, dst);
+		shadow.blend_src = src;
+		shadow.blend_dst = dst;
+	}
+}
+
+state_binding *find_binding(GLenum target, GLuint index) {
+	if (target == GL_UNIFORM_BUFFER && index < STATE_UNIFORM_BINDINGS) {
+		return &shadow.uniform_buffers[index];
+	}
+	if (target == GL_SHADER_STORAGE_BUFFER && index < STATE_STORAGE_BINDINGS) {
+		return &shadow.storage_buffers[index];
+	}
+	return nullptr;
+}
+
+bool same_rect(const int *rect, int x, int y, int width, int height) {
+	return rect[0] == x && rect[1] == y && rect[2] == width && rect[3] == height;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <stdint.h>
+
+// bindings past these are passed straight through, never cached
+#define STATE_TEXTURE_UNITS 4
+#define STATE_UNIFORM_BINDINGS 4
+#define STATE_STORAGE_BINDINGS 16
+
+// fixed function state and objects one pass draws with; apply() issues only what differs
+// from the shadow copy, and skips blend and depth function while their test is off
+struct state_pipeline {
+	GLuint program;
+	GLuint vertex_array;
+	bool depth_test;
+	bool depth_write;
+	GLenum depth_func;
+	bool blend;
+	GLenum blend_equation;
+	GLenum blend_src;
+	GLenum blend_dst;
+	bool cull_face;
+	bool scissor_test;
+};
+
+struct state_stats {
+	// state calls made through the tracker (what an uncached renderer issues), how many
+	// reached GL, and how many the shadow dropped
+	uint32_t requested;
+	uint32_t issued;
+	uint32_t redundant;
+	// apply() calls, and how many of them changed anything
+	uint32_t pipelines;
+	uint32_t pipeline_changes;
+};
+
+// Shadows the GL state of the context, GL thread only. Everything that binds objects or
+// toggles fixed function state for drawing goes through here so the shadow stays exact.
+namespace psystate {
+	// forgets everything, the next request of each kind reaches GL; once the context is current
+	void reset();
+	// off passes every request through (still counted), for comparing against the cache
+	void set_cached(bool cached);
+	// name was deleted, GL dropped whatever bindings it had
+	void forget(GLuint name);
+
+	// GL defaults: depth and blend off, depth writes on, GL_LESS, GL_FUNC_ADD one / zero
+	state_pipeline pipeline();
+	void apply(const state_pipeline *pipeline);
+
+	void enable(GLenum cap);
+	void disable(GLenum cap);
+	void depth_mask(bool write);
+	void use_program(GLuint program);
+	void bind_vertex_array(GLuint vertex_array);
+	// draw framebuffer, reads bind their own
+	void bind_framebuffer(GLuint framebuffer);
+	void bind_indirect_buffer(GLuint buffer);
+	void viewport(int x, int y, int width, int height);
+	void scissor(int x, int y, int width, int height);
+	void bind_texture(GLuint unit, GLuint texture);
+	void bind_buffer_base(GLenum target, GLuint index, GLuint buffer);
+	void bind_buffer_range(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	// rolls this frame's counts over, stats() is the frame before
+	void end_frame();
+	const state_stats *stats();
+	void draw_overlay(const state_stats *stats, bool *cached);
+}
@@ -0,0 +1,463 @@
+#include "texture.h"
+
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+#include <vfs/vfs.h>
+
+#include <stb/stb_image.h>
+
+#include <stdio.h>
+#include <string.h>
+
+void texture_worker(texture_manager *manager);
+bool decode_texture(texture_entry *entry, const vfs_file *source);
+void generate_mips(texture_entry *entry);
+void compress_mips(texture_manager *manager, texture_entry *entry);
+uint64_t hash_source(const vfs_file *source, texture_compression compression);
+std::string cache_path(uint64_t hash);
+bool read_cache(texture_entry *entry, uint64_t hash);
+void write_cache(texture_entry *entry, uint64_t hash);
+bool has_extension(const char *name);
+
+void psytexture::create(texture_manager *manager, int worker_count, texture_compression compression, job_system *jobs) {
+	manager->entries.reset(new texture_entry[TEXTURE_MAX]);
+	manager->count = 0;
+	manager->quit = false;
+	manager->resident_count = 0;
+	manager->cache_hits = 0;
+	manager->cache_misses = 0;
+
+	// S3TC is an extension, BPTC is core since 4.2
+	if (compression == TEXTURE_COMPRESSION_BC1_BC3 && !has_extension("GL_EXT_texture_compression_s3tc")) {
+		fprintf(stderr, "Warning: GL_EXT_texture_compression_s3tc missing, compressing to BC7\n");
+		compression = TEXTURE_COMPRESSION_BC7;
+	}
+	manager->compression = compression;
+	manager->jobs = jobs;
+	if (compression != TEXTURE_COMPRESSION_NONE && !psyfile::create_directories(TEXTURE_CACHE_DIR)) {
+		fprintf(stderr, "Warning: could not create %s, compressed textures will not be cached\n", TEXTURE_CACHE_DIR);
+	}
+
+	// 2x2 magenta/black checker so anything still streaming is obvious
+	const uint8_t checker[16] = {
+		255, 0, 255, 255,    0, 0, 0, 255,
+		  0, 0,   0, 255,  255, 0, 255, 255,
+	};
+	glCreateTextures(GL_TEXTURE_2D, 1, &manager->placeholder);
+	glTextureParameteri(manager->placeholder, GL_TEXTURE_MAX_LEVEL, 0);
+	glTextureParameteri(manager->placeholder, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTextureParameteri(manager->placeholder, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTextureStorage2D(manager->placeholder, 1, GL_RGBA8, 2, 2);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTextureSubImage2D(manager->placeholder, 0, 0, 0, 2, 2, GL_RGBA, GL_UNSIGNED_BYTE, checker);
+
+	psybuffer::create_stream(&manager->staging, TEXTURE_UPLOAD_BUDGET);
+
+	worker_count = worker_count > 0 ? worker_count : 1;
+	for (int i = 0; i < worker_count; i++) {
+		manager->workers.emplace_back(texture_worker, manager);
+	}
+}
+
+void psytexture::destroy(texture_manager *manager) {
+	{
+		std::lock_guard<std::mutex> guard(manager->lock);
+		manager->quit = true;
+	}
+	manager->wake.notify_all();
+	for (std::thread &worker : manager->workers) {
+		worker.join();
+	}
+	manager->workers.clear();
+
+	for (uint32_t i = 0; i < manager->count; i++) {
+		if (manager->entries[i].texture) {
+			psystate::forget(manager->entries[i].texture);
+			glDeleteTextures(1, &manager->entries[i].texture);
+		}
+		psyfile::unmap(&manager->entries[i].cache);
+	}
+	psystate::forget(manager->placeholder);
+	glDeleteTextures(1, &manager->placeholder);
+	psybuffer::destroy_stream(&manager->staging);
+	manager->entries.reset();
+	manager->count = 0;
+}
+
+texture_handle psytexture::load(texture_manager *manager, const char *path) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_TEXTURE);
+	if (manager->count == TEXTURE_MAX) {
+		fprintf(stderr, "Error: texture limit (%d) reached, %s not loaded\n", TEXTURE_MAX, path);
+		return TEXTURE_INVALID;
+	}
+
+	const texture_handle handle = manager->count++;
+	texture_entry *entry = &manager->entries[handle];
+	entry->path = path;
+	entry->status = TEXTURE_STATUS_QUEUED;
+	entry->texture = 0;
+	entry->uploaded_mips = 0;
+	entry->format = GL_RGBA8;
+	entry->cache = {};
+
+	{
+		std::lock_guard<std::mutex> guard(manager->lock);
+		manager->decode_queue.push_back(handle);
+	}
+	manager->wake.notify_one();
+	return handle;
+}
+
+void psytexture::update(texture_manager *manager) {
+	PSY_PROFILE_SCOPE("texture upload");
+	PSY_MEMORY_SCOPE(MEMORY_TAG_TEXTURE);
+
+	psybuffer::begin_frame(&manager->staging);
+
+	GLsizeiptr budget = TEXTURE_UPLOAD_BUDGET;
+	bool uploaded = false;
+	while (budget > 0) {
+		texture_handle handle = TEXTURE_INVALID;
+		{
+			std::lock_guard<std::mutex> guard(manager->lock);
+			if (!manager->upload_queue.empty()) {
+				handle = manager->upload_queue.front();
+			}
+		}
+		if (handle == TEXTURE_INVALID) {
+			break;
+		}
+
+		texture_entry *entry = &manager->entries[handle];
+		const int mip_count = (int)entry->mips.size();
+		const bool compressed = entry->format != GL_RGBA8;
+		if (!entry->texture) {
+			glCreateTextures(GL_TEXTURE_2D, 1, &entry->texture);
+			glTextureParameteri(entry->texture, GL_TEXTURE_MAX_LEVEL, mip_count - 1);
+			glTextureParameteri(entry->texture, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTextureParameteri(entry->texture, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTextureStorage2D(entry->texture, mip_count, entry->format, entry->mips[0].width, entry->mips[0].height);
+		}
+
+		// at least one mip per frame even when it is bigger than the budget; the budget is the
+		// ring's region size and counts the alignment padding, so the ring never has to grow
+		while (entry->uploaded_mips < mip_count) {
+			texture_mip *mip = &entry->mips[entry->uploaded_mips];
+			const GLsizeiptr size = (GLsizeiptr)mip->size;
+			const GLsizeiptr staged_size = (size + 15) & ~(GLsizeiptr)15;
+			if (uploaded && staged_size > budget) {
+				break;
+			}
+
+			// a mip larger than a whole region gets a buffer of its own, deleted right after
+			// the copy is queued, instead of growing the persistent ring for the rest of the run
+			stream_allocation staging = {};
+			GLuint oversized = 0;
+			if (staged_size > TEXTURE_UPLOAD_BUDGET) {
+				glCreateBuffers(1, &oversized);
+				glNamedBufferStorage(oversized, size, mip->data, 0);
+				staging.buffer = oversized;
+			} else {
+				staging = psybuffer::allocate(&manager->staging, size, 16);
+				memcpy(staging.pointer, mip->data, size);
+			}
+
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.buffer);
+			if (compressed) {
+				glCompressedTextureSubImage2D(
+					entry->texture, entry->uploaded_mips,
+					0, 0,
+					mip->width, mip->height,
+					entry->format,
+					(GLsizei)size,
+					(void *)staging.offset);
+			} else {
+				glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+				glTextureSubImage2D(
+					entry->texture, entry->uploaded_mips,
+					0, 0,
+					mip->width, mip->height,
+					GL_RGBA,
+					GL_UNSIGNED_BYTE,
+					(void *)staging.offset);
+			}
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			if (oversized) {
+				glDeleteBuffers(1, &oversized);
+			}
+
+			budget -= staged_size;
+			uploaded = true;
+			entry->uploaded_mips++;
+		}
+
+		if (entry->uploaded_mips < mip_count) {
+			break;
+		}
+
+		std::vector<texture_mip>().swap(entry->mips);
+		psyfile::unmap(&entry->cache);
+		entry->status = TEXTURE_STATUS_RESIDENT;
+		manager->resident_count++;
+		{
+			std::lock_guard<std::mutex> guard(manager->lock);
+			manager->upload_queue.pop_front();
+		}
+	}
+
+	psybuffer::end_frame(&manager->staging);
+}
+
+GLuint psytexture::get(texture_manager *manager, texture_handle handle) {
+	if (handle >= manager->count) {
+		return manager->placeholder;
+	}
+	texture_entry *entry = &manager->entries[handle];
+	return entry->status == TEXTURE_STATUS_RESIDENT ? entry->texture : manager->placeholder;
+}
+
+bool psytexture::all_resident(texture_manager *manager) {
+	uint32_t failed = 0;
+	for (uint32_t i = 0; i < manager->count; i++) {
+		failed += manager->entries[i].status == TEXTURE_STATUS_FAILED;
+	}
+	return manager->resident_count + failed == manager->count;
+}
+
+void texture_worker(texture_manager *manager) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_TEXTURE);
+	stbi_set_flip_vertically_on_load_thread(1);
+
+	for (;;) {
+		texture_handle handle = TEXTURE_INVALID;
+		{
+			std::unique_lock<std::mutex> guard(manager->lock);
+			manager->wake.wait(guard, [manager] { return manager->quit || !manager->decode_queue.empty(); });
+			if (manager->quit) {
+				return;
+			}
+			handle = manager->decode_queue.front();
+			manager->decode_queue.pop_front();
+		}
+
+		texture_entry *entry = &manager->entries[handle];
+		vfs_file source = {};
+		if (!psyvfs::open(entry->path.c_str(), &source)) {
+			fprintf(stderr, "Error: could not open texture %s\n", entry->path.c_str());
+			entry->status = TEXTURE_STATUS_FAILED;
+			continue;
+		}
+
+		// a cache hit skips decoding, mip generation and compression entirely
+		const uint64_t hash = hash_source(&source, manager->compression);
+		if (manager->compression != TEXTURE_COMPRESSION_NONE && read_cache(entry, hash)) {
+			manager->cache_hits++;
+			psyvfs::close(&source);
+		} else {
+			const bool decoded = decode_texture(entry, &source);
+			psyvfs::close(&source);
+			if (!decoded) {
+				fprintf(stderr, "Error: could not decode %s: %s\n", entry->path.c_str(), stbi_failure_reason());
+				entry->status = TEXTURE_STATUS_FAILED;
+				continue;
+			}
+			generate_mips(entry);
+
+			if (manager->compression != TEXTURE_COMPRESSION_NONE) {
+				compress_mips(manager, entry);
+				write_cache(entry, hash);
+				manager->cache_misses++;
+			}
+		}
+
+		entry->status = TEXTURE_STATUS_DECODED;
+		std::lock_guard<std::mutex> guard(manager->lock);
+		manager->upload_queue.push_back(handle);
+	}
+}
+
+bool decode_texture(texture_entry *entry, const vfs_file *source) {
+	int width, height, comp;
+	uint8_t *data = stbi_load_from_memory((const stbi_uc *)source->data, (int)source->size, &width, &height, &comp, 4);
+	if (!data) {
+		return false;
+	}
+
+	texture_mip base = {};
+	base.width = width;
+	base.height = height;
+	base.storage.assign(data, data + (size_t)width * height * 4);
+	base.data = base.storage.data();
+	base.size = base.storage.size();
+	stbi_image_free(data);
+
+	entry->mips.clear();
+	entry->mips.push_back(std::move(base));
+	return true;
+}
+
+// 2x2 box filter down to 1x1, odd edges clamp
+void generate_mips(texture_entry *entry) {
+	while (entry->mips.back().width > 1 || entry->mips.back().height > 1) {
+		const texture_mip &src = entry->mips.back();
+		texture_mip dst = {};
+		dst.width = src.width > 1 ? src.width / 2 : 1;
+		dst.height = src.height > 1 ? src.height / 2 : 1;
+		dst.storage.resize((size_t)dst.width * dst.height * 4);
+
+		for (int y = 0; y < dst.height; y++) {
+			const int y0 = y * 2 < src.height ? y * 2 : src.height - 1;
+			const int y1 = y * 2 + 1 < src.height ? y * 2 + 1 : src.height - 1;
+			for (int x = 0; x < dst.width; x++) {
+				const int x0 = x * 2 < src.width ? x * 2 : src.width - 1;
+				const int x1 = x * 2 + 1 < src.width ? x * 2 + 1 : src.width - 1;
+				const uint8_t *a = &src.data[((size_t)y0 * src.width + x0) * 4];
+				const uint8_t *b = &src.data[((size_t)y0 * src.width + x1) * 4];
+				const uint8_t *c = &src.data[((size_t)y1 * src.width + x0) * 4];
+				const uint8_t *d = &src.data[((size_t)y1 * src.width + x1) * 4];
+				uint8_t *out = &dst.storage[((size_t)y * dst.width + x) * 4];
+				for (int k = 0; k < 4; k++) {
+					out[k] = (uint8_t)((a[k] + b[k] + c[k] + d[k] + 2) / 4);
+				}
+			}
+		}
+		dst.data = dst.storage.data();
+		dst.size = dst.storage.size();
+		entry->mips.push_back(std::move(dst));
+	}
+}
+
+void compress_mips(texture_manager *manager, texture_entry *entry) {
+	PSY_PROFILE_SCOPE("texture compress");
+
+	GLenum format = GL_COMPRESSED_RGBA_BPTC_UNORM;
+	if (manager->compression == TEXTURE_COMPRESSION_BC1_BC3) {
+		const texture_mip &base = entry->mips[0];
+		bool opaque = true;
+		for (size_t i = 3; i < base.size && opaque; i += 4) {
+			opaque = base.data[i] == 255;
+		}
+		format = opaque ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	}
+
+	for (texture_mip &mip : entry->mips) {
+		std::vector<uint8_t> blocks(psytexture::compressed_size(format, mip.width, mip.height));
+		psytexture::compress(format, mip.data, mip.width, mip.height, blocks.data(), manager->jobs);
+		mip.storage.swap(blocks);
+		mip.data = mip.storage.data();
+		mip.size = mip.storage.size();
+	}
+	entry->format = format;
+}
+
+// FNV-1a over the encoded source bytes, salted with the compression mode
+uint64_t hash_source(const vfs_file *source, texture_compression compression) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	const uint8_t *bytes = (const uint8_t *)source->data;
+	for (size_t i = 0; i < source->size; i++) {
+		hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+	}
+	hash = (hash ^ (uint64_t)compression) * 0x100000001b3ull;
+	return hash;
+}
+
+std::string cache_path(uint64_t hash) {
+	char name[64];
+	snprintf(name, sizeof(name), "/%016llx.psyt", (unsigned long long)hash);
+	return std::string(TEXTURE_CACHE_DIR) + name;
+}
+
+bool read_cache(texture_entry *entry, uint64_t hash) {
+	mapped_file file = {};
+	if (!psyfile::map(cache_path(hash).c_str(), &file)) {
+		return false;
+	}
+
+	const texture_cache_header *header = (const texture_cache_header *)file.data;
+	if (file.size < sizeof(texture_cache_header) ||
+		header->magic != TEXTURE_CACHE_MAGIC ||
+		header->version != TEXTURE_CACHE_VERSION ||
+		header->source_hash != hash ||
+		(header->format != GL_COMPRESSED_RGB_S3TC_DXT1_EXT &&
+		 header->format != GL_COMPRESSED_RGBA_S3TC_DXT5_EXT &&
+		 header->format != GL_COMPRESSED_RGBA_BPTC_UNORM) ||
+		header->mip_count == 0 ||
+		header->mip_count > 32 ||
+		sizeof(texture_cache_header) + header->mip_count * sizeof(texture_cache_mip) > file.size) {
+		psyfile::unmap(&file);
+		return false;
+	}
+
+	// mips point straight into the mapping, update() copies them into the staging ring; a
+	// stale or truncated blob is recompressed rather than handed to GL with the wrong sizes
+	const texture_cache_mip *mips = (const texture_cache_mip *)(header + 1);
+	entry->mips.clear();
+	for (uint32_t i = 0; i < header->mip_count; i++) {
+		const uint32_t width = i == 0 ? mips[0].width : (mips[i - 1].width > 1 ? mips[i - 1].width / 2 : 1);
+		const uint32_t height = i == 0 ? mips[0].height : (mips[i - 1].height > 1 ? mips[i - 1].height / 2 : 1);
+		const bool last = width == 1 && height == 1;
+		if (mips[i].width != width || mips[i].height != height ||
+			width == 0 || height == 0 || width > 16384 || height > 16384 ||
+			last != (i == header->mip_count - 1) ||
+			mips[i].size != psytexture::compressed_size(header->format, (int)width, (int)height) ||
+			mips[i].offset > file.size ||
+			mips[i].size > file.size - mips[i].offset) {
+			entry->mips.clear();
+			psyfile::unmap(&file);
+			return false;
+		}
+		texture_mip mip = {};
+		mip.width = (int)mips[i].width;
+		mip.height = (int)mips[i].height;
+		mip.data = (const uint8_t *)file.data + mips[i].offset;
+		mip.size = (size_t)mips[i].size;
+		entry->mips.push_back(std::move(mip));
+	}
+	entry->format = header->format;
+	entry->cache = file;
+	return true;
+}
+
+void write_cache(texture_entry *entry, uint64_t hash) {
+	texture_cache_header header = {};
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.source_hash = hash;
+	header.format = entry->format;
+	header.mip_count = (uint32_t)entry->mips.size();
+
+	std::vector<texture_cache_mip> mips(entry->mips.size());
+	uint64_t offset = sizeof(texture_cache_header) + mips.size() * sizeof(texture_cache_mip);
+	for (size_t i = 0; i < mips.size(); i++) {
+		mips[i].width = (uint32_t)entry->mips[i].width;
+		mips[i].height = (uint32_t)entry->mips[i].height;
+		mips[i].offset = offset;
+		mips[i].size = entry->mips[i].size;
+		offset += entry->mips[i].size;
+	}
+
+	std::vector<uint8_t> blob;
+	blob.reserve((size_t)offset);
+	blob.insert(blob.end(), (const uint8_t *)&header, (const uint8_t *)(&header + 1));
+	blob.insert(blob.end(), (const uint8_t *)mips.data(), (const uint8_t *)(mips.data() + mips.size()));
+	for (const texture_mip &mip : entry->mips) {
+		blob.insert(blob.end(), mip.data, mip.data + mip.size);
+	}
+
+	const std::string path = cache_path(hash);
+	if (!psyfile::write(path.c_str(), blob.data(), blob.size())) {
+		fprintf(stderr, "Warning: could not write texture cache %s\n", path.c_str());
+	}
+}
+
+bool has_extension(const char *name) {
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++) {
+		if (!strcmp((const char *)glGetStringi(GL_EXTENSIONS, i), name)) {
+			return true;
+		}
+	}
+	return false;
+}
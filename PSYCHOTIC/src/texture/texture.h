@@ -0,0 +1,136 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <buffer/buffer.h>
+#include <file/file.h>
+#include <job/job.h>
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define TEXTURE_MAX 1024
+// staging bytes copied into PBOs per frame and the staging ring's region size, a single
+// mip larger than this still goes through on its own, in a one-off buffer
+#define TEXTURE_UPLOAD_BUDGET (8 * 1024 * 1024)
+#define TEXTURE_INVALID 0xffffffffu
+// block rows per compression job, mips with fewer stay on the loader worker
+#define TEXTURE_COMPRESS_BATCH 16
+
+// compressed mip chains are cached here as <source hash>.psyt
+#define TEXTURE_CACHE_DIR "cache/textures"
+// 'PSYT'
+#define TEXTURE_CACHE_MAGIC 0x54595350
+#define TEXTURE_CACHE_VERSION 1
+
+// EXT_texture_compression_s3tc, not part of the core profile glad was generated for
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+typedef uint32_t texture_handle;
+
+enum texture_compression {
+	TEXTURE_COMPRESSION_NONE,
+	// BC1 for opaque sources, BC3 when any texel has alpha
+	TEXTURE_COMPRESSION_BC1_BC3,
+	TEXTURE_COMPRESSION_BC7
+};
+
+enum texture_status {
+	TEXTURE_STATUS_QUEUED,
+	TEXTURE_STATUS_DECODED,
+	TEXTURE_STATUS_RESIDENT,
+	TEXTURE_STATUS_FAILED
+};
+
+// Cache blob:
+//   texture_cache_header
+//   texture_cache_mip[mip_count]
+//   mip data at each texture_cache_mip::offset
+struct texture_cache_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_hash;
+	uint32_t format;
+	uint32_t mip_count;
+};
+
+struct texture_cache_mip {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;
+	uint64_t size;
+};
+
+struct texture_mip {
+	int width;
+	int height;
+	// points into storage, or into the mapped cache blob on a cache hit
+	const uint8_t *data;
+	size_t size;
+	std::vector<uint8_t> storage;
+};
+
+struct texture_entry {
+	std::string path;
+	std::atomic<int> status;
+	GLuint texture;
+	int uploaded_mips;
+	// GL_RGBA8 or one of the block compressed formats
+	GLenum format;
+	// mip chain, written by a worker and consumed by update() on the GL thread
+	std::vector<texture_mip> mips;
+	mapped_file cache;
+};
+
+struct texture_manager {
+	std::unique_ptr<texture_entry[]> entries;
+	uint32_t count;
+	GLuint placeholder;
+	texture_compression compression;
+	// large mips are compressed a few block rows per job
+	job_system *jobs;
+
+	std::vector<std::thread> workers;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::deque<texture_handle> decode_queue;
+	std::deque<texture_handle> upload_queue;
+	bool quit;
+
+	// PBO staging ring, fenced per frame like every other stream buffer
+	stream_buffer staging;
+
+	uint32_t resident_count;
+	std::atomic<uint32_t> cache_hits;
+	std::atomic<uint32_t> cache_misses;
+};
+
+namespace psytexture {
+	void create(texture_manager *manager, int worker_count, texture_compression compression, job_system *jobs);
+	void destroy(texture_manager *manager);
+
+	// queues decode + mip generation on the workers and returns immediately
+	texture_handle load(texture_manager *manager, const char *path);
+	// GL thread, once per frame: uploads decoded mips within TEXTURE_UPLOAD_BUDGET
+	void update(texture_manager *manager);
+	// the placeholder until every mip of the texture is resident
+	GLuint get(texture_manager *manager, texture_handle handle);
+	bool all_resident(texture_manager *manager);
+
+	// texture_compress.cpp: 4x4 block encoders, texels past the edge repeat the last row/column
+	size_t block_size(GLenum format);
+	size_t compressed_size(GLenum format, int width, int height);
+	// TEXTURE_COMPRESS_BATCH block rows per job, waiting on the calling thread; jobs may be null
+	void compress(GLenum format, const uint8_t *rgba, int width, int height, uint8_t *out, job_system *jobs);
+}
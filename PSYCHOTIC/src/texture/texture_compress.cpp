@@ -0,0 +1,298 @@
+#include "texture.h"
+
+#include <emmintrin.h>
+
+#include <string.h>
+
+struct compress_job {
+	GLenum format;
+	const uint8_t *rgba;
+	int width;
+	int height;
+	uint8_t *out;
+};
+
+struct block_writer {
+	uint64_t bits[2];
+	int position;
+};
+
+void compress_block_rows(void *data, uint32_t begin, uint32_t end);
+void compress_rows(GLenum format, const uint8_t *rgba, int width, int height, uint8_t *out, int first_row, int end_row);
+void load_block(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t block[64]);
+void block_bounds(const uint8_t block[64], uint8_t min[4], uint8_t max[4]);
+void project_block(const uint8_t block[64], const uint8_t origin[4], const int axis[4], int steps, int indices[16]);
+void encode_bc1(const uint8_t block[64], uint8_t *out);
+void encode_bc3_alpha(const uint8_t block[64], uint8_t *out);
+void encode_bc7(const uint8_t block[64], uint8_t *out);
+void write_bits(block_writer *writer, uint32_t value, int count);
+
+size_t psytexture::block_size(GLenum format) {
+	return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+}
+
+size_t psytexture::compressed_size(GLenum format, int width, int height) {
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * block_size(format);
+}
+
+void psytexture::compress(GLenum format, const uint8_t *rgba, int width, int height, uint8_t *out, job_system *jobs) {
+	const int block_rows = (height + 3) / 4;
+	if (!jobs || block_rows <= TEXTURE_COMPRESS_BATCH) {
+		compress_rows(format, rgba, width, height, out, 0, block_rows);
+		return;
+	}
+	compress_job job = { format, rgba, width, height, out };
+	psyjob::parallel_for(jobs, (uint32_t)block_rows, TEXTURE_COMPRESS_BATCH, compress_block_rows, &job);
+}
+
+void compress_block_rows(void *data, uint32_t begin, uint32_t end) {
+	const compress_job *job = (const compress_job *)data;
+	compress_rows(job->format, job->rgba, job->width, job->height, job->out, (int)begin, (int)end);
+}
+
+void compress_rows(GLenum format, const uint8_t *rgba, int width, int height, uint8_t *out, int first_row, int end_row) {
+	const int blocks_x = (width + 3) / 4;
+	const int blocks_y = (height + 3) / 4;
+	const size_t size = psytexture::block_size(format);
+
+	uint8_t block[64];
+	for (int by = first_row; by < end_row && by < blocks_y; by++) {
+		uint8_t *row = out + (size_t)by * blocks_x * size;
+		for (int bx = 0; bx < blocks_x; bx++) {
+			load_block(rgba, width, height, bx, by, block);
+			uint8_t *dst = row + bx * size;
+			if (format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT) {
+				encode_bc1(block, dst);
+			} else if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT) {
+				encode_bc3_alpha(block, dst);
+				encode_bc1(block, dst + 8);
+			} else {
+				encode_bc7(block, dst);
+			}
+		}
+	}
+}
+
+// texels past the right/bottom edge repeat the last column/row
+void load_block(const uint8_t *rgba, int width, int height, int bx, int by, uint8_t block[64]) {
+	for (int y = 0; y < 4; y++) {
+		const int sy = by * 4 + y < height ? by * 4 + y : height - 1;
+		for (int x = 0; x < 4; x++) {
+			const int sx = bx * 4 + x < width ? bx * 4 + x : width - 1;
+			memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+		}
+	}
+}
+
+void block_bounds(const uint8_t block[64], uint8_t min[4], uint8_t max[4]) {
+	const __m128i r0 = _mm_loadu_si128((const __m128i *)(block + 0));
+	const __m128i r1 = _mm_loadu_si128((const __m128i *)(block + 16));
+	const __m128i r2 = _mm_loadu_si128((const __m128i *)(block + 32));
+	const __m128i r3 = _mm_loadu_si128((const __m128i *)(block + 48));
+
+	__m128i lo = _mm_min_epu8(_mm_min_epu8(r0, r1), _mm_min_epu8(r2, r3));
+	__m128i hi = _mm_max_epu8(_mm_max_epu8(r0, r1), _mm_max_epu8(r2, r3));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(1, 0, 3, 2)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(1, 0, 3, 2)));
+	lo = _mm_min_epu8(lo, _mm_shuffle_epi32(lo, _MM_SHUFFLE(2, 3, 0, 1)));
+	hi = _mm_max_epu8(hi, _mm_shuffle_epi32(hi, _MM_SHUFFLE(2, 3, 0, 1)));
+
+	const uint32_t packed_min = (uint32_t)_mm_cvtsi128_si32(lo);
+	const uint32_t packed_max = (uint32_t)_mm_cvtsi128_si32(hi);
+	memcpy(min, &packed_min, 4);
+	memcpy(max, &packed_max, 4);
+}
+
+// indices[i] = round(dot(texel - origin, axis) / dot(axis, axis) * steps), clamped to [0, steps]
+void project_block(const uint8_t block[64], const uint8_t origin[4], const int axis[4], int steps, int indices[16]) {
+	const int length = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2] + axis[3] * axis[3];
+	if (length == 0) {
+		memset(indices, 0, sizeof(int) * 16);
+		return;
+	}
+
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i base = _mm_set_epi16(
+		origin[3], origin[2], origin[1], origin[0],
+		origin[3], origin[2], origin[1], origin[0]);
+	const __m128i direction = _mm_set_epi16(
+		(short)axis[3], (short)axis[2], (short)axis[1], (short)axis[0],
+		(short)axis[3], (short)axis[2], (short)axis[1], (short)axis[0]);
+	const __m128 scale = _mm_set1_ps((float)steps / (float)length);
+	const __m128 upper = _mm_set1_ps((float)steps);
+
+	for (int row = 0; row < 4; row++) {
+		const __m128i texels = _mm_loadu_si128((const __m128i *)(block + row * 16));
+		const __m128i lo = _mm_madd_epi16(_mm_sub_epi16(_mm_unpacklo_epi8(texels, zero), base), direction);
+		const __m128i hi = _mm_madd_epi16(_mm_sub_epi16(_mm_unpackhi_epi8(texels, zero), base), direction);
+
+		// madd leaves (rg, ba) partial sums per texel, fold them into one dot per lane
+		const __m128 even = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0));
+		const __m128 odd = _mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1));
+		const __m128i dot = _mm_add_epi32(_mm_castps_si128(even), _mm_castps_si128(odd));
+
+		__m128 t = _mm_mul_ps(_mm_cvtepi32_ps(dot), scale);
+		t = _mm_min_ps(_mm_max_ps(t, _mm_setzero_ps()), upper);
+		_mm_storeu_si128((__m128i *)(indices + row * 4), _mm_cvtps_epi32(t));
+	}
+}
+
+uint16_t pack_565(const uint8_t color[4]) {
+	const int r = (color[0] * 31 + 127) / 255;
+	const int g = (color[1] * 63 + 127) / 255;
+	const int b = (color[2] * 31 + 127) / 255;
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+void unpack_565(uint16_t packed, uint8_t color[4]) {
+	const int r = (packed >> 11) & 31;
+	const int g = (packed >> 5) & 63;
+	const int b = packed & 31;
+	color[0] = (uint8_t)((r << 3) | (r >> 2));
+	color[1] = (uint8_t)((g << 2) | (g >> 4));
+	color[2] = (uint8_t)((b << 3) | (b >> 2));
+	color[3] = 0;
+}
+
+// bounding box endpoints inset by 1/16 of the range, texels projected on the diagonal
+void encode_bc1(const uint8_t block[64], uint8_t *out) {
+	uint8_t min[4], max[4];
+	block_bounds(block, min, max);
+	for (int c = 0; c < 3; c++) {
+		const int inset = (max[c] - min[c]) >> 4;
+		min[c] = (uint8_t)(min[c] + inset);
+		max[c] = (uint8_t)(max[c] - inset);
+	}
+
+	// color0 > color1 selects the 4 color mode; the box max never packs below its min
+	const uint16_t color0 = pack_565(max);
+	const uint16_t color1 = pack_565(min);
+	uint32_t selectors = 0;
+	if (color0 != color1) {
+		uint8_t end0[4], end1[4];
+		unpack_565(color0, end0);
+		unpack_565(color1, end1);
+		const int axis[4] = { end0[0] - end1[0], end0[1] - end1[1], end0[2] - end1[2], 0 };
+
+		// projection runs color1 -> color0, BC1 orders the palette color0, color1, 2/3, 1/3
+		static const uint32_t remap[4] = { 1, 3, 2, 0 };
+		int indices[16];
+		project_block(block, end1, axis, 3, indices);
+		for (int i = 0; i < 16; i++) {
+			selectors |= remap[indices[i]] << (i * 2);
+		}
+	}
+
+	memcpy(out + 0, &color0, 2);
+	memcpy(out + 2, &color1, 2);
+	memcpy(out + 4, &selectors, 4);
+}
+
+void encode_bc3_alpha(const uint8_t block[64], uint8_t *out) {
+	uint8_t min[4], max[4];
+	block_bounds(block, min, max);
+
+	uint64_t selectors = 0;
+	if (max[3] != min[3]) {
+		const uint8_t origin[4] = { 0, 0, 0, min[3] };
+		const int axis[4] = { 0, 0, 0, max[3] - min[3] };
+
+		// alpha0 > alpha1 selects the 8 value mode: alpha0, alpha1, then 6/7 .. 1/7 of alpha0
+		static const uint64_t remap[8] = { 1, 7, 6, 5, 4, 3, 2, 0 };
+		int indices[16];
+		project_block(block, origin, axis, 7, indices);
+		for (int i = 0; i < 16; i++) {
+			selectors |= remap[indices[i]] << (i * 3);
+		}
+	}
+
+	out[0] = max[3];
+	out[1] = min[3];
+	for (int i = 0; i < 6; i++) {
+		out[2 + i] = (uint8_t)(selectors >> (i * 8));
+	}
+}
+
+// 7 bit endpoint plus a p-bit shared by all four channels, picks the p-bit with less error
+void quantize_bc7_endpoint(const uint8_t color[4], uint8_t quantized[4], uint32_t *pbit) {
+	int best_error = 0x7fffffff;
+	for (uint32_t p = 0; p < 2; p++) {
+		uint8_t candidate[4];
+		int error = 0;
+		for (int c = 0; c < 4; c++) {
+			int value = (color[c] - (int)p + 1) >> 1;
+			value = value < 0 ? 0 : (value > 127 ? 127 : value);
+			candidate[c] = (uint8_t)value;
+			const int delta = ((value << 1) | (int)p) - color[c];
+			error += delta * delta;
+		}
+		if (error < best_error) {
+			best_error = error;
+			memcpy(quantized, candidate, 4);
+			*pbit = p;
+		}
+	}
+}
+
+// mode 6 only: one subset, RGBA 7.7.7.7 + p-bit endpoints, 4 bit indices
+void encode_bc7(const uint8_t block[64], uint8_t *out) {
+	uint8_t min[4], max[4];
+	block_bounds(block, min, max);
+	for (int c = 0; c < 4; c++) {
+		const int inset = (max[c] - min[c]) >> 5;
+		min[c] = (uint8_t)(min[c] + inset);
+		max[c] = (uint8_t)(max[c] - inset);
+	}
+
+	uint8_t end0[4], end1[4];
+	uint32_t p0 = 0, p1 = 0;
+	quantize_bc7_endpoint(min, end0, &p0);
+	quantize_bc7_endpoint(max, end1, &p1);
+
+	uint8_t origin[4];
+	int axis[4];
+	for (int c = 0; c < 4; c++) {
+		origin[c] = (uint8_t)((end0[c] << 1) | p0);
+		axis[c] = ((end1[c] << 1) | (int)p1) - origin[c];
+	}
+
+	int indices[16];
+	project_block(block, origin, axis, 15, indices);
+
+	// the anchor texel only stores 3 index bits, so its index must be < 8
+	if (indices[0] >= 8) {
+		uint8_t swap[4];
+		memcpy(swap, end0, 4);
+		memcpy(end0, end1, 4);
+		memcpy(end1, swap, 4);
+		const uint32_t p = p0;
+		p0 = p1;
+		p1 = p;
+		for (int i = 0; i < 16; i++) {
+			indices[i] = 15 - indices[i];
+		}
+	}
+
+	block_writer writer = {};
+	write_bits(&writer, 1 << 6, 7);
+	for (int c = 0; c < 4; c++) {
+		write_bits(&writer, end0[c], 7);
+		write_bits(&writer, end1[c], 7);
+	}
+	write_bits(&writer, p0, 1);
+	write_bits(&writer, p1, 1);
+	write_bits(&writer, (uint32_t)indices[0], 3);
+	for (int i = 1; i < 16; i++) {
+		write_bits(&writer, (uint32_t)indices[i], 4);
+	}
+	memcpy(out, writer.bits, 16);
+}
+
+void write_bits(block_writer *writer, uint32_t value, int count) {
+	for (int i = 0; i < count; i++) {
+		if ((value >> i) & 1) {
+			writer->bits[writer->position >> 6] |= 1ull << (writer->position & 63);
+		}
+		writer->position++;
+	}
+}
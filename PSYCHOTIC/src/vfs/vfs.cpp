@@ -0,0 +1,390 @@
+#include "vfs.h"
+
+#include <bench/bench.h>
+#include <memory/memory.h>
+#include <profiler/profiler.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+// one compressed entry being decompressed, a job per block
+struct vfs_block_job {
+	const uint8_t *stored;
+	const uint32_t *sizes;
+	const uint64_t *offsets;
+	uint8_t *dst;
+	uint64_t size;
+	std::atomic<uint32_t> failed;
+};
+
+bool valid_archive(const mapped_file *file);
+const vfs_entry *find_entry(const char *path);
+bool decompress_entry(const vfs_entry *entry, uint8_t *dst);
+void decompress_blocks(void *data, uint32_t begin, uint32_t end);
+void preload_entries(void *data, uint32_t begin, uint32_t end);
+
+static mapped_file archive;
+static const vfs_entry *archive_entries;
+static const char *archive_names;
+static uint32_t archive_count;
+static job_system *archive_jobs;
+// per entry, taken by the first open()
+static std::atomic<uint8_t *> *preloaded;
+static vfs_stats counters;
+
+bool psyvfs::mount(const char *path, job_system *jobs) {
+	PSY_PROFILE_SCOPE("psyvfs::mount");
+	psyvfs::unmount();
+
+	mapped_file file = {};
+	if (!psyfile::map(path, &file)) {
+		return false;
+	}
+	if (!valid_archive(&file)) {
+		fprintf(stderr, "Error: %s is not a valid archive\n", path);
+		psyfile::unmap(&file);
+		return false;
+	}
+
+	const vfs_header *header = (const vfs_header *)file.data;
+	archive = file;
+	archive_entries = (const vfs_entry *)(header + 1);
+	archive_names = (const char *)file.data + header->names_offset;
+	archive_count = header->entry_count;
+	archive_jobs = jobs;
+	return true;
+}
+
+void psyvfs::unmount() {
+	psyvfs::drop_preloaded();
+	psyfile::unmap(&archive);
+	archive_entries = nullptr;
+	archive_names = nullptr;
+	archive_count = 0;
+	archive_jobs = nullptr;
+	counters.in_place = 0;
+	counters.decompressed = 0;
+	counters.loose = 0;
+	counters.decompressed_bytes = 0;
+	counters.decompress_ticks = 0;
+}
+
+bool psyvfs::mounted() {
+	return archive.data != nullptr;
+}
+
+const vfs_stats *psyvfs::stats() {
+	return &counters;
+}
+
+void psyvfs::preload(const char *const *prefixes, uint32_t count) {
+	PSY_PROFILE_SCOPE("psyvfs::preload");
+	PSY_MEMORY_SCOPE(MEMORY_TAG_VFS);
+	if (!archive_count) {
+		return;
+	}
+	if (!preloaded) {
+		preloaded = new std::atomic<uint8_t *>[archive_count];
+		for (uint32_t i = 0; i < archive_count; i++) {
+			preloaded[i] = nullptr;
+		}
+	}
+
+	std::vector<uint32_t> entries;
+	for (uint32_t i = 0; i < archive_count; i++) {
+		const char *name = archive_names + archive_entries[i].name_offset;
+		if (archive_entries[i].compression == VFS_COMPRESSION_NONE || preloaded[i]) {
+			continue;
+		}
+		for (uint32_t p = 0; p < count; p++) {
+			if (!strncmp(name, prefixes[p], strlen(prefixes[p]))) {
+				entries.push_back(i);
+				break;
+			}
+		}
+	}
+
+	// a job per entry, the ones of more than one block fan out again over their blocks
+	if (archive_jobs) {
+		psyjob::parallel_for(archive_jobs, (uint32_t)entries.size(), 1, preload_entries, entries.data());
+	} else {
+		preload_entries(entries.data(), 0, (uint32_t)entries.size());
+	}
+}
+
+void psyvfs::drop_preloaded() {
+	if (!preloaded) {
+		return;
+	}
+	for (uint32_t i = 0; i < archive_count; i++) {
+		if (preloaded[i]) {
+			psymemory::release(preloaded[i]);
+		}
+	}
+	delete[] preloaded;
+	preloaded = nullptr;
+}
+
+bool psyvfs::open(const char *path, vfs_file *file) {
+	*file = {};
+	const vfs_entry *entry = find_entry(path);
+	if (!entry) {
+		return psyvfs::open_loose(path, file);
+	}
+
+	const uint8_t *stored = (const uint8_t *)archive.data + entry->offset;
+	if (entry->compression == VFS_COMPRESSION_NONE) {
+		file->data = stored;
+		file->size = (size_t)entry->size;
+		counters.in_place++;
+		return true;
+	}
+
+	uint8_t *buffer = preloaded ? preloaded[entry - archive_entries].exchange(nullptr) : nullptr;
+	if (buffer) {
+		file->data = buffer;
+		file->size = (size_t)entry->size;
+		file->buffer = buffer;
+		counters.decompressed++;
+		counters.decompressed_bytes += entry->size;
+		return true;
+	}
+
+	PSY_PROFILE_SCOPE("psyvfs::decompress");
+	const uint64_t start = psybench::ticks();
+	buffer = (uint8_t *)psymemory::allocate(entry->size > 0 ? (size_t)entry->size : 1, MEMORY_TAG_VFS);
+	if (!decompress_entry(entry, buffer)) {
+		fprintf(stderr, "Error: archive entry %s is corrupt\n", path);
+		psymemory::release(buffer);
+		return false;
+	}
+	file->data = buffer;
+	file->size = (size_t)entry->size;
+	file->buffer = buffer;
+	counters.decompressed++;
+	counters.decompressed_bytes += entry->size;
+	counters.decompress_ticks += psybench::ticks() - start;
+	return true;
+}
+
+bool psyvfs::open_loose(const char *path, vfs_file *file) {
+	*file = {};
+	if (!psyfile::map(path, &file->loose)) {
+		return false;
+	}
+	file->data = file->loose.data;
+	file->size = file->loose.size;
+	counters.loose++;
+	return true;
+}
+
+void psyvfs::close(vfs_file *file) {
+	if (file->buffer) {
+		psymemory::release(file->buffer);
+	}
+	psyfile::unmap(&file->loose);
+	*file = {};
+}
+
+uint64_t psyvfs::hash(const char *path) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (const char *c = path; *c; c++) {
+		hash = (hash ^ (uint8_t)*c) * 0x100000001b3ull;
+	}
+	return hash;
+}
+
+bool psyvfs::lz4_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size) {
+	const uint8_t *ip = src;
+	const uint8_t *const ip_end = src + size;
+	uint8_t *op = dst;
+	uint8_t *const op_end = dst + dst_size;
+
+	while (ip < ip_end) {
+		const uint8_t token = *ip++;
+
+		size_t literals = token >> 4;
+		if (literals == 15) {
+			uint8_t extra = 255;
+			while (extra == 255) {
+				if (ip == ip_end) {
+					return false;
+				}
+				extra = *ip++;
+				literals += extra;
+			}
+		}
+		if ((size_t)(ip_end - ip) < literals || (size_t)(op_end - op) < literals) {
+			return false;
+		}
+		memcpy(op, ip, literals);
+		ip += literals;
+		op += literals;
+
+		// the last sequence is literals only
+		if (ip == ip_end) {
+			break;
+		}
+
+		if (ip_end - ip < 2) {
+			return false;
+		}
+		const size_t offset = (size_t)ip[0] | (size_t)ip[1] << 8;
+		ip += 2;
+		if (offset == 0 || offset > (size_t)(op - dst)) {
+			return false;
+		}
+
+		size_t length = token & 15;
+		if (length == 15) {
+			uint8_t extra = 255;
+			while (extra == 255) {
+				if (ip == ip_end) {
+					return false;
+				}
+				extra = *ip++;
+				length += extra;
+			}
+		}
+		length += 4;
+		if ((size_t)(op_end - op) < length) {
+			return false;
+		}
+
+		const uint8_t *match = op - offset;
+		if (offset >= length) {
+			memcpy(op, match, length);
+			op += length;
+		} else {
+			// overlapping, the match repeats what it is writing
+			for (size_t i = 0; i < length; i++) {
+				*op++ = *match++;
+			}
+		}
+	}
+	return op == op_end;
+}
+
+// everything open() and find_entry() index into lies inside the mapping
+bool valid_archive(const mapped_file *file) {
+	if (file->size < sizeof(vfs_header)) {
+		return false;
+	}
+	const vfs_header *header = (const vfs_header *)file->data;
+	if (header->magic != VFS_MAGIC || header->version != VFS_VERSION || header->size != file->size) {
+		return false;
+	}
+	const uint64_t entries_end = sizeof(vfs_header) + (uint64_t)header->entry_count * sizeof(vfs_entry);
+	if (entries_end > header->names_offset || header->names_offset > file->size ||
+		header->names_size > file->size - header->names_offset || header->names_size == 0 || ((const char *)file->data)[header->names_offset + header->names_size - 1] != '\0') {
+		return false;
+	}
+
+	const vfs_entry *entries = (const vfs_entry *)(header + 1);
+	for (uint32_t i = 0; i < header->entry_count; i++) {
+		const vfs_entry &entry = entries[i];
+		if (entry.name_offset >= header->names_size || entry.offset % VFS_ALIGNMENT != 0 ||
+			entry.offset > file->size || entry.stored_size > file->size - entry.offset) {
+			return false;
+		}
+		if (entry.compression == VFS_COMPRESSION_NONE ? entry.stored_size != entry.size : entry.compression != VFS_COMPRESSION_LZ4) {
+			return false;
+		}
+		if (i > 0 && entries[i - 1].hash > entry.hash) {
+			return false;
+		}
+	}
+	return true;
+}
+
+const vfs_entry *find_entry(const char *path) {
+	if (!archive_count) {
+		return nullptr;
+	}
+	const uint64_t hash = psyvfs::hash(path);
+	const vfs_entry *end = archive_entries + archive_count;
+	const vfs_entry *entry = std::lower_bound(archive_entries, end, hash,
+		[](const vfs_entry &a, uint64_t b) { return a.hash < b; });
+	for (; entry != end && entry->hash == hash; entry++) {
+		if (!strcmp(archive_names + entry->name_offset, path)) {
+			return entry;
+		}
+	}
+	return nullptr;
+}
+
+bool decompress_entry(const vfs_entry *entry, uint8_t *dst) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_VFS);
+	const uint64_t block_count = (entry->size + VFS_BLOCK_SIZE - 1) / VFS_BLOCK_SIZE;
+	const uint64_t table_size = block_count * sizeof(uint32_t);
+	if (table_size > entry->stored_size) {
+		return false;
+	}
+
+	const uint8_t *stored = (const uint8_t *)archive.data + entry->offset;
+	const uint32_t *sizes = (const uint32_t *)stored;
+	std::vector<uint64_t> offsets((size_t)block_count);
+	uint64_t offset = table_size;
+	for (uint64_t i = 0; i < block_count; i++) {
+		offsets[(size_t)i] = offset;
+		offset += sizes[i] & ~VFS_BLOCK_RAW;
+	}
+	if (offset > entry->stored_size) {
+		return false;
+	}
+
+	vfs_block_job job;
+	job.stored = stored;
+	job.sizes = sizes;
+	job.offsets = offsets.data();
+	job.dst = dst;
+	job.size = entry->size;
+	job.failed = 0;
+	if (archive_jobs && block_count > 1) {
+		psyjob::parallel_for(archive_jobs, (uint32_t)block_count, 1, decompress_blocks, &job);
+	} else {
+		decompress_blocks(&job, 0, (uint32_t)block_count);
+	}
+	return job.failed == 0;
+}
+
+void decompress_blocks(void *data, uint32_t begin, uint32_t end) {
+	vfs_block_job *job = (vfs_block_job *)data;
+	for (uint32_t i = begin; i < end; i++) {
+		const uint64_t first = (uint64_t)i * VFS_BLOCK_SIZE;
+		const size_t size = (size_t)std::min<uint64_t>(VFS_BLOCK_SIZE, job->size - first);
+		const uint8_t *src = job->stored + job->offsets[i];
+		const uint32_t stored_size = job->sizes[i] & ~VFS_BLOCK_RAW;
+		bool ok;
+		if (job->sizes[i] & VFS_BLOCK_RAW) {
+			ok = stored_size == size;
+			if (ok) {
+				memcpy(job->dst + first, src, size);
+			}
+		} else {
+			ok = psyvfs::lz4_decompress(src, stored_size, job->dst + first, size);
+		}
+		if (!ok) {
+			job->failed++;
+		}
+	}
+}
+
+// a corrupt entry is left for open() to report
+void preload_entries(void *data, uint32_t begin, uint32_t end) {
+	const uint32_t *entries = (const uint32_t *)data;
+	for (uint32_t i = begin; i < end; i++) {
+		const uint32_t index = entries[i];
+		const vfs_entry *entry = &archive_entries[index];
+		const uint64_t start = psybench::ticks();
+		uint8_t *buffer = (uint8_t *)psymemory::allocate(entry->size > 0 ? (size_t)entry->size : 1, MEMORY_TAG_VFS);
+		if (!decompress_entry(entry, buffer)) {
+			psymemory::release(buffer);
+			continue;
+		}
+		preloaded[index] = buffer;
+		counters.decompress_ticks += psybench::ticks() - start;
+	}
+}
@@ -0,0 +1,135 @@
+#pragma once
+
+#include <file/file.h>
+#include <job/job.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// 'PSYA'
+#define VFS_MAGIC 0x41595350
+#define VFS_VERSION 1
+// packed from res/ after every build, mounted at startup when it is there
+#define VFS_DEFAULT_ARCHIVE "assets.psypack"
+// compressed entries are cut into blocks this size, each one decompresses on its own
+#define VFS_BLOCK_SIZE (64 * 1024)
+// a block size with this bit set was stored as is, LZ4 made it bigger
+#define VFS_BLOCK_RAW 0x80000000u
+// entries LZ4 does not shrink below this fraction are stored raw and served in place
+#define VFS_MIN_RATIO 0.9
+// every entry starts on this alignment, so a raw one can be handed out as it is mapped
+#define VFS_ALIGNMENT 16
+
+enum vfs_compression {
+	VFS_COMPRESSION_NONE,
+	VFS_COMPRESSION_LZ4
+};
+
+// Archive:
+//   vfs_header
+//   vfs_entry[entry_count], sorted by hash, then name
+//   names, NUL terminated paths as the loaders ask for them (res/shaders/cube.vert)
+//   per entry at offset: the raw bytes, or a uint32_t compressed size per block followed by the blocks
+struct vfs_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t names_size;
+	uint64_t names_offset;
+	// of the whole archive, a truncated one is rejected
+	uint64_t size;
+};
+
+struct vfs_entry {
+	// FNV-1a of the name
+	uint64_t hash;
+	uint64_t offset;
+	uint64_t size;
+	uint64_t stored_size;
+	uint32_t name_offset;
+	uint32_t compression;
+};
+
+// what open() hands out; data stays valid until close()
+struct vfs_file {
+	const void *data;
+	size_t size;
+	// the decompressed copy, or the mapping of a loose file; neither for an entry served in place
+	uint8_t *buffer;
+	mapped_file loose;
+};
+
+// opens from any thread, counted since the last mount or unmount
+struct vfs_stats {
+	std::atomic<uint32_t> in_place;
+	std::atomic<uint32_t> decompressed;
+	std::atomic<uint32_t> loose;
+	std::atomic<uint64_t> decompressed_bytes;
+	// summed over threads
+	std::atomic<uint64_t> decompress_ticks;
+};
+
+struct vfs_pack_stats {
+	uint32_t files;
+	uint32_t compressed;
+	uint64_t raw_bytes;
+	uint64_t archive_bytes;
+	double pack_ms;
+};
+
+// --asset-bench packs res/ here, apart from the archive the run itself mounts
+#define VFS_BENCH_ARCHIVE "cache/assets_bench.psypack"
+
+// every file under res/ read loose and from the archive, right after dropping them from
+// the page cache and again warm; archive passes include mounting it
+struct vfs_bench_result {
+	uint32_t files;
+	uint64_t bytes;
+	uint64_t archive_bytes;
+	// false where the page cache cannot be dropped, the cold passes are warm then
+	bool evicted;
+	// both ways read the same bytes
+	bool matched;
+	double loose_cold_ms;
+	double loose_warm_ms;
+	double pack_cold_ms;
+	double pack_warm_ms;
+};
+
+namespace psyvfs {
+	// maps the archive; opens look in it before the loose files from then on. Entries of
+	// more than one block decompress over jobs when it is not null
+	bool mount(const char *path, job_system *jobs);
+	void unmount();
+	bool mounted();
+	const vfs_stats *stats();
+
+	// decompresses every compressed entry whose name starts with one of prefixes up front,
+	// entries spread over the jobs given to mount; open() hands the copies out. Call from
+	// the thread that mounted before anything else opens, drop_preloaded() frees the rest
+	void preload(const char *const *prefixes, uint32_t count);
+	void drop_preloaded();
+
+	// the archive entry when there is one, the loose file at path otherwise; paths are
+	// relative to the working directory with '/' separators
+	bool open(const char *path, vfs_file *file);
+	// skips the archive, for files edited since it was packed
+	bool open_loose(const char *path, vfs_file *file);
+	void close(vfs_file *file);
+
+	uint64_t hash(const char *path);
+
+	// build time: every file under directory, named directory/<relative path>
+	bool pack(const char *directory, const char *archive, vfs_pack_stats *stats);
+
+	// --asset-bench, vfs_bench.cpp: mounts and unmounts an archive of its own, so before
+	// the run's own is mounted; false when res/ could not be packed
+	bool run_bench(job_system *jobs, vfs_bench_result *result);
+
+	// LZ4 block format, no frame; compress returns 0 when dst is too small
+	size_t lz4_bound(size_t size);
+	size_t lz4_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+	// false unless src decodes to exactly dst_size bytes
+	bool lz4_decompress(const uint8_t *src, size_t size, uint8_t *dst, size_t dst_size);
+}
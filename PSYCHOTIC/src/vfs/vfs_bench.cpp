@@ -0,0 +1,65 @@
+#include "vfs.h"
+
+#include <bench/bench.h>
+
+#include <string>
+#include <vector>
+
+bool psyvfs::run_bench(job_system *jobs, vfs_bench_result *result) {
+	*result = {};
+	std::vector<std::string> files;
+	vfs_pack_stats pack = {};
+	if (!psyfile::list_files("res", &files) || !psyfile::create_directories("cache") ||
+		!psyvfs::pack("res", VFS_BENCH_ARCHIVE, &pack)) {
+		return false;
+	}
+	result->archive_bytes = pack.archive_bytes;
+	result->evicted = true;
+
+	// loose cold, loose warm, archive cold, archive warm
+	double *timings[4] = { &result->loose_cold_ms, &result->loose_warm_ms, &result->pack_cold_ms, &result->pack_warm_ms };
+	uint64_t checksums[4] = {};
+	for (int pass = 0; pass < 4; pass++) {
+		const bool packed = pass >= 2;
+		if (pass % 2 == 0) {
+			if (packed) {
+				result->evicted = psyfile::evict(VFS_BENCH_ARCHIVE) && result->evicted;
+			} else {
+				for (const std::string &file : files) {
+					result->evicted = psyfile::evict(file.c_str()) && result->evicted;
+				}
+			}
+		}
+
+		const uint64_t start = psybench::ticks();
+		if (packed) {
+			if (!psyvfs::mount(VFS_BENCH_ARCHIVE, jobs)) {
+				return false;
+			}
+			const char *const everything[] = { "" };
+			psyvfs::preload(everything, 1);
+		}
+		result->files = 0;
+		result->bytes = 0;
+		for (const std::string &file : files) {
+			vfs_file data = {};
+			if (!(packed ? psyvfs::open(file.c_str(), &data) : psyvfs::open_loose(file.c_str(), &data))) {
+				continue;
+			}
+			// touches every page, a mapping alone reads nothing
+			const uint8_t *bytes = (const uint8_t *)data.data;
+			for (size_t i = 0; i < data.size; i++) {
+				checksums[pass] = checksums[pass] * 31 + bytes[i];
+			}
+			result->files++;
+			result->bytes += data.size;
+			psyvfs::close(&data);
+		}
+		if (packed) {
+			psyvfs::unmount();
+		}
+		*timings[pass] = psybench::ticks_to_ms(psybench::ticks() - start);
+	}
+	result->matched = checksums[0] == checksums[1] && checksums[0] == checksums[2] && checksums[0] == checksums[3];
+	return true;
+}
@@ -0,0 +1,251 @@
+#include "vfs.h"
+
+#include <bench/bench.h>
+#include <memory/memory.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#define LZ4_HASH_LOG 16
+#define LZ4_MIN_MATCH 4
+// the format ends every block on literals: the last 5 bytes are never matched, and no
+// match starts within the last 12
+#define LZ4_LAST_LITERALS 5
+#define LZ4_MATCH_LIMIT 12
+#define LZ4_MAX_OFFSET 65535
+
+struct vfs_pack_file {
+	std::string name;
+	uint64_t hash;
+	uint64_t size;
+	uint32_t compression;
+	std::vector<uint8_t> stored;
+};
+
+uint32_t lz4_read32(const uint8_t *p);
+uint32_t lz4_hash(uint32_t sequence);
+bool lz4_emit(uint8_t **op, uint8_t *op_end, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_length);
+void pack_entry(const uint8_t *data, size_t size, vfs_pack_file *file);
+
+size_t psyvfs::lz4_bound(size_t size) {
+	return size + size / 255 + 16;
+}
+
+size_t psyvfs::lz4_compress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+	uint8_t *op = dst;
+	uint8_t *const op_end = dst + capacity;
+	const uint8_t *anchor = src;
+
+	if (size > LZ4_MATCH_LIMIT) {
+		// last position each sequence hash was seen at, greedy: the first match found is taken
+		std::vector<uint32_t> table(1 << LZ4_HASH_LOG, 0);
+		const uint8_t *const match_limit = src + size - LZ4_MATCH_LIMIT;
+		const uint8_t *const match_end = src + size - LZ4_LAST_LITERALS;
+
+		const uint8_t *ip = src;
+		while (ip < match_limit) {
+			const uint32_t sequence = lz4_read32(ip);
+			uint32_t &slot = table[lz4_hash(sequence)];
+			const uint8_t *candidate = src + slot;
+			slot = (uint32_t)(ip - src);
+
+			if (candidate >= ip || ip - candidate > LZ4_MAX_OFFSET || lz4_read32(candidate) != sequence) {
+				ip++;
+				continue;
+			}
+
+			const uint8_t *end = ip + LZ4_MIN_MATCH;
+			const uint8_t *match = candidate + LZ4_MIN_MATCH;
+			while (end < match_end && *end == *match) {
+				end++;
+				match++;
+			}
+			if (!lz4_emit(&op, op_end, anchor, (size_t)(ip - anchor), (size_t)(ip - candidate), (size_t)(end - ip))) {
+				return 0;
+			}
+			ip = end;
+			anchor = ip;
+		}
+	}
+
+	if (!lz4_emit(&op, op_end, anchor, (size_t)(src + size - anchor), 0, 0)) {
+		return 0;
+	}
+	return (size_t)(op - dst);
+}
+
+bool psyvfs::pack(const char *directory, const char *archive, vfs_pack_stats *stats) {
+	PSY_MEMORY_SCOPE(MEMORY_TAG_VFS);
+	const uint64_t start = psybench::ticks();
+	*stats = {};
+
+	std::string root = directory;
+	while (root.size() > 1 && root.back() == '/') {
+		root.pop_back();
+	}
+	std::vector<std::string> paths;
+	if (!psyfile::list_files(root.c_str(), &paths)) {
+		fprintf(stderr, "Error: failed to list %s\n", directory);
+		return false;
+	}
+
+	std::vector<vfs_pack_file> files;
+	files.reserve(paths.size());
+	for (const std::string &path : paths) {
+		// empty files cannot be mapped, loose or packed; they are left out
+		mapped_file mapped = {};
+		if (!psyfile::map(path.c_str(), &mapped)) {
+			continue;
+		}
+		vfs_pack_file file;
+		file.name = path;
+		file.hash = psyvfs::hash(path.c_str());
+		pack_entry((const uint8_t *)mapped.data, mapped.size, &file);
+		psyfile::unmap(&mapped);
+
+		stats->files++;
+		stats->compressed += file.compression == VFS_COMPRESSION_LZ4;
+		stats->raw_bytes += file.size;
+		files.push_back(std::move(file));
+	}
+
+	std::sort(files.begin(), files.end(), [](const vfs_pack_file &a, const vfs_pack_file &b) {
+		return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+	});
+
+	vfs_header header = {};
+	header.magic = VFS_MAGIC;
+	header.version = VFS_VERSION;
+	header.entry_count = (uint32_t)files.size();
+	header.names_offset = sizeof(vfs_header) + files.size() * sizeof(vfs_entry);
+
+	std::vector<vfs_entry> entries(files.size());
+	std::string names;
+	for (size_t i = 0; i < files.size(); i++) {
+		entries[i] = {};
+		entries[i].hash = files[i].hash;
+		entries[i].size = files[i].size;
+		entries[i].stored_size = files[i].stored.size();
+		entries[i].compression = files[i].compression;
+		entries[i].name_offset = (uint32_t)names.size();
+		names += files[i].name;
+		names += '\0';
+	}
+	if (names.empty()) {
+		names += '\0';
+	}
+	header.names_size = (uint32_t)names.size();
+
+	uint64_t offset = header.names_offset + header.names_size;
+	for (vfs_entry &entry : entries) {
+		offset = (offset + VFS_ALIGNMENT - 1) & ~(uint64_t)(VFS_ALIGNMENT - 1);
+		entry.offset = offset;
+		offset += entry.stored_size;
+	}
+	header.size = offset;
+
+	std::vector<uint8_t> image((size_t)header.size, 0);
+	memcpy(image.data(), &header, sizeof(header));
+	if (!entries.empty()) {
+		memcpy(image.data() + sizeof(header), entries.data(), entries.size() * sizeof(vfs_entry));
+	}
+	memcpy(image.data() + header.names_offset, names.data(), names.size());
+	for (size_t i = 0; i < files.size(); i++) {
+		if (!files[i].stored.empty()) {
+			memcpy(image.data() + entries[i].offset, files[i].stored.data(), files[i].stored.size());
+		}
+	}
+
+	if (!psyfile::write(archive, image.data(), image.size())) {
+		fprintf(stderr, "Error: failed to write %s\n", archive);
+		return false;
+	}
+	stats->archive_bytes = header.size;
+	stats->pack_ms = psybench::ticks_to_ms(psybench::ticks() - start);
+	return true;
+}
+
+uint32_t lz4_read32(const uint8_t *p) {
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+uint32_t lz4_hash(uint32_t sequence) {
+	return (sequence * 2654435761u) >> (32 - LZ4_HASH_LOG);
+}
+
+// one sequence: token, literal length, literals, then offset and match length unless
+// match_length is 0 (the closing literals)
+bool lz4_emit(uint8_t **op, uint8_t *op_end, const uint8_t *literals, size_t literal_count, size_t offset, size_t match_length) {
+	uint8_t *out = *op;
+	const size_t needed = 1 + literal_count / 255 + 1 + literal_count + (match_length ? 2 + match_length / 255 + 1 : 0);
+	if ((size_t)(op_end - out) < needed) {
+		return false;
+	}
+
+	uint8_t *token = out++;
+	*token = (uint8_t)(std::min<size_t>(literal_count, 15) << 4);
+	if (literal_count >= 15) {
+		size_t rest = literal_count - 15;
+		for (; rest >= 255; rest -= 255) {
+			*out++ = 255;
+		}
+		*out++ = (uint8_t)rest;
+	}
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+
+	if (match_length) {
+		*out++ = (uint8_t)(offset & 0xff);
+		*out++ = (uint8_t)(offset >> 8);
+		const size_t length = match_length - LZ4_MIN_MATCH;
+		*token |= (uint8_t)std::min<size_t>(length, 15);
+		if (length >= 15) {
+			size_t rest = length - 15;
+			for (; rest >= 255; rest -= 255) {
+				*out++ = 255;
+			}
+			*out++ = (uint8_t)rest;
+		}
+	}
+
+	*op = out;
+	return true;
+}
+
+// blocks that do not shrink are kept raw inside the entry, an entry that does not shrink
+// enough overall is kept raw as a whole
+void pack_entry(const uint8_t *data, size_t size, vfs_pack_file *file) {
+	const size_t block_count = (size + VFS_BLOCK_SIZE - 1) / VFS_BLOCK_SIZE;
+	std::vector<uint8_t> stored(block_count * sizeof(uint32_t));
+	std::vector<uint8_t> block(psyvfs::lz4_bound(VFS_BLOCK_SIZE));
+
+	for (size_t i = 0; i < block_count; i++) {
+		const uint8_t *src = data + i * VFS_BLOCK_SIZE;
+		const size_t block_size = std::min<size_t>(VFS_BLOCK_SIZE, size - i * VFS_BLOCK_SIZE);
+		size_t compressed = psyvfs::lz4_compress(src, block_size, block.data(), block.size());
+
+		uint32_t block_header;
+		if (compressed == 0 || compressed >= block_size) {
+			block_header = (uint32_t)block_size | VFS_BLOCK_RAW;
+			stored.insert(stored.end(), src, src + block_size);
+		} else {
+			block_header = (uint32_t)compressed;
+			stored.insert(stored.end(), block.data(), block.data() + compressed);
+		}
+		memcpy(stored.data() + i * sizeof(uint32_t), &block_header, sizeof(block_header));
+	}
+
+	file->size = size;
+	if (stored.size() <= size * VFS_MIN_RATIO) {
+		file->compression = VFS_COMPRESSION_LZ4;
+		file->stored = std::move(stored);
+	} else {
+		file->compression = VFS_COMPRESSION_NONE;
+		file->stored.assign(data, data + size);
+	}
+}
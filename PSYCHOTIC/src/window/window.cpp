@@ -1,11 +1,33 @@
 #include "window.h"
 
+#include <bench/bench.h>
+#include <profiler/profiler.h>
+#include <state/state.h>
+
 #include <stdio.h>
+#include <stdlib.h>
 
 void glfw_error_callback(int error, const char *description);
+void glfw_key_callback(GLFWwindow *handle, int key, int scancode, int action, int mods);
+void glfw_cursor_pos_callback(GLFWwindow *handle, double x, double y);
+void glfw_mouse_button_callback(GLFWwindow *handle, int button, int action, int mods);
+void glfw_scroll_callback(GLFWwindow *handle, double x, double y);
+void queue_event(GLFWwindow *handle, input_event_type type, int code, int action, int mods, double x, double y);
+void create_framebuffer(window_state *window, int width, int height);
+void destroy_framebuffer(window_state *window);
 
 bool psywindow::window_initialize(window_info *info, window_state *window) {
 	glfwSetErrorCallback(glfw_error_callback);
+
+#if defined(__linux__)
+	// CI machines have no display server: fall back to the null platform and
+	// let OSMesa (llvmpipe) create a surfaceless context
+	const bool surfaceless = info->headless && !getenv("DISPLAY") && !getenv("WAYLAND_DISPLAY");
+	if (surfaceless) {
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	}
+#endif
+
 	if (!glfwInit()) {
 		return false;
 	}
@@ -14,13 +36,25 @@ bool psywindow::window_initialize(window_info *info, window_state *window) {
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
+#if defined(__linux__)
+	if (surfaceless) {
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
+#endif
+
+	if (info->headless) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
+
 	GLFWmonitor *monitor = glfwGetPrimaryMonitor();
-	const GLFWvidmode *mode = glfwGetVideoMode(monitor);
+	const GLFWvidmode *mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
 
-	glfwWindowHint(GLFW_RED_BITS, mode->redBits);
-	glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
-	glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
-	glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+	if (mode) {
+		glfwWindowHint(GLFW_RED_BITS, mode->redBits);
+		glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
+		glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
+		glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+	}
 
 	GLFWwindow *handle = glfwCreateWindow(
 		info->width,
@@ -33,12 +67,15 @@ bool psywindow::window_initialize(window_info *info, window_state *window) {
 		return false;
 	} else {
 		window->handle = handle;
+		window->headless = info->headless;
 	}
 
-	glfwSetWindowPos(
-		window->handle,
-		(mode->width - info->width) / 2,
-		(mode->height - info->height) / 2);
+	if (mode && !info->headless) {
+		glfwSetWindowPos(
+			window->handle,
+			(mode->width - info->width) / 2,
+			(mode->height - info->height) / 2);
+	}
 
 	glfwMakeContextCurrent(window->handle);
 
@@ -48,12 +85,25 @@ bool psywindow::window_initialize(window_info *info, window_state *window) {
 		return false;
 	}
 
-	glfwSwapInterval(1);
+	glfwSwapInterval(info->vsync && !info->headless ? 1 : 0);
+
+	// callbacks only queue, the frame decides when to look at the input
+	window->input.head = 0;
+	window->input.tail = 0;
+	window->input.dropped = 0;
+	glfwSetWindowUserPointer(window->handle, window);
+	glfwSetKeyCallback(window->handle, glfw_key_callback);
+	glfwSetCursorPosCallback(window->handle, glfw_cursor_pos_callback);
+	glfwSetMouseButtonCallback(window->handle, glfw_mouse_button_callback);
+	glfwSetScrollCallback(window->handle, glfw_scroll_callback);
+
+	create_framebuffer(window, info->width, info->height);
 
 	return true;
 }
 
 void psywindow::window_shutdown(window_state *window) {
+	destroy_framebuffer(window);
 	if (window->handle) {
 		glfwDestroyWindow(window->handle);
 		window->handle = 0;
@@ -61,9 +111,70 @@ void psywindow::window_shutdown(window_state *window) {
 	glfwTerminate();
 }
 
-void psywindow::end_frame(window_state *window) {
-	glfwSwapBuffers(window->handle);
+void psywindow::poll_events(window_state *window, window_info *info) {
 	glfwPollEvents();
+	if (!window->headless) {
+		glfwGetFramebufferSize(window->handle, &info->width, &info->height);
+	}
+}
+
+bool psywindow::push_event(window_state *window, const input_event *event) {
+	input_queue *queue = &window->input;
+	const uint32_t head = queue->head.load(std::memory_order_relaxed);
+	if (head - queue->tail.load(std::memory_order_acquire) == INPUT_QUEUE_SIZE) {
+		queue->dropped++;
+		return false;
+	}
+	queue->events[head & (INPUT_QUEUE_SIZE - 1)] = *event;
+	queue->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool psywindow::pop_event(window_state *window, input_event *event) {
+	input_queue *queue = &window->input;
+	const uint32_t tail = queue->tail.load(std::memory_order_relaxed);
+	if (tail == queue->head.load(std::memory_order_acquire)) {
+		return false;
+	}
+	*event = queue->events[tail & (INPUT_QUEUE_SIZE - 1)];
+	queue->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+double psywindow::refresh_rate(window_state *window) {
+	GLFWmonitor *monitor = window->headless ? nullptr : glfwGetPrimaryMonitor();
+	const GLFWvidmode *mode = monitor ? glfwGetVideoMode(monitor) : nullptr;
+	return mode && mode->refreshRate > 0 ? (double)mode->refreshRate : 60.0;
+}
+
+void psywindow::make_current(window_state *window, bool current) {
+	glfwMakeContextCurrent(current ? window->handle : nullptr);
+}
+
+void psywindow::begin_frame(window_state *window, window_info *info) {
+	if (info->width > 0 && info->height > 0 &&
+		(info->width != window->framebuffer_width || info->height != window->framebuffer_height)) {
+		destroy_framebuffer(window);
+		create_framebuffer(window, info->width, info->height);
+	}
+
+	psystate::bind_framebuffer(window->framebuffer);
+}
+
+void psywindow::end_frame(window_state *window) {
+	if (window->headless) {
+		glFlush();
+	} else {
+		psystate::disable(GL_SCISSOR_TEST);
+		glBlitNamedFramebuffer(
+			window->framebuffer, 0,
+			0, 0, window->framebuffer_width, window->framebuffer_height,
+			0, 0, window->framebuffer_width, window->framebuffer_height,
+			GL_COLOR_BUFFER_BIT,
+			GL_NEAREST);
+		PSY_PROFILE_GPU_SCOPE("glfwSwapBuffers");
+		glfwSwapBuffers(window->handle);
+	}
 }
 
 bool psywindow::window_alive(window_state *window) {
@@ -74,18 +185,60 @@ void psywindow::kill(window_state *window) {
 	glfwSetWindowShouldClose(window->handle, 1);
 }
 
-void psywindow::window_set_callback(window_state *window, window_callback type, void(*function)) {
-	if (type == WINDOW_CALLBACK_KEY) {
-		glfwSetKeyCallback(window->handle, (GLFWkeyfun)function);
-	}
-	if (type == WINDOW_CALLBACK_CURSOR_POS) {
-		glfwSetCursorPosCallback(window->handle, (GLFWcursorposfun)function);
+void glfw_error_callback(int /*error*/, const char *description) {
+	fprintf(stderr, "Error: %s\n", description);
+}
+
+void create_framebuffer(window_state *window, int width, int height) {
+	glCreateTextures(GL_TEXTURE_2D, 1, &window->color_texture);
+	glTextureStorage2D(window->color_texture, 1, GL_RGBA8, width, height);
+
+	glCreateFramebuffers(1, &window->framebuffer);
+	glNamedFramebufferTexture(window->framebuffer, GL_COLOR_ATTACHMENT0, window->color_texture, 0);
+
+	if (glCheckNamedFramebufferStatus(window->framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		fprintf(stderr, "Error: incomplete framebuffer (%dx%d)\n", width, height);
 	}
-	if (type == WINDOW_CALLBACK_MOUSE_BUTTON) {
-		glfwSetMouseButtonCallback(window->handle, (GLFWmousebuttonfun)function);
+
+	window->framebuffer_width = width;
+	window->framebuffer_height = height;
+}
+
+void destroy_framebuffer(window_state *window) {
+	if (window->framebuffer) {
+		psystate::forget(window->framebuffer);
+		psystate::forget(window->color_texture);
+		glDeleteFramebuffers(1, &window->framebuffer);
+		glDeleteTextures(1, &window->color_texture);
+		window->framebuffer = 0;
+		window->color_texture = 0;
 	}
 }
 
-void glfw_error_callback(int error, const char *description) {
-	fprintf(stderr, "Error: %s\n", description);
+void glfw_key_callback(GLFWwindow *handle, int key, int /*scancode*/, int action, int mods) {
+	queue_event(handle, INPUT_EVENT_KEY, key, action, mods, 0.0, 0.0);
+}
+
+void glfw_cursor_pos_callback(GLFWwindow *handle, double x, double y) {
+	queue_event(handle, INPUT_EVENT_CURSOR_POS, 0, 0, 0, x, y);
+}
+
+void glfw_mouse_button_callback(GLFWwindow *handle, int button, int action, int mods) {
+	queue_event(handle, INPUT_EVENT_MOUSE_BUTTON, button, action, mods, 0.0, 0.0);
+}
+
+void glfw_scroll_callback(GLFWwindow *handle, double x, double y) {
+	queue_event(handle, INPUT_EVENT_SCROLL, 0, 0, 0, x, y);
+}
+
+void queue_event(GLFWwindow *handle, input_event_type type, int code, int action, int mods, double x, double y) {
+	input_event event = {};
+	event.type = type;
+	event.time = psybench::ticks();
+	event.code = code;
+	event.action = action;
+	event.mods = mods;
+	event.x = x;
+	event.y = y;
+	psywindow::push_event((window_state *)glfwGetWindowUserPointer(handle), &event);
 }
@@ -3,27 +3,79 @@
 #include <glad/glad.h>
 #include <glfw/glfw3.h>
 
-enum window_callback {
-	WINDOW_CALLBACK_KEY,
-	WINDOW_CALLBACK_CURSOR_POS,
-	WINDOW_CALLBACK_MOUSE_BUTTON
+#include <stdint.h>
+#include <atomic>
+
+// power of two, events past this many unread ones are dropped
+#define INPUT_QUEUE_SIZE 1024
+
+enum input_event_type {
+	INPUT_EVENT_KEY,
+	INPUT_EVENT_CURSOR_POS,
+	INPUT_EVENT_MOUSE_BUTTON,
+	INPUT_EVENT_SCROLL
+};
+
+struct input_event {
+	input_event_type type;
+	// psybench::ticks() when GLFW delivered it
+	uint64_t time;
+	// key or mouse button
+	int code;
+	int action;
+	int mods;
+	// cursor position or scroll offset
+	double x;
+	double y;
+};
+
+// single producer (the GLFW callbacks, or a script pushing fake input), single consumer
+struct input_queue {
+	input_event events[INPUT_QUEUE_SIZE];
+	std::atomic<uint32_t> head;
+	std::atomic<uint32_t> tail;
+	std::atomic<uint32_t> dropped;
 };
 
 struct window_info {
 	const char *title;
 	int width;
 	int height;
+	// hidden window (or surfaceless OSMesa context when no display is available),
+	// fixed framebuffer size, never presents
+	bool headless;
+	bool vsync;
 };
 
 struct window_state {
 	GLFWwindow *handle;
+	bool headless;
+
+	// every frame renders into this offscreen target, end_frame blits it to the
+	// back buffer unless headless; depth is a frame graph transient
+	GLuint framebuffer;
+	GLuint color_texture;
+	int framebuffer_width;
+	int framebuffer_height;
+
+	input_queue input;
 };
 
 namespace psywindow {
 	bool window_initialize(window_info *info, window_state *window);
 	void window_shutdown(window_state *window);
+	// main thread only (GLFW requirement), queues whatever input arrived and picks up
+	// the current framebuffer size
+	void poll_events(window_state *window, window_info *info);
+	bool push_event(window_state *window, const input_event *event);
+	bool pop_event(window_state *window, input_event *event);
+	// refresh rate of the monitor the window is on, 60 when headless or unknown
+	double refresh_rate(window_state *window);
+	// whichever thread draws owns the context, see psyrender
+	void make_current(window_state *window, bool current);
+	// sizes and binds the offscreen target for info's framebuffer size
+	void begin_frame(window_state *window, window_info *info);
 	void end_frame(window_state *window);
 	bool window_alive(window_state *window);
 	void kill(window_state *window);
-	void window_set_callback(window_state *window, window_callback type, void(*function));
-}
\ No newline at end of file
+}